@@ -0,0 +1,695 @@
+/* File: ftpbench.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Reproducible loopback benchmark of myftpd. Starts the server on a scratch directory, drives it
+ *			with v2 framing through the client's stream layer and writes the results as JSON:
+ *			pwd/cd/dir round trip latency, listing time of a large directory, get/put throughput
+ *			for a range of file sizes and the connection setup rate
+ * Changes:
+ * 16/10/2026 - Added ftpbench.c
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "stream.h"
+
+#define SERV_TCP_PORT 41147		// Port myftpd listens on
+#define MAX_SIZES 16			// File sizes one run measures at most
+#define MAX_ARGS 16				// Options passed on to the server at most
+#define LIST_PAGE 4096			// Directory entries asked for per L request
+#define LIST_RECORD 19			// Bytes of a listing record before its name
+
+typedef struct stats {
+	int n;
+	double avg, p50, p90, p99, max;
+} Stats;
+
+static Conn conn;				// Connection of the request being measured
+static int maxFrame;			// Largest v2 data frame agreed with the server
+static char *frame;				// Data frame buffer, maxFrame bytes
+static char scratch[64];		// Scratch directory: srv/ is the server's, big/ inside it the large directory
+static pid_t server;
+
+static void startServer(char *path, char **args, int nargs);
+static void stopServer(void);
+static int openSession(void);
+static void closeSession(void);
+static int request(char *cmd, char *response, int size);
+static void benchLatency(FILE *out, int rounds);
+static void benchListing(FILE *out, int entries, int runs);
+static long listAll(void);
+static void benchTransfer(FILE *out, long long *sizes, int nsizes, int runs);
+static double getFile(char *name);
+static double putFile(char *name, long long size);
+static void benchConnect(FILE *out, int count);
+static void makeFile(char *path, long long size);
+static long long parseSize(char *s);
+static void summarise(double *samples, int n, Stats *st);
+static void writeStats(FILE *out, char *name, Stats *st, int last);
+static int compareDouble(const void *a, const void *b);
+static int removeEntry(const char *path, const struct stat *sb, int flag, struct FTW *ftw);
+static double now(void);
+static void fail(char *what);
+
+
+/** MAIN function
+ *
+ *	Pre: Syntax to execute program: "ftpbench [-s server] [-o file.json] [-n rounds] [-e entries] [-c connections]
+ *		 [-z size,size,...] [-r runs] [-- server options]". Nothing else may listen on the server port
+ *	Post: Results written as one JSON object, the server stopped and the scratch directory removed
+ */
+	int main(int argc, char *argv[]){
+		char *serverPath = "../Server/myftpd", *outPath = NULL, sizeList[256] = "4K,64K,1M,16M,128M", *tok;
+		int opt, rounds = 2000, entries = 20000, connections = 500, runs = 3, nsizes = 0;
+		long long sizes[MAX_SIZES];
+		struct utsname un;
+		time_t started;
+		FILE *out = stdout;
+
+		while((opt = getopt(argc, argv, "s:o:n:e:c:z:r:")) != -1){
+			if(opt == 's')
+				serverPath = optarg;
+			else if(opt == 'o')
+				outPath = optarg;
+			else if(opt == 'n')
+				rounds = atoi(optarg);
+			else if(opt == 'e')
+				entries = atoi(optarg);
+			else if(opt == 'c')
+				connections = atoi(optarg);
+			else if(opt == 'z')
+				snprintf(sizeList, sizeof(sizeList), "%s", optarg);
+			else if(opt == 'r')
+				runs = atoi(optarg);
+			else {
+				fprintf(stderr, "Syntax: %s [-s server] [-o file.json] [-n rounds] [-e entries] [-c connections] "
+						"[-z size,size,...] [-r runs] [-- server options]\n", argv[0]);
+				exit(1);
+			}
+		}
+		for(tok = strtok(sizeList, ","); tok != NULL && nsizes < MAX_SIZES; tok = strtok(NULL, ","))
+			if((sizes[nsizes] = parseSize(tok)) >= 0)
+				nsizes++;
+		if(rounds < 1 || entries < 1 || connections < 1 || runs < 1 || argc - optind > MAX_ARGS){
+			fprintf(stderr, "Error: rounds, entries, connections and runs must be at least 1, at most %d server options\n", MAX_ARGS);
+			exit(1);
+		}
+		if(outPath != NULL && (out = fopen(outPath, "w")) == NULL)
+			fail(outPath);
+		if(openSession() == 0){
+			fprintf(stderr, "Error: a server is already listening on port %d, stop it first\n", SERV_TCP_PORT);
+			exit(1);
+		}
+
+		signal(SIGPIPE, SIG_IGN);
+		strcpy(scratch, "/tmp/ftpbench.XXXXXX");
+		if(mkdtemp(scratch) == NULL)
+			fail("scratch directory");
+		atexit(stopServer);
+
+		fprintf(stderr, "Preparing %d sizes and a directory of %d entries in %s...\n", nsizes, entries, scratch);
+		startServer(serverPath, argv + optind, argc - optind);
+
+		started = time(NULL);
+		uname(&un);
+		fprintf(out, "{\n  \"benchmark\": \"ftpbench\",\n  \"version\": 1,\n  \"started\": %lld,\n", (long long) started);
+		fprintf(out, "  \"host\": {\"cpus\": %ld, \"kernel\": \"%s %s\", \"machine\": \"%s\"},\n",
+				sysconf(_SC_NPROCESSORS_ONLN), un.sysname, un.release, un.machine);
+		fprintf(out, "  \"server_args\": \"");
+		for(opt = optind; opt < argc; opt++)
+			fprintf(out, "%s%s", opt > optind ? " " : "", argv[opt]);
+		fprintf(out, "\",\n");
+
+		benchLatency(out, rounds);
+		benchListing(out, entries, runs);
+		benchTransfer(out, sizes, nsizes, runs);
+		benchConnect(out, connections);
+
+		fprintf(out, "  \"seconds\": %lld\n}\n", (long long) (time(NULL) - started));
+		if(out != stdout)
+			fclose(out);
+
+		return 0;
+
+	} //END of main function
+
+
+/** Start server - runs myftpd on the scratch directory and waits until it accepts connections
+ *
+ *	Post: server holds the pid of the daemon (the process myftpd left running)
+ */
+	static void startServer(char *path, char **args, int nargs){
+		char dir[128], line[128], *argv[MAX_ARGS + 3];
+		int pfd[2], i, n, fd;
+		FILE *fp;
+
+		snprintf(dir, sizeof(dir), "%s/srv", scratch);
+		if(mkdir(dir, 0755) < 0 || pipe(pfd) < 0)
+			fail("server directory");
+		if((path = realpath(path, NULL)) == NULL)     // The server runs from its own directory
+			fail("server path");
+
+		argv[0] = path;
+		for(i = 0; i < nargs; i++)
+			argv[i + 1] = args[i];
+		argv[nargs + 1] = dir;
+		argv[nargs + 2] = NULL;
+
+		// The daemon prints its pid on stderr and keeps stderr open, so only that line is read
+		if(fork() == 0){
+			close(pfd[0]);
+			dup2(pfd[1], STDERR_FILENO);
+			if((fd = open("/dev/null", O_WRONLY)) >= 0)
+				dup2(fd, STDOUT_FILENO);
+			if(chdir(dir) == 0)
+				execv(path, argv);
+			fprintf(stderr, "Cannot run %s: %s\n", path, strerror(errno));
+			_exit(1);
+		}
+		close(pfd[1]);
+		fp = fdopen(pfd[0], "r");
+		while(fgets(line, sizeof(line), fp) != NULL && sscanf(line, "Remember PID: %d", &server) != 1)
+			fputs(line, stderr);
+		fclose(fp);
+		wait(NULL);
+
+		if(server <= 0){
+			fprintf(stderr, "Error: %s did not start\n", path);
+			exit(1);
+		}
+
+		// The workers are ready once the port accepts connections
+		for(n = 0; n < 100; n++){
+			if(openSession() == 0){
+				closeSession();
+				return;
+			}
+			usleep(20000);
+		}
+		fprintf(stderr, "Error: server is not accepting connections on port %d\n", SERV_TCP_PORT);
+		exit(1);
+
+	} //END of startServer function
+
+
+/** Stop server - stops the daemon and its workers and removes the scratch directory
+ *
+ */
+	static void stopServer(void){
+
+		if(server > 0)
+			kill(server, SIGTERM);
+		server = 0;
+		if(scratch[0] != '\0')
+			nftw(scratch, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+		scratch[0] = '\0';
+
+	} //END of stopServer function
+
+
+/** Open session - connects to the server on loopback and agrees v2 framing
+ *
+ *	Return: 0, or -1 if the connection or the negotiation failed
+ */
+	static int openSession(void){
+		struct sockaddr_in addr;
+		char cmd[64], response[MAX_BLOCK_SIZE];
+		int sock, version = 0, size = 0, on = 1;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(SERV_TCP_PORT);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+			return -1;
+		if(connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0){
+			close(sock);
+			return -1;
+		}
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		conninit(&conn, sock);
+
+		sprintf(cmd, "N2 %d t", V2_MAX_FRAME);
+		if(request(cmd, response, sizeof(response)) < 0 || sscanf(response, "N%d %d", &version, &size) != 2 || version != 2){
+			closeSession();
+			return -1;
+		}
+		conn.version = 2;
+		maxFrame = size;
+
+		if(frame == NULL && (frame = calloc(1, V2_MAX_FRAME)) == NULL)
+			fail("frame buffer");
+		return 0;
+
+	} //END of openSession function
+
+
+/** Close session - closes the connection of the current session
+ *
+ */
+	static void closeSession(void){
+
+		close(conn.fd);
+		conn.fd = -1;
+
+	} //END of closeSession function
+
+
+/** Request - sends a command and reads its response frame
+ *
+ *	Return: Length of the response, -1 if the connection failed
+ */
+	static int request(char *cmd, char *response, int size){
+		FrameHeader hdr;
+		int n;
+
+		if(connwrite(&conn, FT_CMD, 0, cmd, strlen(cmd) + 1) < 0 || (n = connread(&conn, response, size, &hdr)) < 0)
+			return -1;
+		response[n < size ? n : size - 1] = '\0';
+		return n;
+
+	} //END of request function
+
+
+/** Latency benchmark - round trips of pwd, cd and dir (one L page of a small directory) on one session
+ *
+ *	Post: "latency_us" object written, with the distribution of each command
+ */
+	static void benchLatency(FILE *out, int rounds){
+		char response[MAX_BLOCK_SIZE], path[128];
+		double *pwd, *cd, *dir, t;
+		Stats st;
+		int i;
+
+		pwd = malloc(rounds * sizeof(double));
+		cd = malloc(rounds * sizeof(double));
+		dir = malloc(rounds * sizeof(double));
+		snprintf(path, sizeof(path), "%s/srv/small", scratch);
+		if(pwd == NULL || cd == NULL || dir == NULL || mkdir(path, 0755) < 0)
+			fail("latency setup");
+		for(i = 0; i < 16; i++){
+			snprintf(path, sizeof(path), "%s/srv/small/file%02d", scratch, i);
+			makeFile(path, 100);
+		}
+		if(openSession() < 0)
+			fail("latency session");
+
+		fprintf(stderr, "Latency: %d rounds of pwd, cd and dir...\n", rounds);
+		for(i = 0; i < rounds; i++){
+			t = now();
+			if(request("P", response, sizeof(response)) < 0)
+				fail("pwd");
+			pwd[i] = (now() - t) * 1e6;
+
+			// cd alternates into the small directory and back, so every other dir lists it
+			t = now();
+			if(request(i % 2 == 0 ? "Csmall" : "C..", response, sizeof(response)) < 0)
+				fail("cd");
+			cd[i] = (now() - t) * 1e6;
+
+			t = now();
+			if(listAll() < 0)
+				fail("dir");
+			dir[i] = (now() - t) * 1e6;
+		}
+		closeSession();
+
+		fprintf(out, "  \"latency_us\": {\n");
+		summarise(pwd, rounds, &st);
+		writeStats(out, "pwd", &st, 0);
+		summarise(cd, rounds, &st);
+		writeStats(out, "cd", &st, 0);
+		summarise(dir, rounds, &st);
+		writeStats(out, "dir", &st, 1);
+		fprintf(out, "  },\n");
+
+		free(pwd);
+		free(cd);
+		free(dir);
+
+	} //END of benchLatency function
+
+
+/** Listing benchmark - lists a directory of many entries, paged with L
+ *
+ *	Post: "listing" object written: the first listing after the directory was made (cold) and
+ *		  the best of the runs after it (warm, the server's listing cache may answer those)
+ */
+	static void benchListing(FILE *out, int entries, int runs){
+		char path[128], response[MAX_BLOCK_SIZE];
+		double t, cold = 0, warm = 0;
+		long listed = 0;
+		int i;
+
+		snprintf(path, sizeof(path), "%s/srv/big", scratch);
+		if(mkdir(path, 0755) < 0)
+			fail("large directory");
+		for(i = 0; i < entries; i++){
+			snprintf(path, sizeof(path), "%s/srv/big/entry_%07d_with_a_longer_name.dat", scratch, i);
+			makeFile(path, 0);
+		}
+		if(openSession() < 0 || request("Cbig", response, sizeof(response)) < 0 || response[0] != '\0')
+			fail("listing session");
+
+		fprintf(stderr, "Listing: %d entries, %d runs...\n", entries, runs + 1);
+		for(i = 0; i <= runs; i++){
+			t = now();
+			if((listed = listAll()) < 0)
+				fail("listing");
+			t = now() - t;
+			if(i == 0)
+				cold = t;
+			else if(i == 1 || t < warm)
+				warm = t;
+		}
+		closeSession();
+
+		fprintf(out, "  \"listing\": {\"entries\": %ld, \"cold_ms\": %.3f, \"warm_ms\": %.3f, \"entries_per_s\": %.0f},\n",
+				listed, cold * 1e3, warm * 1e3, warm > 0 ? listed / warm : 0);
+
+	} //END of benchListing function
+
+
+/** List all - lists the current server directory with L pages until its end
+ *
+ *	Return: Entries listed (. and .. included), -1 on failure
+ */
+	static long listAll(void){
+		char cmd[64], response[MAX_BLOCK_SIZE];
+		unsigned char *p;
+		long long cursor = 0;
+		long entries = 0;
+		int n, i, len, end;
+		FrameHeader hdr;
+
+		do {
+			snprintf(cmd, sizeof(cmd), "L%lld %d", cursor, LIST_PAGE);
+			if(request(cmd, response, sizeof(response)) < 0 || strncmp(response, "L0", 2) != 0)
+				return -1;
+
+			end = 0;
+			do {
+				if((n = connread(&conn, frame, V2_MAX_FRAME, &hdr)) < 0 || hdr.type != FT_DATA || (hdr.flags & FF_ERROR))
+					return -1;
+				for(p = (unsigned char *) frame; p + LIST_RECORD <= (unsigned char *) frame + n; p += LIST_RECORD + len){
+					len = p[17] << 8 | p[18];
+					if(p[0] != 'E' && p[0] != 'M'){
+						entries++;
+						continue;
+					}
+					end = p[0];
+					for(cursor = 0, i = 1; i <= 8; i++)     // Where the next page starts
+						cursor = cursor << 8 | p[i];
+				}
+			} while(!(hdr.flags & FF_EOF));
+		} while(end == 'M');
+
+		return entries;
+
+	} //END of listAll function
+
+
+/** Transfer benchmark - gets and puts a file of each size, a few times each
+ *
+ *	Post: "throughput" array written, the best and median MB/s (10^6 bytes) of each direction per size.
+ *		  A transfer is timed from its command to its last byte (get) or the server's V0 (put)
+ */
+	static void benchTransfer(FILE *out, long long *sizes, int nsizes, int runs){
+		char name[64], path[160];
+		double *get, *put;
+		int i, r;
+
+		get = malloc(runs * sizeof(double));
+		put = malloc(runs * sizeof(double));
+		if(get == NULL || put == NULL || openSession() < 0)
+			fail("transfer setup");
+
+		fprintf(out, "  \"throughput\": [\n");
+		for(i = 0; i < nsizes; i++){
+			fprintf(stderr, "Transfer: %lld bytes, %d runs each way...\n", sizes[i], runs);
+			snprintf(name, sizeof(name), "get_%lld.bin", sizes[i]);
+			snprintf(path, sizeof(path), "%s/srv/%s", scratch, name);
+			makeFile(path, sizes[i]);
+
+			for(r = 0; r < runs; r++)
+				if((get[r] = getFile(name)) < 0)
+					fail("get");
+			unlink(path);
+
+			// A put needs a name the server does not have yet
+			for(r = 0; r < runs; r++){
+				snprintf(name, sizeof(name), "put_%lld.bin", sizes[i]);
+				if((put[r] = putFile(name, sizes[i])) < 0)
+					fail("put");
+				snprintf(path, sizeof(path), "%s/srv/%s", scratch, name);
+				unlink(path);
+			}
+
+			qsort(get, runs, sizeof(double), compareDouble);
+			qsort(put, runs, sizeof(double), compareDouble);
+			fprintf(out, "    {\"size\": %lld, \"get_mbps\": %.2f, \"get_median_mbps\": %.2f, \"put_mbps\": %.2f, \"put_median_mbps\": %.2f}%s\n",
+					sizes[i], sizes[i] / get[0] / 1e6, sizes[i] / get[runs / 2] / 1e6, sizes[i] / put[0] / 1e6,
+					sizes[i] / put[runs / 2] / 1e6, i < nsizes - 1 ? "," : "");
+		}
+		fprintf(out, "  ],\n");
+		closeSession();
+
+		free(get);
+		free(put);
+
+	} //END of benchTransfer function
+
+
+/** Get file - fetches a file with G/H0 and discards its data frames
+ *
+ *	Return: Seconds taken, -1 on failure
+ */
+	static double getFile(char *name){
+		char cmd[128], response[MAX_BLOCK_SIZE];
+		FrameHeader hdr;
+		double t = now();
+
+		snprintf(cmd, sizeof(cmd), "G%s", name);
+		if(request(cmd, response, sizeof(response)) < 0 || response[1] != '0' ||
+		   connwrite(&conn, FT_CMD, 0, "H0", 3) < 0)
+			return -1;
+		do {
+			if(connread(&conn, frame, V2_MAX_FRAME, &hdr) < 0 || (hdr.flags & FF_ERROR))
+				return -1;
+		} while(!(hdr.flags & FF_EOF));
+
+		return now() - t;
+
+	} //END of getFile function
+
+
+/** Put file - sends size bytes as a new file with U and v2 data frames
+ *
+ *	Return: Seconds taken until the server confirmed the file, -1 on failure
+ */
+	static double putFile(char *name, long long size){
+		char cmd[128], response[MAX_BLOCK_SIZE];
+		long long left = size;
+		double t = now();
+		FrameHeader hdr;
+		int n;
+
+		snprintf(cmd, sizeof(cmd), "U%s", name);
+		if(request(cmd, response, sizeof(response)) < 0 || response[1] != '0')
+			return -1;
+		do {
+			n = left < maxFrame ? left : maxFrame;
+			left -= n;
+			if(connwrite(&conn, FT_DATA, left == 0 ? FF_EOF : 0, frame, n) != n)
+				return -1;
+		} while(left > 0);
+		if(connread(&conn, response, sizeof(response), &hdr) < 0 || strcmp(response, "V0") != 0)
+			return -1;
+
+		return now() - t;
+
+	} //END of putFile function
+
+
+/** Connect benchmark - sessions opened one after another: connect, agree v2 framing, one pwd, close
+ *
+ *	Post: "connect" object written with the sessions per second and the latency of each setup
+ */
+	static void benchConnect(FILE *out, int count){
+		char response[MAX_BLOCK_SIZE];
+		double *setup, t, start;
+		Stats st;
+		int i;
+
+		if((setup = malloc(count * sizeof(double))) == NULL)
+			fail("connect setup");
+
+		fprintf(stderr, "Connect: %d sessions...\n", count);
+		start = now();
+		for(i = 0; i < count; i++){
+			t = now();
+			if(openSession() < 0 || request("P", response, sizeof(response)) < 0)
+				fail("connect");
+			closeSession();
+			setup[i] = (now() - t) * 1e6;
+		}
+		t = now() - start;
+
+		summarise(setup, count, &st);
+		fprintf(out, "  \"connect\": {\"sessions\": %d, \"per_s\": %.1f, \"setup_us\": {\"avg\": %.1f, \"p50\": %.1f, "
+				"\"p99\": %.1f, \"max\": %.1f}},\n", count, count / t, st.avg, st.p50, st.p99, st.max);
+
+		free(setup);
+
+	} //END of benchConnect function
+
+
+/** Make file - creates a file of size bytes of pseudo-random data (the same on every run)
+ *
+ */
+	static void makeFile(char *path, long long size){
+		static char *block;
+		unsigned long long x = 88172645463325252ULL;
+		long long done;
+		int fd, i, n;
+
+		if(block == NULL){
+			if((block = malloc(1 << 20)) == NULL)
+				fail("data block");
+			for(i = 0; i < (1 << 20) / 8; i++){
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				memcpy(block + i * 8, &x, 8);
+			}
+		}
+
+		if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			fail(path);
+		for(done = 0; done < size; done += n){
+			n = size - done < (1 << 20) ? size - done : (1 << 20);
+			if(write(fd, block, n) != n)
+				fail(path);
+		}
+		close(fd);
+
+	} //END of makeFile function
+
+
+/** Parse size - a byte count with an optional K, M or G suffix (powers of 1024)
+ *
+ *	Return: Bytes, -1 if the size is not valid
+ */
+	static long long parseSize(char *s){
+		char *end;
+		long long v = strtoll(s, &end, 10);
+
+		if(end == s || v < 0)
+			return -1;
+		if(*end == 'K' || *end == 'k')
+			v <<= 10;
+		else if(*end == 'M' || *end == 'm')
+			v <<= 20;
+		else if(*end == 'G' || *end == 'g')
+			v <<= 30;
+		else if(*end != '\0')
+			return -1;
+
+		return v;
+
+	} //END of parseSize function
+
+
+/** Summarise - average, percentiles and largest of n samples (sorts the samples)
+ *
+ */
+	static void summarise(double *samples, int n, Stats *st){
+		double sum = 0;
+		int i;
+
+		qsort(samples, n, sizeof(double), compareDouble);
+		for(i = 0; i < n; i++)
+			sum += samples[i];
+
+		st->n = n;
+		st->avg = sum / n;
+		st->p50 = samples[(n - 1) * 50 / 100];
+		st->p90 = samples[(n - 1) * 90 / 100];
+		st->p99 = samples[(n - 1) * 99 / 100];
+		st->max = samples[n - 1];
+
+	} //END of summarise function
+
+
+/** Write stats - one member of the latency object
+ *
+ */
+	static void writeStats(FILE *out, char *name, Stats *st, int last){
+
+		fprintf(out, "    \"%s\": {\"n\": %d, \"avg\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}%s\n",
+				name, st->n, st->avg, st->p50, st->p90, st->p99, st->max, last ? "" : ",");
+
+	} //END of writeStats function
+
+
+/** Compare double - qsort order of samples
+ *
+ */
+	static int compareDouble(const void *a, const void *b){
+
+		return *(double *) a < *(double *) b ? -1 : *(double *) a > *(double *) b;
+
+	} //END of compareDouble function
+
+
+/** Remove entry - nftw callback that deletes the scratch directory bottom up
+ *
+ */
+	static int removeEntry(const char *path, const struct stat *sb, int flag, struct FTW *ftw){
+
+		remove(path);
+		return 0;
+
+	} //END of removeEntry function
+
+
+/** Now - monotonic time in seconds
+ *
+ */
+	static double now(void){
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+
+	} //END of now function
+
+
+/** Fail - reports what failed and exits (the server is stopped by atexit)
+ *
+ */
+	static void fail(char *what){
+
+		fprintf(stderr, "ftpbench: %s failed%s%s\n", what, errno ? ": " : "", errno ? strerror(errno) : "");
+		exit(1);
+
+	} //END of fail function
+
+//END of ftpbench.c
@@ -0,0 +1,69 @@
+#!/bin/bash
+# File: uringbench.sh
+# Authors: Jarryd Kaczmarczyk & Daniel Dobson
+# Date: 16/10/2026
+# Purpose: Compares the io_uring backend (-u) with the default transfer path on loopback.
+#          Starts myftpd on a scratch directory, gets and puts one large file a few times
+#          in each mode and prints the best throughput and the client CPU time of that run
+# Usage: Bench/uringbench.sh [file_size_mb] [runs]   (Server and Client must be built)
+
+SIZE_MB=${1:-512}
+RUNS=${2:-3}
+HERE=$(cd "$(dirname "$0")" && pwd)
+SERVER=$HERE/../Server/myftpd
+CLIENT=$HERE/../Client/myftp
+SCRATCH=$(mktemp -d /tmp/uringbench.XXXXXX)
+TIMEFORMAT='%R %U %S'
+
+[ -x "$SERVER" ] && [ -x "$CLIENT" ] || { echo "Build Server/myftpd and Client/myftp first"; exit 1; }
+trap 'stopServer; rm -rf "$SCRATCH"' EXIT
+
+mkdir -p "$SCRATCH/srv" "$SCRATCH/cli"
+head -c $((SIZE_MB * 1024 * 1024)) /dev/urandom > "$SCRATCH/srv/bench.bin"
+cp "$SCRATCH/srv/bench.bin" "$SCRATCH/cli/up.bin"
+
+startServer() {
+    # The daemon keeps its stderr open, so it goes to a file rather than a pipe
+    (cd "$SCRATCH/srv" && "$SERVER" "$@" "$SCRATCH/srv" >/dev/null 2>"$SCRATCH/server.err")
+    PID=$(sed -n 's/Remember PID: //p' "$SCRATCH/server.err")
+    sleep 0.5
+}
+
+stopServer() {
+    [ -n "$PID" ] && kill "$PID" 2>/dev/null
+    PID=
+    sleep 0.5
+}
+
+# One transfer: prints "seconds user_cpu sys_cpu" of the client
+transfer() {
+    local op=$1; shift
+    rm -f "$SCRATCH/cli/bench.bin" "$SCRATCH/srv/up.bin"
+    cd "$SCRATCH/cli"
+    { time printf '%s\nquit\n' "$op" | "$CLIENT" "$@" >/dev/null; } 2>&1
+    cd - >/dev/null
+}
+
+printf "%-10s %-4s %10s %10s %10s\n" mode op "MB/s" "user s" "sys s"
+for mode in default io_uring; do
+    [ $mode = io_uring ] && flag=-u || flag=
+    startServer $flag
+    for op in "get bench.bin" "put up.bin"; do
+        best=
+        for run in $(seq "$RUNS"); do
+            result=$(transfer "$op" $flag)
+            if [ "${op%% *}" = get ]; then
+                cmp -s "$SCRATCH/srv/bench.bin" "$SCRATCH/cli/bench.bin" || echo "$mode get: file differs"
+            else
+                cmp -s "$SCRATCH/cli/up.bin" "$SCRATCH/srv/up.bin" || echo "$mode put: file differs"
+            fi
+            if [ -z "$best" ] || awk "BEGIN{exit !(${result%% *} < ${best%% *})}"; then
+                best=$result
+            fi
+        done
+        set -- $best
+        printf "%-10s %-4s %10.1f %10.2f %10.2f\n" $mode "${op%% *}" \
+            "$(awk "BEGIN{print $SIZE_MB / $1}")" "$2" "$3"
+    done
+    stopServer
+done
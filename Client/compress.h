@@ -0,0 +1,117 @@
+/* File: compress.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for per-frame compression of file data (zlib and a fast LZ codec)
+ * Changes: 16/10/2026 - Added compress.c/compress.h
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <zlib.h>
+
+/* Codecs a session can agree on with the Z opcode. Every compressed data
+ * frame is flagged FF_ZLIB or FF_LZ and decodes on its own, so a frame may
+ * also be sent as it is (e.g. data that does not compress) */
+#define CODEC_NONE 0
+#define CODEC_ZLIB 1               /* raw deflate, better ratio */
+#define CODEC_LZ   2               /* byte oriented LZ77 (LZ4 block format), faster */
+
+#define PACK_FRAME (1024*256)      /* most file bytes in one compressed frame (larger frames go as they are) */
+#define PACK_SAMPLE (1024*4)       /* bytes compressed first to judge a larger frame */
+#define PACK_MIN_SAVING 10         /* percent a frame must shrink to be sent compressed */
+#define PACK_MAX_SKIP 64           /* most frames sent as they are before sampling again */
+#define PACK_ZLIB_LEVEL 6
+
+typedef struct packer {
+    int codec;                     /* CODEC_* for frames sent */
+    int skip, backoff;             /* frames to send as they are before the next sample */
+    char *buf;                     /* scratch for one compressed or decompressed frame */
+    int bufsize;
+    z_stream def, inf;
+    int zready;                    /* 1: def set up, 2: inf set up */
+    long long rawbytes, wirebytes; /* file bytes, and the same bytes as framed payload */
+    long frames, packed;           /* data frames, and how many of them were compressed */
+    double cpu;                    /* CPU seconds spent compressing/decompressing */
+} Packer;
+
+/*
+ * Set up a packer that does not compress.
+ *
+ * Pre:      1) none,
+ * Post:     1) codec CODEC_NONE, no buffers allocated, statistics zeroed;
+ */
+void packinit(Packer *p);
+
+
+
+/*
+ * Release the buffers and zlib streams of a packer.
+ *
+ * Pre:      1) p was set up with packinit,
+ * Post:     1) as after packinit, the codec is kept;
+ */
+void packfree(Packer *p);
+
+
+
+/*
+ * Codec named "zlib", "lz" or "none".
+ *
+ * Pre:      1) none,
+ * Post:     1) return value >= 0  : CODEC_*
+ *                           = -1  : unknown name
+ */
+int packcodec(char *name);
+
+
+
+/*
+ * Name of a codec, for messages and the Z opcode.
+ */
+char *packname(int codec);
+
+
+
+/*
+ * Compress a data frame in place, if that is worth it.
+ *
+ * Pre:      1) data holds n file bytes,
+ * Post:     1) data holds the payload to send and *flags its FF_ZLIB/FF_LZ flag (0 if
+ *              sent as it is). Frames over PACK_FRAME bytes are not compressed, so the
+ *              receiver never needs more than PACK_FRAME to decode one. A frame that does not shrink by PACK_MIN_SAVING percent
+ *              (judged on a PACK_SAMPLE sample first) is sent as it is, and so are the
+ *              next 1, 2, 4 ... PACK_MAX_SKIP frames, so incompressible data costs little;
+ *           2) return value >= 0  : payload length (<= n)
+ */
+int pack(Packer *p, char *data, int n, int *flags);
+
+
+
+/*
+ * Decompress the payload of a data frame.
+ *
+ * Pre:      1) flags from the frame header,
+ * Post:     1) *out points to the file bytes (data itself if the frame was not compressed,
+ *              otherwise the packer's scratch buffer, valid until the next call);
+ *           2) return value >= 0  : number of file bytes
+ *                           = -1  : payload damaged or more than PACK_FRAME file bytes
+ */
+int unpack(Packer *p, int flags, char *data, int n, char **out);
+
+
+
+/*
+ * Describe the compression since the last call and start counting again. Called at the
+ * end of each transfer, the next one starts sampling afresh.
+ *
+ * Pre:      1) size >= 128,
+ * Post:     1) buf holds e.g. "zlib: 1048576 -> 131072 bytes (ratio 8.00), 4 of 4 frames
+ *              compressed, 12.5 ms CPU";
+ *           2) return value = 1   : buf filled
+ *                           = 0   : nothing to report (no file bytes, or no codec
+ *                                   and no frame compressed)
+ */
+int packstats(Packer *p, char *buf, int size);
+
+#endif
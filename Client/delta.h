@@ -0,0 +1,130 @@
+/* File: delta.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for delta transfer of changed files (rsync-style block signatures and deltas)
+ * Changes: 16/10/2026 - Added delta.c/delta.h
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+/* The side holding the old copy of a file signs each full block of it (a rolling weak
+ * sum and a 64-bit strong hash). The side holding the new copy slides a window over
+ * its file, looks the weak sum up at every byte and sends a delta: blocks the old copy
+ * already has, and literal bytes for the rest. Delta ops, big endian:
+ *
+ *     'L' <u32 length> <bytes>            literal bytes
+ *     'B' <u32 first block> <u32 count>   blocks of the old copy, in a row
+ *     'E' <u64 size> <u32 crc>            end, size and CRC-32 of the new copy
+ *
+ * An op never spans two frames */
+#define DELTA_MIN_BLOCK 1024
+#define DELTA_MAX_BLOCK (1024*64)
+#define DELTA_MAX_BLOCKS (1L << 22)    /* most blocks of an old copy (memory for the index) */
+#define DELTA_SIG_SIZE 12              /* bytes of one block signature on the wire */
+#define DELTA_LITERAL 4096             /* most bytes in one literal op */
+#define DELTA_ROOM (DELTA_LITERAL + 32) /* least output room for deltamake to make progress */
+#define DELTA_READ (1024*1024)         /* bytes of a file read at a time */
+
+typedef struct delta {
+    int fd;                        /* old copy (signing, patching) or new copy (making) */
+    int out;                       /* patching: file the new copy is written to (-1 if none) */
+    int blocksize;
+    long blocks;                   /* full blocks in the old copy */
+    long next;                     /* signing: next block to sign. indexing: signatures received */
+    unsigned int *weak;            /* making: signatures of the old copy */
+    unsigned long long *strong;
+    int *head, *chain;             /* making: first block of each hash bucket, next block in the same bucket */
+    int bits;                      /* making: log2 of the number of buckets */
+    char *buf;                     /* file data being signed, searched or copied */
+    int bufsize;
+    int pos, lit, end, eof;        /* making: window start, first byte not yet sent, bytes in buf, end of file read */
+    unsigned int a, b;             /* making: rolling sums of the window at pos */
+    int rolled;                    /* making: a and b are valid */
+    long run, runlen;              /* making: blocks matched in a row, not yet sent */
+    unsigned int crc;              /* CRC-32 of the new copy so far */
+    long long size;                /* bytes of the new copy made or written */
+    long long literal, matched;    /* bytes sent as they are / taken from the old copy */
+    int done;                      /* signing: every block signed. making: end op made */
+    int patched;                   /* patching: end op seen and checked */
+} Delta;
+
+/*
+ * Block size for an old copy of size bytes, about its square root.
+ */
+int deltablocksize(long long size);
+
+
+
+/*
+ * Set up a delta transfer. The delta owns fd and out from now on.
+ *
+ * Pre:      1) fd open for reading at offset 0, out open for writing or -1,
+ * Post:     1) return value = 0   : ready
+ *                           = -1  : block size or block count out of range
+ */
+int deltainit(Delta *d, int fd, int out, int blocksize, long blocks);
+
+
+
+/*
+ * Close the files of a delta transfer and release its memory.
+ */
+void deltafree(Delta *d);
+
+
+
+/*
+ * Sign the next blocks of the old copy.
+ *
+ * Pre:      1) room >= DELTA_SIG_SIZE,
+ * Post:     1) out holds DELTA_SIG_SIZE bytes per block (u32 weak sum, u64 strong hash),
+ *              done is set once the last block is signed;
+ *           2) return value >= 0  : bytes of signatures
+ *                           = -1  : file read error (file shrank)
+ */
+int deltasign(Delta *d, char *out, int room);
+
+
+
+/*
+ * Take signatures of the old copy, as made by deltasign.
+ *
+ * Pre:      1) n is a multiple of DELTA_SIG_SIZE,
+ * Post:     1) return value = 0   : stored
+ *                           = -1  : more signatures than blocks, or no memory
+ */
+int deltaindex(Delta *d, char *sigs, int n);
+
+
+
+/*
+ * Make the next delta ops of the new copy.
+ *
+ * Pre:      1) every signature taken, room >= DELTA_ROOM,
+ * Post:     1) out holds whole ops, done is set once the end op is made;
+ *           2) return value >= 0  : bytes of ops
+ *                           = -1  : file read error, signatures missing or no memory
+ */
+int deltamake(Delta *d, char *out, int room);
+
+
+
+/*
+ * Apply delta ops to the old copy, writing the new copy to out.
+ *
+ * Pre:      1) ops holds whole ops,
+ * Post:     1) return value = 1   : end op seen, size and CRC-32 match
+ *                           = 0   : more ops to come
+ *                           = -1  : damaged op, old copy unreadable, write error or CRC-32 mismatch
+ */
+int deltapatch(Delta *d, char *ops, int n);
+
+
+
+/*
+ * Describe a delta transfer, e.g. "1048576 bytes: 1040384 from the old copy, 8192 sent (0.8%)".
+ */
+void deltastats(Delta *d, char *buf, int size);
+
+#endif
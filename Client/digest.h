@@ -0,0 +1,116 @@
+/* File: digest.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for 128-bit file digests and the digest index kept beside each file
+ * Changes: 16/10/2026 - Added digest.c/digest.h
+ *		   16/10/2026 - Added digestindexed, digeststable and digeststore, so a digest can be built a piece
+ *						at a time (or from data as it is written) and then indexed
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <sys/stat.h>
+
+/* A digest is a 128-bit hash of the file bytes, in the style of XXH3 (eight 64-bit lanes,
+ * 32x32->64 bit multiplies, so SSE2 does two lanes per instruction). It is not
+ * bit-compatible with XXH3, both ends use this file.
+ *
+ * The index is an extended attribute on the file itself, "<size> <mtime sec>.<nsec> <hex>",
+ * so it follows the file through renames and needs no locking between processes. An entry
+ * only counts while the size and mtime still match. It is refreshed lazily, on the first
+ * lookup after a change.
+ *
+ * A digest read from a file is only indexed if the file's mtime was older than the start of
+ * the read by more than DIGEST_SETTLE, so a write during the read cannot have gone unnoticed
+ * in the same clock tick. File systems that keep whole seconds get DIGEST_SETTLE_COARSE */
+#define DIGEST_SIZE 16                 /* bytes of a digest */
+#define DIGEST_HEX (DIGEST_SIZE*2 + 1) /* hex form with its null */
+#define DIGEST_BLOCK 1024              /* bytes between two scrambles of the lanes */
+#define DIGEST_READ (1024*1024)        /* bytes of a file read at a time */
+#define DIGEST_XATTR "user.myftp.digest"
+#define DIGEST_SETTLE 50000000LL              /* ns, more than a coarse kernel clock tick */
+#define DIGEST_SETTLE_COARSE 2000000000LL     /* ns, mtime with no fraction of a second */
+
+typedef struct digest {
+    unsigned long long acc[8];         /* lanes */
+    unsigned char buf[DIGEST_BLOCK];   /* bytes of a block not yet hashed */
+    int have;
+    unsigned long long total;          /* bytes hashed so far */
+} Digest;
+
+/*
+ * Start a digest.
+ */
+void digestinit(Digest *d);
+
+
+
+/*
+ * Hash the next n bytes. Splitting the bytes over several calls gives the same digest.
+ */
+void digestupdate(Digest *d, char *data, long n);
+
+
+
+/*
+ * Finish a digest, DIGEST_SIZE bytes are stored in out.
+ */
+void digestfinal(Digest *d, unsigned char *out);
+
+
+
+/*
+ * Hex form of a digest, DIGEST_HEX bytes are stored in hex.
+ */
+void digesthex(unsigned char *digest, char *hex);
+
+
+
+/*
+ * Digest of a file from its index entry.
+ *
+ * Pre:      1) st from fstat(fd);
+ * Post:     1) return value = 1   : the entry is current, out holds the digest
+ *                           = 0   : no entry, or it is for another size or mtime
+ */
+int digestindexed(int fd, struct stat *st, unsigned char *out);
+
+
+
+/*
+ * Whether a digest read from a file since start may be indexed.
+ *
+ * Pre:      1) st from fstat(fd) before the read started, start from CLOCK_REALTIME at that time;
+ * Post:     1) return value = 1 if the file still has the size and mtime of st and its mtime
+ *              had settled (DIGEST_SETTLE) by start, else 0
+ */
+int digeststable(int fd, struct stat *st, struct timespec *start);
+
+
+
+/*
+ * Store a digest in the index of a file.
+ *
+ * Pre:      1) digest of the st->st_size bytes of the file, st from fstat(fd) after the last of them
+ *              was read or written;
+ * Post:     1) nothing is stored if the file system has no extended attributes
+ */
+void digeststore(int fd, struct stat *st, unsigned char *digest);
+
+
+
+/*
+ * Digest of a whole file, from its index entry when that is still current.
+ *
+ * Pre:      1) fd open for reading (the file offset is not used), st from fstat(fd),
+ * Post:     1) out holds the digest. A digest that had to be computed is stored in the
+ *              index, unless the file changed while it was read or may still be changing
+ *              (digeststable) or the file system has no extended attributes;
+ *           2) return value = 1   : from the index
+ *                           = 0   : computed
+ *                           = -1  : file read error
+ */
+int digestlookup(int fd, struct stat *st, unsigned char *out);
+
+#endif
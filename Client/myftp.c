@@ -16,8 +16,64 @@
  *					- Setup of socket into socketSetup function
  *					- Getting user input into FTPExec function
  *					- Executing commands into locCommands and serverCommands functions			
+ * 16/10/2026 - get uses the raw stream mode when the server offers it (G0R): the file size
+ *				arrives in one frame and the file bytes follow unframed, in large reads
+ *			  - get moves file bytes socket -> pipe -> file with splice(), only frame headers are read
+ *				into user space. Falls back to read()/write() if the file system does not support splice
+ *			  - Negotiates v2 framing at connect time (N opcode): 12 byte typed headers, data frames up to
+ *				4 MB with an end of file flag, optional CRC-32 (-c). -1 keeps the v1 framing
+ *			  - v1 put ends with an empty frame when the file ends on a full frame, so the server does not wait
+ *			  - Commands, responses and frame headers go through the buffered stream layer (Conn in stream.c):
+ *				one read() fills a read-ahead buffer, header and payload leave in one write
+ *			  - Added -u option to move get/put file data with io_uring (uring.c): several file and socket
+ *				operations in flight on registered buffers, read()/write() if the kernel has no io_uring
+ *			  - Added "get -j N" and "put -j N": the file is split into byte ranges, each moved on its own
+ *				connection (R/W opcodes) with pread()/pwrite() at its offset, checked against the server's
+ *				CRC-32 of the range (K opcode) and retried on its own if it failed
+ *			  - Added "get -r" and "put -r" to resume a transfer from the size of the partial file, after
+ *				checking its last bytes against the other copy. A v2 get that loses the connection keeps the
+ *				partial file so it can be resumed
+ *			  - pwd, dir and cd lines that are already waiting on stdin are sent back to back as tagged v2
+ *				requests (up to PIPE_DEPTH in flight), the replies are matched by tag and shown in order.
+ *				A script of N such commands costs about one round trip instead of N
+ *			  - Added "mget <glob>" (expanded by the server) and "mput <glob>" (expanded here): the files are
+ *				streamed back to back with no per-file handshake and the status of each is shown at the end
+ *			  - Added compression of file data: -z <codec> or "compress <codec>" agrees zlib or the LZ codec
+ *				with the server (Z opcode). Frames are compressed one at a time when that pays, and the ratio
+ *				and CPU time are shown after each transfer
+ *			  - Added "sync <file>" (or "sync get <file>") and "sync put <file>": a file that changed on one side
+ *				moves as a delta against the old copy on the other (S opcode, delta.c). The side with the old
+ *				copy sends block signatures, the other answers with literal bytes and block references only
+ *			  - Added "hash <file>" to compare the server's digest of a file with the local copy (I opcode, digest.c).
+ *				get and put of a file that already exists on the other side at the same size ask for the server's
+ *				digest first and are skipped if the copies are identical. Digests come from an index kept in an
+ *				extended attribute of each file, so an unchanged file is not read again
+ *			  - dir on a v2 connection lists the server directory a page at a time (L opcode) with the type, size and
+ *				mtime of every entry, in as many frames as it takes. ldir no longer overflows its buffer on large directories
+ *			  - Added "rget [-j N] <dir>" and "rput [-j N] <dir>" to copy a directory tree. Directories are created first
+ *				and the small files streamed back to back on this connection like an mget/mput (T opcode walks the
+ *				server's tree). Files of MIN_RANGE bytes or more go to up to N child processes (lanes), each moving
+ *				one file at a time on its own connection, checked by CRC-32 and retried like a parallel range
+ *			  - Added "stats" to show the server's counters and the request latency percentiles of each opcode (X opcode)
+ *			  - Added -L <spec>: a load generator. K sessions, each a child process on its own connection, replay a
+ *				weighted mix (or a script) of pwd/dir/cd/get/put at a target rate or as fast as they go, and the
+ *				throughput, errors and p50/p99/p999 latency of each command are shown at the end
+ *			  - Added the socket transport profile (transport.c): -T reads a profile file and -t changes one setting.
+ *				Every connection gets it before connect(), and is corked while file data is sent. Added "transport"
+ *				to show the settings this side's socket and the server's actually have (O opcode)
+ *			  - A raw stream get whose size is not a number (the server could not open the file) fails instead of
+ *				writing an empty file
+ *			  - mput does not send a name too long for the server's reply, it is listed as failed instead
+ *			  - rput names are limited to what fits in its W command and the server's reply, longer ones are listed
+ *				as too long instead of being sent cut short
+ *			  - A framed get checks how its data arrived: a failed checksum or an error from the server removes the
+ *				file, a lost connection keeps it for "get -r", and neither is reported as downloaded
+ *			  - Writes of received file data are checked: a short write is finished, and a failed one (ENOSPC, EIO)
+ *				fails the get and removes the file. The rest of the data is read and dropped
+ *			  - The CRC-32 of a range (K) is zlib's crc32() instead of the table loop
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -27,34 +83,226 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <linux/tcp.h>
 #include <netdb.h>
+#include <glob.h>
+#include <fts.h>
+#include <time.h>
+#include <zlib.h>
 #include "token.h"
 #include "stream.h"
+#include "uring.h"
+#include "compress.h"
+#include "delta.h"
+#include "digest.h"
+#include "transport.h"
 
 #define SERV_TCP_PORT 41147     // Default server listening port
 #define BUFSIZE (1024*5)		// Size of buffer
+#define RAW_BUFSIZE (1024*64)	// Read size for raw stream get
+#define PIPE_CAPACITY (1024*64)	// Default pipe size, most bytes spliced in one go
+#define MAX_JOBS 16				// Most connections a parallel get/put opens
+#define MIN_RANGE (1024*1024)	// Smallest range worth a connection of its own
+#define RANGE_RETRIES 3			// Attempts at each range before a parallel transfer gives up
+#define PIPE_DEPTH 64			// Most tagged commands waiting for a response at once
+#define LIST_PAGE 4096			// Directory entries asked for per L request
+#define LIST_RECORD 19			// Bytes of a listing record before its name
+#define TREE_JOBS 4				// Lanes an rget/rput runs for large files unless -j says otherwise
+#define LOAD_CMDS 32			// Most commands in a load spec
+#define LOAD_SESSIONS 1024		// Most sessions a load run opens
+#define LOAD_SUB_BITS 4
+#define LOAD_SUB (1 << LOAD_SUB_BITS)	// Latency histogram buckets per power of two (values within 6.25%)
+#define LOAD_BUCKETS 640		// Covers latencies up to 2^40 microseconds
+
+typedef struct request {
+	int tag;		// Request ID sent in the v2 header
+	char op;		// Opcode, says how to show the response
+} Request;
+
+typedef struct lane {
+	pid_t pid;		// Child moving the file, 0 while the lane is free
+	int fd;			// Local file, shared with the child
+	int tries;		// Attempts at the file so far
+	long long size;
+	char name[BUFSIZE];		// File name on the server
+	char local[BUFSIZE];	// File name here
+} Lane;
+
+typedef struct tree {
+	int sending;			// 1 for rput, 0 for rget
+	int jobs;				// Lanes that may run at once
+	int dirs, files, big;	// Directories created, files moved, how many of them on a lane
+	int failed;
+	int waiting;			// rput names sent whose status has not arrived
+	FILE *status;			// Failures, shown at the end
+	char *report;
+	size_t reportlen;
+	Lane lane[MAX_JOBS];
+} Tree;
+
+typedef struct loadCmd {
+	int weight;			// Share of the mix, 0 in a script replayed in order
+	char op;			// Request sent: P, C, L (D on v1), G or U
+	char arg[256];		// Directory or file name
+	char text[64];		// Command as written in the spec, for the report
+} LoadCmd;
+
+typedef struct load {
+	int sessions;			// Connections replaying the spec at once
+	double rate;			// Commands per second over all sessions, 0 for as fast as they go
+	double duration;		// Seconds to run for, unless requests is set
+	long long requests;		// Commands to send over all sessions, 0 to run for duration
+	int ncmds, weights;		// Commands in the spec, sum of their weights (0 for a script)
+	LoadCmd cmd[LOAD_CMDS];
+} Load;
+
+typedef struct loadStats {
+	long long count, errors, sum, max;		// Commands, failures, total and largest latency (microseconds)
+	unsigned int buckets[LOAD_BUCKETS];		// Commands by latency, LOAD_SUB buckets per power of two
+} LoadStats;
+
+typedef struct loadSlot {
+	LoadStats connect;				// Connection setup: connect, framing and codec agreed
+	LoadStats cmd[LOAD_CMDS];		// Each command of the spec
+	long long bytesIn, bytesOut;	// Bytes that crossed the socket, from TCP_INFO
+	int lost;						// Connection lost before the session was done
+} LoadSlot;
+
+static int splicePipe[2] = {-1, -1};	// Pipe for splicing get data socket -> file
+static int noSplice;					// Target file system does not support splice
+static Conn conn;						// Buffered connection to the server, conn.version is the agreed framing
+static int maxFrame = MAX_BLOCK_SIZE;	// Largest v2 data frame agreed with the server
+static int useChecksum;					// Ask for CRC-32 on every v2 frame (-c)
+static int useRing;						// Move file data with io_uring (-u)
+static char serverHost[60];				// Server address, parallel transfers open more connections to it
+static unsigned short serverPort;
+static int wantVersion = 2;				// Framing to offer the server
+static int tagging;						// Server repeats request IDs (negotiated "t"), commands can be pipelined
+static Request pending[PIPE_DEPTH];		// Pipelined commands waiting for a response, oldest first
+static int inflight;
+static int lastTag;						// Request ID of the last tagged command (1 - 65535)
+static char lineBuf[BUFSIZE];			// Input read from stdin but not yet returned by readLine
+static int lineLen;
+static Packer packer;					// Codec agreed with the server (Z), compression statistics
+static int wantCodec = CODEC_NONE;		// Codec to ask for at connect time (-z)
 
 int socketSetup(unsigned short listen_port, char * listen_host);
+void negotiateFraming(int sock);
+int sendCmd(int sock, char *buf, int nbytes);
+int recvCmd(int sock, char *buf, int bufsize);
 void FTPExec(int loc_sock);
+int readLine(char *line, int size, int wait);
+char controlRequest(char **loc_token, char *send);
+void showResponse(char op, char *response);
+void sendTagged(char op, char *send);
+void collectReplies(int *prompted, int keep);
 void locCommands(char **loc_token);
 void serverCommands(char **loc_token, int loc_sock);
 void readDirFiles(char response[]);
 void getFile(int sock, char send[], char **token);
+int recvToFile(int sock, int fd, long long size);
+int writeFile(int fd, char *buf, int n);
+long long rawSize(char *response);
+int recvFrames(int sock, int fd);
 void sendFile(int sock, char send[], char **token);
+int sendFrames(int sock, int fd);
+int ringTransfer(Xfer *x);
+int recvFileData(int sock, int fd);
+int sendFileData(int sock, int fd);
+void getBatch(int sock, char *pattern);
+void putBatch(int sock, char *pattern);
+int replyReady(void);
+int jobCount(char **loc_token);
+void getParallel(int sock, char *name, int jobs);
+void putParallel(int sock, char *name, int jobs);
+int runRanges(char *name, int fd, long long size, int jobs, int sending);
+int rangeConnect(void);
+int getRange(int sock, int fd, char *name, long long offset, long long length);
+int putRange(int sock, int fd, char *name, long long offset, long long length);
+void resumeGet(int sock, char *name);
+void resumePut(int sock, char *name);
+int remoteSize(int sock, char *name, long long *size);
+int tailMatches(int sock, int fd, char *name, long long size);
+int checkRange(int sock, char *name, long long offset, long long length, unsigned int crc);
+int selectCodec(int sock, int codec);
+void showPacking(void);
+void syncGet(int sock, char *name);
+void syncPut(int sock, char *name);
+int sendSyncFrames(Delta *d, int sign);
+int recvSyncFrames(Delta *d, int sigs);
+void showDigests(int sock, char *name);
+int sameFile(int sock, char *name);
+int remoteDigest(int sock, char *name, long long want, long long *size, unsigned char *digest);
+int listDir(int sock, int show);
+unsigned long long getBigEndian(unsigned char *p, int bytes);
+int batchFile(int sock, char *name, char *local, FILE *status);
+void getTree(int sock, char *root, int jobs);
+void putTree(int sock, char *root, int jobs);
+Tree *treeSetup(char *root, int jobs, int sending);
+void treeFinish(Tree *t, char *root);
+int treeName(char *root, char *name, char *out, int size);
+int treeReplies(Tree *t, int sock, int all);
+void laneStart(Tree *t, char *name, char *local, int fd, long long size);
+int laneFork(Lane *l, int sending);
+void laneReap(Tree *t, int wait);
+void laneDone(Tree *t, Lane *l, int ok);
+void runLoad(Load *l);
+int loadSpec(char *path, Load *l);
+void loadSession(Load *l, int k, LoadSlot *slot, long long started);
+int loadCommand(LoadCmd *c, int sock, int sink, int k, int seq);
+void loadRecord(LoadStats *s, long long usec, int failed);
+void loadReport(Load *l, LoadSlot *slots, double elapsed);
+int loadBucket(long long usec);
+long long loadPercentile(LoadStats *s, int permille);
+long long loadClock(void);
 
 
 /** MAIN function
  *
  *	Pre: TCP port number and buffer size must be predefined before execution
- *		 Syntax to execute program: "myftp [<host name> | <ip address>]"
+ *		 Syntax to execute program: "myftp [-1] [-c] [-u] [-z codec] [-L spec] [-T file] [-t setting] [<host name> | <ip address>] [<port>]"
+ *		 -1 keeps the original v1 framing, -c asks for a CRC-32 on every frame, -u uses io_uring for file data,
+ *		 -z compresses file data with zlib or lz, -L replays a load spec on many sessions instead of reading commands,
+ *		 -T reads a transport profile file and -t changes one of its settings ("key=value")
  */
 	int main(int argc, char *argv[]){
 		
-		int sock;                           	// Socket
-		char host[60];                      	// Host address
+		int sock, opt;                          	// Socket
+		char *host = serverHost;                	// Host address
 		unsigned short port;    // Server listening port
+		char *spec = NULL;		// Load spec (-L)
+		Load *load;
+
+		// Get options
+		packinit(&packer);
+		while((opt = getopt(argc, argv, "1cuz:L:T:t:")) != -1){
+			if(opt == '1')
+				wantVersion = 1;
+			else if(opt == 'c')
+				useChecksum = 1;
+			else if(opt == 'u')
+				useRing = 1;
+			else if(opt == 'z' && (wantCodec = packcodec(optarg)) >= 0)
+				;
+			else if(opt == 'L')
+				spec = optarg;
+			else if(opt == 'T' && transportLoad(optarg) == 0)
+				;     // Settings are applied in the order given, later ones win
+			else if(opt == 't' && transportSet(optarg) == 0)
+				;
+			else {
+				printf("Syntax: %s [-1] [-c] [-u] [-z zlib|lz] [-L spec] [-T transport_file] [-t setting] <server host name> <server listening port>\n", argv[0]);
+				exit(1);
+			}
+		}
+		argc -= optind - 1;
+		argv += optind - 1;
 
 		   // Get server IP and port number */
 		if (argc==1) {  // Server running on the local host and on default port
@@ -74,12 +322,31 @@ void sendFile(int sock, char send[], char **token);
 				exit(1);
 			}
 		} else {
-			printf("Syntax: %s <server host name> <server listening port>\n", argv[0]);
+			printf("Syntax: %s [-1] [-c] [-u] [-z zlib|lz] [-L spec] [-T transport_file] [-t setting] <server host name> <server listening port>\n", argv[0]);
 			exit(1);
 		}
 		
+		//Replay a load spec instead of reading commands
+		serverPort = port;
+		if(spec != NULL){
+			if((load = malloc(sizeof(Load))) == NULL || loadSpec(spec, load) < 0)
+				exit(1);
+			runLoad(load);
+			return 0;
+		}
+
 		//Setup socket
 		sock = socketSetup(port, host);
+		conninit(&conn, sock);
+		//Agree on framing with the server
+		if(wantVersion == 2)
+			negotiateFraming(sock);
+		//Agree on compression of file data
+		if(wantCodec != CODEC_NONE && selectCodec(sock, wantCodec) < 0)
+			printf("Server does not support %s compression, file data is sent as it is\n", packname(wantCodec));
+		//Set up io_uring for file data if asked to
+		if(useRing && uringSetup(1) < 0)
+			printf("io_uring not available (%s), using read/write\n", strerror(errno));
 		//Execute user commands
 		FTPExec(sock);
 		
@@ -98,6 +365,7 @@ void sendFile(int sock, char send[], char **token);
 		
 		struct sockaddr_in ser_addr;        // Server address
 		struct hostent *hp;                 // Host info
+		char err[256];                      // Transport options the kernel refused
 		int sock;
 		
 		// Erase data in memory starting at address
@@ -119,6 +387,10 @@ void sendFile(int sock, char send[], char **token);
 			  exit(1);
 		}
 
+		// Buffer sizes only set the window if they are given before connect()
+		if(transportApply(sock, err, sizeof(err)) > 0)
+			printf("Transport options refused:%s\n", err);
+
 		// Connect socket to server
 		if (connect(sock, (struct sockaddr *) &ser_addr, sizeof(ser_addr)) < 0) {
 			perror("Client connect");
@@ -130,23 +402,92 @@ void sendFile(int sock, char send[], char **token);
 	} // END of socketSetup function
 
 
+/** Negotiate framing - Offers v2 framing to the server with the N opcode
+ *
+ *	Pre: Socket connected, no other command sent yet
+ *	Post: conn.version, maxFrame, useChecksum and tagging hold what the server agreed to.
+ *		  A server without v2 answers "Command not recognised." and the connection stays on v1
+ */
+	void negotiateFraming(int sock){
+		char send[BUFSIZE], response[BUFSIZE];
+		int version = 1, size = 0;
+		char opts[16] = "";
+
+		sprintf(send, "N2 %d %s", V2_MAX_FRAME, useChecksum ? "ct" : "t");
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0)
+			return;
+
+		if(response[0] == 'N' && sscanf(response + 1, "%d %d %15s", &version, &size, opts) >= 2 && version == 2){
+			conn.version = 2;
+			maxFrame = size;
+			useChecksum = strchr(opts, 'c') != NULL;
+			tagging = strchr(opts, 't') != NULL;
+		} else
+			useChecksum = 0;
+
+	} //END of negotiateFraming function
+
+
+/** Send command - Sends a command frame in the framing agreed with the server
+ *
+ *	Return: nbytes on success, otherwise a write error (see connwrite)
+ */
+	int sendCmd(int sock, char *buf, int nbytes){
+
+		return connwrite(&conn, FT_CMD, conn.version == 2 && useChecksum ? FF_CHECKSUM : 0, buf, nbytes);
+
+	} //END of sendCmd function
+
+
+/** Receive command response - Reads a response frame in the framing agreed with the server
+ *
+ *	Return: length of the response, or a read error (see connread)
+ */
+	int recvCmd(int sock, char *buf, int bufsize){
+		FrameHeader hdr;
+		int n;
+
+		// Responses come out of the read-ahead buffer, one read() can bring several
+		if((n = connread(&conn, buf, bufsize, &hdr)) == -2)
+			printf("Response from server failed its checksum\n");
+
+		return n;
+
+	} //END of recvCmd function
+
+
 /** Execution of user input - Gets user input and passes input to local or server command functions
  *	
  *	Pre: Socket must be connected and predefined BUFSIZE must be provided
  *	Post: Input is set to lowercase, tokenised and sent to local or server function, otherwise,
- *		  user enters "quit" to return to main function
+ *		  user enters "quit" (or input ends) to return to main function.
+ *		  pwd/dir/cd lines typed (or scripted) ahead are pipelined when the server tags its responses
  */
 	void FTPExec(int loc_sock){
 		
 		char input[BUFSIZE];
 		char *token[BUFSIZE];
+		char send[BUFSIZE], op;
+		int prompted = 0;	// Prompt printed and nothing shown after it yet
 		
 		// Get user input
 		while(1) {
-			printf("> ");       // Prompt
-			fgets(input, BUFSIZE, stdin);   // Input
+			if(!prompted && inflight == 0){
+				printf("> ");       // Prompt
+				prompted = 1;
+			}
 
-			int n = strlen(input);
+			// Lines already waiting are taken without blocking, replies are collected once there are none
+			int n = readLine(input, BUFSIZE, inflight == 0);   // Input
+			if(n == 0){
+				collectReplies(&prompted, 0);
+				continue;
+			}
+			if(n < 0)
+				strcpy(input, "quit");      // End of input
+
+			n = strlen(input);
 			
 			//Check input
 			if((input[0] >= 'A' && input[0] <= 'Z') || (input[0] >= 'a' && input[0] <= 'z')){
@@ -164,13 +505,26 @@ void sendFile(int sock, char send[], char **token);
 					input[i] = tolower(input[i]); 
 				}
 
+				tokenise(input, token);    // Tokenise input
+
+				// pwd, dir and cd only wait for their reply once no more input is ready
+				if(tagging && (op = controlRequest(token, send)) != 0){
+					collectReplies(&prompted, PIPE_DEPTH - 1);
+					sendTagged(op, send);
+					continue;
+				}
+
+				// Anything else runs after the replies to earlier commands are shown
+				collectReplies(&prompted, 0);
+				if(!prompted)
+					printf("> ");
+				prompted = 0;
+
 				//If user enters "quit", return to main and quit program
-				if(strcmp(input, "quit") == 0){
+				if(strcmp(token[0], "quit") == 0 && token[1] == NULL){
 					printf("Bye from client\n");
 					break;
 				}else{
-					tokenise(input, token);    // Tokenise input
-					
 					/*If input contains 'l', execute local command function,
 					  otherwise server command function */
 					if(strchr(token[0],'l'))
@@ -178,13 +532,173 @@ void sendFile(int sock, char send[], char **token);
 					else
 						serverCommands(token,loc_sock);
 				}
-			}else
+			}else{
+				collectReplies(&prompted, 0);
+				if(!prompted)
+					printf("> ");
+				prompted = 0;
 				printf("Invalid input! Please try again.\n");
+			}
 		}
 		
 	} //END of FTPExec function
 
 
+/** Read line - Returns the next line of user input, newline included (like fgets)
+ *
+ *	Pre: size > 1
+ *	Post: Input is read from stdin in blocks, lines after the one returned stay buffered
+ *	Return: Length of the line, 0 if wait is 0 and no whole line is ready yet, -1 at end of input
+ */
+	int readLine(char *line, int size, int wait){
+		struct pollfd pfd;
+		char *nl;
+		int n;
+
+		pfd.fd = 0;
+		pfd.events = POLLIN;
+
+		while((nl = memchr(lineBuf, '\n', lineLen)) == NULL && lineLen < sizeof(lineBuf)){
+			if(!wait && poll(&pfd, 1, 0) <= 0)
+				return 0;
+			fflush(stdout);     // Prompt and replies are seen before blocking
+			if((n = read(0, lineBuf + lineLen, sizeof(lineBuf) - lineLen)) <= 0){
+				if(lineLen == 0)
+					return -1;
+				break;      // Last line has no newline
+			}
+			lineLen += n;
+		}
+
+		n = nl != NULL ? nl - lineBuf + 1 : lineLen;
+		memcpy(line, lineBuf, n < size ? n : size - 1);
+		line[n < size ? n : size - 1] = '\0';
+		memmove(lineBuf, lineBuf + n, lineLen - n);
+		lineLen -= n;
+
+		return n;
+
+	} //END of readLine function
+
+
+/** Control request - Builds the request for a pwd, dir or cd command
+ *
+ *	Pre: Tokenised user input
+ *	Post: send holds the request
+ *	Return: Opcode of the request, 0 if the input is not pwd, dir or cd
+ */
+	char controlRequest(char **loc_token, char *send){
+
+		//pwd Command - Display current directory of the server (INPUT FORMAT: "pwd")
+		if(strcmp(loc_token[0], "pwd") == 0 && loc_token[1] == NULL)
+			strcpy(send, "P");     // Single ASCII character for header command
+
+		//dir Command - Display the file names under the current directory of the server (INPUT FORMAT: "dir")
+		//v2 lists the directory a page at a time instead (listDir)
+		else if(strcmp(loc_token[0], "dir") == 0 && loc_token[1] == NULL && conn.version == 1)
+			strcpy(send, "D");     // Single ASCII character for header command
+
+		//cd Command - Change the current directory of the server (INPUT FORMAT: "cd <pathname>")
+		else if(strcmp(loc_token[0], "cd") == 0 && (loc_token[1] == NULL || loc_token[2] == NULL)){
+			strcpy(send, "C");     // Single ASCII character for header command
+			if(loc_token[1] != NULL)
+				strcat(send, loc_token[1]);
+			else
+				strcat(send, "/");	//If no dir provided, set new dir to default system dir "/"
+		} else
+			return 0;
+
+		return send[0];
+
+	} //END of controlRequest function
+
+
+/** Show response - Displays the server's response to a pwd, dir or cd request
+ *
+ */
+	void showResponse(char op, char *response){
+
+		if(op == 'P')
+			printf("Server working dir: %s\n", response);
+		else if(op == 'D'){
+			//If successful (response != 1), display file names.
+			if(response[0] == 1)
+				printf("Server could not open directory\n");
+			else
+				printf("Files in server working dir: %s\n", response);
+		} else {
+			//If response is not 0, server could not change dir
+			if(response[0] != 0)
+				printf("Error changing directory\n");
+			else
+				printf("Directory successfully changed\n");
+		}
+
+	} //END of showResponse function
+
+
+/** Send tagged - Queues a command with the next request ID, without waiting for its response
+ *
+ *	Pre: Tags agreed with the server, fewer than PIPE_DEPTH commands in flight
+ *	Post: Command queued on conn (sent by the next flush) and remembered in pending
+ */
+	void sendTagged(char op, char *send){
+
+		lastTag = lastTag % 0xFFFF + 1;     // 0 means untagged
+		conn.tag = lastTag;
+		connqueue(&conn, FT_CMD, useChecksum ? FF_CHECKSUM : 0, send, strlen(send) + 1);
+		conn.tag = 0;
+
+		pending[inflight].tag = lastTag;
+		pending[inflight].op = op;
+		inflight++;
+
+	} //END of sendTagged function
+
+
+/** Collect replies - Sends queued commands and shows responses until at most keep are in flight
+ *
+ *	Pre: prompted says whether a prompt is showing with nothing after it yet
+ *	Post: Each response is matched to its command by tag and shown after a prompt
+ */
+	void collectReplies(int *prompted, int keep){
+		char response[BUFSIZE];
+		FrameHeader hdr;
+		int n, i;
+
+		if(inflight <= keep)
+			return;
+		connflush(&conn);
+
+		while(inflight > keep){
+			if((n = connread(&conn, response, sizeof(response), &hdr)) < 0 && n != -2){
+				printf("Connection to server lost\n");
+				inflight = 0;
+				return;
+			}
+
+			for(i = 0; i < inflight && pending[i].tag != hdr.tag; i++)
+				;
+			if(i == inflight){
+				printf("Response to unknown request %d ignored\n", hdr.tag);
+				continue;
+			}
+
+			if(!*prompted)
+				printf("> ");
+			*prompted = 0;
+			if(n == -2)
+				printf("Response from server failed its checksum\n");
+			else
+				showResponse(pending[i].op, response);
+
+			memmove(pending + i, pending + i + 1, (inflight - i - 1) * sizeof(Request));
+			inflight--;
+		}
+
+	} //END of collectReplies function
+
+
 /** Local command execution - Executes commands to display/change local directories, and display file names
  *
  *	Pre: Command (token) from user contains 'l' and buffer size has been predefined
@@ -235,54 +749,109 @@ void sendFile(int sock, char send[], char **token);
  */
 	void serverCommands(char **loc_token, int loc_sock){
 		
-		char send[BUFSIZE], response[BUFSIZE];
-		
-		//pwd Command - Display current directory of the server (INPUT FORMAT: "pwd")
-		if(strcmp(loc_token[0], "pwd") == 0 && loc_token[1] == NULL){       // Server pwd
-			strcpy(send, "P");     // Single ASCII character for header command
-			writen(loc_sock, send, strlen(send) + 1);
-			readn(loc_sock, response, sizeof(response));
-
-			printf("Server working dir: %s\n", response);
+		char send[BUFSIZE], response[BUFSIZE], op, *dirname;
+		int n;
 		
-		//dir Command - Display the file names under the current directory of the server (INPUT FORMAT: "dir")	
-		} else if(strcmp(loc_token[0], "dir") == 0 && loc_token[1] == NULL){    // Server dir
-			strcpy(send, "D");     // Single ASCII character for header command
-			writen(loc_sock, send, strlen(send) + 1);
-			
-			//Read response from server. If successful (response != 0), display file names.
-			readn(loc_sock, response, sizeof(response));
-			if(response[0] == 1)
-				printf("Server could not open directory\n");
-			else
-				printf("Files in server working dir: %s\n", response);
+		//pwd, dir and cd Commands - Display/change the current directory of the server, display its file names
+		//(INPUT FORMAT: "pwd", "dir", "cd <pathname>")
+		if((op = controlRequest(loc_token, send)) != 0){
+			sendCmd(loc_sock, send, strlen(send) + 1);
+			recvCmd(loc_sock, response, sizeof(response));
+			showResponse(op, response);
 		
-		//cd Command - Change the current directory of the client (INPUT FORMAT: "cd <pathname>")	
-		} else if(strcmp(loc_token[0], "cd") == 0 && loc_token[2] == NULL){     // Server cd
-			strcpy(send, "C");     // Single ASCII character for header command
-			
-			//Check token - must have no more than 2 tokens (1 for command and other for new dir)
-			if(loc_token[1] != NULL)
-				strcat(send, loc_token[1]);
-			else if(loc_token[1] == NULL)
-				strcat(send, "/");	//If no dir provided, set new dir to default system dir "/"
+		//dir Command (v2) - Display the entries of the server's current directory with their type, size and mtime
+		} else if(strcmp(loc_token[0], "dir") == 0 && loc_token[1] == NULL){
+			if(listDir(loc_sock, 1) == -1){     // Server without L, names only
+				sendCmd(loc_sock, "D", 2);
+				recvCmd(loc_sock, response, sizeof(response));
+				showResponse('D', response);
+			}
+
+		//get -j Command - Retrieve the named file over several connections at once (INPUT FORMAT: "get -j <connections> <filename>")
+		} else if(strcmp(loc_token[0], "get") == 0 && loc_token[1] != NULL && strcmp(loc_token[1], "-j") == 0){
+			if((n = jobCount(loc_token)) > 0)
+				getParallel(loc_sock, loc_token[3], n);
+
+		//put -j Command - Send the named file over several connections at once (INPUT FORMAT: "put -j <connections> <filename>")
+		} else if(strcmp(loc_token[0], "put") == 0 && loc_token[1] != NULL && strcmp(loc_token[1], "-j") == 0){
+			if((n = jobCount(loc_token)) > 0)
+				putParallel(loc_sock, loc_token[3], n);
+
+		//get -r Command - Resume a partial download from the size of the local file (INPUT FORMAT: "get -r <filename>")
+		} else if(strcmp(loc_token[0], "get") == 0 && loc_token[1] != NULL && strcmp(loc_token[1], "-r") == 0 &&
+				  loc_token[2] != NULL && loc_token[3] == NULL){
+			resumeGet(loc_sock, loc_token[2]);
+
+		//put -r Command - Resume a partial upload from the size of the server's file (INPUT FORMAT: "put -r <filename>")
+		} else if(strcmp(loc_token[0], "put") == 0 && loc_token[1] != NULL && strcmp(loc_token[1], "-r") == 0 &&
+				  loc_token[2] != NULL && loc_token[3] == NULL){
+			resumePut(loc_sock, loc_token[2]);
+
+		//rget/rput Commands - Copy a directory tree from/to the server (INPUT FORMAT: "rget [-j <connections>] <dirname>")
+		} else if((strcmp(loc_token[0], "rget") == 0 || strcmp(loc_token[0], "rput") == 0) && loc_token[1] != NULL &&
+				  (strcmp(loc_token[1], "-j") == 0 || loc_token[2] == NULL)){
+			if(strcmp(loc_token[1], "-j") == 0){
+				n = jobCount(loc_token);
+				dirname = loc_token[3];
+			} else {
+				n = TREE_JOBS;
+				dirname = loc_token[1];
+			}
+			if(n > 0 && strcmp(loc_token[0], "rget") == 0)
+				getTree(loc_sock, dirname, n);
+			else if(n > 0)
+				putTree(loc_sock, dirname, n);
+
+		//mget Command - Retrieve every file matching a glob, expanded by the server (INPUT FORMAT: "mget <glob>")
+		} else if(strcmp(loc_token[0], "mget") == 0 && loc_token[1] != NULL && loc_token[2] == NULL){
+			getBatch(loc_sock, loc_token[1]);
+
+		//mput Command - Send every local file matching a glob (INPUT FORMAT: "mput <glob>")
+		} else if(strcmp(loc_token[0], "mput") == 0 && loc_token[1] != NULL && loc_token[2] == NULL){
+			putBatch(loc_sock, loc_token[1]);
+
+		//compress Command - Compress the file data of the next transfers (INPUT FORMAT: "compress <zlib | lz | none>")
+		} else if(strcmp(loc_token[0], "compress") == 0 && loc_token[1] != NULL && loc_token[2] == NULL){
+			if((n = packcodec(loc_token[1])) < 0)
+				printf("Unknown codec %s (zlib, lz or none)\n", loc_token[1]);
+			else if(selectCodec(loc_sock, n) < 0)
+				printf("Server does not support %s compression\n", loc_token[1]);
 			else
-				printf("Incorrect input\n");
-			
-			writen(loc_sock, send, strlen(send) + 1);
-			
-			//Read response from server (if response is not 0, server could not change dir)
-			readn(loc_sock,response,sizeof(response));
-			if(response[0] != 0)
-				printf("Error changing directory\n");
+				printf("File data compression set to %s\n", packname(n));
+
+		//sync Command - Bring a changed file up to date by sending only what changed (INPUT FORMAT: "sync [get | put] <filename>")
+		} else if(strcmp(loc_token[0], "sync") == 0 && loc_token[1] != NULL && (loc_token[2] == NULL ||
+				  (loc_token[3] == NULL && (strcmp(loc_token[1], "get") == 0 || strcmp(loc_token[1], "put") == 0)))){
+			if(loc_token[2] == NULL || strcmp(loc_token[1], "get") == 0)
+				syncGet(loc_sock, loc_token[2] == NULL ? loc_token[1] : loc_token[2]);
 			else
-				printf("Directory successfully changed\n");
-		
+				syncPut(loc_sock, loc_token[2]);
+
+		//stats Command - Display the server's counters and request latencies (INPUT FORMAT: "stats")
+		} else if(strcmp(loc_token[0], "stats") == 0 && loc_token[1] == NULL){
+			sendCmd(loc_sock, "X", 2);
+			if(recvCmd(loc_sock, response, sizeof(response)) > 0)
+				printf("Server stats:\n%s\n", response);
+
+		//transport Command - Display the socket options of both ends of the connection (INPUT FORMAT: "transport")
+		} else if(strcmp(loc_token[0], "transport") == 0 && loc_token[1] == NULL){
+			transportDump(loc_sock, response, sizeof(response));
+			printf("Client side:\n%s\n", response);
+			sendCmd(loc_sock, "O", 2);
+			if(recvCmd(loc_sock, response, sizeof(response)) > 0)
+				printf("Server side:\n%s\n", response);
+
+		//hash Command - Compare the server's digest of a file with the local copy (INPUT FORMAT: "hash <filename>")
+		} else if(strcmp(loc_token[0], "hash") == 0 && loc_token[1] != NULL && loc_token[2] == NULL){
+			showDigests(loc_sock, loc_token[1]);
+
 		//get Command - Retrieve the named file from the current directory of the server (INPUT FORMAT: "get <filename>")	
 		} else if(strcmp(loc_token[0], "get") == 0 && loc_token[2] == NULL){    // Server get
 			strcpy(send, "G");     // Single ASCII character for header command
-			//If file name exists, get file from server, otherwise display error.
-			if(loc_token[1] != NULL){
+			//If file name exists, get file from server, otherwise display error. Skipped if the local copy is identical
+			if(loc_token[1] != NULL && sameFile(loc_sock, loc_token[1]))
+				printf("Local %s is identical to the server's copy, get skipped\n", loc_token[1]);
+			else if(loc_token[1] != NULL){
 				strcat(send, loc_token[1]);
 				getFile(loc_sock, send, loc_token);     // get file functionality
 			}else
@@ -291,8 +860,10 @@ void sendFile(int sock, char send[], char **token);
 		//put Command - Send the named file to the current directory of the server (INPUT FORMAT: "put <filename>")	
 		} else if(strcmp(loc_token[0], "put") == 0 && loc_token[2] == NULL){    // Server put
 			strcpy(send, "U");      // Single ASCII character for header command
-			//If file name exists, send file to server, otherwise display error.
-			if(loc_token[1] != NULL){
+			//If file name exists, send file to server, otherwise display error. Skipped if the server's copy is identical
+			if(loc_token[1] != NULL && sameFile(loc_sock, loc_token[1]))
+				printf("Server's %s is identical to the local copy, put skipped\n", loc_token[1]);
+			else if(loc_token[1] != NULL){
 				strcat(send, loc_token[1]);
 				sendFile(loc_sock, send, loc_token);     // send file functionality
 			}else
@@ -300,6 +871,8 @@ void sendFile(int sock, char send[], char **token);
 			
 		} else
 			printf("Invalid input! Please try again.\n");
+
+		showPacking();      // Ratio and CPU time of any compressed transfer above
 		
 	} //END of serverCommands function
 
@@ -314,16 +887,23 @@ void sendFile(int sock, char send[], char **token);
 		DIR *dp;
 		struct dirent *dirp;
 		char directory[BUFSIZE];
-
-		directory[0] = '\0';    // First is null terminator
+		size_t len = 0, n;
 		
 		// Reopen directory to start from the start of directory
 		if((dp = opendir(".")) != NULL){
-			// Read directory names into array
+			// Read directory names into array, as many as fit
 			while((dirp = readdir(dp)) != NULL){
-				strcat(directory, "\n");
-				strcat(directory, dirp->d_name);
+				n = strlen(dirp->d_name);
+				if(len + n + 1 + sizeof("\n...") > sizeof(directory)){
+					strcpy(directory + len, "\n...");
+					len += strlen("\n...");
+					break;
+				}
+				directory[len++] = '\n';
+				memcpy(directory + len, dirp->d_name, n);
+				len += n;
 			}
+			directory[len] = '\0';
 
 			// Close directory
 			closedir(dp);
@@ -343,33 +923,81 @@ void sendFile(int sock, char send[], char **token);
  *		  write contents of file to the client current directory then close file
  */
 	void getFile(int sock, char send[], char **token){
+		Xfer *x;
+		long long size;
 		int fd, n;
-		char buf[BUFSIZE];
 		char response[BUFSIZE];
 		
 		if(access(token[1], F_OK) ==0)
-			printf("File already exists in the current client directory!\n");
+			printf("File already exists in the current client directory! (\"get -r %s\" resumes a partial file)\n", token[1]);
 		else{
-			writen(sock, send, strlen(send) + 1);       // Send command code to server
-			readn(sock, response, sizeof(response));    // Read response
+			noSplice = 0;       // Retry splice, the current directory may be on another file system
+			sendCmd(sock, send, strlen(send) + 1);       // Send command code to server
+			recvCmd(sock, response, sizeof(response));    // Read response
 
-			if(response[1] == '0'){     // If server ready and file exists
+			if(response[1] == '0' && conn.version == 2){     // v2 data frames end with FF_EOF
 				strcpy(send, "H");      // Single ASCII character for header command
 				strcat(send, "0");      // Single ASCII character for header command status
 
-				writen(sock, send, strlen(send) + 1);       // Write ready status to server
+				sendCmd(sock, send, strlen(send) + 1);       // Write ready status to server
 				fd = open(token[1], O_WRONLY | O_CREAT, S_IRWXU);  // Open file
 
-				while((n = readn(sock, buf, sizeof(buf))) > 0){     // Read file contents from server
-					buf[n] = '\0';        // Null-terminator string
-					write(fd, buf, n);    // Write contents to file
-					if(n < BUFSIZE-2){
-						break;
-					}
+				// Compressed frames are decoded here, not by io_uring
+				if(packer.codec == CODEC_NONE && (x = uringStartRecv(&conn, fd, 0, 2, maxFrame, 0, NULL)) != NULL)
+					n = ringTransfer(x);
+				else
+					n = recvFrames(sock, fd);
+				if(n == -1)
+					printf("Connection lost while downloading file, \"get -r %s\" resumes it\n", token[1]);
+				else if(n < 0){
+					printf("File was not downloaded intact\n");
+					unlink(token[1]);
+				}else
+					printf("File successfully downloaded from server\n");
+				close(fd);
+			}else if(response[1] == '0' && response[2] == 'R'){     // Server offers raw stream
+				strcpy(send, "H");      // Single ASCII character for header command
+				strcat(send, "R");      // Ready for raw stream
+
+				sendCmd(sock, send, strlen(send) + 1);       // Write ready status to server
+				recvCmd(sock, response, sizeof(response));    // File size
+				if((size = rawSize(response)) < 0){
+					printf("Server could not open the file!\n");
+					return;
 				}
+				fd = open(token[1], O_WRONLY | O_CREAT, S_IRWXU);  // Open file
+
+				if((x = uringStartRecv(&conn, fd, 0, XFER_RAW, 0, size, NULL)) != NULL)
+					n = ringTransfer(x);
+				else
+					n = recvToFile(sock, fd, size);
+				if(n == -1)
+					printf("Connection lost while downloading file, \"get -r %s\" resumes it\n", token[1]);
+				else if(n < 0){
+					printf("File could not be written\n");
+					unlink(token[1]);
+				}else
+					printf("File successfully downloaded from server\n");
+				close(fd);
+			}else if(response[1] == '0'){     // If server ready and file exists
+				strcpy(send, "H");      // Single ASCII character for header command
+				strcat(send, "0");      // Single ASCII character for header command status
+
+				sendCmd(sock, send, strlen(send) + 1);       // Write ready status to server
+				fd = open(token[1], O_WRONLY | O_CREAT, S_IRWXU);  // Open file
 
+				if((x = uringStartRecv(&conn, fd, 0, 1, MAX_BLOCK_SIZE, 0, NULL)) != NULL)
+					n = ringTransfer(x);
+				else
+					n = recvFileData(sock, fd);     // Read file contents from server
+				if(n == -1)
+					printf("Connection lost while downloading file, \"get -r %s\" resumes it\n", token[1]);
+				else if(n < 0){
+					printf("File was not downloaded intact\n");
+					unlink(token[1]);
+				}else
+					printf("File successfully downloaded from server\n");
 				close(fd);
-				printf("File successfully downloaded from server\n");
 			}else if(response[1] == '1')
 				printf("File does not exist in the current server directory!\n");
 			else
@@ -379,6 +1007,162 @@ void sendFile(int sock, char send[], char **token);
 	} //END of getFile function
 
 
+/** Raw size - Reads the file size that starts a raw stream
+ *
+ *	Return: The size, or -1 if the server sent something else (it could not open the file)
+ */
+	long long rawSize(char *response){
+		long long size;
+		char *end;
+
+		size = strtoll(response, &end, 10);
+		return end == response || *end != '\0' || size < 0 ? -1 : size;
+
+	} //END of rawSize function
+
+
+/** Receive to file - Moves exactly size bytes from the socket to a file
+ *
+ *	Pre: Connection positioned at file data (raw stream, or payload of a frame whose header was read), fd open for writing
+ *	Post: size bytes copied from the connection to the file. Bytes already in the read-ahead buffer are
+ *		  written first, the rest moves with splice() through a pipe when the file system supports it,
+ *		  otherwise with read()/write(). Once a write fails the rest is read and dropped, so the
+ *		  connection stays in step with the server
+ *	Return: 0 on success, -1 if the connection failed before all bytes arrived, -2 if the file could not be written
+ */
+	int recvToFile(int sock, int fd, long long size){
+		char buf[RAW_BUFSIZE];
+		int n, m, done, failed = 0;
+
+		if(!noSplice && splicePipe[0] < 0 && pipe(splicePipe) < 0)
+			noSplice = 1;
+
+		while(size > 0 && (n = conntake(&conn, buf, size < RAW_BUFSIZE ? size : RAW_BUFSIZE)) > 0){
+			if(!failed && writeFile(fd, buf, n) < 0)    // Write read-ahead bytes to file
+				failed = 1;
+			size -= n;
+		}
+
+		while(size > 0){
+			if(noSplice || failed){
+				if((n = read(sock, buf, size < RAW_BUFSIZE ? size : RAW_BUFSIZE)) <= 0)
+					return -1;
+				if(!failed && writeFile(fd, buf, n) < 0)    // Write contents to file
+					failed = 1;
+				size -= n;
+				continue;
+			}
+
+			// Pipe is always empty here, so never ask for more than it can hold
+			if((n = splice(sock, NULL, splicePipe[1], NULL, size < PIPE_CAPACITY ? size : PIPE_CAPACITY, SPLICE_F_MOVE)) <= 0){
+				if(n < 0 && errno == EINTR)
+					continue;
+				if(n < 0 && errno == EINVAL){
+					noSplice = 1;
+					continue;
+				}
+				return -1;
+			}
+
+			for(done = 0; done < n; done += m){
+				if((m = splice(splicePipe[0], NULL, fd, NULL, n - done, SPLICE_F_MOVE)) < 0){
+					if(errno == EINTR){
+						m = 0;
+						continue;
+					}
+					// File system cannot splice - copy what is in the pipe and stop using it
+					noSplice = 1;
+					if((m = read(splicePipe[0], buf, n - done)) <= 0)
+						return -1;
+					if(!failed && writeFile(fd, buf, m) < 0)
+						failed = 1;
+				}
+			}
+			size -= n;
+		}
+
+		return failed ? -2 : 0;
+
+	} //END of recvToFile function
+
+
+/** Write file - Writes n bytes to a file, finishing short writes
+ *
+ *	Return: 0 on success, -1 if a write failed (ENOSPC, EIO...)
+ */
+	int writeFile(int fd, char *buf, int n){
+		int nw;
+
+		while(n > 0){
+			if((nw = write(fd, buf, n)) < 0 && errno == EINTR)
+				continue;
+			if(nw <= 0)
+				return -1;
+			buf += nw;
+			n -= nw;
+		}
+
+		return 0;
+
+	} //END of writeFile function
+
+
+/** Receive frames - Writes the v2 data frames of a get to a file
+ *
+ *	Pre: v2 framing agreed, H0 sent, fd open for writing
+ *	Post: Every data frame up to the one flagged FF_EOF is written to the file. Plain payloads are
+ *		  spliced, checksummed or compressed payloads are read, verified and decompressed first
+ *	Return: 0 on success, -1 if the connection failed, -2 if the server reported an error, a checksum
+ *			failed, a frame could not be decompressed or the file could not be written
+ */
+	int recvFrames(int sock, int fd){
+		FrameHeader hdr;
+		char *buf = NULL, *out;
+		int n, nr, result = 0;
+
+		do {
+			if(connheader(&conn, &hdr) < 0 || hdr.type != FT_DATA || hdr.length > maxFrame){
+				result = -1;
+				break;
+			}
+
+			if(hdr.flags & (FF_CHECKSUM | FF_PACKED)){
+				if(buf == NULL && (buf = malloc(maxFrame)) == NULL){
+					result = -1;
+					break;
+				}
+				for(n = conntake(&conn, buf, hdr.length); n < hdr.length; n += nr)
+					if((nr = read(sock, buf + n, hdr.length - n)) <= 0)
+						break;
+				if(n < hdr.length){
+					result = -1;
+					break;
+				}
+				if((hdr.flags & FF_CHECKSUM) && crc32buf(0, buf, n) != hdr.crc)
+					result = -2;    // Keep reading to stay in step with the server
+				if((n = unpack(&packer, hdr.flags, buf, n, &out)) < 0)
+					result = -2;
+				else if(result == 0 && writeFile(fd, out, n) < 0)    // Write contents to file
+					result = -2;
+			} else if((n = recvToFile(sock, fd, hdr.length)) == -1){
+				result = -1;
+				break;
+			} else {
+				if(n < 0)
+					result = -2;
+				unpack(&packer, 0, NULL, hdr.length, &out);    // Counted in the compression statistics
+			}
+
+			if(hdr.flags & FF_ERROR)
+				result = -2;
+		} while(!(hdr.flags & FF_EOF));
+
+		free(buf);
+		return result;
+
+	} //END of recvFrames function
+
+
 /** Send file from remote server
  *
  *	Pre: Command 'put' requested from the user, a connected socket to the server, 
@@ -388,34 +1172,2033 @@ void sendFile(int sock, char send[], char **token);
  */
 	void sendFile(int sock, char send[], char **token){
 		char response[BUFSIZE];             // Test message recieved from server
-		char data[BUFSIZE];
-		char buf[BUFSIZE];
-		int fd, size, n;
+		int fd, n;
+		struct stat st;
+		Xfer *x;
 		
 		if(access(token[1], F_OK) !=0)
 			printf("File does not exist in the current client directory!\n");
 		else{
-			writen(sock, send, strlen(send) + 1);       // Send command code to server
-			readn(sock, response, sizeof(response));     // Read response
+			sendCmd(sock, send, strlen(send) + 1);       // Send command code to server
+			recvCmd(sock, response, sizeof(response));     // Read response
+
+			if(response[1] == '0' && conn.version == 2){     // v2 data frames, then V0/V1 from the server
+				fd = open(token[1], O_RDONLY, S_IRUSR);     // Open file
+				if(uringActive() && packer.codec == CODEC_NONE && fstat(fd, &st) == 0 &&
+				   (x = uringStartSend(&conn, fd, 0, st.st_size, 2, maxFrame, useChecksum, NULL)) != NULL)
+					n = ringTransfer(x);
+				else
+					n = sendFrames(sock, fd);
+				close(fd);
 
-			if(response[1] == '0'){         // If server ready and file exists
+				if(n < 0 || recvCmd(sock, response, sizeof(response)) <= 0)
+					printf("Connection lost while sending file\n");
+				else if(strcmp(response, "V0") != 0)
+					printf("Server did not receive the file intact!\n");
+				else
+					printf("File successfully sent to server\n");
+			}else if(response[1] == '0'){         // If server ready and file exists
 				fd = open(token[1], O_RDONLY, S_IRUSR);     // Open file
 
-				while((n = read(fd, buf, BUFSIZE-1)) > 0){      // Read contents of file
-					buf[n] = '\0';
-					writen(sock, buf, n);   // Send contents to server
+				if(uringActive() && fstat(fd, &st) == 0 &&
+				   (x = uringStartSend(&conn, fd, 0, st.st_size, 1, BUFSIZE-1, 0, NULL)) != NULL){
+					n = ringTransfer(x);
+					close(fd);
+					printf("%s\n", n < 0 ? "Connection lost while sending file" : "File successfully sent to server");
+					return;
 				}
+
+				sendFileData(sock, fd);     // Send contents to server
 				
 				close(fd);
 				printf("File successfully sent to server\n");
 			}else if(response[1] == '1')
-				printf("File already exists on the server!\n");
+				printf("File already exists on the server! (\"put -r %s\" resumes a partial file)\n", token[1]);
 			else
 				printf("Server does not have permission to accept the file!");
 		}
 		
 	} //END of sendFile function
 
+
+/** Send frames - Sends a file as v2 data frames of up to maxFrame bytes, the last one flagged FF_EOF
+ *
+ *	Pre: v2 framing agreed, server acknowledged the put, fd open for reading
+ *	Post: Whole file sent, frames compressed with the agreed codec when that pays.
+ *		  A read error ends the file with FF_ERROR so the server discards it
+ *	Return: 0 on success, -1 on write error
+ */
+	int sendFrames(int sock, int fd){
+		struct stat st;
+		long long left;
+		char *buf;
+		int n, flags, packed, frame;
+
+		// Compressed frames are kept smaller so each one is compressed while the last is on the wire
+		frame = packer.codec != CODEC_NONE && maxFrame > PACK_FRAME ? PACK_FRAME : maxFrame;
+		if(fstat(fd, &st) < 0 || (buf = malloc(frame)) == NULL)
+			return connwrite(&conn, FT_DATA, FF_EOF | FF_ERROR, "", 0) < 0 ? -1 : 0;
+
+		left = st.st_size;
+		transportCork(sock, 1);     // Headers and data leave in full segments
+		do {
+			n = read(fd, buf, left < frame ? left : frame);
+			if(n < 0 || (n == 0 && left > 0)){      // Read failed or file shrank
+				n = connwrite(&conn, FT_DATA, FF_EOF | FF_ERROR, "", 0);
+				break;
+			}
+
+			left -= n;
+			n = pack(&packer, buf, n, &packed);
+			flags = (left == 0 ? FF_EOF : 0) | (useChecksum ? FF_CHECKSUM : 0) | packed;
+			if((n = connwrite(&conn, FT_DATA, flags, buf, n)) < 0)
+				break;
+		} while(left > 0);
+		transportCork(sock, 0);
+
+		free(buf);
+		return n < 0 ? -1 : 0;
+
+	} //END of sendFrames function
+
+/** Ring transfer - Waits for a file transfer started on the io_uring backend
+ *
+ *	Pre: x returned by uringStartSend/uringStartRecv
+ *	Post: Transfer finished and its slot released
+ *	Return: 0 on success, -1 if the connection failed, -2 if the data was damaged or flagged as failed
+ */
+	int ringTransfer(Xfer *x){
+
+		uringWait(x);
+		return uringFinish(x);
+
+	} //END of ringTransfer function
+
+
+/** Receive file data - Writes the data frames of one file to fd, in the framing agreed with the server
+ *
+ *	Pre: The server is sending the file, fd open for writing
+ *	Post: v2: frames up to the one flagged FF_EOF. v1: frames up to the first short one
+ *	Return: 0 on success, -1 if the connection failed, -2 if the file did not arrive intact (v2) or could
+ *			not be written
+ */
+	int recvFileData(int sock, int fd){
+		FrameHeader hdr;
+		int n, m, result = 0;
+
+		if(conn.version == 2)
+			return recvFrames(sock, fd);
+
+		while(connheader(&conn, &hdr) == 0){
+			n = hdr.length;
+			if(n > 0 && (m = recvToFile(sock, fd, n)) < 0){    // Write contents to file
+				if(m == -1)
+					return -1;
+				result = -2;     // Keep reading to stay in step with the server
+			}
+			if(n < BUFSIZE-2)
+				return result;
+		}
+
+		return -1;
+
+	} //END of recvFileData function
+
+
+/** Send file data - Sends a file as data frames in the framing agreed with the server
+ *
+ *	Pre: The server is expecting the file, fd open for reading
+ *	Post: v2: frames of up to maxFrame bytes, the last flagged FF_EOF. v1: BUFSIZE-1 byte frames ended
+ *		  by a short (or empty) frame
+ *	Return: 0 on success, -1 on write error
+ */
+	int sendFileData(int sock, int fd){
+		char buf[BUFSIZE];
+		int n, size = 0, result = 0;
+
+		if(conn.version == 2)
+			return sendFrames(sock, fd);
+
+		transportCork(sock, 1);
+		while((n = read(fd, buf, BUFSIZE-1)) > 0){      // Read contents of file
+			if((result = connwrite(&conn, FT_DATA, 0, buf, n)) < 0)   // Send contents to server
+				break;
+			size = n;
+		}
+
+		// The server stops at the first short frame, so end a file that filled its last frame
+		if(result >= 0 && (size == 0 || size >= BUFSIZE-2))
+			result = connwrite(&conn, FT_DATA, 0, buf, 0);
+		transportCork(sock, 0);
+
+		return result < 0 ? -1 : 0;
+
+	} //END of sendFileData function
+
+
+/** Batch get - Downloads every file matching a glob on the server (mget). The server expands the glob
+ *				and streams the files back to back, each announced as "M0 <size> <name>" or "M1 <name>"
+ *
+ *	Pre: Connected to the server
+ *	Post: Each file is saved under the last part of its name in the current directory. Files that
+ *		  already exist here are read and dropped. The status of every file is shown at the end
+ */
+	void getBatch(int sock, char *pattern){
+		char send[BUFSIZE], response[BUFSIZE], *name, *local, *report = NULL;
+		size_t reportlen = 0;
+		long long size;
+		FILE *status;
+		int n, pos = 0, received = 0, failed = 0;
+
+		if((status = open_memstream(&report, &reportlen)) == NULL)
+			return;
+
+		snprintf(send, sizeof(send), "M%s", pattern);
+		sendCmd(sock, send, strlen(send) + 1);
+
+		while(1){
+			if(recvCmd(sock, response, sizeof(response)) <= 0){
+				fprintf(status, "Connection lost during mget\n");
+				break;
+			}
+			if(response[0] != 'M'){
+				fprintf(status, "Server does not support mget!\n");
+				break;
+			}
+			if(response[1] == 'E')      // End of the batch
+				break;
+			if(response[1] != '0' || sscanf(response + 3, "%lld %n", &size, &pos) < 1){
+				fprintf(status, "  %s: cannot be read on the server\n", response + 3);
+				failed++;
+				continue;
+			}
+
+			name = response + 3 + pos;
+			local = strrchr(name, '/') != NULL ? strrchr(name, '/') + 1 : name;
+			if((n = batchFile(sock, name, local, status)) <= 0){
+				failed++;
+				if(n < 0)
+					break;
+				continue;
+			}
+			fprintf(status, "  %s: ok (%lld bytes)\n", name, size);
+			received++;
+		}
+
+		fclose(status);
+		printf("mget %s: %d files downloaded, %d failed\n%s", pattern, received, failed, report);
+		free(report);
+
+	} //END of getBatch function
+
+
+/** Batch put - Sends every local file matching a glob (mput). Each file is sent as "Y<name>" and its
+ *				data frames straight away; the server's status replies are collected while sending
+ *
+ *	Pre: Connected to the server
+ *	Post: The status of every file is shown at the end
+ */
+	void putBatch(int sock, char *pattern){
+		char send[BUFSIZE], response[BUFSIZE], *report = NULL;
+		size_t reportlen = 0;
+		int fd, i, waiting = 0, sent = 0, failed = 0, lost = 0;
+		struct stat st;
+		FILE *status;
+		glob_t gl;
+
+		if(glob(pattern, 0, NULL, &gl) != 0){
+			printf("No files in the current client directory match %s\n", pattern);
+			globfree(&gl);
+			return;
+		}
+
+		// A server without mput would take the file data for commands, so ask first
+		sendCmd(sock, "Y", 2);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || strcmp(response, "Y0") != 0){
+			printf("Server does not support mput!\n");
+			globfree(&gl);
+			return;
+		}
+
+		if((status = open_memstream(&report, &reportlen)) == NULL){
+			globfree(&gl);
+			return;
+		}
+
+		for(i = 0; i <= gl.gl_pathc && !lost; i++){
+			// Status replies that have arrived, all of them after the last file
+			while(waiting > 0 && (i == gl.gl_pathc || replyReady())){
+				if(recvCmd(sock, response, sizeof(response)) <= 0){
+					lost = 1;
+					break;
+				}
+				waiting--;
+				if(response[1] == '0'){
+					fprintf(status, "  %s: ok\n", response + 3);
+					sent++;
+				} else {
+					fprintf(status, "  %s: %s\n", response + 3, response[1] == '1' ? "already exists on the server" :
+							response[1] == '2' ? "cannot be created on the server" : "not received intact");
+					failed++;
+				}
+			}
+			if(i == gl.gl_pathc || lost)
+				break;
+
+			// The server's "Yc <name>" reply has to hold the name, so a longer one is not sent cut short
+			if(strlen(gl.gl_pathv[i]) > BUFSIZE - 4){
+				fprintf(status, "  %s: name too long\n", gl.gl_pathv[i]);
+				failed++;
+				continue;
+			}
+
+			if((fd = open(gl.gl_pathv[i], O_RDONLY)) < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+				if(fd >= 0)
+					close(fd);
+				if(fd < 0 || !S_ISDIR(st.st_mode)){     // Directories match a glob too, they are skipped
+					fprintf(status, "  %s: cannot be read\n", gl.gl_pathv[i]);
+					failed++;
+				}
+				continue;
+			}
+
+			// The name is queued and leaves in the same write as the start of the file
+			snprintf(send, sizeof(send), "Y%s", gl.gl_pathv[i]);
+			if(connqueue(&conn, FT_CMD, conn.version == 2 && useChecksum ? FF_CHECKSUM : 0, send, strlen(send) + 1) < 0 ||
+			   sendFileData(sock, fd) < 0)
+				lost = 1;
+			close(fd);
+			waiting++;
+		}
+
+		if(lost)
+			fprintf(status, "Connection lost during mput, %d files not confirmed\n", waiting);
+		fclose(status);
+		printf("mput %s: %d files uploaded, %d failed\n%s", pattern, sent, failed, report);
+		free(report);
+		globfree(&gl);
+
+	} //END of putBatch function
+
+
+/** Reply ready - Whether a whole response frame can be read without blocking
+ *
+ */
+	int replyReady(void){
+		struct pollfd pfd;
+		FrameHeader hdr;
+		int h;
+
+		pfd.fd = conn.fd;
+		pfd.events = POLLIN;
+
+		while(1){
+			if((h = connpeek(&conn, &hdr)) > 0 && conn.rlen - conn.rpos >= h + hdr.length)
+				return 1;
+			if(poll(&pfd, 1, 0) <= 0 || connfill(&conn) <= 0)
+				return 0;
+		}
+
+	} //END of replyReady function
+
+
+/** Job count - Checks a "get -j <connections> <filename>" or "put -j ..." command
+ *
+ *	Return: Number of connections (1 to MAX_JOBS), or 0 after telling the user what is wrong
+ */
+	int jobCount(char **loc_token){
+		int n;
+
+		if(loc_token[2] == NULL || loc_token[3] == NULL || loc_token[4] != NULL){
+			printf("Syntax: %s -j <connections> <filename>\n", loc_token[0]);
+			return 0;
+		}
+		if((n = atoi(loc_token[2])) < 1 || n > MAX_JOBS){
+			printf("Number of connections must be between 1 and %d\n", MAX_JOBS);
+			return 0;
+		}
+
+		return n;
+
+	} //END of jobCount function
+
+
+/** Parallel get - Downloads a file as byte ranges moved at the same time on separate connections
+ *
+ *	Pre: Connected to the server, 1 <= jobs <= MAX_JOBS
+ *	Post: The server is asked for the file size (R with length 0), the local file is created at full size
+ *		  and every range written at its own offset. A file that could not be downloaded intact is removed
+ */
+	void getParallel(int sock, char *name, int jobs){
+		long long size;
+		int fd, n;
+
+		if(access(name, F_OK) == 0){
+			printf("File already exists in the current client directory!\n");
+			return;
+		}
+
+		if((n = remoteSize(sock, name, &size)) < 0){
+			printf("%s\n", n == -2 ? "Server does not support parallel transfers!" : "File does not exist in the current server directory!");
+			return;
+		}
+
+		if((fd = open(name, O_WRONLY | O_CREAT | O_EXCL, S_IRWXU)) < 0){
+			printf("Cannot create file %s: %s\n", name, strerror(errno));
+			return;
+		}
+
+		if(ftruncate(fd, size) < 0 || runRanges(name, fd, size, jobs, 0) < 0){
+			printf("File was not downloaded intact\n");
+			unlink(name);
+		}else
+			printf("File successfully downloaded from server\n");
+		close(fd);
+
+	} //END of getParallel function
+
+
+/** Parallel put - Sends a file as byte ranges moved at the same time on separate connections
+ *
+ *	Pre: Connected to the server, 1 <= jobs <= MAX_JOBS
+ *	Post: The server creates the file (W with length 0) and every range is written into it at its own offset
+ */
+	void putParallel(int sock, char *name, int jobs){
+		char send[BUFSIZE], response[BUFSIZE];
+		struct stat st;
+		int fd;
+
+		if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+			printf("File does not exist in the current client directory!\n");
+			if(fd >= 0)
+				close(fd);
+			return;
+		}
+
+		sprintf(send, "Wc 0 0 %s", name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || response[0] != 'W')
+			printf("Server does not support parallel transfers!\n");
+		else if(response[1] == '1')
+			printf("File already exists on the server!\n");
+		else if(response[1] != '0')
+			printf("Server does not have permission to accept the file!\n");
+		else if(runRanges(name, fd, st.st_size, jobs, 1) < 0)
+			printf("File was not sent intact, the copy on the server is incomplete\n");
+		else
+			printf("File successfully sent to server\n");
+		close(fd);
+
+	} //END of putParallel function
+
+
+/** Run ranges - Splits size bytes into up to jobs ranges and moves each one in a child process
+ *				 with its own connection. A range that fails is started again on its own
+ *
+ *	Pre: fd open on the local file (at full size for a get), sending = 1 for put, 0 for get
+ *	Post: Every range moved and checked, or one of them failed RANGE_RETRIES times
+ *	Return: 0 on success, -1 on failure
+ */
+	int runRanges(char *name, int fd, long long size, int jobs, int sending){
+		long long start[MAX_JOBS + 1];
+		pid_t pid[MAX_JOBS];
+		int tries[MAX_JOBS], done[MAX_JOBS];
+		int nranges, i, status, left, failed = 0;
+
+		// Ranges below MIN_RANGE cost more in connection setup than they save
+		nranges = size / MIN_RANGE < jobs ? size / MIN_RANGE : jobs;
+		if(nranges < 1)
+			nranges = 1;
+		for(i = 0; i <= nranges; i++)
+			start[i] = size * i / nranges;
+		for(i = 0, left = 0; i < nranges; i++){
+			tries[i] = 0;
+			done[i] = (start[i] == start[i + 1]);     // Only an empty file has an empty range
+			left += !done[i];
+		}
+
+		while(left > 0 && !failed){
+			fflush(stdout);     // Children must not inherit buffered output
+			for(i = 0; i < nranges; i++){
+				if(done[i])
+					continue;
+				if((pid[i] = fork()) == 0){
+					if(sending)
+						exit(putRange(rangeConnect(), fd, name, start[i], start[i + 1] - start[i]) < 0);
+					exit(getRange(rangeConnect(), fd, name, start[i], start[i + 1] - start[i]) < 0);
+				}
+			}
+
+			for(i = 0; i < nranges; i++){
+				if(done[i])
+					continue;
+				if(pid[i] > 0 && waitpid(pid[i], &status, 0) == pid[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0){
+					done[i] = 1;
+					left--;
+				} else if(++tries[i] >= RANGE_RETRIES){
+					printf("Range %d (bytes %lld-%lld) failed %d times, giving up\n", i, start[i], start[i + 1] - 1, tries[i]);
+					failed = 1;
+				} else
+					printf("Range %d (bytes %lld-%lld) failed, retrying\n", i, start[i], start[i + 1] - 1);
+			}
+		}
+
+		return failed ? -1 : 0;
+
+	} //END of runRanges function
+
+
+/** Range connection - Opens another connection to the server for one range, in the framing of the first
+ *
+ *	Pre: Called in a child process of runRanges (the connection replaces conn)
+ *	Return: Connected socket, the child exits if the server cannot be reached
+ */
+	int rangeConnect(void){
+		int sock;
+
+		sock = socketSetup(serverPort, serverHost);
+		conninit(&conn, sock);
+		if(wantVersion == 2)
+			negotiateFraming(sock);
+		if(packer.codec != CODEC_NONE)
+			selectCodec(sock, packer.codec);
+
+		return sock;
+
+	} //END of rangeConnect function
+
+
+/** Get range - Downloads length bytes of a file from offset, written with pwrite() at the same offset
+ *
+ *	Pre: sock connected through conn, fd open for writing (may be shared with other ranges)
+ *	Post: The range is written and checked against the server's CRC-32 of it
+ *	Return: 0 on success, -1 if the connection failed or the range did not arrive intact
+ */
+	int getRange(int sock, int fd, char *name, long long offset, long long length){
+		char send[BUFSIZE], response[BUFSIZE];
+		FrameHeader hdr;
+		long long got = 0;
+		unsigned int crc = 0;
+		char *buf, *out;
+		int n, last, result = 0;
+
+		sprintf(send, "R%lld %lld %s", offset, length, name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || strncmp(response, "R0", 2) != 0 ||
+		   (buf = malloc(maxFrame)) == NULL)
+			return -1;
+
+		do {
+			if((n = connread(&conn, buf, maxFrame, &hdr)) == -2){
+				n = hdr.length;     // Checksum failed, keep reading to stay in step with the server
+				result = -1;
+			} else if(n < 0 || (conn.version == 2 && hdr.type != FT_DATA)){
+				free(buf);
+				return -1;
+			}
+			// v2 ends at the frame flagged FF_EOF, v1 at the first short frame
+			last = conn.version == 2 ? (hdr.flags & FF_EOF) != 0 : n < BUFSIZE-2;
+			if((n = unpack(&packer, hdr.flags, buf, n, &out)) < 0){
+				n = 0;
+				result = -1;
+			}
+			if((hdr.flags & FF_ERROR) || pwrite(fd, out, n, offset + got) != n)
+				result = -1;
+			crc = crc32(crc, (Bytef *) out, n);
+			got += n;
+		} while(!last);
+
+		free(buf);
+		if(result < 0 || got != length)
+			return -1;
+
+		return checkRange(sock, name, offset, length, crc);
+
+	} //END of getRange function
+
+
+/** Put range - Sends length bytes of a file from offset, read with pread() at the same offset
+ *
+ *	Pre: sock connected through conn, fd open for reading (may be shared with other ranges)
+ *	Post: The range is written into the server's file and checked against its CRC-32 of it
+ *	Return: 0 on success, -1 if the connection failed or the range did not arrive intact
+ */
+	int putRange(int sock, int fd, char *name, long long offset, long long length){
+		char send[BUFSIZE], response[BUFSIZE];
+		long long sent = 0;
+		unsigned int crc = 0;
+		char *buf;
+		int n = 0, m, frame, flags = 0, packed;
+
+		sprintf(send, "Ww %lld %lld %s", offset, length, name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || strcmp(response, "W0") != 0 ||
+		   (buf = malloc(maxFrame)) == NULL)
+			return -1;
+
+		frame = conn.version == 1 ? BUFSIZE-1 : packer.codec != CODEC_NONE && maxFrame > PACK_FRAME ? PACK_FRAME : maxFrame;
+		while(sent < length){
+			if((n = pread(fd, buf, length - sent < frame ? length - sent : frame, offset + sent)) <= 0){
+				// Read failed or file shrank - a v2 server is told, a v1 server sees the connection close
+				if(conn.version == 2)
+					connwrite(&conn, FT_DATA, FF_EOF | FF_ERROR, "", 0);
+				free(buf);
+				return -1;
+			}
+			crc = crc32(crc, (Bytef *) buf, n);
+			sent += n;
+			m = n;
+			if(conn.version == 2){
+				m = pack(&packer, buf, n, &packed);
+				flags = (sent == length ? FF_EOF : 0) | (useChecksum ? FF_CHECKSUM : 0) | packed;
+			}
+			if(connwrite(&conn, FT_DATA, flags, buf, m) < 0){
+				free(buf);
+				return -1;
+			}
+		}
+		free(buf);
+
+		// The v1 server stops at the first short frame, so end a range that filled its last frame
+		if(conn.version == 1 && n >= BUFSIZE-2 && connwrite(&conn, FT_DATA, 0, "", 0) < 0)
+			return -1;
+		if(conn.version == 2 && (recvCmd(sock, response, sizeof(response)) <= 0 || strcmp(response, "V0") != 0))
+			return -1;
+
+		return checkRange(sock, name, offset, length, crc);
+
+	} //END of putRange function
+
+
+/** Check range - Compares the CRC-32 of a range with the server's CRC-32 of the same bytes (K opcode)
+ *
+ *	Pre: Connected, no transfer in progress
+ *	Return: 0 if the server holds the same length bytes at offset, -1 otherwise
+ */
+	int checkRange(int sock, char *name, long long offset, long long length, unsigned int crc){
+		char send[BUFSIZE], response[BUFSIZE];
+		unsigned int servercrc;
+		long long bytes;
+
+		sprintf(send, "K%lld %lld %s", offset, length, name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 ||
+		   sscanf(response, "K0 %x %lld", &servercrc, &bytes) != 2)
+			return -1;
+
+		if(servercrc != crc || bytes != length){
+			printf("Range at byte %lld does not match the server's copy\n", offset);
+			return -1;
+		}
+
+		return 0;
+
+	} //END of checkRange function
+
+
+/** Resume get - Downloads the rest of a partial file, from its local size to the server's size
+ *
+ *	Pre: Connected to the server
+ *	Post: The last bytes of the partial file are checked against the server's copy (K opcode), then the
+ *		  missing range is appended (R opcode). A partial file that does not match is left alone
+ */
+	void resumeGet(int sock, char *name){
+		long long size;
+		struct stat st;
+		int fd, n;
+
+		if((fd = open(name, O_RDWR)) < 0 || fstat(fd, &st) < 0){
+			printf("No partial file %s in the current client directory, use get\n", name);
+			if(fd >= 0)
+				close(fd);
+			return;
+		}
+
+		if((n = remoteSize(sock, name, &size)) == -2)
+			printf("Server does not support resuming transfers!\n");
+		else if(n < 0)
+			printf("File does not exist in the current server directory!\n");
+		else if(st.st_size > size || !tailMatches(sock, fd, name, st.st_size))
+			printf("Local file does not match the server's copy, cannot resume\n");
+		else if(st.st_size == size)
+			printf("File is already complete\n");
+		else if(getRange(sock, fd, name, st.st_size, size - st.st_size) < 0)
+			printf("File was not downloaded intact, \"get -r %s\" tries again\n", name);
+		else
+			printf("File successfully downloaded from server (resumed at byte %lld)\n", (long long) st.st_size);
+		close(fd);
+
+	} //END of resumeGet function
+
+
+/** Resume put - Sends the rest of a file whose upload stopped, from the size of the server's copy
+ *
+ *	Pre: Connected to the server
+ *	Post: The last bytes of the server's partial file are checked against the local file (K opcode),
+ *		  then the missing range is written into it (W opcode)
+ */
+	void resumePut(int sock, char *name){
+		long long size;
+		struct stat st;
+		int fd, n;
+
+		if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+			printf("File does not exist in the current client directory!\n");
+			if(fd >= 0)
+				close(fd);
+			return;
+		}
+
+		if((n = remoteSize(sock, name, &size)) == -2)
+			printf("Server does not support resuming transfers!\n");
+		else if(n < 0)
+			printf("No partial file %s on the server, use put\n", name);
+		else if(size > st.st_size || !tailMatches(sock, fd, name, size))
+			printf("Server's file does not match the local copy, cannot resume\n");
+		else if(size == st.st_size)
+			printf("File is already complete on the server\n");
+		else if(putRange(sock, fd, name, size, st.st_size - size) < 0)
+			printf("File was not sent intact, \"put -r %s\" tries again\n", name);
+		else
+			printf("File successfully sent to server (resumed at byte %lld)\n", size);
+		close(fd);
+
+	} //END of resumePut function
+
+
+/** Remote size - Asks the server for the size of a file (R opcode with a length of 0)
+ *
+ *	Return: 0 with *size set, -1 if the server cannot open the file, -2 if the server has no R opcode
+ */
+	int remoteSize(int sock, char *name, long long *size){
+		char send[BUFSIZE], response[BUFSIZE];
+
+		sprintf(send, "R0 0 %s", name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || response[0] != 'R')
+			return -2;
+		if(response[1] != '0')
+			return -1;
+
+		*size = atoll(response + 3);
+		return 0;
+
+	} //END of remoteSize function
+
+
+/** Tail matches - Checks that the last bytes (up to MIN_RANGE) of the first size bytes of a local
+ *				   file are the same as in the server's copy, before a transfer is resumed after them
+ *
+ *	Return: 1 if they match (or size is 0), 0 otherwise
+ */
+	int tailMatches(int sock, int fd, char *name, long long size){
+		long long offset = size > MIN_RANGE ? size - MIN_RANGE : 0;
+		unsigned int crc = 0;
+		char *buf;
+		int n = 0, done = 0;
+
+		if(size == 0)
+			return 1;
+		if((buf = malloc(MIN_RANGE)) == NULL)
+			return 0;
+
+		while(done < size - offset && (n = pread(fd, buf + done, size - offset - done, offset + done)) > 0)
+			done += n;
+		crc = crc32(crc, (Bytef *) buf, done);
+		free(buf);
+
+		return done == size - offset && checkRange(sock, name, offset, size - offset, crc) == 0;
+
+	} //END of tailMatches function
+
+
+/** Select codec - Asks the server to compress file data with a codec (Z opcode)
+ *
+ *	Pre: Connected, no transfer in progress
+ *	Post: packer.codec holds the agreed codec, or CODEC_NONE if the server refused it
+ *		  (v1 framing, or a server without compression). No codec needs no agreement on v1
+ *	Return: 0 if agreed, -1 otherwise
+ */
+	int selectCodec(int sock, int codec){
+		char send[BUFSIZE], response[BUFSIZE];
+
+		packfree(&packer);      // Buffers and zlib state of the previous codec
+		packer.codec = CODEC_NONE;
+		if(conn.version != 2)
+			return codec == CODEC_NONE ? 0 : -1;
+
+		sprintf(send, "Z%s", packname(codec));
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || strcmp(response, "Z0") != 0)
+			return -1;
+
+		packer.codec = codec;
+		return 0;
+
+	} //END of selectCodec function
+
+
+/** Show packing - Prints the ratio and CPU time of the compressed transfer that just finished
+ *
+ */
+	void showPacking(void){
+		char stats[256];
+
+		if(packstats(&packer, stats, sizeof(stats)))
+			printf("Compression %s\n", stats);
+
+	} //END of showPacking function
+
+
+/** Sync get - Brings the local copy of a file up to date with the server's copy, receiving only what changed
+ *
+ *	Pre: Connected to the server with v2 framing, the local copy exists
+ *	Post: Signatures of the local copy are sent ("Sg"), and the server's delta is applied to it in a temporary
+ *		  file. The temporary file replaces the local copy once its size and CRC-32 match the server's copy
+ */
+	void syncGet(int sock, char *name){
+		char send[BUFSIZE], response[BUFSIZE], temp[BUFSIZE], stats[256];
+		struct stat st;
+		int fd, out, n, m = 0;
+		Delta d;
+
+		if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+			printf("No local copy of %s to sync, use get\n", name);
+			if(fd >= 0)
+				close(fd);
+			return;
+		}
+		if(conn.version != 2){
+			printf("sync needs v2 framing (not available with -1)\n");
+			close(fd);
+			return;
+		}
+
+		// The new copy is built next to the old one and only replaces it once it is intact
+		snprintf(temp, sizeof(temp), "%s.syncXXXXXX", name);
+		if((out = mkstemp(temp)) < 0){
+			printf("Cannot create a temporary file for %s: %s\n", name, strerror(errno));
+			close(fd);
+			return;
+		}
+		fchmod(out, st.st_mode & 07777);
+		n = deltablocksize(st.st_size);
+		deltainit(&d, fd, out, n, st.st_size / n);
+
+		snprintf(send, sizeof(send), "Sg %d %ld %s", d.blocksize, d.blocks, name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || response[0] != 'S')
+			printf("Server does not support sync!\n");
+		else if(response[1] == '1')
+			printf("File does not exist in the current server directory!\n");
+		else if(response[1] != '0')
+			printf("Server refused to sync %s\n", name);
+		else if((n = sendSyncFrames(&d, 1)) == -1 || (m = recvSyncFrames(&d, 0)) == -1)
+			printf("Connection lost during sync, local copy kept\n");
+		else if(n < 0 || m < 0 || !d.patched)
+			printf("File was not synchronised intact, local copy kept\n");
+		else if(rename(temp, name) < 0)
+			printf("Cannot replace %s: %s\n", name, strerror(errno));
+		else {
+			deltastats(&d, stats, sizeof(stats));
+			printf("File synchronised with server: %s\n", stats);
+			temp[0] = '\0';    // Renamed, nothing to remove
+		}
+
+		deltafree(&d);
+		if(temp[0] != '\0')
+			unlink(temp);
+
+	} //END of syncGet function
+
+
+/** Sync put - Brings the server's copy of a file up to date with the local copy, sending only what changed
+ *
+ *	Pre: Connected to the server with v2 framing
+ *	Post: The server sends the signatures of its copy ("Sp"), and the delta of the local copy against them
+ *		  is sent back. The server replaces its copy once the rebuilt file matches and answers V0 (or V1)
+ */
+	void syncPut(int sock, char *name){
+		char send[BUFSIZE], response[BUFSIZE], stats[256];
+		long long size;
+		long blocks;
+		int fd, blocksize, n;
+		struct stat st;
+		Delta d;
+
+		if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+			printf("File does not exist in the current client directory!\n");
+			if(fd >= 0)
+				close(fd);
+			return;
+		}
+		if(conn.version != 2){
+			printf("sync needs v2 framing (not available with -1)\n");
+			close(fd);
+			return;
+		}
+
+		snprintf(send, sizeof(send), "Sp %s", name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || response[0] != 'S'){
+			printf("Server does not support sync!\n");
+			close(fd);
+			return;
+		}
+		if(response[1] != '0' || sscanf(response + 2, "%d %ld %lld", &blocksize, &blocks, &size) != 3){
+			if(response[1] == '1')
+				printf("No copy of %s on the server to sync, use put\n", name);
+			else
+				printf("Server refused to sync %s\n", name);
+			close(fd);
+			return;
+		}
+
+		// Signatures of the server's copy in, delta of the local copy out
+		if(deltainit(&d, fd, -1, blocksize, blocks) < 0)
+			n = recvSyncFrames(NULL, 1);
+		else
+			n = recvSyncFrames(&d, 1);
+		if(n == -2)    // The server still waits for a delta, tell it there is none
+			n = connwrite(&conn, FT_DATA, FF_EOF | FF_ERROR, "", 0) < 0 ? -1 : -2;
+		else if(n == 0)
+			n = sendSyncFrames(&d, 0);
+
+		if(n == -1 || recvCmd(sock, response, sizeof(response)) <= 0)
+			printf("Connection lost during sync\n");
+		else if(n < 0 || strcmp(response, "V0") != 0)
+			printf("File was not synchronised intact, the server kept its copy\n");
+		else {
+			deltastats(&d, stats, sizeof(stats));
+			printf("File synchronised to server: %s\n", stats);
+		}
+		deltafree(&d);
+
+	} //END of syncPut function
+
+
+/** Send sync frames - Sends the signatures of the local copy (sign = 1), or its delta against the
+ *					   server's signatures (sign = 0), as data frames. The last one is flagged FF_EOF
+ *
+ *	Return: 0 on success, -1 on write error, -2 if the local file could not be read (the server is told with FF_ERROR)
+ */
+	int sendSyncFrames(Delta *d, int sign){
+		char *buf;
+		int n, frame, flags;
+
+		// The server collects each frame whole, in its buffer for one compressed frame
+		frame = maxFrame < PACK_FRAME ? maxFrame : PACK_FRAME;
+		if((buf = malloc(frame)) == NULL)
+			return connwrite(&conn, FT_DATA, FF_EOF | FF_ERROR, "", 0) < 0 ? -1 : -2;
+
+		do {
+			flags = 0;
+			if(sign)
+				n = deltasign(d, buf, frame);
+			else if((n = deltamake(d, buf, frame)) > 0)
+				n = pack(&packer, buf, n, &flags);    // Literal bytes may compress, signatures never do
+			if(n < 0){
+				n = connwrite(&conn, FT_DATA, FF_EOF | FF_ERROR, "", 0) < 0 ? -1 : -2;
+				break;
+			}
+			flags |= (d->done ? FF_EOF : 0) | (useChecksum ? FF_CHECKSUM : 0);
+			n = connwrite(&conn, FT_DATA, flags, buf, n) < 0 ? -1 : 0;
+		} while(n == 0 && !d->done);
+
+		free(buf);
+		return n;
+
+	} //END of sendSyncFrames function
+
+
+/** Receive sync frames - Reads the server's signatures (sigs = 1) or delta (sigs = 0) into d, up to the
+ *						  frame flagged FF_EOF. With d NULL the frames are read and dropped
+ *
+ *	Return: 0 on success, -1 if the connection failed, -2 if a frame was damaged, flagged as failed by the
+ *			server or could not be applied (frames are still read to stay in step with the server)
+ */
+	int recvSyncFrames(Delta *d, int sigs){
+		FrameHeader hdr;
+		char *buf, *out;
+		int n, result = d == NULL ? -2 : 0;
+
+		if((buf = malloc(maxFrame)) == NULL)
+			return -1;
+
+		do {
+			if((n = connread(&conn, buf, maxFrame, &hdr)) == -2){
+				result = -2;    // Checksum failed
+				continue;
+			}
+			if(n < 0 || hdr.type != FT_DATA){
+				result = -1;
+				break;
+			}
+			if(hdr.flags & FF_ERROR)
+				result = -2;
+			else if(result == 0 && ((n = unpack(&packer, hdr.flags, buf, n, &out)) < 0 ||
+									(sigs ? deltaindex(d, out, n) : deltapatch(d, out, n)) < 0))
+				result = -2;
+		} while(!(hdr.flags & FF_EOF));
+
+		free(buf);
+		return result;
+
+	} //END of recvSyncFrames function
+
+
+/** Show digests - Shows the server's size and digest of a file next to the local copy's
+ *
+ *	Pre: Connected to the server
+ *	Post: Both digests are shown and whether the copies are identical
+ */
+	void showDigests(int sock, char *name){
+		unsigned char local[DIGEST_SIZE], remote[DIGEST_SIZE];
+		char hex[DIGEST_HEX];
+		long long size;
+		struct stat st;
+		int fd, n;
+
+		if((n = remoteDigest(sock, name, -1, &size, remote)) == -1){
+			printf("File does not exist in the current server directory!\n");
+			return;
+		} else if(n < 0){
+			printf("Server could not give a digest of %s\n", name);
+			return;
+		}
+		digesthex(remote, hex);
+		printf("Server copy: %lld bytes, digest %s\n", size, hex);
+
+		if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+			printf("Local copy:  none\n");
+		else if(digestlookup(fd, &st, local) < 0)
+			printf("Local copy:  cannot be read: %s\n", strerror(errno));
+		else {
+			digesthex(local, hex);
+			printf("Local copy:  %lld bytes, digest %s (%s)\n", (long long) st.st_size, hex,
+				   st.st_size == size && memcmp(local, remote, DIGEST_SIZE) == 0 ? "identical" : "differs");
+		}
+		if(fd >= 0)
+			close(fd);
+
+	} //END of showDigests function
+
+
+/** Same file - Checks whether the local copy of a file and the server's copy are identical (size and digest)
+ *
+ *	Pre: Connected to the server
+ *	Post: The server is only asked if a local copy exists, and only computes its digest if the sizes match
+ *	Return: 1 if identical, 0 if they differ, either copy is missing or the server has no digests
+ */
+	int sameFile(int sock, char *name){
+		unsigned char local[DIGEST_SIZE], remote[DIGEST_SIZE];
+		long long size;
+		struct stat st;
+		int fd, same = 0;
+
+		if((fd = open(name, O_RDONLY)) < 0)
+			return 0;
+		if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && remoteDigest(sock, name, st.st_size, &size, remote) == 0 &&
+		   digestlookup(fd, &st, local) >= 0)
+			same = (memcmp(local, remote, DIGEST_SIZE) == 0);
+		close(fd);
+		return same;
+
+	} //END of sameFile function
+
+
+/** Remote digest - Asks the server for the size and digest of a file (I opcode)
+ *
+ *	Pre: want is the size the digest is wanted for, -1 for any size
+ *	Return: 0 with size and digest set, 1 if the server's copy is not want bytes long (only size set),
+ *			-1 if the server has no such file, -2 if it has no digests or could not read the file
+ */
+	int remoteDigest(int sock, char *name, long long want, long long *size, unsigned char *digest){
+		char send[BUFSIZE], response[BUFSIZE], hex[DIGEST_HEX];
+		unsigned int byte;
+		long long mtime;     // Not compared, the digest decides
+		int i;
+
+		snprintf(send, sizeof(send), "I%lld %s", want, name);
+		sendCmd(sock, send, strlen(send) + 1);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || response[0] != 'I' || response[1] == '2')
+			return -2;
+		if(response[1] != '0')
+			return -1;
+		if(sscanf(response + 2, "%lld %lld %32s", size, &mtime, hex) != 3)
+			return -2;
+		if(hex[0] == '-')
+			return 1;
+
+		for(i = 0; i < DIGEST_SIZE; i++){
+			if(sscanf(hex + i * 2, "%2x", &byte) != 1)
+				return -2;
+			digest[i] = byte;
+		}
+		return 0;
+
+	} //END of remoteDigest function
+
+
+/** List directory - Shows the entries of the server's current directory a page at a time (L opcode)
+ *
+ *	Pre: Connected to the server
+ *	Post: Each entry is shown with its type, size and mtime as its frame arrives (if show is set), and the next
+ *		  page is asked for until the directory ends, so memory stays at one frame whatever the size of the directory
+ *	Return: Entries listed, -1 if the server does not support L (v1 or an older server), -2 if the connection
+ *			was lost, -3 if the server could not read the directory or a frame failed its checksum
+ */
+	int listDir(int sock, int show){
+		char send[64], response[BUFSIZE], when[32], *buf;
+		unsigned char *p;
+		long long cursor = 0, mtime;
+		int n, len, end = 0, entries = 0, result = 0;
+		time_t t;
+		FrameHeader hdr;
+
+		if(conn.version != 2 || (buf = malloc(maxFrame)) == NULL)
+			return -1;
+
+		do {
+			snprintf(send, sizeof(send), "L%lld %d", cursor, LIST_PAGE);
+			sendCmd(sock, send, strlen(send) + 1);
+			if(recvCmd(sock, response, sizeof(response)) <= 0 || response[0] != 'L' || (entries == 0 && response[1] == '2')){
+				free(buf);
+				return -1;
+			}
+			if(response[1] != '0'){
+				if(show)
+					printf("Server could not open directory\n");
+				result = -3;
+				break;
+			}
+			if(show && entries == 0 && cursor == 0)
+				printf("Files in server working dir:\n");
+
+			end = 0;
+			do {
+				if((n = connread(&conn, buf, maxFrame, &hdr)) < 0 || hdr.type != FT_DATA){
+					if(show)
+						printf(n == -2 ? "Listing from server failed its checksum\n" : "Connection lost during dir\n");
+					end = -1;
+					result = n == -2 ? -3 : -2;
+					if(n != -2)
+						break;
+					continue;
+				}
+				if(hdr.flags & FF_ERROR){
+					if(show)
+						printf("Server could not read the rest of the directory\n");
+					end = -1;
+					result = -3;
+				}
+
+				for(p = (unsigned char *) buf; end >= 0 && p + LIST_RECORD <= (unsigned char *) buf + n; p += LIST_RECORD + len){
+					len = getBigEndian(p + 17, 2);
+					if(p[0] == 'E' || p[0] == 'M'){
+						end = p[0];
+						cursor = getBigEndian(p + 1, 8);    // Where the next page starts
+						continue;
+					}
+					if(!show){
+						entries++;
+						continue;
+					}
+					t = mtime = getBigEndian(p + 9, 8);
+					strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&t));
+					printf("%c %12lld %s %.*s\n", p[0], (long long) getBigEndian(p + 1, 8), when, len, (char *) p + LIST_RECORD);
+					entries++;
+				}
+			} while(!(hdr.flags & FF_EOF));
+		} while(end == 'M');
+
+		if(show)
+			printf("%d entries\n", entries);
+		free(buf);
+		return result < 0 ? result : entries;
+
+	} //END of listDir function
+
+
+/** Get big endian - reads a number stored most significant byte first
+ *
+ */
+	unsigned long long getBigEndian(unsigned char *p, int bytes){
+		unsigned long long v = 0;
+
+		while(bytes-- > 0)
+			v = v << 8 | *p++;
+		return v;
+
+	} //END of getBigEndian function
+
+
+/** Batch file - Receives one file of an mget or rget, announced by the server and followed by its data frames
+ *
+ *	Pre: The announcement has been read, the data frames of the file come next
+ *	Post: The file is saved as local. If local cannot be created the data is read and dropped, so the connection
+ *		  stays in step with the server. A file that did not arrive intact is removed. Failures are written to status
+ *	Return: 1 if saved, 0 if not, -1 if the connection was lost
+ */
+	int batchFile(int sock, char *name, char *local, FILE *status){
+		int fd, n, err;
+
+		// A file that cannot be created still has to be read to stay in step with the server
+		if((fd = open(local, O_WRONLY | O_CREAT | O_EXCL, S_IRWXU)) < 0){
+			err = errno;
+			fd = open("/dev/null", O_WRONLY);
+			n = recvFileData(sock, fd);
+			close(fd);
+			if(n == -1){
+				fprintf(status, "  %s: connection lost\n", name);
+				return -1;
+			}
+			fprintf(status, "  %s: %s, skipped\n", name, err == EEXIST ? "already exists in the current client directory" : strerror(err));
+			return 0;
+		}
+
+		n = recvFileData(sock, fd);
+		close(fd);
+		if(n < 0){
+			unlink(local);
+			fprintf(status, "  %s: %s\n", name, n == -1 ? "connection lost" : "not downloaded intact");
+			return n == -1 ? -1 : 0;
+		}
+
+		return 1;
+
+	} //END of batchFile function
+
+
+/** Tree get - Downloads a directory tree (rget). The server walks it and streams it like an mget: every directory
+ *			   ("MD <name>") before the files in it, small files with their data. Files of MIN_RANGE bytes or more
+ *			   are only announced ("MB <size> <name>"), each is fetched by a lane - a child process with its own
+ *			   connection - while the small files keep arriving on this one
+ *
+ *	Pre: Connected to the server, 1 <= jobs <= MAX_JOBS
+ *	Post: The tree is copied under the last part of root in the current directory. Directories that exist already
+ *		  are filled in, files that exist are left alone. Failures are listed at the end
+ */
+	void getTree(int sock, char *root, int jobs){
+		char send[BUFSIZE], response[BUFSIZE], local[BUFSIZE], *name;
+		long long size;
+		struct stat st;
+		int fd, n, pos;
+		Tree *t;
+
+		if((t = treeSetup(root, jobs, 0)) == NULL)
+			return;
+
+		snprintf(send, sizeof(send), "T%d %s", MIN_RANGE, root);
+		sendCmd(sock, send, strlen(send) + 1);
+
+		while(1){
+			laneReap(t, 0);
+			if(recvCmd(sock, response, sizeof(response)) <= 0){
+				fprintf(t->status, "Connection lost during rget\n");
+				break;
+			}
+			if(response[0] != 'M'){
+				fprintf(t->status, "Server does not support rget!\n");
+				break;
+			}
+			if(response[1] == 'E')      // End of the tree
+				break;
+
+			pos = 0;
+			if(response[1] == 'D')
+				name = response + 3;
+			else if((response[1] == '0' || response[1] == 'B') && sscanf(response + 3, "%lld %n", &size, &pos) >= 1)
+				name = response + 3 + pos;
+			else {
+				fprintf(t->status, "  %s: cannot be read on the server\n", response + 3);
+				t->failed++;
+				continue;
+			}
+
+			// Only names inside the tree are written, the data of any other file is read and dropped
+			if(treeName(root, name, local, sizeof(local)) < 0){
+				fprintf(t->status, "  %s: not inside %s, skipped\n", name, root);
+				t->failed++;
+				if(response[1] == '0' && (fd = open("/dev/null", O_WRONLY)) >= 0){
+					n = recvFileData(sock, fd);
+					close(fd);
+					if(n == -1)
+						break;
+				}
+				continue;
+			}
+
+			if(response[1] == 'D'){
+				if(mkdir(local, S_IRWXU) == 0 || (errno == EEXIST && stat(local, &st) == 0 && S_ISDIR(st.st_mode)))
+					t->dirs++;
+				else {
+					fprintf(t->status, "  %s: %s\n", local, strerror(errno));
+					t->failed++;
+				}
+			} else if(response[1] == 'B'){
+				// Created at full size here, the lane writes the file in place
+				if((fd = open(local, O_WRONLY | O_CREAT | O_EXCL, S_IRWXU)) < 0 || ftruncate(fd, size) < 0){
+					fprintf(t->status, "  %s: %s, skipped\n", name, errno == EEXIST ? "already exists in the current client directory" : strerror(errno));
+					if(fd >= 0){
+						close(fd);
+						unlink(local);
+					}
+					t->failed++;
+				} else
+					laneStart(t, name, local, fd, size);
+			} else if((n = batchFile(sock, name, local, t->status)) < 0){
+				t->failed++;
+				break;
+			} else if(n == 0)
+				t->failed++;
+			else
+				t->files++;
+		}
+
+		treeFinish(t, root);
+
+	} //END of getTree function
+
+
+/** Tree put - Uploads a directory tree (rput). The tree is walked here and sent like an mput: every directory as
+ *			   "Y<name>/" before the files in it, small files with their data, the status replies collected while
+ *			   sending. Files of MIN_RANGE bytes or more are created on the server (W) and each is sent by a lane
+ *
+ *	Pre: Connected to the server, 1 <= jobs <= MAX_JOBS
+ *	Post: The tree is copied under the last part of root in the server's current directory. Directories that exist
+ *		  already are filled in, files that exist are left alone. Failures are listed at the end
+ */
+	void putTree(int sock, char *root, int jobs){
+		char send[BUFSIZE], response[BUFSIZE];
+		char remote[BUFSIZE - 7];     // Longest name that fits "Wc 0 0 <name>", and the server's "Yc <name>" reply
+		char *paths[2] = {root, NULL};
+		FTSENT *ent;
+		FTS *fts;
+		int fd, lost = 0;
+		Tree *t;
+
+		if((t = treeSetup(root, jobs, 1)) == NULL)
+			return;
+
+		// A server without mput would take the file data for commands, so ask first
+		sendCmd(sock, "Y", 2);
+		if(recvCmd(sock, response, sizeof(response)) <= 0 || strcmp(response, "Y0") != 0){
+			fprintf(t->status, "Server does not support rput!\n");
+			treeFinish(t, root);
+			return;
+		}
+
+		// Symbolic links are followed, fts leaves out a directory that loops back on the walk
+		if((fts = fts_open(paths, FTS_LOGICAL | FTS_NOCHDIR, NULL)) == NULL){
+			fprintf(t->status, "Cannot read %s: %s\n", root, strerror(errno));
+			treeFinish(t, root);
+			return;
+		}
+
+		while(!lost && (ent = fts_read(fts)) != NULL){
+			laneReap(t, 0);
+			if(treeReplies(t, sock, 0) < 0){
+				lost = 1;
+				break;
+			}
+			if(ent->fts_info == FTS_DP || ent->fts_info == FTS_DC)
+				continue;     // Directory already sent, or a loop
+			if(treeName(root, ent->fts_path, remote, sizeof(remote) - 1) < 0){
+				fprintf(t->status, "  %s: name too long\n", ent->fts_path);
+				t->failed++;
+				continue;
+			}
+
+			// The server creates a directory before anything sent after it, no reply is awaited
+			if(ent->fts_info == FTS_D){
+				strcat(remote, "/");
+				snprintf(send, sizeof(send), "Y%s", remote);
+				if(connqueue(&conn, FT_CMD, conn.version == 2 && useChecksum ? FF_CHECKSUM : 0, send, strlen(send) + 1) < 0)
+					lost = 1;
+				t->waiting++;
+				continue;
+			}
+
+			if(ent->fts_info != FTS_F || (fd = open(ent->fts_path, O_RDONLY)) < 0){
+				fprintf(t->status, "  %s: cannot be read\n", ent->fts_path);
+				t->failed++;
+				continue;
+			}
+
+			if(ent->fts_statp->st_size < MIN_RANGE){
+				snprintf(send, sizeof(send), "Y%s", remote);
+				if(connqueue(&conn, FT_CMD, conn.version == 2 && useChecksum ? FF_CHECKSUM : 0, send, strlen(send) + 1) < 0 ||
+				   sendFileData(sock, fd) < 0)
+					lost = 1;
+				close(fd);
+				t->waiting++;
+				continue;
+			}
+
+			// A lane's connection only finds the directory once this one has created it, so the replies come first
+			if(treeReplies(t, sock, 1) < 0){
+				close(fd);
+				lost = 1;
+				break;
+			}
+			snprintf(send, sizeof(send), "Wc 0 0 %s", remote);
+			sendCmd(sock, send, strlen(send) + 1);
+			if(recvCmd(sock, response, sizeof(response)) <= 0){
+				close(fd);
+				lost = 1;
+				break;
+			}
+			if(strcmp(response, "W0") != 0){
+				fprintf(t->status, "  %s: %s\n", remote, response[1] == '1' ? "already exists on the server" : "cannot be created on the server");
+				t->failed++;
+				close(fd);
+				continue;
+			}
+			laneStart(t, remote, ent->fts_path, fd, ent->fts_statp->st_size);
+		}
+
+		if(!lost && treeReplies(t, sock, 1) < 0)
+			lost = 1;
+		if(lost)
+			fprintf(t->status, "Connection lost during rput, %d names not confirmed\n", t->waiting);
+		fts_close(fts);
+		treeFinish(t, root);
+
+	} //END of putTree function
+
+
+/** Tree setup - Checks the root of an rget/rput and allocates the state of the copy
+ *
+ *	Post: Any '/' at the end of root is removed
+ *	Return: Tree with an empty report, or NULL after telling the user what is wrong
+ */
+	Tree *treeSetup(char *root, int jobs, int sending){
+		char *base;
+		int len = strlen(root);
+		Tree *t;
+
+		while(len > 1 && root[len - 1] == '/')
+			root[--len] = '\0';
+		base = strrchr(root, '/') != NULL ? strrchr(root, '/') + 1 : root;
+		if(*base == '\0' || strcmp(base, "..") == 0){
+			printf("%s has no name of its own to copy the tree under\n", root);
+			return NULL;
+		}
+
+		if((t = calloc(1, sizeof(Tree))) == NULL)
+			return NULL;
+		t->sending = sending;
+		t->jobs = jobs;
+		if((t->status = open_memstream(&t->report, &t->reportlen)) == NULL){
+			free(t);
+			return NULL;
+		}
+
+		return t;
+
+	} //END of treeSetup function
+
+
+/** Tree finish - Waits for the lanes of an rget/rput, shows what was copied and what failed, and frees the tree
+ *
+ */
+	void treeFinish(Tree *t, char *root){
+		int i;
+
+		for(i = 0; i < t->jobs; i++)
+			while(t->lane[i].pid != 0)
+				laneReap(t, 1);
+
+		fclose(t->status);
+		printf("%s %s: %d directories, %d files %s (%d on connections of their own), %d failed\n%s", t->sending ? "rput" : "rget",
+			   root, t->dirs, t->files, t->sending ? "uploaded" : "downloaded", t->big, t->failed, t->report);
+		free(t->report);
+		free(t);
+
+	} //END of treeFinish function
+
+
+/** Tree name - Maps a name under root to the same name under the other side's copy of root
+ *				(the last part of root, in the current directory)
+ *
+ *	Return: 0 with the mapped name in out, -1 if name is not under root, climbs out of it or is too long
+ */
+	int treeName(char *root, char *name, char *out, int size){
+		char *base = strrchr(root, '/') != NULL ? strrchr(root, '/') + 1 : root;
+		char *rest = name + strlen(root);
+		int n;
+
+		if(strncmp(name, root, strlen(root)) != 0 || (*rest != '\0' && *rest != '/') || strstr(rest, "/../") != NULL ||
+		   ((n = strlen(rest)) >= 3 && strcmp(rest + n - 3, "/..") == 0))
+			return -1;
+
+		return snprintf(out, size, "%s%s", base, rest) < size ? 0 : -1;
+
+	} //END of treeName function
+
+
+/** Tree replies - Reads the status replies to rput names that have arrived, or all of them
+ *
+ *	Return: 0, or -1 if the connection was lost
+ */
+	int treeReplies(Tree *t, int sock, int all){
+		char response[BUFSIZE];
+		int len;
+
+		// Directory names may still be queued, they have to leave before their replies can come back
+		if(all && t->waiting > 0 && connflush(&conn) < 0)
+			return -1;
+
+		while(t->waiting > 0 && (all || replyReady())){
+			if(recvCmd(sock, response, sizeof(response)) <= 0)
+				return -1;
+			t->waiting--;
+			len = strlen(response);
+			if(response[1] == '0' && len > 3 && response[len - 1] == '/')
+				t->dirs++;
+			else if(response[1] == '0')
+				t->files++;
+			else {
+				fprintf(t->status, "  %s: %s\n", response + 3, response[1] == '1' ? "already exists on the server" :
+						response[1] == '2' ? "cannot be created on the server" : "not received intact");
+				t->failed++;
+			}
+		}
+
+		return 0;
+
+	} //END of treeReplies function
+
+
+/** Lane start - Hands a large file of an rget/rput to a lane once one of the jobs lanes is free
+ *
+ *	Pre: fd open on the local file (created at full size for rget), the server's copy exists (created for rput)
+ *	Post: A child process moves the file on a connection of its own, fd belongs to the lane until it is done
+ */
+	void laneStart(Tree *t, char *name, char *local, int fd, long long size){
+		Lane *l;
+		int i;
+
+		while(1){
+			for(i = 0; i < t->jobs && t->lane[i].pid != 0; i++)
+				;
+			if(i < t->jobs)
+				break;
+			laneReap(t, 1);     // Every lane busy, wait for one
+		}
+
+		l = &t->lane[i];
+		l->fd = fd;
+		l->size = size;
+		l->tries = 0;
+		snprintf(l->name, sizeof(l->name), "%s", name);
+		snprintf(l->local, sizeof(l->local), "%s", local);
+		if(laneFork(l, t->sending) < 0)
+			laneDone(t, l, 0);
+
+	} //END of laneStart function
+
+
+/** Lane fork - Starts the child process that moves the file of a lane, with a range of the whole file
+ *
+ *	Return: 0, or -1 if the process could not be started
+ */
+	int laneFork(Lane *l, int sending){
+
+		fflush(stdout);     // Children must not inherit buffered output
+		if((l->pid = fork()) == 0){
+			if(sending)
+				exit(putRange(rangeConnect(), l->fd, l->name, 0, l->size) < 0);
+			exit(getRange(rangeConnect(), l->fd, l->name, 0, l->size) < 0);
+		}
+
+		return l->pid < 0 ? -1 : 0;
+
+	} //END of laneFork function
+
+
+/** Lane reap - Collects the lanes whose child has finished. A file that failed is started again on its own,
+ *				up to RANGE_RETRIES times
+ *
+ *	Pre: wait = 1 blocks until a child finishes, so a lane must be busy
+ */
+	void laneReap(Tree *t, int wait){
+		pid_t pid;
+		int i, status;
+
+		while((pid = waitpid(-1, &status, wait ? 0 : WNOHANG)) > 0){
+			wait = 0;
+			for(i = 0; i < t->jobs && t->lane[i].pid != pid; i++)
+				;
+			if(i == t->jobs)
+				continue;
+
+			if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+				laneDone(t, &t->lane[i], 1);
+			else if(++t->lane[i].tries < RANGE_RETRIES && laneFork(&t->lane[i], t->sending) == 0)
+				printf("%s failed, retrying\n", t->lane[i].name);
+			else
+				laneDone(t, &t->lane[i], 0);
+		}
+
+	} //END of laneReap function
+
+
+/** Lane done - Frees a lane once its file has moved, or has failed for the last time
+ *
+ *	Post: A failed file is listed in the report. A failed rget file is removed, a failed rput file stays
+ *		  on the server, incomplete
+ */
+	void laneDone(Tree *t, Lane *l, int ok){
+
+		if(ok){
+			t->files++;
+			t->big++;
+		} else {
+			fprintf(t->status, "  %s: %s\n", l->name, t->sending ? "not sent intact, the copy on the server is incomplete" :
+					"not downloaded intact");
+			if(!t->sending)
+				unlink(l->local);
+			t->failed++;
+		}
+		close(l->fd);
+		l->pid = 0;
+
+	} //END of laneDone function
+
+
+/** Run load - Replays a load spec against the server on many sessions at once and reports the results (-L)
+ *
+ *	Pre: serverHost and serverPort set, l read by loadSpec
+ *	Post: l->sessions child processes each connect and replay the spec. Their counts and latency histograms
+ *		  are kept in shared memory, one slot per session, and summed once every session has ended
+ */
+	void runLoad(Load *l){
+		LoadSlot *slots;
+		pid_t pid;
+		long long started;
+		int k;
+
+		slots = mmap(NULL, sizeof(LoadSlot) * l->sessions, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(slots == MAP_FAILED){
+			perror("Load setup");
+			exit(1);
+		}
+
+		printf("Load: %d sessions, %s, ", l->sessions, l->weights > 0 ? "weighted mix" : "script in order");
+		if(l->rate > 0)
+			printf("%.1f commands/s", l->rate);
+		else
+			printf("as fast as possible");
+		if(l->requests > 0)
+			printf(", %lld commands\n", l->requests);
+		else
+			printf(", %.1f s\n", l->duration);
+		fflush(stdout);     // Children must not repeat buffered output
+
+		started = loadClock();
+		for(k = 0; k < l->sessions; k++){
+			if((pid = fork()) == 0)
+				loadSession(l, k, &slots[k], started);
+			if(pid < 0){
+				perror("Load fork");
+				l->sessions = k;
+				break;
+			}
+		}
+		while(wait(NULL) > 0)
+			;
+
+		loadReport(l, slots, (loadClock() - started) / 1e6);
+		munmap(slots, sizeof(LoadSlot) * l->sessions);
+
+	} //END of runLoad function
+
+
+/** Load spec - Reads a load spec: settings, then the commands to replay
+ *
+ *	Pre: path names a text file, one setting or command per line ('#' starts a comment):
+ *			sessions <K>		connections open at once (default 1)
+ *			rate <R>			commands per second over all sessions (default 0, as fast as they go)
+ *			duration <S>		seconds to run for (default 10)
+ *			requests <N>		commands to send over all sessions, instead of a duration
+ *			[<weight>] pwd | dir | cd <dir> | get <file> | put <file>
+ *		 Commands with a weight are drawn at random in proportion to it. Without weights the commands are
+ *		 a script that every session runs in order, again and again. A spec cannot mix the two
+ *	Post: l holds the spec
+ *	Return: 0, or -1 with the reason shown
+ */
+	int loadSpec(char *path, Load *l){
+		FILE *f;
+		char line[BUFSIZE], *token[MAX_NUM_TOKENS], **t, *hash;
+		LoadCmd *c;
+		struct stat st;
+		int lineno = 0, weighted = 0, scripted = 0;
+
+		memset(l, 0, sizeof(*l));
+		l->sessions = 1;
+		l->duration = 10;
+		if((f = fopen(path, "r")) == NULL){
+			printf("Cannot open load spec %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+
+		while(fgets(line, sizeof(line), f) != NULL){
+			lineno++;
+			if((hash = strchr(line, '#')) != NULL)
+				*hash = '\0';
+			tokenise(line, token);
+			if((t = token)[0] == NULL)
+				continue;
+
+			if(strcmp(t[0], "sessions") == 0 && t[1] != NULL && t[2] == NULL)
+				l->sessions = atoi(t[1]);
+			else if(strcmp(t[0], "rate") == 0 && t[1] != NULL && t[2] == NULL)
+				l->rate = atof(t[1]);
+			else if(strcmp(t[0], "duration") == 0 && t[1] != NULL && t[2] == NULL)
+				l->duration = atof(t[1]);
+			else if(strcmp(t[0], "requests") == 0 && t[1] != NULL && t[2] == NULL)
+				l->requests = atoll(t[1]);
+			else {
+				if(l->ncmds == LOAD_CMDS){
+					printf("%s:%d: more than %d commands\n", path, lineno, LOAD_CMDS);
+					break;
+				}
+				c = &l->cmd[l->ncmds];
+				if(isdigit((unsigned char) t[0][0])){
+					if((c->weight = atoi(t[0])) <= 0 || t[1] == NULL){
+						printf("%s:%d: a weight is a number above 0 ahead of a command\n", path, lineno);
+						break;
+					}
+					t++;
+				}
+				if((c->weight > 0 ? scripted : weighted) > 0){
+					printf("%s:%d: every command needs a weight, or none does\n", path, lineno);
+					break;
+				}
+
+				if(strcmp(t[0], "pwd") == 0 && t[1] == NULL)
+					c->op = 'P';
+				else if(strcmp(t[0], "dir") == 0 && t[1] == NULL)
+					c->op = 'L';
+				else if(t[1] != NULL && t[2] == NULL && strlen(t[1]) < sizeof(c->arg)){
+					if(strcmp(t[0], "cd") == 0)
+						c->op = 'C';
+					else if(strcmp(t[0], "get") == 0)
+						c->op = 'G';
+					else if(strcmp(t[0], "put") == 0 && stat(t[1], &st) == 0 && S_ISREG(st.st_mode))
+						c->op = 'U';
+					strcpy(c->arg, t[1]);
+				}
+				if(c->op == 0){
+					printf("%s:%d: not a load setting or command (put needs a local file)\n", path, lineno);
+					break;
+				}
+
+				snprintf(c->text, sizeof(c->text), "%s%s%s", t[0], t[1] != NULL ? " " : "", t[1] != NULL ? t[1] : "");
+				if(c->weight > 0){
+					l->weights += c->weight;
+					weighted++;
+				} else
+					scripted++;
+				l->ncmds++;
+			}
+		}
+
+		if(!feof(f)){
+			fclose(f);
+			return -1;
+		}
+		fclose(f);
+
+		if(l->ncmds == 0 || l->sessions < 1 || l->sessions > LOAD_SESSIONS || l->rate < 0 ||
+		   (l->requests <= 0 && l->duration <= 0)){
+			printf("%s: needs a command, 1 - %d sessions and a duration or request count\n", path, LOAD_SESSIONS);
+			return -1;
+		}
+
+		return 0;
+
+	} //END of loadSpec function
+
+
+/** Load session - Replays the spec on one connection, in a child process of runLoad
+ *
+ *	Pre: k is the session's number, slot its zeroed counts, started the loadClock() time the run began
+ *	Post: Commands are sent until the session's share of the requests is done or the duration is up.
+ *		  At a target rate each command is due K/rate seconds after the last one (sessions start staggered),
+ *		  and its latency counts from when it was due, so time spent waiting behind a slow server shows.
+ *		  A connection that is lost ends the session. The child exits
+ */
+	void loadSession(Load *l, int k, LoadSlot *slot, long long started){
+		struct tcp_info info;
+		socklen_t len = sizeof(info);
+		LoadCmd *c;
+		long long interval = 0, due, now, end, left;
+		unsigned int seed = getpid() ^ (k << 16);
+		int sock, i = 0, r, seq = 0, sink;
+
+		// Connection setup: connect, agree framing and compression
+		due = loadClock();
+		sock = socketSetup(serverPort, serverHost);
+		conninit(&conn, sock);
+		if(wantVersion == 2)
+			negotiateFraming(sock);
+		if(wantCodec != CODEC_NONE)
+			selectCodec(sock, wantCodec);
+		loadRecord(&slot->connect, loadClock() - due, 0);
+
+		if((sink = open("/dev/null", O_WRONLY)) < 0)
+			exit(1);
+
+		left = l->requests > 0 ? l->requests / l->sessions + (k < l->requests % l->sessions) : -1;
+		end = started + (long long) (l->duration * 1e6);
+		if(l->rate > 0){
+			interval = (long long) (l->sessions * 1e6 / l->rate);
+			due = loadClock() + interval * k / l->sessions;
+		}
+
+		while(left != 0 && (l->requests > 0 || loadClock() < end)){
+			// A weighted mix draws each command, a script takes them in turn
+			if(l->weights > 0)
+				for(i = 0, r = rand_r(&seed) % l->weights; r >= l->cmd[i].weight; i++)
+					r -= l->cmd[i].weight;
+			c = &l->cmd[i];
+
+			if(l->rate > 0){
+				if(l->requests <= 0 && due >= end)
+					break;
+				while((now = loadClock()) < due)
+					usleep(due - now);
+			} else
+				due = loadClock();
+
+			r = loadCommand(c, sock, sink, k, seq++);
+			loadRecord(&slot->cmd[c - l->cmd], loadClock() - due, r != 0);
+			if(r < 0){
+				slot->lost = 1;
+				break;
+			}
+
+			due += interval;
+			if(l->weights == 0)
+				i = (i + 1) % l->ncmds;
+			if(left > 0)
+				left--;
+		}
+
+		// Bytes that crossed the socket each way, frame headers included
+		if(getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0){
+			slot->bytesIn = info.tcpi_bytes_received;
+			slot->bytesOut = info.tcpi_bytes_acked;
+		}
+		close(sock);
+		exit(0);
+
+	} //END of loadSession function
+
+
+/** Load command - Sends one command of a load spec and reads the whole response, showing nothing
+ *
+ *	Pre: sock connected through conn, sink open for writing (downloaded data is thrown away there)
+ *	Post: get reads the file the way getFile does. put sends the local file under a new name on the server
+ *		  (<file>.<session>.<pid>.<n>) because the server does not replace files
+ *	Return: 0 if the server carried the command out, 1 if it refused it, -1 if the connection was lost
+ */
+	int loadCommand(LoadCmd *c, int sock, int sink, int k, int seq){
+		char send[BUFSIZE], response[BUFSIZE], *base;
+		int fd, n;
+
+		switch(c->op){
+			case 'P':
+				sendCmd(sock, "P", 2);
+				return recvCmd(sock, response, sizeof(response)) <= 0 ? -1 : 0;
+
+			case 'C':
+				snprintf(send, sizeof(send), "C%s", c->arg);
+				sendCmd(sock, send, strlen(send) + 1);
+				if(recvCmd(sock, response, sizeof(response)) <= 0)
+					return -1;
+				return response[0] != 0;
+
+			case 'L':
+				if((n = listDir(sock, 0)) == -1){     // v1 server, names only
+					sendCmd(sock, "D", 2);
+					if(recvCmd(sock, response, sizeof(response)) <= 0)
+						return -1;
+					return response[0] == 1;
+				}
+				return n == -2 ? -1 : n == -3;
+
+			case 'G':
+				snprintf(send, sizeof(send), "G%s", c->arg);
+				sendCmd(sock, send, strlen(send) + 1);
+				if(recvCmd(sock, response, sizeof(response)) <= 0)
+					return -1;
+				if(response[1] != '0')
+					return 1;
+				if(response[2] == 'R' && conn.version != 2){     // Raw stream: size, then the bytes
+					sendCmd(sock, "HR", 3);
+					if(recvCmd(sock, response, sizeof(response)) <= 0)
+						return -1;
+					if(rawSize(response) < 0)
+						return 1;     // Server could not open the file
+					n = recvToFile(sock, sink, rawSize(response));
+					return n == -1 ? -1 : n < 0;
+				}
+				sendCmd(sock, "H0", 3);
+				n = recvFileData(sock, sink);
+				return n == -1 ? -1 : n < 0;
+
+			default:
+				base = strrchr(c->arg, '/') != NULL ? strrchr(c->arg, '/') + 1 : c->arg;
+				snprintf(send, sizeof(send), "U%s.%d.%d.%d", base, k, (int) getpid(), seq);
+				sendCmd(sock, send, strlen(send) + 1);
+				if(recvCmd(sock, response, sizeof(response)) <= 0)
+					return -1;
+				if(response[1] != '0')
+					return 1;
+				// A file that cannot be read is sent as a failed (v2) or empty (v1) file
+				fd = open(c->arg, O_RDONLY);
+				n = sendFileData(sock, fd);
+				if(fd >= 0)
+					close(fd);
+				if(n < 0 || (conn.version == 2 && recvCmd(sock, response, sizeof(response)) <= 0))
+					return -1;
+				return fd < 0 || (conn.version == 2 && strcmp(response, "V0") != 0);
+		}
+
+	} //END of loadCommand function
+
+
+/** Load record - Counts a finished command, with its latency, in a histogram of the session's slot
+ *
+ */
+	void loadRecord(LoadStats *s, long long usec, int failed){
+
+		if(usec < 0)
+			usec = 0;
+		s->count++;
+		s->errors += failed;
+		s->sum += usec;
+		s->buckets[loadBucket(usec)]++;
+		if(usec > s->max)
+			s->max = usec;
+
+	} //END of loadRecord function
+
+
+/** Load report - Sums the slots of every session and shows throughput, errors and latency per command
+ *
+ *	Pre: Every session has ended, elapsed is the length of the run in seconds
+ */
+	void loadReport(Load *l, LoadSlot *slots, double elapsed){
+		LoadStats *sum, *s;
+		long long bytesIn = 0, bytesOut = 0, total = 0, errors = 0;
+		int i, k, b, lost = 0, unconnected = 0;
+
+		if((sum = calloc(l->ncmds + 1, sizeof(LoadStats))) == NULL)
+			return;
+
+		// sum[0] is connection setup, sum[1..] the commands
+		for(k = 0; k < l->sessions; k++){
+			lost += slots[k].lost;
+			unconnected += slots[k].connect.count == 0;
+			bytesIn += slots[k].bytesIn;
+			bytesOut += slots[k].bytesOut;
+			for(i = 0; i <= l->ncmds; i++){
+				s = i == 0 ? &slots[k].connect : &slots[k].cmd[i - 1];
+				sum[i].count += s->count;
+				sum[i].errors += s->errors;
+				sum[i].sum += s->sum;
+				if(s->max > sum[i].max)
+					sum[i].max = s->max;
+				for(b = 0; b < LOAD_BUCKETS; b++)
+					sum[i].buckets[b] += s->buckets[b];
+			}
+		}
+		for(i = 1; i <= l->ncmds; i++){
+			total += sum[i].count;
+			errors += sum[i].errors;
+		}
+
+		printf("%lld commands in %.2f s: %.1f commands/s", total, elapsed, total / elapsed);
+		if(l->rate > 0)
+			printf(" (target %.1f)", l->rate);
+		printf(", %lld errors\n", errors);
+		printf("Data: %.2f MB in (%.2f MB/s), %.2f MB out (%.2f MB/s)\n", bytesIn / 1e6, bytesIn / 1e6 / elapsed,
+			   bytesOut / 1e6, bytesOut / 1e6 / elapsed);
+		if(unconnected > 0 || lost > 0)
+			printf("%d sessions could not connect, %d lost their connection\n", unconnected, lost);
+
+		// Latency percentiles are the top of their bucket, at most 6.25% above the real value
+		printf("%-24s %9s %7s %9s %9s %9s %9s %9s  (us)\n", "command", "count", "errors", "per s", "p50", "p99", "p999", "max");
+		for(i = 0; i <= l->ncmds; i++){
+			s = &sum[i];
+			if(s->count == 0)
+				continue;
+			printf("%-24.24s %9lld %7lld %9.1f %9lld %9lld %9lld %9lld\n", i == 0 ? "(connect)" : l->cmd[i - 1].text,
+				   s->count, s->errors, s->count / elapsed, loadPercentile(s, 500), loadPercentile(s, 990),
+				   loadPercentile(s, 999), s->max);
+		}
+
+		free(sum);
+
+	} //END of loadReport function
+
+
+/** Load bucket - histogram bucket of a latency: exact below LOAD_SUB, then LOAD_SUB buckets per power of two
+ *
+ */
+	int loadBucket(long long usec){
+		int e, b;
+
+		if(usec < LOAD_SUB)
+			return usec;
+
+		e = 63 - __builtin_clzll(usec);
+		b = (e - LOAD_SUB_BITS + 1) * LOAD_SUB + ((usec >> (e - LOAD_SUB_BITS)) & (LOAD_SUB - 1));
+
+		return b < LOAD_BUCKETS ? b : LOAD_BUCKETS - 1;
+
+	} //END of loadBucket function
+
+
+/** Load percentile - latency that permille thousandths of the commands did not exceed
+ *
+ */
+	long long loadPercentile(LoadStats *s, int permille){
+		long long want, seen = 0, top;
+		int b, e;
+
+		want = (s->count * permille + 999) / 1000;
+		for(b = 0; b < LOAD_BUCKETS; b++){
+			if((seen += s->buckets[b]) < want)
+				continue;
+			if(b < LOAD_SUB)
+				return b;
+			e = b / LOAD_SUB + LOAD_SUB_BITS - 1;
+			top = ((long long) (LOAD_SUB + b % LOAD_SUB + 1) << (e - LOAD_SUB_BITS)) - 1;
+			return top < s->max ? top : s->max;
+		}
+
+		return s->max;
+
+	} //END of loadPercentile function
+
+
+/** Load clock - microseconds on the monotonic clock, the same in every process
+ *
+ */
+	long long loadClock(void){
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+
+	} //END of loadClock function
+
 //END OF myftp (CLIENT)
 
 
@@ -5,13 +5,23 @@
  * Changes:
  * 20/10/2021 - Added stream.c/stream.h, fixed implementation
  * 24/10/2021 - Change two-byte short int to four-byte int
+ * 16/10/2026 - Added readlen so a caller can read the payload itself (e.g. with splice)
+ * 16/10/2026 - Added v2 framing: readframe, readheader, writeframe, packheader, unpackheader, crc32buf
+ * 16/10/2026 - Added buffered connection: conninit, connfill, connpeek, connheader, conntake, connread,
+ *              connqueue, connflush, connwrite
+ * 16/10/2026 - connqueue puts the connection's tag (request ID) on v2 frames
+ * 16/10/2026 - writen sends the size and the data with one writev() instead of two one-byte writes first
  */
 
 #include  <unistd.h>
+#include  <string.h>
 #include  <sys/types.h>
+#include  <sys/uio.h>
 #include  <netinet/in.h> /* struct sockaddr_in, htons(), htonl(), */
 #include  "stream.h"
 
+static int writeiov(Conn *c, struct iovec *iov, int iovcnt);
+
 
 /*
  * purpose:  read a stream of bytes from "fd" to "buf".
@@ -45,30 +55,484 @@ int readn(int fd, char *buf, int bufsize){
 }
 
 
+/*
+ * purpose:  read the length header of the next frame from "fd".
+ * pre:      1) the payload of the previous frame has been fully read,
+ * post:     1) only the 2 byte header has been consumed;
+ *           2) return value >= 0  : payload length of the frame
+ *                           = -1  : read error / connection closed
+ */
+int readlen(int fd){
+    unsigned char hdr[2];
+    int n, nr;
+
+    for (n=0; n < 2; n += nr) {
+        if ((nr = read(fd, hdr+n, 2-n)) <= 0)
+            return (-1);
+    }
+    return ((hdr[0] << 8) | hdr[1]);
+}
+
+
+
 /*
  * purpose:  write "nbytes" bytes from "buf" to "fd".
  * pre:      1) nbytes <= MAX_BLOCK_SIZE,
- * post:     1) nbytes bytes from buf written to fd;
+ * post:     1) size and nbytes bytes from buf written to fd with one writev();
  *           2) return value = nbytes : number of bytes written
  *                           = -3     : too many bytes to send
  *                           otherwise: write error
  */
 int writen(int fd, char *buf, int nbytes){
     short data_size = nbytes;     /* short must be two bytes long */
+    struct iovec iov[2];
     int n, nw;
 
     if (nbytes > MAX_BLOCK_SIZE)
          return (-3);    /* too many bytes to send in one go */
 
-    /* send the data size */
+    /* the size and the data leave in one system call, and so in one segment with TCP_NODELAY */
     data_size = htons(data_size);
-    if (write(fd, (char *) &data_size, 1) != 1) return (-1);
-    if (write(fd, (char *) (&data_size)+1, 1) != 1) return (-1);
+    iov[0].iov_base = (char *) &data_size;
+    iov[0].iov_len = 2;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = nbytes;
+
+    for (n=0; n < 2 + nbytes; n += nw) {
+        if ((nw = writev(fd, iov, 2)) <= 0)
+            return (nw);    /* write error */
+
+        /* skip what was written before trying again */
+        if (nw < iov[0].iov_len) {
+            iov[0].iov_base = (char *) iov[0].iov_base + nw;
+            iov[0].iov_len -= nw;
+        } else {
+            iov[1].iov_base = (char *) iov[1].iov_base + (nw - iov[0].iov_len);
+            iov[1].iov_len -= nw - iov[0].iov_len;
+            iov[0].iov_len = 0;
+        }
+    }
+    return (nbytes);
+}
+
+
+
+/*
+ * purpose:  read a v2 frame (header and payload) from "fd" to "buf".
+ * pre:      1) connection negotiated to v2, bufsize >= payload length,
+ * post:     1) hdr holds the frame header, buf the payload;
+ *           2) return value >= 0  : payload length
+ *                           = -1  : read error / connection closed
+ *                           = -2  : checksum mismatch
+ *                           = -3  : buffer too small
+ */
+int readframe(int fd, char *buf, int bufsize, FrameHeader *hdr){
+    int n, nr;
+
+    if (readheader(fd, hdr) < 0)
+        return (-1);
+    if (hdr->length > bufsize)
+        return (-3);     /* buffer too small */
 
-    /* send nbytes */
-    for (n=0; n<nbytes; n += nw) {
-         if ((nw = write(fd, buf+n, nbytes-n)) <= 0)
-             return (nw);    /* write error */
+    for (n=0; n < hdr->length; n += nr) {
+        if ((nr = read(fd, buf+n, hdr->length-n)) <= 0)
+            return (-1);       /* error in reading */
     }
+
+    if ((hdr->flags & FF_CHECKSUM) && crc32buf(0, buf, n) != hdr->crc)
+        return (-2);     /* payload damaged */
     return (n);
 }
+
+
+
+/*
+ * purpose:  read only the 12 byte header of the next v2 frame from "fd".
+ * pre:      1) payload of the previous frame has been fully read,
+ * post:     1) hdr holds the frame header, the payload is still unread;
+ *           2) return value = 0   : header read
+ *                           = -1  : read error / connection closed
+ */
+int readheader(int fd, FrameHeader *hdr){
+    char raw[V2_HDR_SIZE];
+    int n, nr;
+
+    for (n=0; n < V2_HDR_SIZE; n += nr) {
+        if ((nr = read(fd, raw+n, V2_HDR_SIZE-n)) <= 0)
+            return (-1);
+    }
+    unpackheader(raw, hdr);
+    return (0);
+}
+
+
+
+/*
+ * purpose:  write a v2 frame of "nbytes" bytes from "buf" to "fd".
+ * pre:      1) connection negotiated to v2, nbytes <= negotiated frame size,
+ * post:     1) header and payload written with one writev();
+ *           2) return value = nbytes : number of payload bytes written
+ *                           otherwise: write error
+ */
+int writeframe(int fd, int type, int flags, char *buf, int nbytes){
+    char raw[V2_HDR_SIZE];
+    FrameHeader hdr;
+    struct iovec iov[2];
+    int n, nw;
+
+    hdr.type = type;
+    hdr.flags = flags;
+    hdr.tag = 0;
+    hdr.length = nbytes;
+    hdr.crc = (flags & FF_CHECKSUM) ? crc32buf(0, buf, nbytes) : 0;
+    packheader(raw, &hdr);
+
+    /* header and payload leave in one system call */
+    iov[0].iov_base = raw;
+    iov[0].iov_len = V2_HDR_SIZE;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = nbytes;
+
+    for (n=0; n < V2_HDR_SIZE + nbytes; n += nw) {
+        if ((nw = writev(fd, iov, 2)) <= 0)
+            return (-1);    /* write error */
+
+        /* skip what was written before trying again */
+        if (nw < iov[0].iov_len) {
+            iov[0].iov_base = (char *) iov[0].iov_base + nw;
+            iov[0].iov_len -= nw;
+        } else {
+            iov[1].iov_base = (char *) iov[1].iov_base + (nw - iov[0].iov_len);
+            iov[1].iov_len -= nw - iov[0].iov_len;
+            iov[0].iov_len = 0;
+        }
+    }
+    return (nbytes);
+}
+
+
+
+/*
+ * purpose:  convert a frame header to its 12 byte wire format.
+ * pre:      1) dst has room for V2_HDR_SIZE bytes,
+ * post:     1) dst holds the header in network byte order;
+ */
+void packheader(char *dst, FrameHeader *hdr){
+    unsigned short tag = htons(hdr->tag);
+    unsigned int length = htonl(hdr->length);
+    unsigned int crc = htonl(hdr->crc);
+
+    dst[0] = hdr->type;
+    dst[1] = hdr->flags;
+    memcpy(dst+2, &tag, 2);
+    memcpy(dst+4, &length, 4);
+    memcpy(dst+8, &crc, 4);
+}
+
+
+
+/*
+ * purpose:  convert 12 bytes of wire format to a frame header.
+ * pre:      1) src holds V2_HDR_SIZE bytes,
+ * post:     1) hdr holds the header in host byte order;
+ */
+void unpackheader(char *src, FrameHeader *hdr){
+    unsigned short tag;
+    unsigned int length, crc;
+
+    memcpy(&tag, src+2, 2);
+    memcpy(&length, src+4, 4);
+    memcpy(&crc, src+8, 4);
+
+    hdr->type = (unsigned char) src[0];
+    hdr->flags = (unsigned char) src[1];
+    hdr->tag = ntohs(tag);
+    hdr->length = ntohl(length);
+    hdr->crc = ntohl(crc);
+}
+
+
+
+/*
+ * purpose:  update a CRC-32 (as used by zlib) with "len" bytes from "buf".
+ * pre:      1) crc is 0 for a new checksum, or a previous result,
+ * post:     1) return value : updated CRC-32;
+ */
+unsigned int crc32buf(unsigned int crc, char *buf, int len){
+    static unsigned int table[256];
+    unsigned int c;
+    int i, k;
+
+    /* build the table for the reflected polynomial on first use */
+    if (table[1] == 0) {
+        for (i=0; i < 256; i++) {
+            for (c=i, k=0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (i=0; i < len; i++)
+        crc = table[(crc ^ (unsigned char) buf[i]) & 0xFF] ^ (crc >> 8);
+    return (~crc);
+}
+
+
+
+/*
+ * purpose:  set up a buffered connection on "fd".
+ * pre:      1) fd is a connected socket,
+ * post:     1) empty read-ahead and write buffers, v1 framing;
+ */
+void conninit(Conn *c, int fd){
+    c->fd = fd;
+    c->version = 1;
+    c->rpos = c->rlen = 0;
+    c->woff = c->wlen = 0;
+    c->reads = c->writes = 0;
+    c->tag = 0;
+}
+
+
+
+/*
+ * purpose:  read once from the socket into the read-ahead buffer.
+ * pre:      1) free space in rbuf (unread bytes are moved to the front first),
+ * post:     1) as many bytes as one read() returns are appended;
+ *           2) return value > 0   : number of bytes read
+ *                           = 0   : connection closed / buffer full
+ *                           = -1  : read error (EAGAIN on a non-blocking socket)
+ */
+int connfill(Conn *c){
+    int nr;
+
+    if (c->rpos > 0) {
+        memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+        c->rlen -= c->rpos;
+        c->rpos = 0;
+    }
+    if (c->rlen == CONN_RBUF)
+        return (0);
+
+    c->reads++;
+    if ((nr = read(c->fd, c->rbuf + c->rlen, CONN_RBUF - c->rlen)) > 0)
+        c->rlen += nr;
+    return (nr);
+}
+
+
+
+/*
+ * purpose:  parse the header of the next frame in the read-ahead buffer.
+ * pre:      1) none,
+ * post:     1) hdr holds the header (v1: length only, type 0), nothing is consumed;
+ *           2) return value > 0   : header size, a whole header is buffered
+ *                           = 0   : header not complete yet
+ */
+int connpeek(Conn *c, FrameHeader *hdr){
+    unsigned char *p = (unsigned char *) c->rbuf + c->rpos;
+
+    if (c->rlen - c->rpos < connhdrsize(c))
+        return (0);
+
+    if (c->version == 2) {
+        unpackheader((char *) p, hdr);
+    } else {
+        hdr->type = hdr->flags = hdr->tag = 0;
+        hdr->length = (p[0] << 8) | p[1];
+        hdr->crc = 0;
+    }
+    return (connhdrsize(c));
+}
+
+
+
+/*
+ * purpose:  size of a frame header in the framing the connection uses.
+ * pre:      1) none,
+ * post:     1) return value : 2 for v1, V2_HDR_SIZE for v2;
+ */
+int connhdrsize(Conn *c){
+    return (c->version == 2 ? V2_HDR_SIZE : 2);
+}
+
+
+
+/*
+ * purpose:  read and consume the header of the next frame, the payload is left unread.
+ * pre:      1) payload of the previous frame has been fully consumed,
+ * post:     1) hdr holds the header;
+ *           2) return value = 0   : header read
+ *                           = -1  : read error / connection closed
+ */
+int connheader(Conn *c, FrameHeader *hdr){
+    int h;
+
+    while ((h = connpeek(c, hdr)) == 0) {
+        if (connfill(c) <= 0)
+            return (-1);
+    }
+    c->rpos += h;
+    return (0);
+}
+
+
+
+/*
+ * purpose:  take up to "n" bytes that are already in the read-ahead buffer.
+ * pre:      1) none (no system call is made),
+ * post:     1) bytes copied to buf and consumed;
+ *           2) return value : number of bytes taken (0 if nothing is buffered)
+ */
+int conntake(Conn *c, char *buf, int n){
+    if (n > c->rlen - c->rpos)
+        n = c->rlen - c->rpos;
+    memcpy(buf, c->rbuf + c->rpos, n);
+    c->rpos += n;
+    return (n);
+}
+
+
+
+/*
+ * purpose:  read the next frame (header and payload) from the connection to "buf".
+ * pre:      1) bufsize >= payload length,
+ * post:     1) hdr holds the header, buf the payload. Bytes already read ahead
+ *                         are used first, so several frames can come from one read();
+ *           2) return value >= 0  : payload length
+ *                           = -1  : read error / connection closed
+ *                           = -2  : checksum mismatch
+ *                           = -3  : buffer too small
+ */
+int connread(Conn *c, char *buf, int bufsize, FrameHeader *hdr){
+    int n, nr;
+
+    if (connheader(c, hdr) < 0)
+        return (-1);
+    if (hdr->length > bufsize)
+        return (-3);     /* buffer too small */
+
+    /* whatever is buffered first, then straight from the socket */
+    for (n = conntake(c, buf, hdr->length); n < hdr->length; n += nr) {
+        c->reads++;
+        if ((nr = read(c->fd, buf+n, hdr->length-n)) <= 0)
+            return (-1);       /* error in reading */
+    }
+
+    if ((hdr->flags & FF_CHECKSUM) && crc32buf(0, buf, n) != hdr->crc)
+        return (-2);     /* payload damaged */
+    return (n);
+}
+
+
+
+/*
+ * purpose:  queue a frame of "nbytes" bytes from "buf" to be sent by connflush.
+ * pre:      1) nbytes <= negotiated frame size (v1: MAX_BLOCK_SIZE),
+ * post:     1) header and payload copied behind any frames already queued, so
+ *                         many frames leave in one write(). A payload too large for the
+ *                         buffer is sent at once with writev() after the queue;
+ *           2) return value = nbytes : frame queued or sent
+ *                           otherwise: write error
+ */
+int connqueue(Conn *c, int type, int flags, char *buf, int nbytes){
+    FrameHeader hdr;
+    unsigned short data_size = htons(nbytes);
+    char raw[V2_HDR_SIZE];
+    int hsize = connhdrsize(c);
+    struct iovec iov[3];
+
+    hdr.type = type;
+    hdr.flags = flags;
+    hdr.tag = c->tag;
+    hdr.length = nbytes;
+    hdr.crc = (flags & FF_CHECKSUM) ? crc32buf(0, buf, nbytes) : 0;
+    if (c->version == 2)
+        packheader(raw, &hdr);
+    else
+        memcpy(raw, &data_size, 2);
+
+    if (c->wlen + hsize + nbytes <= CONN_WBUF) {
+        memcpy(c->wbuf + c->wlen, raw, hsize);
+        memcpy(c->wbuf + c->wlen + hsize, buf, nbytes);
+        c->wlen += hsize + nbytes;
+        return (nbytes);
+    }
+
+    /* does not fit - queued frames, header and payload leave in one writev() */
+    iov[0].iov_base = c->wbuf + c->woff;
+    iov[0].iov_len = c->wlen - c->woff;
+    iov[1].iov_base = raw;
+    iov[1].iov_len = hsize;
+    iov[2].iov_base = buf;
+    iov[2].iov_len = nbytes;
+    c->woff = c->wlen = 0;
+    return (writeiov(c, iov, 3) < 0 ? -1 : nbytes);
+}
+
+
+
+/*
+ * purpose:  write every queued frame to the socket.
+ * pre:      1) none,
+ * post:     1) queue empty;
+ *           2) return value = 0   : all queued bytes written
+ *                           = -1  : write error (EAGAIN on a non-blocking socket,
+ *                                   the unsent bytes stay queued)
+ */
+int connflush(Conn *c){
+    int nw;
+
+    while (c->woff < c->wlen) {
+        c->writes++;
+        if ((nw = write(c->fd, c->wbuf + c->woff, c->wlen - c->woff)) <= 0)
+            return (-1);    /* write error */
+        c->woff += nw;
+    }
+    c->woff = c->wlen = 0;
+    return (0);
+}
+
+
+
+/*
+ * purpose:  queue a frame and flush it together with anything queued before it.
+ * pre:      1) as connqueue,
+ * post:     1) frame and earlier queued frames written;
+ *           2) return value = nbytes : number of payload bytes written
+ *                           otherwise: write error
+ */
+int connwrite(Conn *c, int type, int flags, char *buf, int nbytes){
+    if (connqueue(c, type, flags, buf, nbytes) < 0 || connflush(c) < 0)
+        return (-1);
+    return (nbytes);
+}
+
+
+
+/*
+ * purpose:  write every byte described by "iov", retrying after partial writes.
+ * return:   0 on success, -1 on write error
+ */
+static int writeiov(Conn *c, struct iovec *iov, int iovcnt){
+    int nw;
+
+    while (iovcnt > 0) {
+        c->writes++;
+        if ((nw = writev(c->fd, iov, iovcnt)) <= 0)
+            return (-1);    /* write error */
+
+        /* skip what was written before trying again */
+        while (iovcnt > 0 && nw >= iov->iov_len) {
+            nw -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + nw;
+            iov->iov_len -= nw;
+        }
+    }
+    return (0);
+}
@@ -3,12 +3,66 @@
  * Date: 20/10/2021
  * Purpose: Head file for stream read and stream write.
  * Changes: 20/10/2021 - Added stream.c/stream.h, fixed implementation
+ *          16/10/2026 - Added readlen
+ *          16/10/2026 - Added v2 framing (typed 12 byte header, 32-bit length, flags, CRC-32)
+ *          16/10/2026 - Added buffered connection (Conn) with read-ahead and coalesced writes
+ *          16/10/2026 - v2 tag carries a request ID (Conn.tag), responses repeat the tag of their command
+ *          16/10/2026 - Added compressed data frame flags (FF_ZLIB, FF_LZ)
  */
 
+#ifndef STREAM_H
+#define STREAM_H
 
 #define MAX_BLOCK_SIZE (1024*5)    /* maximum size of any piece of */
                                    /* data that can be sent by client */
 
+/* v2 framing - negotiated at connect time with the N opcode:
+ *   byte  0     type   (FT_*)
+ *   byte  1     flags  (FF_*)
+ *   bytes 2-3   tag    (request ID, repeated in the response, 0 if untagged)
+ *   bytes 4-7   payload length
+ *   bytes 8-11  CRC-32 of the payload (as sent, compressed or not) if FF_CHECKSUM is set, otherwise 0
+ * all in network byte order, followed by the payload */
+#define V2_HDR_SIZE 12
+#define V2_MIN_FRAME MAX_BLOCK_SIZE
+#define V2_MAX_FRAME (1024*1024*4) /* largest frame either side will negotiate */
+
+#define FT_CMD  1                  /* command from the client */
+#define FT_RESP 2                  /* response from the server */
+#define FT_DATA 3                  /* file data, either direction */
+
+#define FF_EOF      0x01           /* last data frame of a file */
+#define FF_ERROR    0x02           /* transfer failed, payload may be partial */
+#define FF_CHECKSUM 0x04           /* crc field holds the CRC-32 of the payload */
+#define FF_ZLIB     0x08           /* payload is compressed with zlib (raw deflate) */
+#define FF_LZ       0x10           /* payload is compressed with the LZ codec (compress.c) */
+#define FF_PACKED   (FF_ZLIB | FF_LZ)
+
+typedef struct frameHeader {
+    int type;
+    int flags;
+    int tag;
+    unsigned int length;
+    unsigned int crc;
+} FrameHeader;
+
+/* Buffered connection - one read() fills the read-ahead buffer with as many
+ * frames as have arrived, and queued frames (header and payload together)
+ * leave in one write(). Works in v1 or v2 framing */
+#define CONN_RBUF (2*(MAX_BLOCK_SIZE+V2_HDR_SIZE))   /* read-ahead, two full command frames */
+#define CONN_WBUF (4*(MAX_BLOCK_SIZE+V2_HDR_SIZE))   /* queued output */
+
+typedef struct conn {
+    int fd;
+    int version;                   /* framing in use, 1 or 2 */
+    char rbuf[CONN_RBUF];
+    int rpos, rlen;                /* unread bytes are rbuf[rpos..rlen) */
+    char wbuf[CONN_WBUF];
+    int woff, wlen;                /* unsent bytes are wbuf[woff..wlen) */
+    long reads, writes;            /* system calls made, for benchmarks */
+    int tag;                       /* v2 tag put on frames queued from now on */
+} Conn;
+
 /*
  * purpose:  read a stream of bytes from "fd" to "buf".
  * pre:      1) size of buf bufsize >= MAX_BLOCK_SIZE,
@@ -23,6 +77,17 @@ int readn(int fd, char *buf, int bufsize);
 
 
 
+/*
+ * purpose:  read the length header of the next frame from "fd".
+ * pre:      1) the payload of the previous frame has been fully read,
+ * post:     1) only the 2 byte header has been consumed;
+ *           2) return value >= 0  : payload length of the frame
+ *                           = -1  : read error / connection closed
+ */
+int readlen(int fd);
+
+
+
 /*
  * purpose:  write "nbytes" bytes from "buf" to "fd".
  * pre:      1) nbytes <= MAX_BLOCK_SIZE,
@@ -32,3 +97,179 @@ int readn(int fd, char *buf, int bufsize);
  *                           otherwise: write error
  */
 int writen(int fd, char *buf, int nbytes);
+
+
+
+/*
+ * purpose:  read a v2 frame (header and payload) from "fd" to "buf".
+ * pre:      1) connection negotiated to v2, bufsize >= payload length,
+ * post:     1) hdr holds the frame header, buf the payload;
+ *           2) return value >= 0  : payload length
+ *                           = -1  : read error / connection closed
+ *                           = -2  : checksum mismatch
+ *                           = -3  : buffer too small
+ */
+int readframe(int fd, char *buf, int bufsize, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  read only the 12 byte header of the next v2 frame from "fd".
+ * pre:      1) payload of the previous frame has been fully read,
+ * post:     1) hdr holds the frame header, the payload is still unread;
+ *           2) return value = 0   : header read
+ *                           = -1  : read error / connection closed
+ */
+int readheader(int fd, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  write a v2 frame of "nbytes" bytes from "buf" to "fd".
+ * pre:      1) connection negotiated to v2, nbytes <= negotiated frame size,
+ * post:     1) header and payload written with one writev();
+ *           2) return value = nbytes : number of payload bytes written
+ *                           otherwise: write error
+ */
+int writeframe(int fd, int type, int flags, char *buf, int nbytes);
+
+
+
+/*
+ * purpose:  convert a frame header to its 12 byte wire format.
+ * pre:      1) dst has room for V2_HDR_SIZE bytes,
+ * post:     1) dst holds the header in network byte order;
+ */
+void packheader(char *dst, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  convert 12 bytes of wire format to a frame header.
+ * pre:      1) src holds V2_HDR_SIZE bytes,
+ * post:     1) hdr holds the header in host byte order;
+ */
+void unpackheader(char *src, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  update a CRC-32 (as used by zlib) with "len" bytes from "buf".
+ * pre:      1) crc is 0 for a new checksum, or a previous result,
+ * post:     1) return value : updated CRC-32;
+ */
+unsigned int crc32buf(unsigned int crc, char *buf, int len);
+
+
+
+/*
+ * purpose:  set up a buffered connection on "fd".
+ * pre:      1) fd is a connected socket,
+ * post:     1) empty read-ahead and write buffers, v1 framing;
+ */
+void conninit(Conn *c, int fd);
+
+
+
+/*
+ * purpose:  read once from the socket into the read-ahead buffer.
+ * pre:      1) free space in rbuf (unread bytes are moved to the front first),
+ * post:     1) as many bytes as one read() returns are appended;
+ *           2) return value > 0   : number of bytes read
+ *                           = 0   : connection closed / buffer full
+ *                           = -1  : read error (EAGAIN on a non-blocking socket)
+ */
+int connfill(Conn *c);
+
+
+
+/*
+ * purpose:  parse the header of the next frame in the read-ahead buffer.
+ * pre:      1) none,
+ * post:     1) hdr holds the header (v1: length only, type 0), nothing is consumed;
+ *           2) return value > 0   : header size, a whole header is buffered
+ *                           = 0   : header not complete yet
+ */
+int connpeek(Conn *c, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  size of a frame header in the framing the connection uses.
+ * pre:      1) none,
+ * post:     1) return value : 2 for v1, V2_HDR_SIZE for v2;
+ */
+int connhdrsize(Conn *c);
+
+
+
+/*
+ * purpose:  read and consume the header of the next frame, the payload is left unread.
+ * pre:      1) payload of the previous frame has been fully consumed,
+ * post:     1) hdr holds the header;
+ *           2) return value = 0   : header read
+ *                           = -1  : read error / connection closed
+ */
+int connheader(Conn *c, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  take up to "n" bytes that are already in the read-ahead buffer.
+ * pre:      1) none (no system call is made),
+ * post:     1) bytes copied to buf and consumed;
+ *           2) return value : number of bytes taken (0 if nothing is buffered)
+ */
+int conntake(Conn *c, char *buf, int n);
+
+
+
+/*
+ * purpose:  read the next frame (header and payload) from the connection to "buf".
+ * pre:      1) bufsize >= payload length,
+ * post:     1) hdr holds the header, buf the payload. Bytes already read ahead
+ *                         are used first, so several frames can come from one read();
+ *           2) return value >= 0  : payload length
+ *                           = -1  : read error / connection closed
+ *                           = -2  : checksum mismatch
+ *                           = -3  : buffer too small
+ */
+int connread(Conn *c, char *buf, int bufsize, FrameHeader *hdr);
+
+
+
+/*
+ * purpose:  queue a frame of "nbytes" bytes from "buf" to be sent by connflush.
+ * pre:      1) nbytes <= negotiated frame size (v1: MAX_BLOCK_SIZE),
+ * post:     1) header and payload copied behind any frames already queued, so
+ *                         many frames leave in one write(). A payload too large for the
+ *                         buffer is sent at once with writev() after the queue;
+ *           2) return value = nbytes : frame queued or sent
+ *                           otherwise: write error
+ */
+int connqueue(Conn *c, int type, int flags, char *buf, int nbytes);
+
+
+
+/*
+ * purpose:  write every queued frame to the socket.
+ * pre:      1) none,
+ * post:     1) queue empty;
+ *           2) return value = 0   : all queued bytes written
+ *                           = -1  : write error (EAGAIN on a non-blocking socket,
+ *                                   the unsent bytes stay queued)
+ */
+int connflush(Conn *c);
+
+
+
+/*
+ * purpose:  queue a frame and flush it together with anything queued before it.
+ * pre:      1) as connqueue,
+ * post:     1) frame and earlier queued frames written;
+ *           2) return value = nbytes : number of payload bytes written
+ *                           otherwise: write error
+ */
+int connwrite(Conn *c, int type, int flags, char *buf, int nbytes);
+
+#endif
@@ -0,0 +1,211 @@
+/* File: streambench.c (CLIENT)
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Microbenchmark of the stream layer - system calls and latency per command round trip
+ *			with the original readn()/writen() and with the buffered connection (Conn)
+ * Changes:
+ * 16/10/2026 - Added streambench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include "stream.h"
+
+#define MODE_LEGACY 0		// readn()/writen(), one frame at a time
+#define MODE_CONN 1			// connread()/connwrite(), one frame at a time
+#define MODE_BURST 2		// connqueue() a burst of frames, one connflush(), read the replies
+
+static void echoPeer(int fd, int mode);
+static void runBench(int mode, int rounds, int size, int burst);
+static void ioCounters(long *syscr, long *syscw);
+static double now(void);
+
+
+/** MAIN function
+ *
+ *	Pre: Syntax to execute program: "streambench [-n rounds] [-s frame_size] [-b burst]"
+ *	Post: One line of results per mode is printed
+ */
+	int main(int argc, char *argv[]){
+		int opt, rounds = 20000, size = 64, burst = 8;
+
+		while((opt = getopt(argc, argv, "n:s:b:")) != -1){
+			if(opt == 'n')
+				rounds = atoi(optarg);
+			else if(opt == 's')
+				size = atoi(optarg);
+			else if(opt == 'b')
+				burst = atoi(optarg);
+			else {
+				printf("Syntax: %s [-n rounds] [-s frame_size] [-b burst]\n", argv[0]);
+				exit(1);
+			}
+		}
+		if(rounds < 1 || size < 1 || size > MAX_BLOCK_SIZE || burst < 1 || burst * (size + 2) > CONN_WBUF){
+			printf("Error: need rounds >= 1, 1 <= frame_size <= %d and burst frames that fit in %d bytes\n",
+				   MAX_BLOCK_SIZE, CONN_WBUF);
+			exit(1);
+		}
+
+		printf("%-8s %8s %6s %10s %10s %10s\n", "mode", "rounds", "size", "us/rt", "reads/rt", "writes/rt");
+		runBench(MODE_LEGACY, rounds, size, 1);
+		runBench(MODE_CONN, rounds, size, 1);
+		runBench(MODE_BURST, rounds, size, burst);
+
+		return 0;
+
+	} //END of main function
+
+
+/** Run benchmark - Times round trips of one mode against an echo peer on a socket pair
+ *
+ *	Pre: size fits in one v1 frame, burst frames fit in the Conn write buffer
+ *	Post: Latency and client side read/write system calls per round trip are printed.
+ *		  A round trip is one frame sent and its echo received (a burst counts as burst round trips)
+ */
+	static void runBench(int mode, int rounds, int size, int burst){
+		int sv[2], i, j, n = 0;
+		long r0, w0, r1, w1;
+		double start, elapsed;
+		char *buf;
+		pid_t pid;
+		Conn *c;
+		FrameHeader hdr;
+		static const char *names[] = {"legacy", "conn", "burst"};
+
+		buf = malloc(MAX_BLOCK_SIZE);
+		c = malloc(sizeof(Conn));
+		if(buf == NULL || c == NULL || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+			perror("streambench setup");
+			exit(1);
+		}
+		memset(buf, 'x', size);
+		fflush(stdout);     // Child must not inherit buffered output
+
+		if((pid = fork()) == 0){
+			close(sv[0]);
+			echoPeer(sv[1], mode);
+			exit(0);
+		}
+		close(sv[1]);
+		conninit(c, sv[0]);
+
+		rounds = (rounds + burst - 1) / burst * burst;
+		ioCounters(&r0, &w0);
+		start = now();
+
+		for(i = 0; i < rounds && n >= 0; i += burst){
+			if(mode == MODE_LEGACY){
+				if((n = writen(sv[0], buf, size)) == size)
+					n = readn(sv[0], buf, MAX_BLOCK_SIZE);
+			} else if(mode == MODE_CONN){
+				if((n = connwrite(c, FT_CMD, 0, buf, size)) == size)
+					n = connread(c, buf, MAX_BLOCK_SIZE, &hdr);
+			} else {
+				for(j = 0; j < burst; j++)
+					connqueue(c, FT_CMD, 0, buf, size);
+				n = connflush(c);
+				for(j = 0; j < burst && n >= 0; j++)
+					n = connread(c, buf, MAX_BLOCK_SIZE, &hdr);
+			}
+		}
+
+		elapsed = now() - start;
+		ioCounters(&r1, &w1);
+
+		// No /proc/self/io - fall back to the counts kept by the connection (not for legacy)
+		if(r1 == 0 && w1 == 0){
+			r0 = w0 = 0;
+			r1 = c->reads;
+			w1 = c->writes;
+		}
+
+		close(sv[0]);
+		waitpid(pid, NULL, 0);
+
+		if(n < 0)
+			printf("%-8s failed after %d round trips\n", names[mode], i);
+		else
+			printf("%-8s %8d %6d %10.2f %10.2f %10.2f\n", names[mode], rounds, size, elapsed * 1e6 / rounds,
+				   (double) (r1 - r0) / rounds, (double) (w1 - w0) / rounds);
+
+		free(buf);
+		free(c);
+
+	} //END of runBench function
+
+
+/** Echo peer - Sends every frame it receives straight back, until the other end closes
+ *
+ *	Pre: fd is one end of a connected socket pair
+ *	Post: In burst mode replies are queued while more frames are already buffered and
+ *		  flushed together, the way the server answers pipelined commands
+ */
+	static void echoPeer(int fd, int mode){
+		char buf[MAX_BLOCK_SIZE];
+		FrameHeader hdr;
+		Conn *c;
+		int n;
+
+		if((c = malloc(sizeof(Conn))) == NULL)
+			return;
+		conninit(c, fd);
+
+		while(1){
+			if(mode == MODE_LEGACY){
+				if((n = readn(fd, buf, sizeof(buf))) <= 0 || writen(fd, buf, n) != n)
+					break;
+				continue;
+			}
+
+			if((n = connread(c, buf, sizeof(buf), &hdr)) < 0)
+				break;
+			connqueue(c, FT_RESP, 0, buf, n);
+			if(mode == MODE_CONN || c->rpos == c->rlen)
+				if(connflush(c) < 0)
+					break;
+		}
+
+		free(c);
+
+	} //END of echoPeer function
+
+
+/** I/O counters - read and write system calls made so far by this process (/proc/self/io)
+ *
+ */
+	static void ioCounters(long *syscr, long *syscw){
+		char line[128];
+		FILE *fp;
+
+		*syscr = *syscw = 0;
+		if((fp = fopen("/proc/self/io", "r")) == NULL)
+			return;
+		while(fgets(line, sizeof(line), fp) != NULL){
+			sscanf(line, "syscr: %ld", syscr);
+			sscanf(line, "syscw: %ld", syscw);
+		}
+		fclose(fp);
+
+	} //END of ioCounters function
+
+
+/** Now - wall clock time in seconds
+ *
+ */
+	static double now(void){
+		struct timeval tv;
+
+		gettimeofday(&tv, NULL);
+		return tv.tv_sec + tv.tv_usec / 1e6;
+
+	} //END of now function
+
+//END of streambench.c
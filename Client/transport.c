@@ -0,0 +1,258 @@
+/* File: transport.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Socket transport profile of the client and the server: buffer sizes, TCP_NODELAY for command
+ *			traffic, TCP_CORK around file data, congestion control, keepalive and TCP_NOTSENT_LOWAT.
+ *			The profile comes from a file of settings and from command line flags, and only the options
+ *			it names are set, everything else stays as the kernel has it
+ * Changes:
+ * 16/10/2026 - Added transport.c/transport.h
+ */
+
+#define _GNU_SOURCE
+#include  <stdio.h>
+#include  <stdlib.h>
+#include  <stdarg.h>
+#include  <string.h>
+#include  <errno.h>
+#include  <sys/types.h>
+#include  <sys/socket.h>
+#include  <netinet/in.h>
+#include  <netinet/tcp.h>
+#include  "transport.h"
+
+static Transport profile = { 0, 0, 1, 1, "", 0, 0, 0, 0 };
+
+static int sizeValue(char *value);
+static int switchValue(char *value);
+static int appendf(char *buf, int size, int len, char *fmt, ...);
+
+
+/** Set - see transport.h
+ *
+ */
+	int transportSet(char *setting){
+		char key[32], *value;
+		size_t n;
+		int v;
+
+		if((n = strcspn(setting, "= \t")) == 0 || n >= sizeof(key) || setting[n] == '\0')
+			return -1;
+		memcpy(key, setting, n);
+		key[n] = '\0';
+		value = setting + n + strspn(setting + n, "= \t");
+
+		if(strcmp(key, "congestion") == 0){
+			if(strlen(value) >= TRANSPORT_NAME)
+				return -1;
+			strcpy(profile.congestion, strcmp(value, "default") == 0 ? "" : value);
+			return 0;
+		}
+
+		v = strcmp(key, "nodelay") == 0 || strcmp(key, "cork") == 0 ? switchValue(value) : sizeValue(value);
+		if(v < 0)
+			return -1;
+
+		if(strcmp(key, "sndbuf") == 0)
+			profile.sndbuf = v;
+		else if(strcmp(key, "rcvbuf") == 0)
+			profile.rcvbuf = v;
+		else if(strcmp(key, "nodelay") == 0)
+			profile.nodelay = v;
+		else if(strcmp(key, "cork") == 0)
+			profile.cork = v;
+		else if(strcmp(key, "keepalive") == 0)
+			profile.keepalive = v;
+		else if(strcmp(key, "keepintvl") == 0)
+			profile.keepintvl = v;
+		else if(strcmp(key, "keepcnt") == 0)
+			profile.keepcnt = v;
+		else if(strcmp(key, "notsent_lowat") == 0)
+			profile.lowat = v;
+		else
+			return -1;
+
+		return 0;
+
+	} //END of transportSet function
+
+
+/** Load - see transport.h
+ *
+ */
+	int transportLoad(char *file){
+		FILE *fp;
+		char line[256], *p, *end;
+		int lineno = 0;
+
+		if((fp = fopen(file, "r")) == NULL){
+			fprintf(stderr, "Cannot open transport profile %s: %s\n", file, strerror(errno));
+			return -1;
+		}
+
+		while(fgets(line, sizeof(line), fp) != NULL){
+			lineno++;
+			if((end = strchr(line, '#')) != NULL)
+				*end = '\0';
+			for(end = line + strlen(line); end > line && strchr(" \t\r\n", end[-1]) != NULL; end--)
+				;
+			*end = '\0';
+			p = line + strspn(line, " \t");
+			if(*p == '\0')
+				continue;     // Blank or comment
+
+			if(transportSet(p) < 0){
+				fprintf(stderr, "%s line %d: bad setting \"%s\"\n", file, lineno, p);
+				fclose(fp);
+				return -1;
+			}
+		}
+
+		fclose(fp);
+		return 0;
+
+	} //END of transportLoad function
+
+
+/** Apply - see transport.h
+ *
+ */
+	int transportApply(int sock, char *err, int size){
+		int failed = 0, len = 0, on = 1;
+
+		err[0] = '\0';
+
+		// Sizes of 0 and the empty name mean the option was not asked for
+		if(profile.sndbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &profile.sndbuf, sizeof(int)) < 0)
+			failed++, len = appendf(err, size, len, " sndbuf (%s)", strerror(errno));
+		if(profile.rcvbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &profile.rcvbuf, sizeof(int)) < 0)
+			failed++, len = appendf(err, size, len, " rcvbuf (%s)", strerror(errno));
+		if(setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &profile.nodelay, sizeof(int)) < 0)
+			failed++, len = appendf(err, size, len, " nodelay (%s)", strerror(errno));
+		if(profile.congestion[0] != '\0' &&
+		   setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, profile.congestion, strlen(profile.congestion)) < 0)
+			failed++, len = appendf(err, size, len, " congestion %s (%s)", profile.congestion, strerror(errno));
+		if(profile.keepalive > 0 && (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0 ||
+		   setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &profile.keepalive, sizeof(int)) < 0 ||
+		   (profile.keepintvl > 0 && setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &profile.keepintvl, sizeof(int)) < 0) ||
+		   (profile.keepcnt > 0 && setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &profile.keepcnt, sizeof(int)) < 0)))
+			failed++, len = appendf(err, size, len, " keepalive (%s)", strerror(errno));
+		if(profile.lowat > 0 && setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &profile.lowat, sizeof(int)) < 0)
+			failed++, len = appendf(err, size, len, " notsent_lowat (%s)", strerror(errno));
+
+		return failed;
+
+	} //END of transportApply function
+
+
+/** Cork - see transport.h
+ *
+ */
+	void transportCork(int sock, int on){
+
+		// Uncorking sends what is left at once, whatever TCP_NODELAY says
+		if(profile.cork)
+			setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+
+	} //END of transportCork function
+
+
+/** Dump - see transport.h
+ *
+ */
+	int transportDump(int sock, char *buf, int size){
+		int sndbuf = 0, rcvbuf = 0, nodelay = 0, cork = 0, keepalive = 0, idle = 0, intvl = 0, cnt = 0, lowat = 0, len;
+		char congestion[TRANSPORT_NAME] = "";
+		struct tcp_info info;
+		socklen_t n = sizeof(int);
+
+		getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, &n);
+		getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &n);
+		getsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, &n);
+		getsockopt(sock, IPPROTO_TCP, TCP_CORK, &cork, &n);
+		getsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, &n);
+		getsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, &n);
+		getsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, &n);
+		getsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &cnt, &n);
+		getsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, &n);
+		n = sizeof(congestion) - 1;
+		getsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, congestion, &n);
+
+		// The kernel doubles the buffer sizes it was given, for its own bookkeeping
+		len = appendf(buf, size, 0, "sndbuf %d\nrcvbuf %d\nnodelay %s\ncork %s (%s around file data)\ncongestion %s",
+					  sndbuf, rcvbuf, nodelay ? "on" : "off", cork ? "on" : "off", profile.cork ? "on" : "off", congestion);
+		if(keepalive)
+			len = appendf(buf, size, len, "\nkeepalive %d s, every %d s, %d probes", idle, intvl, cnt);
+		else
+			len = appendf(buf, size, len, "\nkeepalive off");
+		if(lowat > 0)
+			len = appendf(buf, size, len, "\nnotsent_lowat %d", lowat);
+		else
+			len = appendf(buf, size, len, "\nnotsent_lowat default");
+
+		n = sizeof(info);
+		if(getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &n) == 0)
+			len = appendf(buf, size, len, "\nrtt %u us (var %u), cwnd %u, mss %u, retransmits %u",
+						  info.tcpi_rtt, info.tcpi_rttvar, info.tcpi_snd_cwnd, info.tcpi_snd_mss, info.tcpi_total_retrans);
+
+		return len;
+
+	} //END of transportDump function
+
+
+/** Size value - a non-negative number of bytes or seconds, with an optional K or M suffix
+ *
+ *	Return: The value, or -1 if it is not one
+ */
+	static int sizeValue(char *value){
+		char *end;
+		long n;
+
+		n = strtol(value, &end, 10);
+		if(end == value || n < 0)
+			return -1;
+		if(*end == 'K' || *end == 'k')
+			n <<= 10, end++;
+		else if(*end == 'M' || *end == 'm')
+			n <<= 20, end++;
+
+		return *end != '\0' || n > 1 << 30 ? -1 : n;
+
+	} //END of sizeValue function
+
+
+/** Switch value - 1 for on (or 1), 0 for off (or 0)
+ *
+ *	Return: The value, or -1 if it is neither
+ */
+	static int switchValue(char *value){
+
+		if(strcmp(value, "on") == 0 || strcmp(value, "1") == 0)
+			return 1;
+		if(strcmp(value, "off") == 0 || strcmp(value, "0") == 0)
+			return 0;
+		return -1;
+
+	} //END of switchValue function
+
+
+/** Append - formats onto the text in buf, which is cut short rather than overrun
+ *
+ *	Return: New length of the text
+ */
+	static int appendf(char *buf, int size, int len, char *fmt, ...){
+		va_list ap;
+		int n;
+
+		if(len >= size - 1)
+			return len;
+
+		va_start(ap, fmt);
+		n = vsnprintf(buf + len, size - len, fmt, ap);
+		va_end(ap);
+
+		return n < 0 ? len : (len + n < size ? len + n : size - 1);
+
+	} //END of appendf function
+
+//END of transport.c
@@ -0,0 +1,54 @@
+/* File: transport.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the socket transport profile shared by the client and the server
+ * Changes: 16/10/2026 - Added transport.c/transport.h, socket options from a profile file or flags
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#define TRANSPORT_NAME 16				// Longest congestion control name kept, with its terminator
+
+typedef struct transport {
+	int sndbuf, rcvbuf;					// SO_SNDBUF / SO_RCVBUF bytes, 0 leaves them to the kernel's autotuning
+	int nodelay;						// TCP_NODELAY, small frames leave at once (default on)
+	int cork;							// TCP_CORK while file data is sent, frames leave in full segments (default on)
+	char congestion[TRANSPORT_NAME];	// TCP_CONGESTION algorithm, "" for the system default
+	int keepalive;						// Seconds idle before keepalive probes, 0 for none
+	int keepintvl, keepcnt;				// Seconds between probes, probes before the peer is given up (0: default)
+	int lowat;							// TCP_NOTSENT_LOWAT bytes, 0 for the system default
+} Transport;
+
+/* Change one setting of the profile of this process
+ *
+ *	Pre: setting is "key=value" or "key value". Keys: sndbuf, rcvbuf, nodelay, cork, congestion, keepalive,
+ *		 keepintvl, keepcnt, notsent_lowat. Sizes take a K or M suffix, switches are on or off
+ *	Return: 0, or -1 if the key is unknown or the value does not suit it
+ */
+int transportSet(char *setting);
+
+/* Read a profile file, one setting per line (# starts a comment). Later settings win
+ *
+ *	Return: 0, or -1 after reporting the first line that cannot be used on stderr
+ */
+int transportLoad(char *file);
+
+/* Set the options of the profile on sock. A listening socket passes them on to the sockets it accepts,
+ * buffer sizes only count for the window if they are set before listen() or connect()
+ *
+ *	Post: err names the options the kernel refused, "" if there were none
+ *	Return: Number of options refused
+ */
+int transportApply(int sock, char *err, int size);
+
+/* Cork (on = 1) sock before file data is sent and uncork it afterwards, if the profile corks */
+void transportCork(int sock, int on);
+
+/* The settings sock actually has, read back from the kernel, and its TCP_INFO, one "name value" per line
+ *
+ *	Return: Length of the text in buf
+ */
+int transportDump(int sock, char *buf, int size);
+
+#endif
@@ -0,0 +1,781 @@
+/* File: uring.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: io_uring backend for file transfers. Each transfer owns a few registered buffers and two
+ *			fixed file slots (socket and file). Sending keeps several file reads in flight and sends
+ *			the filled buffers as a linked chain of socket writes; receiving keeps a socket read in
+ *			flight while earlier data is written to the file at known offsets
+ * Changes:
+ * 16/10/2026 - Added uring.c/uring.h (raw system calls, no liburing needed)
+ * 16/10/2026 - Transfers start at a given file offset
+ * 16/10/2026 - Framed receives read no further past the current frame than conn can take back
+ * 16/10/2026 - A compressed data frame ends a receive as a protocol error, callers that compress do not use io_uring
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+// Buffer states
+#define UB_FREE 0		// Unused
+#define UB_READING 1	// Send: file reads in flight
+#define UB_READY 2		// Send: frames built, waiting to be sent
+#define UB_SENDING 3	// Send: socket write in flight
+#define UB_RECEIVING 4	// Receive: socket read in flight
+#define UB_WRITING 5	// Receive: parsed, file writes may be in flight
+
+// Operation kinds, kept in the user data of each submission
+#define OP_FILE 0		// File read (send) or file write (receive)
+#define OP_SOCK 1		// Socket write (send) or socket read (receive)
+
+#define USER_DATA(slot, buf, op, len) (((unsigned long long) (len) << 32) | ((slot) << 16) | ((buf) << 8) | (op))
+
+static struct {
+	int fd;
+	unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+	unsigned *cqhead, *cqtail, *cqmask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned sqentries;
+	unsigned toSubmit;					// Queue entries filled in but not yet submitted
+	int nslots;
+	Xfer *slots[URING_MAX_SLOTS];		// Transfer using each slot, NULL if free
+	Xfer xfers[URING_MAX_SLOTS];
+} ring = { -1 };
+
+static int setupRing(int nslots);
+static struct io_uring_sqe *getSqe(void);
+static int submit(int wait);
+static void complete(struct io_uring_cqe *cqe);
+static void queueOp(Xfer *x, int op, int buf, int fixedFile, char *addr, int len, long long off, int link);
+static void sendFill(Xfer *x);
+static void sendKick(Xfer *x);
+static void sendComplete(Xfer *x, int buf, int op, int res);
+static void recvKick(Xfer *x);
+static void recvComplete(Xfer *x, int buf, int op, int res, int len);
+static void recvParse(Xfer *x, int buf, int start, int n);
+static void frameEnd(Xfer *x);
+static void checkDone(Xfer *x);
+static Xfer *takeSlot(Conn *conn, int fd, void *owner);
+
+
+/** Setup - Creates the ring, registers the buffers and fixed file slots. Halves the number of
+ *			slots until the registered buffers fit in the locked memory limit
+ *
+ *	Return: Number of slots, -1 with errno set when io_uring is not available
+ */
+	int uringSetup(int nslots){
+
+		if(nslots > URING_MAX_SLOTS)
+			nslots = URING_MAX_SLOTS;
+
+		while(nslots >= 1){
+			if(setupRing(nslots) == 0)
+				return nslots;
+			if(errno != ENOMEM)
+				return -1;      // No io_uring in this kernel (ENOSYS) or not allowed (EPERM)
+			nslots /= 2;
+		}
+
+		return -1;
+
+	} //END of uringSetup function
+
+
+/** Setup ring - One attempt at uringSetup with nslots slots
+ *
+ */
+	static int setupRing(int nslots){
+		struct io_uring_params p;
+		struct iovec iov[URING_MAX_SLOTS * URING_DEPTH];
+		int files[URING_MAX_SLOTS * 2];
+		char *sq, *cq, *mem;
+		size_t sqsize, cqsize, sqesize, memsize = (size_t) nslots * URING_DEPTH * URING_BUFSIZE;
+		int i, err;
+
+		memset(&p, 0, sizeof(p));
+		if((ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+			return -1;
+
+		sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+		sqesize = p.sq_entries * sizeof(struct io_uring_sqe);
+		sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+		cq = mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+		ring.sqes = mmap(NULL, sqesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+		mem = mmap(NULL, memsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(sq == MAP_FAILED || cq == MAP_FAILED || ring.sqes == MAP_FAILED || mem == MAP_FAILED)
+			goto fail;
+
+		ring.sqhead = (unsigned *) (sq + p.sq_off.head);
+		ring.sqtail = (unsigned *) (sq + p.sq_off.tail);
+		ring.sqmask = (unsigned *) (sq + p.sq_off.ring_mask);
+		ring.sqarray = (unsigned *) (sq + p.sq_off.array);
+		ring.cqhead = (unsigned *) (cq + p.cq_off.head);
+		ring.cqtail = (unsigned *) (cq + p.cq_off.tail);
+		ring.cqmask = (unsigned *) (cq + p.cq_off.ring_mask);
+		ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+		ring.sqentries = p.sq_entries;
+		ring.toSubmit = 0;
+
+		// Buffers are pinned once here instead of on every operation
+		for(i = 0; i < nslots * URING_DEPTH; i++){
+			iov[i].iov_base = mem + (size_t) i * URING_BUFSIZE;
+			iov[i].iov_len = URING_BUFSIZE;
+		}
+		if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iov, nslots * URING_DEPTH) < 0)
+			goto fail;
+
+		// Two sparse fixed file slots per transfer, filled in when a transfer starts
+		for(i = 0; i < nslots * 2; i++)
+			files[i] = -1;
+		if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES, files, nslots * 2) < 0)
+			goto fail;
+
+		for(i = 0; i < nslots; i++){
+			ring.slots[i] = NULL;
+			ring.xfers[i].slot = i;
+		}
+		for(i = 0; i < nslots * URING_DEPTH; i++)
+			ring.xfers[i / URING_DEPTH].bufs[i % URING_DEPTH].base = iov[i].iov_base;
+		ring.nslots = nslots;
+
+		return 0;
+
+	fail:
+		err = errno;
+		if(sq != MAP_FAILED)
+			munmap(sq, sqsize);
+		if(cq != MAP_FAILED)
+			munmap(cq, cqsize);
+		if(ring.sqes != MAP_FAILED)
+			munmap(ring.sqes, sqesize);
+		if(mem != MAP_FAILED)
+			munmap(mem, memsize);
+		close(ring.fd);
+		ring.fd = -1;
+		errno = err;
+		return -1;
+
+	} //END of setupRing function
+
+
+/** Ring fd - descriptor to watch for completions
+ *
+ */
+	int uringFd(void){
+
+		return ring.fd;
+
+	} //END of uringFd function
+
+
+/** Active - whether the backend is set up in this process
+ *
+ */
+	int uringActive(void){
+
+		return ring.fd >= 0;
+
+	} //END of uringActive function
+
+
+/** Take slot - claims a free slot and installs the socket and file as its fixed files
+ *
+ *	Return: Transfer reset to its initial state, NULL if every slot is in use
+ */
+	static Xfer *takeSlot(Conn *conn, int fd, void *owner){
+		struct io_uring_files_update upd;
+		int files[2], i;
+		Xfer *x;
+
+		if(ring.fd < 0)
+			return NULL;
+		for(i = 0; i < ring.nslots && ring.slots[i] != NULL; i++)
+			;
+		if(i == ring.nslots)
+			return NULL;
+
+		files[0] = conn->fd;
+		files[1] = fd;
+		memset(&upd, 0, sizeof(upd));
+		upd.offset = i * 2;
+		upd.fds = (unsigned long) files;
+		if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES_UPDATE, &upd, 2) < 0)
+			return NULL;
+
+		x = &ring.xfers[i];
+		x->conn = conn;
+		x->fd = fd;
+		x->owner = owner;
+		x->lastframe = -1;
+		x->needterm = 0;
+		x->fileoff = 0;
+		x->inflight = x->sendsinflight = 0;
+		x->fillnext = x->sendnext = 0;
+		x->recvbuf = -1;
+		x->hdrhave = 0;
+		x->frameleft = 0;
+		x->flags = 0;
+		x->ended = x->failed = x->broken = x->done = x->reported = 0;
+		x->bytes = 0;
+		for(i = 0; i < URING_DEPTH; i++){
+			x->bufs[i].state = UB_FREE;
+			x->bufs[i].pending = 0;
+		}
+		ring.slots[x->slot] = x;
+
+		return x;
+
+	} //END of takeSlot function
+
+
+/** Start send - see uring.h
+ *
+ */
+	Xfer *uringStartSend(Conn *conn, int fd, long long offset, long long size, int version, int frame, int checksum, void *owner){
+		Xfer *x;
+
+		if(connflush(conn) < 0 || (x = takeSlot(conn, fd, owner)) == NULL)
+			return NULL;
+
+		x->sending = 1;
+		x->version = version;
+		x->hsize = version == XFER_RAW ? 0 : (version == 2 ? V2_HDR_SIZE : 2);
+		x->frame = version == XFER_RAW || frame > URING_BUFSIZE - x->hsize ? URING_BUFSIZE - x->hsize : frame;
+		x->checksum = version == 2 && checksum;
+		x->left = size;
+		x->fileoff = offset;
+		x->needterm = version == 1 || (version == 2 && size == 0);
+
+		sendFill(x);
+		sendKick(x);
+		submit(0);
+		checkDone(x);
+
+		return x;
+
+	} //END of uringStartSend function
+
+
+/** Start receive - see uring.h
+ *
+ */
+	Xfer *uringStartRecv(Conn *conn, int fd, long long offset, int version, int maxframe, long long size, void *owner){
+		Xfer *x;
+		int n;
+
+		if((x = takeSlot(conn, fd, owner)) == NULL)
+			return NULL;
+
+		x->sending = 0;
+		x->version = version;
+		x->hsize = version == XFER_RAW ? 0 : (version == 2 ? V2_HDR_SIZE : 2);
+		x->frame = maxframe;
+		x->left = size;
+		x->fileoff = offset;
+		x->ended = version == XFER_RAW && size == 0;
+
+		// Whatever the connection already read ahead is the start of the data
+		if(!x->ended && (n = conntake(conn, x->bufs[0].base, URING_BUFSIZE)) > 0){
+			x->bufs[0].state = UB_WRITING;
+			recvParse(x, 0, 0, n);
+			if(x->bufs[0].pending == 0)
+				x->bufs[0].state = UB_FREE;
+		}
+
+		recvKick(x);
+		submit(0);
+		checkDone(x);
+
+		return x;
+
+	} //END of uringStartRecv function
+
+
+/** Reap - see uring.h
+ *
+ */
+	int uringReap(Xfer **done, int max, int wait){
+		unsigned head, tail;
+		int i, n = 0;
+
+		if(ring.fd < 0)
+			return 0;
+
+		head = *ring.cqhead;
+		tail = __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE);
+		submit(wait && head == tail);
+
+		// Completions may queue new operations, which are submitted together below
+		while(head != (tail = __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE))){
+			while(head != tail){
+				complete(&ring.cqes[head & *ring.cqmask]);
+				head++;
+			}
+			__atomic_store_n(ring.cqhead, head, __ATOMIC_RELEASE);
+		}
+		submit(0);
+
+		for(i = 0; i < ring.nslots; i++)
+			if(ring.slots[i] != NULL && ring.slots[i]->done && !ring.slots[i]->reported && n < max){
+				ring.slots[i]->reported = 1;
+				if(done != NULL)
+					done[n] = ring.slots[i];
+				n++;
+			}
+
+		return n;
+
+	} //END of uringReap function
+
+
+/** Wait - blocks until one transfer has finished (others progress meanwhile)
+ *
+ */
+	void uringWait(Xfer *x){
+
+		while(!x->done)
+			uringReap(NULL, 0, 1);
+
+	} //END of uringWait function
+
+
+/** Finish - see uring.h
+ *
+ */
+	int uringFinish(Xfer *x){
+		struct io_uring_files_update upd;
+		int files[2] = {-1, -1};
+
+		memset(&upd, 0, sizeof(upd));
+		upd.offset = x->slot * 2;
+		upd.fds = (unsigned long) files;
+		syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES_UPDATE, &upd, 2);
+		ring.slots[x->slot] = NULL;
+
+		if(x->broken)
+			return -1;
+		return x->failed ? -2 : 0;
+
+	} //END of uringFinish function
+
+
+/** Get submission queue entry - next free entry, submitting queued entries if the queue is full
+ *
+ */
+	static struct io_uring_sqe *getSqe(void){
+		unsigned tail = *ring.sqtail;
+		struct io_uring_sqe *sqe;
+
+		if(tail - __atomic_load_n(ring.sqhead, __ATOMIC_ACQUIRE) == ring.sqentries)
+			submit(0);
+
+		sqe = &ring.sqes[tail & *ring.sqmask];
+		memset(sqe, 0, sizeof(*sqe));
+		ring.sqarray[tail & *ring.sqmask] = tail & *ring.sqmask;
+		__atomic_store_n(ring.sqtail, tail + 1, __ATOMIC_RELEASE);
+		ring.toSubmit++;
+
+		return sqe;
+
+	} //END of getSqe function
+
+
+/** Submit - hands queued entries to the kernel, optionally waiting for one completion
+ *
+ *	Return: io_uring_enter result
+ */
+	static int submit(int wait){
+		int n;
+
+		if(ring.toSubmit == 0 && !wait)
+			return 0;
+
+		do {
+			n = syscall(__NR_io_uring_enter, ring.fd, ring.toSubmit, wait ? 1 : 0,
+						wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		} while(n < 0 && errno == EINTR);
+
+		if(n > 0)
+			ring.toSubmit -= n < ring.toSubmit ? n : ring.toSubmit;
+
+		return n;
+
+	} //END of submit function
+
+
+/** Queue operation - fills in one read or write on a registered buffer
+ *
+ *	Pre: fixedFile is 0 for the socket, 1 for the file of the transfer
+ *	Post: Entry queued, submitted on the next submit(). link = 1 makes the next entry wait for this one
+ */
+	static void queueOp(Xfer *x, int op, int buf, int fixedFile, char *addr, int len, long long off, int link){
+		struct io_uring_sqe *sqe = getSqe();
+		int write = x->sending == (op == OP_SOCK);
+
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->flags = IOSQE_FIXED_FILE | (link ? IOSQE_IO_LINK : 0);
+		sqe->fd = x->slot * 2 + fixedFile;
+		sqe->addr = (unsigned long) addr;
+		sqe->len = len;
+		sqe->off = off;
+		sqe->buf_index = x->slot * URING_DEPTH + buf;
+		sqe->user_data = USER_DATA(x->slot, buf, op, len);
+
+		x->inflight++;
+		x->bufs[buf].pending++;
+
+	} //END of queueOp function
+
+
+/** Complete - routes one completion to its transfer
+ *
+ */
+	static void complete(struct io_uring_cqe *cqe){
+		unsigned long long ud = cqe->user_data;
+		int slot = (ud >> 16) & 0xff, buf = (ud >> 8) & 0xff, op = ud & 0xff, len = ud >> 32;
+		Xfer *x = ring.slots[slot];
+
+		if(x == NULL)
+			return;
+
+		x->inflight--;
+		x->bufs[buf].pending--;
+
+		if(x->sending)
+			sendComplete(x, buf, op, cqe->res);
+		else
+			recvComplete(x, buf, op, cqe->res, len);
+
+		checkDone(x);
+
+	} //END of complete function
+
+
+/** Send fill - builds frames in every free buffer, in rotation. Headers are written now and the
+ *				file reads for their payloads are queued; the CRC-32 is filled in when they complete
+ *
+ */
+	static void sendFill(Xfer *x){
+		UringBuf *b;
+		FrameHeader fh;
+		int n, pos;
+
+		while(!x->broken && (x->left > 0 || x->needterm) && x->bufs[x->fillnext].state == UB_FREE){
+			b = &x->bufs[x->fillnext];
+			b->expect = b->got = 0;
+			pos = 0;
+
+			// Whole frames only - a v1 receiver stops at the first short one
+			while(x->left > 0){
+				n = x->left < x->frame ? x->left : x->frame;
+				if(pos + x->hsize + n > URING_BUFSIZE)
+					break;
+
+				if(x->version == 2){
+					fh.type = FT_DATA;
+					fh.flags = (n == x->left ? FF_EOF : 0) | (x->checksum ? FF_CHECKSUM : 0);
+					fh.tag = 0;
+					fh.length = n;
+					fh.crc = 0;
+					packheader(b->base + pos, &fh);
+				} else if(x->version == 1){
+					b->base[pos] = n >> 8;
+					b->base[pos + 1] = n & 0xff;
+				}
+
+				queueOp(x, OP_FILE, x->fillnext, 1, b->base + pos + x->hsize, n, x->fileoff, 0);
+				x->fileoff += n;
+				x->left -= n;
+				x->lastframe = n;
+				b->expect += n;
+				pos += x->hsize + n;
+			}
+
+			// v1 needs an empty frame after a full last frame (or for an empty file), v2 only for an empty file
+			if(x->left == 0 && x->needterm){
+				if(x->version == 1 && x->lastframe >= 0 && x->lastframe < MAX_BLOCK_SIZE-2)
+					x->needterm = 0;
+				else if(pos + x->hsize <= URING_BUFSIZE){
+					memset(b->base + pos, 0, x->hsize);
+					if(x->version == 2){
+						fh.type = FT_DATA;
+						fh.flags = FF_EOF;
+						fh.tag = 0;
+						fh.length = fh.crc = 0;
+						packheader(b->base + pos, &fh);
+					}
+					pos += x->hsize;
+					x->needterm = 0;
+				}
+			}
+
+			b->len = pos;
+			b->off = 0;
+			b->state = b->pending > 0 ? UB_READING : UB_READY;
+			x->fillnext = (x->fillnext + 1) % URING_DEPTH;
+		}
+
+	} //END of sendFill function
+
+
+/** Send kick - sends every ready buffer, in order, as one linked chain of socket writes.
+ *				A new chain starts only when the previous one has completed, so writes never overtake
+ *
+ */
+	static void sendKick(Xfer *x){
+		UringBuf *b;
+		int i, n, buf;
+
+		if(x->sendsinflight > 0 || x->broken)
+			return;
+
+		for(n = 0; n < URING_DEPTH && x->bufs[(x->sendnext + n) % URING_DEPTH].state == UB_READY; n++)
+			;
+
+		for(i = 0; i < n; i++){
+			buf = (x->sendnext + i) % URING_DEPTH;
+			b = &x->bufs[buf];
+			b->state = UB_SENDING;
+			queueOp(x, OP_SOCK, buf, 0, b->base + b->off, b->len - b->off, -1, i < n - 1);
+			x->sendsinflight++;
+		}
+
+	} //END of sendKick function
+
+
+/** Send complete - a file read filled part of a buffer, or a socket write finished
+ *
+ */
+	static void sendComplete(Xfer *x, int buf, int op, int res){
+		UringBuf *b = &x->bufs[buf];
+		FrameHeader fh;
+		int pos;
+
+		if(op == OP_FILE){
+			if(res < 0)
+				x->broken = 1;
+			else
+				b->got += res;
+			if(b->pending > 0)
+				return;
+
+			if(b->got != b->expect)
+				x->broken = 1;      // Read error or file shrank, the frames cannot be completed
+			else if(x->checksum){
+				for(pos = 0; pos < b->len; pos += V2_HDR_SIZE + fh.length){
+					unpackheader(b->base + pos, &fh);
+					fh.crc = crc32buf(0, b->base + pos + V2_HDR_SIZE, fh.length);
+					packheader(b->base + pos, &fh);
+				}
+			}
+			b->state = UB_READY;
+		} else {
+			x->sendsinflight--;
+			if(res == -ECANCELED)
+				b->state = UB_READY;    // An earlier write in the chain was short, send again
+			else if(res <= 0)
+				x->broken = 1;
+			else if((b->off += res) < b->len)
+				b->state = UB_READY;    // Short write, the rest goes in the next chain
+			else {
+				b->state = UB_FREE;
+				x->bytes += b->expect;
+				x->sendnext = (x->sendnext + 1) % URING_DEPTH;
+			}
+		}
+
+		sendFill(x);
+		sendKick(x);
+
+	} //END of sendComplete function
+
+
+/** Receive kick - starts the next socket read into a free buffer
+ *
+ */
+	static void recvKick(Xfer *x){
+		int i, want = URING_BUFSIZE;
+		long long ahead;
+
+		if(x->recvbuf >= 0 || x->ended || x->broken)
+			return;
+
+		for(i = 0; i < URING_DEPTH && x->bufs[i].state != UB_FREE; i++)
+			;
+		if(i == URING_DEPTH)
+			return;     // Every buffer still being written to the file
+
+		// A raw stream never reads past its end. Framed data may, the bytes after the last frame go
+		// back to conn - read no further than the current frame plus what conn has room for
+		if(x->version == XFER_RAW){
+			if(x->left < want)
+				want = x->left;
+		} else {
+			ahead = x->hdrhave < x->hsize ? x->hsize - x->hdrhave : x->frameleft;
+			ahead += CONN_RBUF - (x->conn->rlen - x->conn->rpos);
+			if(ahead < want)
+				want = ahead;
+		}
+
+		x->bufs[i].state = UB_RECEIVING;
+		x->recvbuf = i;
+		queueOp(x, OP_SOCK, i, 0, x->bufs[i].base, want, -1, 0);
+
+	} //END of recvKick function
+
+
+/** Receive complete - a socket read brought data, or a file write finished
+ *
+ */
+	static void recvComplete(Xfer *x, int buf, int op, int res, int len){
+		UringBuf *b = &x->bufs[buf];
+
+		if(op == OP_SOCK){
+			x->recvbuf = -1;
+			if(res <= 0)
+				x->broken = 1;      // Connection closed or failed
+			else {
+				b->state = UB_WRITING;
+				recvParse(x, buf, 0, res);
+			}
+		} else if(res != len)
+			x->failed = 1;      // File write failed, keep reading to stay in step with the peer
+
+		if(b->pending == 0 && (b->state == UB_WRITING || b->state == UB_RECEIVING))
+			b->state = UB_FREE;
+
+		recvKick(x);
+
+	} //END of recvComplete function
+
+
+/** Receive parse - walks frame headers in received bytes and queues file writes for the payloads
+ *
+ *	Post: Bytes after the last frame of the file are appended to the connection's read-ahead buffer
+ */
+	static void recvParse(Xfer *x, int buf, int start, int n){
+		char *data = x->bufs[buf].base;
+		FrameHeader fh;
+		int pos = start, k;
+		long long seg;
+		Conn *c = x->conn;
+
+		while(pos < n && !x->ended && !x->broken){
+			if(x->version != XFER_RAW && x->hdrhave < x->hsize){
+				k = x->hsize - x->hdrhave < n - pos ? x->hsize - x->hdrhave : n - pos;
+				memcpy(x->hdr + x->hdrhave, data + pos, k);
+				x->hdrhave += k;
+				pos += k;
+				if(x->hdrhave < x->hsize)
+					break;
+
+				if(x->version == 2)
+					unpackheader(x->hdr, &fh);
+				else {
+					fh.type = FT_DATA;
+					fh.flags = 0;
+					fh.length = ((unsigned char) x->hdr[0] << 8) | (unsigned char) x->hdr[1];
+					fh.crc = 0;
+				}
+				if(fh.type != FT_DATA || fh.length > x->frame || (fh.flags & FF_PACKED)){
+					x->broken = 1;      // Not a data frame this side can accept (compressed ones are decoded by the caller)
+					break;
+				}
+				x->frameleft = x->framelen = fh.length;
+				x->flags = fh.flags;
+				x->expectcrc = fh.crc;
+				x->crc = 0;
+				if(x->frameleft == 0)
+					frameEnd(x);
+				continue;
+			}
+
+			seg = x->version == XFER_RAW ? x->left : x->frameleft;
+			if(seg > n - pos)
+				seg = n - pos;
+			if(x->flags & FF_CHECKSUM)
+				x->crc = crc32buf(x->crc, data + pos, seg);
+			if(x->fd >= 0)
+				queueOp(x, OP_FILE, buf, 1, data + pos, seg, x->fileoff, 0);
+			x->fileoff += seg;
+			x->bytes += seg;
+			pos += seg;
+
+			if(x->version == XFER_RAW){
+				if((x->left -= seg) == 0)
+					x->ended = 1;
+			} else if((x->frameleft -= seg) == 0)
+				frameEnd(x);
+		}
+
+		// Start of whatever the peer sent next (e.g. the next command) belongs to the connection
+		if(x->ended && pos < n){
+			if(c->rpos > 0){
+				memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+				c->rlen -= c->rpos;
+				c->rpos = 0;
+			}
+			if(n - pos > CONN_RBUF - c->rlen)
+				x->broken = 1;
+			else {
+				memcpy(c->rbuf + c->rlen, data + pos, n - pos);
+				c->rlen += n - pos;
+			}
+		}
+
+	} //END of recvParse function
+
+
+/** Frame end - checks a completed receive frame and decides whether it was the last
+ *
+ */
+	static void frameEnd(Xfer *x){
+
+		x->hdrhave = 0;
+
+		if(x->version == 2){
+			if((x->flags & FF_CHECKSUM) && x->crc != x->expectcrc)
+				x->failed = 1;
+			if(x->flags & FF_ERROR)
+				x->failed = 1;
+			if(x->flags & FF_EOF)
+				x->ended = 1;
+		} else if(x->framelen < MAX_BLOCK_SIZE-2)
+			x->ended = 1;       // v1 ends at the first short frame
+
+	} //END of frameEnd function
+
+
+/** Check done - marks a transfer done once it has nothing left to do and nothing in flight
+ *
+ */
+	static void checkDone(Xfer *x){
+		int i;
+
+		if(x->inflight > 0 || x->done)
+			return;
+
+		if(!x->broken){
+			if(x->sending && (x->left > 0 || x->needterm))
+				return;
+			if(!x->sending && !x->ended)
+				return;
+			for(i = 0; i < URING_DEPTH; i++)
+				if(x->bufs[i].state != UB_FREE)
+					return;
+		}
+
+		x->done = 1;
+
+	} //END of checkDone function
+
+//END of uring.c
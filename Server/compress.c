@@ -0,0 +1,388 @@
+/* File: compress.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Per-frame compression of file data. Each data frame is compressed on its own (zlib raw
+ *			deflate, or a small LZ77 codec writing the LZ4 block format), so memory stays at one frame
+ *			per transfer and a frame decodes without the ones before it
+ * Changes:
+ * 16/10/2026 - Added compress.c/compress.h
+ */
+
+#include  <stdio.h>
+#include  <stdlib.h>
+#include  <string.h>
+#include  <time.h>
+#include  "stream.h"
+#include  "compress.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5         /* a match never reaches the last bytes of a frame */
+#define LZ_HASH_BITS 13
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH(seq) (((seq) * 2654435761U) >> (32 - LZ_HASH_BITS))
+
+static int compressbuf(Packer *p, char *src, int n, int cap);
+static int lzpack(unsigned char *src, int n, unsigned char *dst, int cap);
+static int lzunpack(unsigned char *src, int n, unsigned char *dst, int cap);
+static int lzlength(unsigned char *dst, int op, int cap, int len);
+static int growbuf(Packer *p, int size);
+static double cputime(void);
+
+
+/*
+ * Set up a packer that does not compress.
+ */
+void packinit(Packer *p){
+
+    memset(p, 0, sizeof(Packer));
+    p->codec = CODEC_NONE;
+}
+
+
+/*
+ * Release the buffers and zlib streams of a packer.
+ */
+void packfree(Packer *p){
+    int codec = p->codec;
+
+    if (p->zready & 1)
+        deflateEnd(&p->def);
+    if (p->zready & 2)
+        inflateEnd(&p->inf);
+    free(p->buf);
+    packinit(p);
+    p->codec = codec;
+}
+
+
+/*
+ * Codec named "zlib", "lz" or "none".
+ */
+int packcodec(char *name){
+
+    if (strcmp(name, "zlib") == 0)
+        return (CODEC_ZLIB);
+    if (strcmp(name, "lz") == 0)
+        return (CODEC_LZ);
+    if (strcmp(name, "none") == 0)
+        return (CODEC_NONE);
+    return (-1);
+}
+
+
+/*
+ * Name of a codec.
+ */
+char *packname(int codec){
+
+    return (codec == CODEC_ZLIB ? "zlib" : codec == CODEC_LZ ? "lz" : "none");
+}
+
+
+/*
+ * Compress a data frame in place, if that is worth it.
+ */
+int pack(Packer *p, char *data, int n, int *flags){
+    int m = -1, want;
+    double start;
+
+    *flags = 0;
+    p->frames++;
+    p->rawbytes += n;
+    p->wirebytes += n;
+
+    if (p->codec == CODEC_NONE || n < LZ_MIN_MATCH + LZ_LAST_LITERALS || n > PACK_FRAME)
+        return (n);
+    if (p->skip > 0) {
+        p->skip--;     /* recent data did not compress, send this frame as it is */
+        return (n);
+    }
+    if (growbuf(p, n) < 0)
+        return (n);
+
+    start = cputime();
+
+    /* a sample from the middle of a large frame shows whether the rest is worth the CPU */
+    want = PACK_SAMPLE - PACK_SAMPLE * PACK_MIN_SAVING / 100;
+    if (n < 4 * PACK_SAMPLE ||
+        compressbuf(p, data + n / 2 - PACK_SAMPLE / 2, PACK_SAMPLE, want) >= 0)
+        m = compressbuf(p, data, n, n - n * PACK_MIN_SAVING / 100);
+
+    if (m < 0) {
+        /* back off: 1, 2, 4 ... frames go out as they are before trying again */
+        p->backoff = p->backoff == 0 ? 1 : p->backoff * 2 > PACK_MAX_SKIP ? PACK_MAX_SKIP : p->backoff * 2;
+        p->skip = p->backoff;
+    } else {
+        p->backoff = 0;
+        memcpy(data, p->buf, m);
+        *flags = p->codec == CODEC_ZLIB ? FF_ZLIB : FF_LZ;
+        p->packed++;
+        p->wirebytes -= n - m;
+    }
+
+    p->cpu += cputime() - start;
+    return (m < 0 ? n : m);
+}
+
+
+/*
+ * Decompress the payload of a data frame.
+ */
+int unpack(Packer *p, int flags, char *data, int n, char **out){
+    int m = -1, cap = PACK_FRAME;
+    double start;
+
+    p->frames++;
+    p->wirebytes += n;
+    *out = data;
+
+    if (!(flags & FF_PACKED)) {
+        p->rawbytes += n;
+        return (n);
+    }
+    if (growbuf(p, cap) < 0)
+        return (-1);
+
+    start = cputime();
+    if (flags & FF_LZ)
+        m = lzunpack((unsigned char *) data, n, (unsigned char *) p->buf, cap);
+    else {
+        if (!(p->zready & 2)) {
+            memset(&p->inf, 0, sizeof(z_stream));
+            if (inflateInit2(&p->inf, -15) != Z_OK)
+                return (-1);
+            p->zready |= 2;
+        } else
+            inflateReset(&p->inf);
+        p->inf.next_in = (unsigned char *) data;
+        p->inf.avail_in = n;
+        p->inf.next_out = (unsigned char *) p->buf;
+        p->inf.avail_out = cap;
+        if (inflate(&p->inf, Z_FINISH) == Z_STREAM_END && p->inf.avail_in == 0)
+            m = cap - p->inf.avail_out;
+    }
+    p->cpu += cputime() - start;
+
+    if (m < 0)
+        return (-1);
+    p->packed++;
+    p->rawbytes += m;
+    *out = p->buf;
+    return (m);
+}
+
+
+/*
+ * Describe the compression since the last call and start counting again.
+ */
+int packstats(Packer *p, char *buf, int size){
+    int shown = p->rawbytes > 0 && (p->codec != CODEC_NONE || p->packed > 0);
+
+    if (shown)
+        snprintf(buf, size, "%s: %lld -> %lld bytes (ratio %.2f), %ld of %ld frames compressed, %.1f ms CPU",
+                 packname(p->codec), p->rawbytes, p->wirebytes,
+                 p->wirebytes > 0 ? (double) p->rawbytes / p->wirebytes : 1.0, p->packed, p->frames, p->cpu * 1000);
+    p->rawbytes = p->wirebytes = 0;
+    p->frames = p->packed = 0;
+    p->cpu = 0;
+    p->skip = p->backoff = 0;
+    return (shown);
+}
+
+
+/*
+ * Compress n bytes from src into the scratch buffer with the packer's codec.
+ * Returns the compressed size, or -1 if it would be more than cap bytes.
+ */
+static int compressbuf(Packer *p, char *src, int n, int cap){
+
+    if (p->codec == CODEC_LZ)
+        return (lzpack((unsigned char *) src, n, (unsigned char *) p->buf, cap));
+
+    if (!(p->zready & 1)) {
+        memset(&p->def, 0, sizeof(z_stream));
+        if (deflateInit2(&p->def, PACK_ZLIB_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return (-1);
+        p->zready |= 1;
+    } else
+        deflateReset(&p->def);
+
+    p->def.next_in = (unsigned char *) src;
+    p->def.avail_in = n;
+    p->def.next_out = (unsigned char *) p->buf;
+    p->def.avail_out = cap;
+    if (deflate(&p->def, Z_FINISH) != Z_STREAM_END)
+        return (-1);     /* output did not fit in cap */
+    return (cap - p->def.avail_out);
+}
+
+
+/*
+ * LZ77 in the LZ4 block format: sequences of a token (literal count << 4 | match length - 4),
+ * extra length bytes of 255 when a count reaches 15, the literals, a 2 byte little endian
+ * offset back into the output and the match length extension. The last sequence has
+ * literals only. Matches are found through a hash table of 4 byte prefixes, and the search
+ * steps faster the longer it goes without a match, so incompressible data passes quickly.
+ * Returns the compressed size, or -1 if it would be more than cap bytes.
+ */
+static int lzpack(unsigned char *src, int n, unsigned char *dst, int cap){
+    static int table[1 << LZ_HASH_BITS];
+    int i = 0, anchor = 0, ref, len, lit, op = 0, limit = n - LZ_LAST_LITERALS;
+    unsigned int seq, old;
+    unsigned long long a, b;
+
+    memset(table, 0xff, sizeof(table));     /* -1: no position */
+
+    while (i + LZ_MIN_MATCH <= limit) {
+        memcpy(&seq, src + i, 4);
+        ref = table[LZ_HASH(seq)];
+        table[LZ_HASH(seq)] = i;
+        if (ref >= 0)
+            memcpy(&old, src + ref, 4);
+        if (ref < 0 || i - ref > LZ_MAX_OFFSET || old != seq) {
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        /* extend the match 8 bytes at a time, the first differing byte ends it */
+        for (len = LZ_MIN_MATCH; i + len + 8 <= limit; len += 8) {
+            memcpy(&a, src + ref + len, 8);
+            memcpy(&b, src + i + len, 8);
+            if (a != b)
+                break;
+        }
+        while (i + len < limit && src[ref + len] == src[i + len])
+            len++;
+
+        lit = i - anchor;
+        if (op + 1 + lit / 255 + 1 + lit + 2 > cap)
+            return (-1);
+        dst[op++] = (lit < 15 ? lit : 15) << 4 | (len - LZ_MIN_MATCH < 15 ? len - LZ_MIN_MATCH : 15);
+        if (lit >= 15)
+            op = lzlength(dst, op, cap, lit - 15);
+        memcpy(dst + op, src + anchor, lit);
+        op += lit;
+        dst[op++] = (i - ref) & 0xff;
+        dst[op++] = (i - ref) >> 8;
+        if (len - LZ_MIN_MATCH >= 15 && (op = lzlength(dst, op, cap, len - LZ_MIN_MATCH - 15)) < 0)
+            return (-1);
+
+        i += len;
+        anchor = i;
+        if (i - 2 + LZ_MIN_MATCH <= limit) {
+            memcpy(&seq, src + i - 2, 4);     /* later data often repeats what follows this match */
+            table[LZ_HASH(seq)] = i - 2;
+        }
+    }
+
+    /* last literals */
+    lit = n - anchor;
+    if (op + 1 + lit / 255 + 1 + lit > cap)
+        return (-1);
+    dst[op++] = (lit < 15 ? lit : 15) << 4;
+    if (lit >= 15)
+        op = lzlength(dst, op, cap, lit - 15);
+    memcpy(dst + op, src + anchor, lit);
+
+    return (op + lit);
+}
+
+
+/*
+ * Append a length extension (bytes of 255, then the rest). Returns the new output
+ * position, or -1 if it would pass cap.
+ */
+static int lzlength(unsigned char *dst, int op, int cap, int len){
+
+    for (; len >= 255; len -= 255) {
+        if (op >= cap)
+            return (-1);
+        dst[op++] = 255;
+    }
+    if (op >= cap)
+        return (-1);
+    dst[op++] = len;
+    return (op);
+}
+
+
+/*
+ * Decode an LZ block, checking every length and offset against both buffers.
+ * Returns the decoded size, or -1 if the block is damaged or decodes to more than cap bytes.
+ */
+static int lzunpack(unsigned char *src, int n, unsigned char *dst, int cap){
+    int ip = 0, op = 0, lit, len, off, k;
+    unsigned char token, b;
+
+    while (ip < n) {
+        token = src[ip++];
+
+        lit = token >> 4;
+        if (lit == 15)
+            do {
+                if (ip >= n)
+                    return (-1);
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        if (lit > n - ip || lit > cap - op)
+            return (-1);
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n)
+            break;     /* the last sequence has no match */
+
+        if (n - ip < 2)
+            return (-1);
+        off = src[ip] | src[ip + 1] << 8;
+        ip += 2;
+        len = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15)
+            do {
+                if (ip >= n)
+                    return (-1);
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        if (off == 0 || off > op || len > cap - op)
+            return (-1);
+
+        /* the match may overlap the bytes it produces (a run), copy forwards */
+        if (off >= len)
+            memcpy(dst + op, dst + op - off, len);
+        else
+            for (k = 0; k < len; k++)
+                dst[op + k] = dst[op + k - off];
+        op += len;
+    }
+
+    return (op);
+}
+
+
+/*
+ * Make the scratch buffer at least size bytes.
+ */
+static int growbuf(Packer *p, int size){
+    char *b;
+
+    if (p->bufsize >= size)
+        return (0);
+    if ((b = realloc(p->buf, size)) == NULL)
+        return (-1);
+    p->buf = b;
+    p->bufsize = size;
+    return (0);
+}
+
+
+/*
+ * CPU time used by this thread, in seconds.
+ */
+static double cputime(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
@@ -0,0 +1,613 @@
+/* File: delta.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Delta transfer of changed files. The old copy is signed block by block, the new copy is
+ *			searched for those blocks with a rolling sum, and only the bytes that changed are sent
+ * Changes:
+ * 16/10/2026 - Added delta.c/delta.h
+ */
+
+#include  <stdio.h>
+#include  <stdlib.h>
+#include  <string.h>
+#include  <unistd.h>
+#include  <errno.h>
+#include  "stream.h"
+#include  "delta.h"
+
+#if defined(__SSE2__)
+#include  <emmintrin.h>
+#endif
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+#define BUCKET(d, w) ((unsigned int) ((w) * 2654435761U) >> (32 - (d)->bits))
+
+static void weaksum(unsigned char *p, int n, unsigned int *sa, unsigned int *sb);
+static unsigned long long strongsum(unsigned char *p, int n);
+static unsigned long long xxround(unsigned long long acc, unsigned long long input);
+static unsigned long long get64le(unsigned char *p);
+static int buildindex(Delta *d);
+static long findblock(Delta *d, unsigned int w);
+static int refill(Delta *d);
+static int putliteral(Delta *d, unsigned char *out, int len);
+static int putrun(Delta *d, unsigned char *out);
+static int copyblocks(Delta *d, long block, long count);
+static int readfull(int fd, char *buf, int n, long long offset);
+static int writefull(int fd, char *buf, int n);
+static void put32(unsigned char *p, unsigned int v);
+static unsigned int get32(unsigned char *p);
+
+
+/*
+ * Block size for an old copy of size bytes.
+ */
+int deltablocksize(long long size){
+    int bs = DELTA_MIN_BLOCK;
+
+    /* about the square root, a multiple of 64: signatures and literal bytes grow alike */
+    while (bs < DELTA_MAX_BLOCK && (long long) bs * bs < size)
+        bs += 64;
+    return (bs);
+}
+
+
+/*
+ * Set up a delta transfer.
+ */
+int deltainit(Delta *d, int fd, int out, int blocksize, long blocks){
+
+    memset(d, 0, sizeof(Delta));
+    d->fd = fd;
+    d->out = out;
+    d->blocksize = blocksize;
+    d->blocks = blocks;
+    if (blocksize < DELTA_MIN_BLOCK || blocksize > DELTA_MAX_BLOCK || blocks < 0 || blocks > DELTA_MAX_BLOCKS)
+        return (-1);
+    return (0);
+}
+
+
+/*
+ * Close the files of a delta transfer and release its memory.
+ */
+void deltafree(Delta *d){
+
+    if (d->fd >= 0)
+        close(d->fd);
+    if (d->out >= 0)
+        close(d->out);
+    d->fd = d->out = -1;
+    free(d->weak);
+    free(d->strong);
+    free(d->head);
+    free(d->chain);
+    free(d->buf);
+    d->weak = NULL;
+    d->strong = NULL;
+    d->head = d->chain = NULL;
+    d->buf = NULL;
+}
+
+
+/*
+ * Sign the next blocks of the old copy.
+ */
+int deltasign(Delta *d, char *out, int room){
+    unsigned char *p, *o;
+    unsigned long long s;
+    unsigned int a, b;
+    long n, i;
+
+    n = room / DELTA_SIG_SIZE;
+    if (n > d->blocks - d->next)
+        n = d->blocks - d->next;
+    if (n > DELTA_READ / d->blocksize)
+        n = DELTA_READ / d->blocksize;
+
+    if (d->buf == NULL && (d->buf = malloc(DELTA_READ)) == NULL)
+        return (-1);
+    if (n > 0 && readfull(d->fd, d->buf, n * d->blocksize, (long long) d->next * d->blocksize) < 0)
+        return (-1);
+
+    for (i = 0; i < n; i++) {
+        p = (unsigned char *) d->buf + i * d->blocksize;
+        o = (unsigned char *) out + i * DELTA_SIG_SIZE;
+        weaksum(p, d->blocksize, &a, &b);
+        s = strongsum(p, d->blocksize);
+        put32(o, (a & 0xffff) | b << 16);
+        put32(o + 4, (unsigned int) (s >> 32));
+        put32(o + 8, (unsigned int) s);
+    }
+
+    d->next += n;
+    d->done = d->next == d->blocks;
+    return (n * DELTA_SIG_SIZE);
+}
+
+
+/*
+ * Take signatures of the old copy.
+ */
+int deltaindex(Delta *d, char *sigs, int n){
+    unsigned char *p;
+    long i, count = n / DELTA_SIG_SIZE;
+
+    if (n % DELTA_SIG_SIZE != 0 || count > d->blocks - d->next)
+        return (-1);
+    if (d->weak == NULL) {
+        d->weak = malloc((d->blocks + 1) * sizeof(unsigned int));
+        d->strong = malloc((d->blocks + 1) * sizeof(unsigned long long));
+        if (d->weak == NULL || d->strong == NULL)
+            return (-1);
+    }
+
+    for (i = 0; i < count; i++) {
+        p = (unsigned char *) sigs + i * DELTA_SIG_SIZE;
+        d->weak[d->next + i] = get32(p);
+        d->strong[d->next + i] = (unsigned long long) get32(p + 4) << 32 | get32(p + 8);
+    }
+    d->next += count;
+    return (0);
+}
+
+
+/*
+ * Make the next delta ops of the new copy. The window slides one byte at a time while
+ * nothing matches, with the rolling sums updated from the byte leaving and the byte
+ * entering. Literal bytes are held back until a block matches or DELTA_LITERAL of them
+ * are waiting, and matching blocks in a row go out as one op.
+ */
+int deltamake(Delta *d, char *out, int room){
+    unsigned char *o = (unsigned char *) out, *p;
+    unsigned int a, b, bs = d->blocksize;
+    int n = 0, pos, stop;
+    long blk;
+
+    if (d->head == NULL && buildindex(d) < 0)
+        return (-1);
+
+    while (!d->done && room - n >= DELTA_ROOM) {
+        /* keep a whole window and the byte after it in the buffer */
+        if (!d->eof && d->end - d->pos <= (int) bs) {
+            if (refill(d) < 0)
+                return (-1);
+            continue;
+        }
+
+        /* the last bytes of the file, shorter than a block, go as they are */
+        if (d->end - d->pos < (int) bs) {
+            if (d->end > d->lit) {
+                n += putliteral(d, o + n, d->end - d->lit > DELTA_LITERAL ? DELTA_LITERAL : d->end - d->lit);
+                continue;
+            }
+            n += putrun(d, o + n);
+            o[n] = 'E';
+            put32(o + n + 1, (unsigned int) (d->size >> 32));
+            put32(o + n + 5, (unsigned int) d->size);
+            put32(o + n + 9, d->crc);
+            n += 13;
+            d->done = 1;
+            break;
+        }
+
+        if (!d->rolled)
+            weaksum((unsigned char *) d->buf + d->pos, bs, &d->a, &d->b);
+        d->rolled = 1;
+
+        /* slide until a block matches, the literal is full or the buffer runs out */
+        p = (unsigned char *) d->buf;
+        a = d->a;
+        b = d->b;
+        pos = d->pos;
+        stop = d->end - bs;
+        if (stop > d->lit + DELTA_LITERAL)
+            stop = d->lit + DELTA_LITERAL;
+        blk = -1;
+        while (1) {
+            if (d->head[BUCKET(d, (a & 0xffff) | b << 16)] >= 0) {
+                d->pos = pos;
+                if ((blk = findblock(d, (a & 0xffff) | b << 16)) >= 0)
+                    break;
+            }
+            if (pos >= stop)
+                break;
+            a += p[pos + bs] - p[pos];
+            b += a - bs * p[pos];
+            pos++;
+        }
+        d->pos = pos;
+        d->a = a;
+        d->b = b;
+
+        if (blk >= 0) {
+            if (d->pos > d->lit)
+                n += putliteral(d, o + n, d->pos - d->lit);
+            if (d->runlen > 0 && blk == d->run + d->runlen)
+                d->runlen++;
+            else {
+                n += putrun(d, o + n);
+                d->run = blk;
+                d->runlen = 1;
+            }
+            d->crc = crc32buf(d->crc, d->buf + d->pos, bs);
+            d->pos += bs;
+            d->lit = d->pos;
+            d->size += bs;
+            d->matched += bs;
+            d->rolled = 0;
+        } else if (d->pos - d->lit >= DELTA_LITERAL)
+            n += putliteral(d, o + n, DELTA_LITERAL);
+        else if (d->eof) {
+            d->pos++;     /* last whole window did not match, the rest is the short tail */
+            d->rolled = 0;
+        }
+    }
+
+    return (n);
+}
+
+
+/*
+ * Apply delta ops to the old copy.
+ */
+int deltapatch(Delta *d, char *ops, int n){
+    unsigned char *p = (unsigned char *) ops;
+    unsigned int len, crc;
+    long long size;
+    long blk, count;
+    int i = 0;
+
+    while (i < n) {
+        if (d->patched)
+            return (-1);     /* nothing may follow the end op */
+
+        if (p[i] == 'L' && n - i >= 5) {
+            len = get32(p + i + 1);
+            if (len > (unsigned int) (n - i - 5) || writefull(d->out, ops + i + 5, len) < 0)
+                return (-1);
+            d->crc = crc32buf(d->crc, ops + i + 5, len);
+            d->size += len;
+            d->literal += len;
+            i += 5 + len;
+        } else if (p[i] == 'B' && n - i >= 9) {
+            blk = get32(p + i + 1);
+            count = get32(p + i + 5);
+            if (blk > d->blocks || count > d->blocks - blk || copyblocks(d, blk, count) < 0)
+                return (-1);
+            i += 9;
+        } else if (p[i] == 'E' && n - i >= 13) {
+            size = (long long) get32(p + i + 1) << 32 | get32(p + i + 5);
+            crc = get32(p + i + 9);
+            if (size != d->size || crc != d->crc)
+                return (-1);
+            d->patched = 1;
+            i += 13;
+        } else
+            return (-1);
+    }
+
+    return (d->patched);
+}
+
+
+/*
+ * Describe a delta transfer.
+ */
+void deltastats(Delta *d, char *buf, int size){
+
+    snprintf(buf, size, "%lld bytes: %lld from the old copy, %lld sent (%.1f%%), %d byte blocks",
+             d->size, d->matched, d->literal, d->size > 0 ? 100.0 * d->literal / d->size : 0.0, d->blocksize);
+}
+
+
+/*
+ * Rolling sums of a block: a is the sum of the bytes, b the sum of each byte times its
+ * distance from the end (the same as adding a after every byte). SSE2 takes 16 bytes a
+ * step: one SAD gives their sum, two multiply-adds by 16..1 their share of b, and the
+ * 16 * a carried in from earlier steps is added once at the end.
+ */
+static void weaksum(unsigned char *p, int n, unsigned int *sa, unsigned int *sb){
+    unsigned int a = 0, b = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128(), v, s1 = zero, ps = zero, s2 = zero;
+    __m128i wlo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16), whi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+
+    for (; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128((__m128i *) (p + i));
+        ps = _mm_add_epi32(ps, s1);
+        s1 = _mm_add_epi32(s1, _mm_sad_epu8(v, zero));
+        s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), wlo));
+        s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), whi));
+    }
+    s2 = _mm_add_epi32(s2, _mm_slli_epi32(ps, 4));
+    s1 = _mm_add_epi32(s1, _mm_shuffle_epi32(s1, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2 = _mm_add_epi32(s2, _mm_shuffle_epi32(s2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2 = _mm_add_epi32(s2, _mm_shuffle_epi32(s2, _MM_SHUFFLE(2, 3, 0, 1)));
+    a = _mm_cvtsi128_si32(s1);
+    b = _mm_cvtsi128_si32(s2);
+#endif
+
+    for (; i < n; i++) {
+        a += p[i];
+        b += a;
+    }
+    *sa = a;
+    *sb = b;
+}
+
+
+/*
+ * Strong hash of a block (XXH64, seed 0). Four independent 64-bit lanes take 32 bytes a
+ * step, so the multiplies of one lane overlap those of the others.
+ */
+static unsigned long long strongsum(unsigned char *p, int n){
+    unsigned long long h, v1, v2, v3, v4;
+    int i = 0;
+
+    if (n >= 32) {
+        v1 = XXH_P1 + XXH_P2;
+        v2 = XXH_P2;
+        v3 = 0;
+        v4 = -XXH_P1;
+        for (; i + 32 <= n; i += 32) {
+            v1 = xxround(v1, get64le(p + i));
+            v2 = xxround(v2, get64le(p + i + 8));
+            v3 = xxround(v3, get64le(p + i + 16));
+            v4 = xxround(v4, get64le(p + i + 24));
+        }
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = (h ^ xxround(0, v1)) * XXH_P1 + XXH_P4;
+        h = (h ^ xxround(0, v2)) * XXH_P1 + XXH_P4;
+        h = (h ^ xxround(0, v3)) * XXH_P1 + XXH_P4;
+        h = (h ^ xxround(0, v4)) * XXH_P1 + XXH_P4;
+    } else
+        h = XXH_P5;
+
+    h += n;
+    for (; i + 8 <= n; i += 8) {
+        h ^= xxround(0, get64le(p + i));
+        h = ROTL64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (i + 4 <= n) {
+        h ^= (unsigned long long) (p[i] | p[i + 1] << 8 | p[i + 2] << 16 | (unsigned int) p[i + 3] << 24) * XXH_P1;
+        h = ROTL64(h, 23) * XXH_P2 + XXH_P3;
+        i += 4;
+    }
+    for (; i < n; i++) {
+        h ^= p[i] * XXH_P5;
+        h = ROTL64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return (h);
+}
+
+
+/*
+ * One XXH64 lane step.
+ */
+static unsigned long long xxround(unsigned long long acc, unsigned long long input){
+
+    acc += input * XXH_P2;
+    acc = ROTL64(acc, 31);
+    return (acc * XXH_P1);
+}
+
+
+/*
+ * 8 bytes as a little endian number, so both ends hash alike whatever their byte order.
+ */
+static unsigned long long get64le(unsigned char *p){
+    unsigned long long v;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&v, p, 8);
+#else
+    int k;
+
+    for (v = 0, k = 7; k >= 0; k--)
+        v = v << 8 | p[k];
+#endif
+    return (v);
+}
+
+
+/*
+ * Hash table of the weak sums, at least twice as many buckets as blocks. Each bucket
+ * chains its blocks in order, so the first block of a repeated run is found first.
+ */
+static int buildindex(Delta *d){
+    long i;
+    unsigned int w;
+
+    if (d->next != d->blocks || (d->blocks > 0 && d->weak == NULL))
+        return (-1);     /* signatures missing */
+
+    for (d->bits = 10; (1L << d->bits) < 2 * d->blocks; d->bits++)
+        ;
+    d->head = malloc((1L << d->bits) * sizeof(int));
+    d->chain = malloc((d->blocks + 1) * sizeof(int));
+    d->bufsize = DELTA_READ + d->blocksize + DELTA_LITERAL;
+    if (d->head == NULL || d->chain == NULL || (d->buf = malloc(d->bufsize)) == NULL)
+        return (-1);
+
+    memset(d->head, 0xff, (1L << d->bits) * sizeof(int));     /* -1: empty */
+    for (i = d->blocks - 1; i >= 0; i--) {
+        w = d->weak[i];
+        d->chain[i] = d->head[BUCKET(d, w)];
+        d->head[BUCKET(d, w)] = i;
+    }
+    return (0);
+}
+
+
+/*
+ * Block of the old copy with the same weak sum and strong hash as the window at pos, or -1.
+ * The block after the last one matched is tried first, so runs stay whole.
+ */
+static long findblock(Delta *d, unsigned int w){
+    unsigned char *p = (unsigned char *) d->buf + d->pos;
+    unsigned long long s = 0;
+    int have = 0;
+    long i, e = d->run + d->runlen;
+
+    if (d->runlen > 0 && e < d->blocks && d->weak[e] == w) {
+        s = strongsum(p, d->blocksize);
+        have = 1;
+        if (d->strong[e] == s)
+            return (e);
+    }
+
+    for (i = d->head[BUCKET(d, w)]; i >= 0; i = d->chain[i]) {
+        if (d->weak[i] != w)
+            continue;
+        if (!have)
+            s = strongsum(p, d->blocksize);
+        have = 1;
+        if (d->strong[i] == s)
+            return (i);
+    }
+    return (-1);
+}
+
+
+/*
+ * Move the bytes not yet sent to the front of the buffer and read more of the new copy
+ * behind them. The rolling sums stay valid, the window only moves in memory.
+ */
+static int refill(Delta *d){
+    int n;
+
+    memmove(d->buf, d->buf + d->lit, d->end - d->lit);
+    d->pos -= d->lit;
+    d->end -= d->lit;
+    d->lit = 0;
+
+    while (d->end < d->bufsize) {
+        if ((n = read(d->fd, d->buf + d->end, d->bufsize - d->end)) < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return (-1);
+        if (n == 0) {
+            d->eof = 1;
+            break;
+        }
+        d->end += n;
+    }
+    return (0);
+}
+
+
+/*
+ * Literal op for the next len bytes not yet sent, behind any run still waiting.
+ * Returns the bytes of ops made.
+ */
+static int putliteral(Delta *d, unsigned char *out, int len){
+    int n = putrun(d, out);
+
+    out[n] = 'L';
+    put32(out + n + 1, len);
+    memcpy(out + n + 5, d->buf + d->lit, len);
+    d->crc = crc32buf(d->crc, d->buf + d->lit, len);
+    d->lit += len;
+    d->size += len;
+    d->literal += len;
+    return (n + 5 + len);
+}
+
+
+/*
+ * Block op for the run of matched blocks waiting, if any. Returns the bytes of ops made.
+ */
+static int putrun(Delta *d, unsigned char *out){
+
+    if (d->runlen == 0)
+        return (0);
+    out[0] = 'B';
+    put32(out + 1, d->run);
+    put32(out + 5, d->runlen);
+    d->runlen = 0;
+    return (9);
+}
+
+
+/*
+ * Copy count blocks of the old copy from block to the new copy, DELTA_READ bytes at a time.
+ */
+static int copyblocks(Delta *d, long block, long count){
+    long long offset = (long long) block * d->blocksize, left = (long long) count * d->blocksize;
+    int n;
+
+    if (d->buf == NULL && (d->buf = malloc(DELTA_READ)) == NULL)
+        return (-1);
+
+    for (; left > 0; left -= n, offset += n) {
+        n = left < DELTA_READ ? left : DELTA_READ;
+        if (readfull(d->fd, d->buf, n, offset) < 0 || writefull(d->out, d->buf, n) < 0)
+            return (-1);
+        d->crc = crc32buf(d->crc, d->buf, n);
+    }
+
+    d->size += (long long) count * d->blocksize;
+    d->matched += (long long) count * d->blocksize;
+    return (0);
+}
+
+
+/*
+ * Read exactly n bytes at offset. Returns 0, or -1 on error or end of file.
+ */
+static int readfull(int fd, char *buf, int n, long long offset){
+    int done = 0, r;
+
+    while (done < n) {
+        if ((r = pread(fd, buf + done, n - done, offset + done)) < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return (-1);
+        done += r;
+    }
+    return (0);
+}
+
+
+/*
+ * Write all n bytes. Returns 0, or -1 on error.
+ */
+static int writefull(int fd, char *buf, int n){
+    int done = 0, w;
+
+    while (done < n) {
+        if ((w = write(fd, buf + done, n - done)) < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return (-1);
+        done += w;
+    }
+    return (0);
+}
+
+
+static void put32(unsigned char *p, unsigned int v){
+
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+
+static unsigned int get32(unsigned char *p){
+
+    return ((unsigned int) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+}
@@ -0,0 +1,350 @@
+/* File: digest.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: 128-bit file digests, and the digest index kept in an extended attribute of each file
+ *			so an unchanged file is never read twice to answer "is it the same?"
+ * Changes:
+ * 16/10/2026 - Added digest.c/digest.h
+ * 16/10/2026 - Index lookup, the settle check and the store are separate calls. A file only has to have
+ *				settled for DIGEST_SETTLE before it is indexed, not two seconds
+ */
+
+#include  <stdio.h>
+#include  <stdlib.h>
+#include  <string.h>
+#include  <unistd.h>
+#include  <time.h>
+#include  <sys/types.h>
+#include  <sys/stat.h>
+#include  <sys/xattr.h>
+#include  "digest.h"
+
+#if defined(__SSE2__)
+#include  <emmintrin.h>
+#endif
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3 1609587929392839161ULL
+#define PRIME64_4 9650029242287828579ULL
+#define PRIME64_5 2870177450012600261ULL
+#define STRIPE 64                          /* bytes taken by one pass over the 8 lanes */
+#define STRIPES (DIGEST_BLOCK / STRIPE)
+
+static void hashstripes(unsigned long long *acc, unsigned char *p, int stripes);
+static void accumulate(unsigned long long *acc, unsigned char *p, const unsigned long long *k);
+static void scramble(unsigned long long *acc);
+static unsigned long long merge(unsigned long long *acc, const unsigned long long *k, unsigned long long start);
+static unsigned long long fold(unsigned long long a, unsigned long long b);
+#if !defined(__SSE2__)
+static unsigned long long get64le(unsigned char *p);
+#endif
+static int unhex(char *hex, unsigned char *out);
+
+/* Keys: stripe s of a block uses key[s .. s+7], scrambles use key[24 .. 31],
+ * the two halves of the digest are merged with key[32 .. 39] and key[40 .. 47] */
+static const unsigned long long key[48] = {
+    0x3164ce8f711ffcb4ULL, 0xee205813171c79dfULL, 0x2b01a8f108dd1666ULL,
+    0x94599bd0372510c5ULL, 0x17cbfb4557b163b5ULL, 0x9c488eaa01c675ebULL,
+    0x4f9bebd5a3900b36ULL, 0x80ef03db8f85f69eULL, 0xbeb8c44bfe480d8aULL,
+    0x1ab57098e3a77331ULL, 0xc6f95d8b3ccf0764ULL, 0xeb0f8731a5a32f7fULL,
+    0x371827c6ce1c0077ULL, 0xbbff5b0ad8af5587ULL, 0xf1e00e723585b4b5ULL,
+    0x2138b6229bb71ec2ULL, 0x1b108fbe3cbc0b4fULL, 0xe037862a412f6e79ULL,
+    0xa14d40202854b89fULL, 0x74f736e07e06d66bULL, 0x4535ca554f3eedbbULL,
+    0x7a2748521a743208ULL, 0x86983e4effbbb05bULL, 0x94633b2d158bec7cULL,
+    0x684a8ad11ded2539ULL, 0x9e71546e9f9074d2ULL, 0x03e36fdd66c3e24fULL,
+    0xced971d5f1a9e834ULL, 0x276fdade0559ebd2ULL, 0x9e937c1a6e58edc0ULL,
+    0x999c1884c7cda4a5ULL, 0xba41bd1eac548f13ULL, 0xc5033d108bdef5b6ULL,
+    0x86f700439e6eea4bULL, 0xe257e04e623e307dULL, 0xeba543d2e3a394deULL,
+    0x6b2d903b46858f88ULL, 0x82a1775fa741d68bULL, 0x746f64ab4d37aac5ULL,
+    0x748f31232b473fdbULL, 0x5bfc585eb01db6a5ULL, 0x8aca5492f47915b7ULL,
+    0x2e5cf14c41ff51d3ULL, 0xe37f370ef1074a94ULL, 0x02cdfe358641ee55ULL,
+    0xe3203a7e6dd1b860ULL, 0xd29f68d769c8c75eULL, 0x3b7a235adb8713daULL,
+};
+
+
+/*
+ * Start a digest.
+ */
+void digestinit(Digest *d){
+    d->acc[0] = PRIME32_3;
+    d->acc[1] = PRIME64_1;
+    d->acc[2] = PRIME64_2;
+    d->acc[3] = PRIME64_3;
+    d->acc[4] = PRIME64_4;
+    d->acc[5] = PRIME32_2;
+    d->acc[6] = PRIME64_5;
+    d->acc[7] = PRIME32_1;
+    d->have = 0;
+    d->total = 0;
+}
+
+
+/*
+ * Hash the next n bytes.
+ */
+void digestupdate(Digest *d, char *data, long n){
+    unsigned char *p = (unsigned char *) data;
+    int fill;
+
+    d->total += n;
+    if (d->have + n < DIGEST_BLOCK) {
+        memcpy(d->buf + d->have, p, n);
+        d->have += n;
+        return;
+    }
+
+    /* blocks are hashed where they lie, only the pieces at either end are copied */
+    if (d->have > 0) {
+        fill = DIGEST_BLOCK - d->have;
+        memcpy(d->buf + d->have, p, fill);
+        hashstripes(d->acc, d->buf, STRIPES);
+        scramble(d->acc);
+        p += fill;
+        n -= fill;
+    }
+    for (; n >= DIGEST_BLOCK; p += DIGEST_BLOCK, n -= DIGEST_BLOCK) {
+        hashstripes(d->acc, p, STRIPES);
+        scramble(d->acc);
+    }
+    memcpy(d->buf, p, n);
+    d->have = n;
+}
+
+
+/*
+ * Finish a digest.
+ */
+void digestfinal(Digest *d, unsigned char *out){
+    unsigned long long acc[8], half[2];
+    int stripes = d->have / STRIPE, rest = d->have % STRIPE, i;
+
+    memcpy(acc, d->acc, sizeof(acc));
+    hashstripes(acc, d->buf, stripes);
+    if (rest > 0) {
+        /* zero padding is told apart from real zeros by the length merged in below */
+        memset(d->buf + d->have, 0, STRIPE - rest);
+        accumulate(acc, d->buf + stripes * STRIPE, key + stripes);
+    }
+
+    half[0] = merge(acc, key + 32, d->total * PRIME64_1);
+    half[1] = merge(acc, key + 40, ~(d->total * PRIME64_2));
+    for (i = 0; i < DIGEST_SIZE; i++)
+        out[i] = half[i / 8] >> (i % 8 * 8);
+}
+
+
+/*
+ * Hex form of a digest.
+ */
+void digesthex(unsigned char *digest, char *hex){
+    int i;
+
+    for (i = 0; i < DIGEST_SIZE; i++)
+        sprintf(hex + i * 2, "%02x", digest[i]);
+}
+
+
+/*
+ * Digest of a file from its index entry.
+ */
+int digestindexed(int fd, struct stat *st, unsigned char *out){
+    char entry[128], hex[DIGEST_HEX];
+    long long size, sec;
+    long nsec;
+    int n;
+
+    if ((n = fgetxattr(fd, DIGEST_XATTR, entry, sizeof(entry) - 1)) <= 0)
+        return (0);
+    entry[n] = '\0';
+    return (sscanf(entry, "%lld %lld.%ld %32s", &size, &sec, &nsec, hex) == 4 && size == st->st_size &&
+            sec == st->st_mtim.tv_sec && nsec == st->st_mtim.tv_nsec && unhex(hex, out) == 0);
+}
+
+
+/*
+ * Whether a digest read from a file since start may be indexed.
+ */
+int digeststable(int fd, struct stat *st, struct timespec *start){
+    struct stat after;
+    long long age;
+
+    /* a write in the same clock tick as the read would not move mtime, so the file has to have settled first */
+    age = (start->tv_sec - st->st_mtim.tv_sec) * 1000000000LL + start->tv_nsec - st->st_mtim.tv_nsec;
+    return (fstat(fd, &after) == 0 && after.st_size == st->st_size &&
+            after.st_mtim.tv_sec == st->st_mtim.tv_sec && after.st_mtim.tv_nsec == st->st_mtim.tv_nsec &&
+            age > (st->st_mtim.tv_nsec == 0 ? DIGEST_SETTLE_COARSE : DIGEST_SETTLE));
+}
+
+
+/*
+ * Store a digest in the index of a file.
+ */
+void digeststore(int fd, struct stat *st, unsigned char *digest){
+    char entry[128], hex[DIGEST_HEX];
+
+    digesthex(digest, hex);
+    snprintf(entry, sizeof(entry), "%lld %lld.%09ld %s", (long long) st->st_size,
+             (long long) st->st_mtim.tv_sec, (long) st->st_mtim.tv_nsec, hex);
+    fsetxattr(fd, DIGEST_XATTR, entry, strlen(entry), 0);    /* not supported: computed every time */
+}
+
+
+/*
+ * Digest of a whole file, from its index entry when that is still current.
+ */
+int digestlookup(int fd, struct stat *st, unsigned char *out){
+    struct timespec start;
+    long long off = 0;
+    char *buf;
+    Digest d;
+    int n;
+
+    if (digestindexed(fd, st, out))
+        return (1);
+
+    clock_gettime(CLOCK_REALTIME, &start);
+    if ((buf = malloc(DIGEST_READ)) == NULL)
+        return (-1);
+    digestinit(&d);
+    while ((n = pread(fd, buf, DIGEST_READ, off)) > 0) {
+        digestupdate(&d, buf, n);
+        off += n;
+    }
+    free(buf);
+    if (n < 0)
+        return (-1);
+    digestfinal(&d, out);
+
+    if (off == st->st_size && digeststable(fd, st, &start))
+        digeststore(fd, st, out);
+    return (0);
+}
+
+
+/*
+ * Hash whole stripes, stripe s with key[s ..].
+ */
+static void hashstripes(unsigned long long *acc, unsigned char *p, int stripes){
+    int s;
+
+    for (s = 0; s < stripes; s++)
+        accumulate(acc, p + s * STRIPE, key + s);
+}
+
+
+/*
+ * Take one stripe into the lanes: each lane adds the product of the two halves of its
+ * keyed input, and the unkeyed input of its neighbour (so no input bits are lost).
+ */
+static void accumulate(unsigned long long *acc, unsigned char *p, const unsigned long long *k){
+    int i;
+#if defined(__SSE2__)
+    __m128i a, data, dk, prod, swap;
+
+    for (i = 0; i < 8; i += 2) {
+        data = _mm_loadu_si128((__m128i *) (p + i * 8));
+        dk = _mm_xor_si128(data, _mm_loadu_si128((__m128i *) (k + i)));
+        prod = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        swap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        a = _mm_loadu_si128((__m128i *) (acc + i));
+        a = _mm_add_epi64(a, _mm_add_epi64(prod, swap));
+        _mm_storeu_si128((__m128i *) (acc + i), a);
+    }
+#else
+    unsigned long long v, dk;
+
+    for (i = 0; i < 8; i++) {
+        v = get64le(p + i * 8);
+        dk = v ^ k[i];
+        acc[i ^ 1] += v;
+        acc[i] += (dk & 0xffffffffULL) * (dk >> 32);
+    }
+#endif
+}
+
+
+/*
+ * Mix the lanes at the end of a block, so high bits reach the next products.
+ */
+static void scramble(unsigned long long *acc){
+    const unsigned long long *k = key + 24;
+    int i;
+#if defined(__SSE2__)
+    __m128i a, prime = _mm_set1_epi32(PRIME32_1), lo, hi;
+
+    for (i = 0; i < 8; i += 2) {
+        a = _mm_loadu_si128((__m128i *) (acc + i));
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((__m128i *) (k + i)));
+        lo = _mm_mul_epu32(a, prime);
+        hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128((__m128i *) (acc + i), _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+    }
+#else
+    for (i = 0; i < 8; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= k[i];
+        acc[i] *= PRIME32_1;
+    }
+#endif
+}
+
+
+/*
+ * Merge the lanes into 64 bits.
+ */
+static unsigned long long merge(unsigned long long *acc, const unsigned long long *k, unsigned long long start){
+    unsigned long long h = start;
+    int i;
+
+    for (i = 0; i < 8; i += 2)
+        h += fold(acc[i] ^ k[i], acc[i + 1] ^ k[i + 1]);
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return (h);
+}
+
+
+/*
+ * 64x64 -> 128 bit product, folded to 64 bits.
+ */
+static unsigned long long fold(unsigned long long a, unsigned long long b){
+    unsigned __int128 p = (unsigned __int128) a * b;
+
+    return ((unsigned long long) p ^ (unsigned long long) (p >> 64));
+}
+
+
+#if !defined(__SSE2__)
+static unsigned long long get64le(unsigned char *p){
+    unsigned long long v = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+        v = v << 8 | p[i];
+    return (v);
+}
+#endif
+
+
+/*
+ * Digest from its hex form.
+ */
+static int unhex(char *hex, unsigned char *out){
+    unsigned int byte;
+    int i;
+
+    if (strlen(hex) != DIGEST_SIZE * 2)
+        return (-1);
+    for (i = 0; i < DIGEST_SIZE; i++) {
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1)
+            return (-1);
+        out[i] = byte;
+    }
+    return (0);
+}
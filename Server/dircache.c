@@ -0,0 +1,341 @@
+/* File: dircache.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Cache of serialized directory listings (D responses and L pages) in memory shared by
+ *			the daemon's workers and their children. Each process watches the directories it lists
+ *			with inotify and marks them changed when an event arrives. A listing is only served
+ *			by a process that was already watching its directory when it was read
+ * Changes:
+ * 16/10/2026 - Added dircache.c/dircache.h
+ * 16/10/2026 - Setup failure goes to the asynchronous logger
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include "dircache.h"
+#include "logger.h"
+
+// Anything that changes the names, sizes or mtimes a listing shows
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | \
+					IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct dirSlot {
+	unsigned long long seq;			// Odd while a process writes the slot (readers retry or miss)
+	dev_t dev;						// Directory, and which listing of it
+	ino_t ino;
+	long long cursor;
+	int entries;
+	int len;						// Bytes of data
+	unsigned long long built;		// Clock when the directory was read
+	char data[DIRCACHE_DATA];
+} DirSlot;
+
+typedef struct dirShared {
+	unsigned long long clock;		// Orders directory reads and changes across processes
+	unsigned long long flushed;		// Clock when an event queue overflowed, older listings are stale
+	unsigned long long changed[DIRCACHE_CHANGED];	// Clock of the last change to the directories hashed here
+	unsigned long long hits, misses, stores, invalidations;
+	DirSlot slots[DIRCACHE_SLOTS];
+} DirShared;
+
+static DirShared *shared;			// NULL if the cache is off
+
+static struct {
+	pid_t owner;					// Process the inotify instance belongs to
+	int fd;
+	int count;
+	struct {
+		int wd;
+		dev_t dev;
+		ino_t ino;
+		unsigned long long since;	// Clock once the watch was in place
+	} watch[DIRCACHE_WATCHES];
+} local = { 0, -1 };
+
+static int readSlot(DirSlot *slot, struct stat *st, long long cursor, int entries, unsigned long long since, char *out, int room);
+static DirSlot *slotFor(struct stat *st, long long cursor, int entries);
+static unsigned long long *changedClock(dev_t dev, ino_t ino);
+static int findWatch(struct stat *st);
+static unsigned long long tick(void);
+static void raiseTo(unsigned long long *clock, unsigned long long value);
+
+
+/** Setup - see dircache.h
+ *
+ */
+	int dircacheSetup(void){
+		void *p;
+
+		// Shared anonymous memory is inherited by every fork(), pages are only touched when a slot is used
+		p = mmap(NULL, sizeof(DirShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(p == MAP_FAILED){
+			logPrint(LOG_ERROR, "Directory cache setup failed: %s", strerror(errno));
+			return -1;
+		}
+
+		shared = p;
+		shared->clock = 1;
+		return 0;
+
+	} //END of dircacheSetup function
+
+
+/** Fd - see dircache.h
+ *
+ */
+	int dircacheFd(void){
+
+		if(shared == NULL)
+			return -1;
+
+		// An instance inherited across fork() belongs to the parent, and so do its watches
+		if(local.owner != getpid()){
+			if(local.fd >= 0)
+				close(local.fd);
+			local.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			local.owner = getpid();
+			local.count = 0;
+		}
+
+		return local.fd;
+
+	} //END of dircacheFd function
+
+
+/** Events - see dircache.h
+ *
+ */
+	void dircacheEvents(void){
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		struct inotify_event *ev;
+		int n, pos, i;
+
+		if(dircacheFd() < 0)
+			return;
+
+		while((n = read(local.fd, buf, sizeof(buf))) > 0){
+			for(pos = 0; pos < n; pos += sizeof(struct inotify_event) + ev->len){
+				ev = (struct inotify_event *) (buf + pos);
+
+				// Events were lost, no listing read before now can be trusted
+				if(ev->mask & IN_Q_OVERFLOW){
+					raiseTo(&shared->flushed, tick());
+					continue;
+				}
+
+				for(i = 0; i < local.count && local.watch[i].wd != ev->wd; i++)
+					;
+				if(i == local.count)
+					continue;
+
+				raiseTo(changedClock(local.watch[i].dev, local.watch[i].ino), tick());
+				__atomic_add_fetch(&shared->invalidations, 1, __ATOMIC_RELAXED);
+
+				// Directory removed (or its watch dropped), forget the watch
+				if(ev->mask & IN_IGNORED)
+					local.watch[i] = local.watch[--local.count];
+			}
+		}
+
+	} //END of dircacheEvents function
+
+
+/** Lookup - see dircache.h
+ *
+ */
+	int dircacheLookup(int dirfd, long long cursor, int entries, char *out, int room){
+		struct stat st;
+		int n = -1, i;
+
+		if(shared == NULL)
+			return -1;
+
+		// Changes this process has been told about count before anything is served
+		dircacheEvents();
+
+		if(fstat(dirfd, &st) == 0 && (i = findWatch(&st)) >= 0)
+			n = readSlot(slotFor(&st, cursor, entries), &st, cursor, entries, local.watch[i].since, out, room);
+
+		__atomic_add_fetch(n < 0 ? &shared->misses : &shared->hits, 1, __ATOMIC_RELAXED);
+		return n;
+
+	} //END of dircacheLookup function
+
+
+/** Begin - see dircache.h
+ *
+ */
+	unsigned long long dircacheBegin(int dirfd){
+		char path[64];
+		struct stat st;
+		int wd;
+
+		if(dircacheFd() < 0 || fstat(dirfd, &st) < 0)
+			return 0;
+
+		if(findWatch(&st) < 0){
+			if(local.count == DIRCACHE_WATCHES)
+				return 0;
+			snprintf(path, sizeof(path), "/proc/self/fd/%d", dirfd);
+			if((wd = inotify_add_watch(local.fd, path, WATCH_MASK)) < 0)
+				return 0;
+
+			local.watch[local.count].wd = wd;
+			local.watch[local.count].dev = st.st_dev;
+			local.watch[local.count].ino = st.st_ino;
+			local.watch[local.count].since = tick();
+			local.count++;
+		}
+
+		return tick();
+
+	} //END of dircacheBegin function
+
+
+/** Store - see dircache.h
+ *
+ */
+	void dircacheStore(int dirfd, long long cursor, int entries, unsigned long long built, char *data, int len){
+		struct stat st;
+		DirSlot *slot;
+		unsigned long long seq;
+
+		if(shared == NULL || built == 0 || len > DIRCACHE_DATA || fstat(dirfd, &st) < 0)
+			return;
+
+		// Take the slot, unless another process is writing it
+		slot = slotFor(&st, cursor, entries);
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+		if((seq & 1) || !__atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return;
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		slot->dev = st.st_dev;
+		slot->ino = st.st_ino;
+		slot->cursor = cursor;
+		slot->entries = entries;
+		slot->len = len;
+		slot->built = built;
+		memcpy(slot->data, data, len);
+
+		__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&shared->stores, 1, __ATOMIC_RELAXED);
+
+	} //END of dircacheStore function
+
+
+/** Stats - see dircache.h
+ *
+ */
+	void dircacheStats(char *buf, int size){
+
+		if(shared == NULL)
+			snprintf(buf, size, "cache off");
+		else
+			snprintf(buf, size, "cache %llu hits, %llu misses, %llu stored, %llu invalidated",
+					 __atomic_load_n(&shared->hits, __ATOMIC_RELAXED), __atomic_load_n(&shared->misses, __ATOMIC_RELAXED),
+					 __atomic_load_n(&shared->stores, __ATOMIC_RELAXED), __atomic_load_n(&shared->invalidations, __ATOMIC_RELAXED));
+
+	} //END of dircacheStats function
+
+
+/** Read slot - copies a listing out of its slot if it is the one asked for and still current
+ *
+ *	Pre: since is when this process started watching the directory
+ *	Return: Bytes copied, -1 if the slot holds another listing, a stale one or was rewritten while copying
+ */
+	static int readSlot(DirSlot *slot, struct stat *st, long long cursor, int entries, unsigned long long since, char *out, int room){
+		unsigned long long seq, built;
+		int len;
+
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		len = slot->len;
+		built = slot->built;
+		if((seq & 1) || slot->dev != st->st_dev || slot->ino != st->st_ino || slot->cursor != cursor ||
+		   slot->entries != entries || len < 0 || len > room)
+			return -1;
+
+		// Read before this process watched the directory, or changed since it was read
+		if(built <= since || built <= __atomic_load_n(changedClock(st->st_dev, st->st_ino), __ATOMIC_ACQUIRE) ||
+		   built <= __atomic_load_n(&shared->flushed, __ATOMIC_ACQUIRE))
+			return -1;
+
+		memcpy(out, slot->data, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+			return -1;
+
+		return len;
+
+	} //END of readSlot function
+
+
+/** Slot for - the slot a listing is kept in
+ *
+ */
+	static DirSlot *slotFor(struct stat *st, long long cursor, int entries){
+		unsigned long long h;
+
+		h = (st->st_ino * 0x9E3779B97F4A7C15ULL) ^ st->st_dev ^ (cursor * 0xC2B2AE3D27D4EB4FULL) ^ entries;
+		return &shared->slots[(h ^ h >> 29) % DIRCACHE_SLOTS];
+
+	} //END of slotFor function
+
+
+/** Changed clock - the change clock a directory hashes onto
+ *
+ */
+	static unsigned long long *changedClock(dev_t dev, ino_t ino){
+		unsigned long long h = (ino * 0x9E3779B97F4A7C15ULL) ^ dev;
+
+		return &shared->changed[(h ^ h >> 31) % DIRCACHE_CHANGED];
+
+	} //END of changedClock function
+
+
+/** Find watch - index of this process's watch on a directory, -1 if it has none
+ *
+ */
+	static int findWatch(struct stat *st){
+		int i;
+
+		if(dircacheFd() < 0)
+			return -1;
+		for(i = 0; i < local.count; i++)
+			if(local.watch[i].dev == st->st_dev && local.watch[i].ino == st->st_ino)
+				return i;
+		return -1;
+
+	} //END of findWatch function
+
+
+/** Tick - next value of the shared clock
+ *
+ */
+	static unsigned long long tick(void){
+
+		return __atomic_add_fetch(&shared->clock, 1, __ATOMIC_ACQ_REL);
+
+	} //END of tick function
+
+
+/** Raise to - sets a shared clock to value unless another process already set it later
+ *
+ */
+	static void raiseTo(unsigned long long *clock, unsigned long long value){
+		unsigned long long now = __atomic_load_n(clock, __ATOMIC_RELAXED);
+
+		while(now < value && !__atomic_compare_exchange_n(clock, &now, value, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+
+	} //END of raiseTo function
+
+//END of dircache.c
@@ -0,0 +1,55 @@
+/* File: dircache.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the directory listing cache shared by the server processes
+ * Changes: 16/10/2026 - Added dircache.c/dircache.h, listings invalidated by inotify
+ */
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#define DIRCACHE_SLOTS 32				// Listings kept, one per slot (direct mapped)
+#define DIRCACHE_DATA (1024*256)		// Largest serialized listing kept
+#define DIRCACHE_CHANGED 1024			// Change clocks, directories hash onto them
+#define DIRCACHE_WATCHES 256			// Directories one process watches at most
+
+/* Set up the cache shared by this process and every process it forks afterwards
+ *
+ *	Pre: Called once, before the workers are forked
+ *	Return: 0, or -1 if the shared memory cannot be mapped (listings are then never cached)
+ */
+int dircacheSetup(void);
+
+/* inotify descriptor of this process, created on first use (-1 if not available).
+ * Readable when a watched directory changed, dircacheEvents() should then be called
+ */
+int dircacheFd(void);
+
+/* Read the inotify events of this process and mark the directories they name as changed */
+void dircacheEvents(void);
+
+/* Look up a serialized listing of directory dirfd
+ *
+ *	Pre: cursor and entries say which listing (the D response is cursor -1, entries 0)
+ *	Post: A listing taken after this process started watching the directory, and not changed
+ *		  since, is copied to out. Counted as a hit or a miss
+ *	Return: Bytes copied, or -1 on a miss
+ */
+int dircacheLookup(int dirfd, long long cursor, int entries, char *out, int room);
+
+/* Start reading directory dirfd for a listing that may be stored afterwards
+ *
+ *	Post: This process watches the directory (changes from now on invalidate the listing)
+ *	Return: Clock value to pass to dircacheStore, 0 if the listing cannot be cached
+ */
+unsigned long long dircacheBegin(int dirfd);
+
+/* Store a listing read since dircacheBegin returned built (nothing is stored if built is 0,
+ * the listing is larger than DIRCACHE_DATA or its slot is being written by another process)
+ */
+void dircacheStore(int dirfd, long long cursor, int entries, unsigned long long built, char *data, int len);
+
+/* Hit, miss, store and invalidation counts of all processes, for the log */
+void dircacheStats(char *buf, int size);
+
+#endif
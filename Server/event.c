@@ -0,0 +1,274 @@
+/* File: event.c (SERVER)
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Non-blocking epoll engine that owns every client session in one process
+ * Changes:
+ * 16/10/2026 - Added event.c/event.h, replaces fork per connection as the default server mode
+ * 16/10/2026 - Completions of the io_uring backend are waited on with the sockets. A session whose
+ *				transfer io_uring owns is taken out of epoll until the transfer finishes
+ * 16/10/2026 - inotify events of the directory listing cache are read as they arrive, so a change seen
+ *				by this worker invalidates the listing for every worker
+ * 16/10/2026 - Log records go through the asynchronous logger, connect and close records name the session
+ * 16/10/2026 - Accepts, accept failures and the accept queue of the listener are counted in the metrics
+ * 16/10/2026 - Sessions moving file data are served after the rest of each batch of events, so commands are
+ *				not answered behind bulk transfers. A session the scheduler holds back leaves epoll until its
+ *				time comes, the wait for events ends in time for the first of them
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include "session.h"
+#include "event.h"
+#include "metrics.h"
+
+static void acceptClients(int epfd, int listen_sock);
+static void updateInterest(int epfd, Session *sess);
+static void endSession(int epfd, Session *sess, int result);
+static void serveEvent(int epfd, Session *sess, unsigned int events);
+static int releaseHeld(int epfd);
+
+static char ringMarker;		// epoll data of the io_uring completion queue
+static char dirMarker;		// epoll data of the listing cache's inotify descriptor
+static Session *held;		// Sessions the scheduler holds back, out of epoll until their time
+
+
+/** Event loop - Waits on the listening socket and every session socket, and hands
+ *				 readiness to the session state machine so no client can block another
+ *
+ *	Pre: listen_sock is bound and listening
+ *	Post: Runs until a fatal error. Closed sessions are removed and destroyed
+ */
+	void eventLoop(int listen_sock){
+		int epfd, n, i, j, done, nbulk;
+		struct epoll_event ev, events[MAX_EVENTS];
+		unsigned int bulkevents[MAX_EVENTS];
+		Xfer *finished[MAX_EVENTS];
+		Session *sess, *bulk[MAX_EVENTS];
+
+		if((epfd = epoll_create1(0)) < 0){
+			logPrint(LOG_ERROR, "epoll setup failed: %s", strerror(errno));
+			exit(1);
+		}
+
+		fcntl(listen_sock, F_SETFL, fcntl(listen_sock, F_GETFL) | O_NONBLOCK);
+
+		// Listening socket is registered with a NULL pointer, sessions with their own
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sock, &ev) < 0){
+			logPrint(LOG_ERROR, "epoll add listener failed: %s", strerror(errno));
+			exit(1);
+		}
+
+		// Completion queue of the io_uring backend, readable when transfers have progressed
+		ev.events = EPOLLIN;
+		ev.data.ptr = &ringMarker;
+		if(uringActive() && epoll_ctl(epfd, EPOLL_CTL_ADD, uringFd(), &ev) < 0){
+			logPrint(LOG_ERROR, "epoll add io_uring failed: %s", strerror(errno));
+			exit(1);
+		}
+
+		// Changes to directories this worker has listed
+		ev.events = EPOLLIN;
+		ev.data.ptr = &dirMarker;
+		if(dircacheFd() >= 0 && epoll_ctl(epfd, EPOLL_CTL_ADD, dircacheFd(), &ev) < 0)
+			logPrint(LOG_ERROR, "epoll add inotify failed: %s", strerror(errno));
+
+		logPrint(LOG_INFO, "Event loop started");
+		fflush(stdout);
+
+		while(1){
+			if((n = epoll_wait(epfd, events, MAX_EVENTS, releaseHeld(epfd))) < 0){
+				if(errno == EINTR)
+					continue;
+				logPrint(LOG_ERROR, "epoll wait failed: %s", strerror(errno));
+				exit(1);
+			}
+
+			for(i = nbulk = 0; i < n; i++){
+				if((sess = events[i].data.ptr) == NULL){
+					acceptClients(epfd, listen_sock);
+					continue;
+				}
+				if(events[i].data.ptr == &ringMarker){
+					do {
+						done = uringReap(finished, MAX_EVENTS, 0);
+						for(j = 0; j < done; j++)
+							endSession(epfd, finished[j]->owner, sessionOnRing(finished[j]->owner));
+					} while(done == MAX_EVENTS);
+					continue;
+				}
+				if(events[i].data.ptr == &dirMarker){
+					dircacheEvents();
+					continue;
+				}
+
+				// File data waits until every command of the batch has been answered
+				if(sess->state == SESS_GET_SEND || sess->state == SESS_PUT_RECV){
+					bulk[nbulk] = sess;
+					bulkevents[nbulk++] = events[i].events;
+					continue;
+				}
+				serveEvent(epfd, sess, events[i].events);
+			}
+			for(i = 0; i < nbulk; i++)
+				serveEvent(epfd, bulk[i], bulkevents[i]);
+
+			fflush(stdout);
+		}
+
+	} //END of eventLoop function
+
+
+/** Serve event - Hands the readiness of a session's socket to its state machine
+ *
+ */
+	static void serveEvent(int epfd, Session *sess, unsigned int events){
+		int result = 0;
+
+		if(events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			if(sessionWantsRead(sess))
+				result = sessionOnReadable(sess);
+		if(result == 0 && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+			if(sessionWantsWrite(sess))
+				result = sessionOnWritable(sess);
+
+		endSession(epfd, sess, result);
+
+	} //END of serveEvent function
+
+
+/** Release held - Puts sessions whose time has come back into epoll
+ *
+ *	Return: Milliseconds until the next held session is due, -1 if none is held
+ */
+	static int releaseHeld(int epfd){
+		Session **link = &held, *sess;
+		long long wake, first = 0;
+
+		while((sess = *link) != NULL){
+			if((wake = sessionHeld(sess)) == 0){
+				*link = sess->heldnext;
+				updateInterest(epfd, sess);
+				continue;
+			}
+			if(first == 0 || wake < first)
+				first = wake;
+			link = &sess->heldnext;
+		}
+
+		if(first == 0)
+			return -1;
+		return (first - shaperClock()) / 1000000 + 1;     // Rounded up, epoll waits whole milliseconds
+
+	} //END of releaseHeld function
+
+
+/** Accept clients - Accepts every pending connection and registers a session for each
+ *
+ *	Pre: Listening socket is non-blocking and readable
+ *	Post: New sessions registered for input, or the listener is drained
+ */
+	static void acceptClients(int epfd, int listen_sock){
+		int newSock;
+		socklen_t cli_addr_len;             // Client address length
+		struct sockaddr_in cli_addr;
+		struct epoll_event ev;
+		Session *sess;
+
+		metricsAcceptQueue(listen_sock);     // Connections that were waiting when this worker woke up
+
+		while(1){
+			cli_addr_len = sizeof(cli_addr);
+			newSock = accept4(listen_sock, (struct sockaddr *) &cli_addr, &cli_addr_len, SOCK_NONBLOCK);
+
+			if(newSock < 0){
+				if(errno == EINTR)
+					continue;
+				if(errno != EAGAIN && errno != EWOULDBLOCK){
+					logPrint(LOG_ERROR, "Server accept failed: %s", strerror(errno));
+					metricsAdd(MET_ACCEPT_ERRORS, 1);
+				}
+				return;
+			}
+			metricsAdd(MET_ACCEPTED, 1);
+
+			if((sess = sessionCreate(newSock)) == NULL){
+				close(newSock);
+				continue;
+			}
+
+			ev.events = sess->epevents = EPOLLIN;
+			ev.data.ptr = sess;
+			if(epoll_ctl(epfd, EPOLL_CTL_ADD, newSock, &ev) < 0){
+				logPrint(LOG_ERROR, "epoll add client failed: %s", strerror(errno));
+				sessionDestroy(sess);
+				continue;
+			}
+
+			logPrint(LOG_INFO, "New client connected (sess=%u)", sess->id);
+		}
+
+	} //END of acceptClients function
+
+
+/** End session - Destroys a session that failed or has nothing left to do, otherwise updates its interest
+ *
+ */
+	static void endSession(int epfd, Session *sess, int result){
+		unsigned int id = sess->id;
+
+		if(result < 0 || (!sessionWantsRead(sess) && !sessionWantsWrite(sess) && sess->state != SESS_RING && sess->shape.wake == 0)){
+			if(sess->epevents != 0)
+				epoll_ctl(epfd, EPOLL_CTL_DEL, sess->sock, NULL);
+			sessionDestroy(sess);
+			logPrint(LOG_INFO, "Client session closed (sess=%u)", id);
+			return;
+		}
+
+		// Only the event that held the session back can get here while it is held
+		updateInterest(epfd, sess);
+		if(sess->shape.wake != 0){
+			sess->heldnext = held;
+			held = sess;
+		}
+
+	} //END of endSession function
+
+
+/** Update interest - Watches a session for input and/or output depending on its state
+ *
+ *	Pre: sess registered with epfd, unless its epevents is 0
+ *	Post: epoll mask changed only if the session now wants something different. A session
+ *		  wanting nothing (io_uring owns its socket) is removed so hangups do not spin the loop
+ */
+	static void updateInterest(int epfd, Session *sess){
+		struct epoll_event ev;
+
+		ev.events = 0;
+		if(sessionWantsRead(sess))
+			ev.events |= EPOLLIN;
+		if(sessionWantsWrite(sess))
+			ev.events |= EPOLLOUT;
+		ev.data.ptr = sess;
+
+		if(ev.events != sess->epevents){
+			if(ev.events == 0)
+				epoll_ctl(epfd, EPOLL_CTL_DEL, sess->sock, NULL);
+			else
+				epoll_ctl(epfd, sess->epevents == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, sess->sock, &ev);
+			sess->epevents = ev.events;
+		}
+
+	} //END of updateInterest function
+
+//END of event.c
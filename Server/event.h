@@ -0,0 +1,15 @@
+/* File: event.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the epoll event engine
+ * Changes: 16/10/2026 - Added event.c/event.h, single process serves all clients
+ */
+
+#define MAX_EVENTS 256		// Events handled per epoll_wait call
+
+/* Run the event loop - accepts clients on a listening socket and serves all of them from this process
+ *
+ *	Pre: listen_sock is bound and listening
+ *	Post: Does not return unless epoll cannot be set up or accept fails fatally
+ */
+void eventLoop(int listen_sock);
@@ -0,0 +1,231 @@
+/* File: filecache.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Cache of small file contents in memory shared by the daemon's workers and their children,
+ *			so a file fetched again and again is sent without opening or reading it. Slots are grouped
+ *			in sets of FILECACHE_WAYS, a file hashes onto one set and replaces the least recently used
+ *			slot in it. A copy is only served while the file has the inode, size, mtime and ctime it was read with
+ * Changes:
+ * 16/10/2026 - Added filecache.c/filecache.h
+ * 16/10/2026 - A slot is matched on ctime too. A hit never opens the file, so without it a copy cached before
+ *				a chmod or chown would still be sent to sessions the new permissions no longer allow
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "filecache.h"
+#include "stream.h"
+#include "logger.h"
+
+typedef struct fileShared {
+	unsigned long long clock;		// Orders hits, the least recent slot of a set is replaced
+	unsigned long long hits, misses, stores, replaced, stale;
+	int sets;						// Sets of FILECACHE_WAYS slots
+	HotFile slots[];
+} FileShared;
+
+static FileShared *shared;			// NULL if the cache is off
+
+static HotFile *setFor(struct stat *st);
+static int sameFile(HotFile *hot, struct stat *st);
+
+
+/** Setup - see filecache.h
+ *
+ */
+	int filecacheSetup(long long size){
+		long long sets;
+		void *p;
+
+		if(size <= 0)
+			return 0;
+
+		sets = size / ((long long) sizeof(HotFile) * FILECACHE_WAYS);
+		if(sets < 1)
+			sets = 1;
+
+		// Shared anonymous memory is inherited by every fork(), slot pages are only touched once used
+		p = mmap(NULL, sizeof(FileShared) + sets * FILECACHE_WAYS * sizeof(HotFile), PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(p == MAP_FAILED){
+			logPrint(LOG_ERROR, "Hot-file cache setup failed: %s", strerror(errno));
+			return -1;
+		}
+
+		shared = p;
+		shared->sets = sets;
+		return 0;
+
+	} //END of filecacheSetup function
+
+
+/** Limit - see filecache.h
+ *
+ */
+	int filecacheLimit(void){
+
+		return shared == NULL ? 0 : FILECACHE_FILE;
+
+	} //END of filecacheLimit function
+
+
+/** Lookup - see filecache.h
+ *
+ */
+	HotFile *filecacheLookup(struct stat *st){
+		HotFile *hot;
+		unsigned long long seq;
+		int i;
+
+		if(shared == NULL)
+			return NULL;
+
+		for(i = 0, hot = setFor(st); i < FILECACHE_WAYS; i++, hot++){
+			if(hot->ino != st->st_ino || hot->dev != st->st_dev)
+				continue;
+
+			// Pinned before the slot is checked, so a writer either sees the pin or is seen writing
+			__atomic_add_fetch(&hot->readers, 1, __ATOMIC_SEQ_CST);
+			seq = __atomic_load_n(&hot->seq, __ATOMIC_SEQ_CST);
+			if(!(seq & 1) && hot->ino == st->st_ino && hot->dev == st->st_dev){
+				if(sameFile(hot, st)){
+					__atomic_store_n(&hot->used, __atomic_add_fetch(&shared->clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+					__atomic_add_fetch(&shared->hits, 1, __ATOMIC_RELAXED);
+					return hot;
+				}
+				__atomic_add_fetch(&shared->stale, 1, __ATOMIC_RELAXED);
+			}
+			__atomic_sub_fetch(&hot->readers, 1, __ATOMIC_RELEASE);
+		}
+
+		__atomic_add_fetch(&shared->misses, 1, __ATOMIC_RELAXED);
+		return NULL;
+
+	} //END of filecacheLookup function
+
+
+/** Store - see filecache.h
+ *
+ */
+	HotFile *filecacheStore(struct stat *st, int fd){
+		HotFile *hot, *victim = NULL;
+		struct stat now;
+		unsigned long long seq;
+		int i;
+
+		if(shared == NULL || !S_ISREG(st->st_mode) || st->st_size > FILECACHE_FILE)
+			return NULL;
+
+		// An older copy of the same file is replaced first, otherwise the slot used least recently
+		for(i = 0, hot = setFor(st); i < FILECACHE_WAYS; i++, hot++){
+			if(__atomic_load_n(&hot->readers, __ATOMIC_RELAXED) > 0 || (__atomic_load_n(&hot->seq, __ATOMIC_RELAXED) & 1))
+				continue;
+			if(hot->ino == st->st_ino && hot->dev == st->st_dev){
+				victim = hot;
+				break;
+			}
+			if(victim == NULL || hot->used < victim->used)
+				victim = hot;
+		}
+		if((hot = victim) == NULL)
+			return NULL;
+
+		// Take the slot, unless another process writes it or has pinned it meanwhile
+		seq = __atomic_load_n(&hot->seq, __ATOMIC_RELAXED);
+		if((seq & 1) || !__atomic_compare_exchange_n(&hot->seq, &seq, seq + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			return NULL;
+		if(__atomic_load_n(&hot->readers, __ATOMIC_SEQ_CST) > 0){
+			__atomic_store_n(&hot->seq, seq, __ATOMIC_RELEASE);
+			return NULL;
+		}
+
+		if(hot->ino != 0 && (hot->ino != st->st_ino || hot->dev != st->st_dev))
+			__atomic_add_fetch(&shared->replaced, 1, __ATOMIC_RELAXED);
+
+		// The copy only counts if the file did not change while it was read
+		hot->ino = 0;
+		if(pread(fd, hot->data, st->st_size, 0) != st->st_size || fstat(fd, &now) < 0 || now.st_ino != st->st_ino ||
+		   now.st_size != st->st_size || now.st_mtim.tv_sec != st->st_mtim.tv_sec || now.st_mtim.tv_nsec != st->st_mtim.tv_nsec ||
+		   now.st_ctim.tv_sec != st->st_ctim.tv_sec || now.st_ctim.tv_nsec != st->st_ctim.tv_nsec){
+			__atomic_store_n(&hot->seq, seq + 2, __ATOMIC_RELEASE);
+			return NULL;
+		}
+
+		hot->dev = st->st_dev;
+		hot->ino = st->st_ino;
+		hot->size = st->st_size;
+		hot->mtime = st->st_mtim;
+		hot->ctime = st->st_ctim;
+		hot->crc = crc32buf(0, hot->data, st->st_size);
+		hot->used = __atomic_add_fetch(&shared->clock, 1, __ATOMIC_RELAXED);
+
+		// Pinned for the caller before other processes can see it
+		__atomic_add_fetch(&hot->readers, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&hot->seq, seq + 2, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&shared->stores, 1, __ATOMIC_RELAXED);
+
+		return hot;
+
+	} //END of filecacheStore function
+
+
+/** Release - see filecache.h
+ *
+ */
+	void filecacheRelease(HotFile *hot){
+
+		__atomic_sub_fetch(&hot->readers, 1, __ATOMIC_RELEASE);
+
+	} //END of filecacheRelease function
+
+
+/** Stats - see filecache.h
+ *
+ */
+	void filecacheStats(char *buf, int size){
+		unsigned long long hits, misses;
+
+		if(shared == NULL){
+			snprintf(buf, size, "cache off");
+			return;
+		}
+
+		hits = __atomic_load_n(&shared->hits, __ATOMIC_RELAXED);
+		misses = __atomic_load_n(&shared->misses, __ATOMIC_RELAXED);
+		snprintf(buf, size, "cache %llu hits (%.1f%%), %llu misses, %llu stored, %llu replaced, %llu stale, %d slots of %d KB",
+				 hits, hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0, misses,
+				 __atomic_load_n(&shared->stores, __ATOMIC_RELAXED), __atomic_load_n(&shared->replaced, __ATOMIC_RELAXED),
+				 __atomic_load_n(&shared->stale, __ATOMIC_RELAXED), shared->sets * FILECACHE_WAYS, FILECACHE_FILE / 1024);
+
+	} //END of filecacheStats function
+
+
+/** Set for - first slot of the set a file is kept in
+ *
+ */
+	static HotFile *setFor(struct stat *st){
+		unsigned long long h = (st->st_ino * 0x9E3779B97F4A7C15ULL) ^ st->st_dev;
+
+		return &shared->slots[(h ^ h >> 29) % shared->sets * FILECACHE_WAYS];
+
+	} //END of setFor function
+
+
+/** Same file - whether a slot holds the version of the file st describes
+ *
+ */
+	static int sameFile(HotFile *hot, struct stat *st){
+
+		return hot->size == st->st_size && hot->mtime.tv_sec == st->st_mtim.tv_sec && hot->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+			   hot->ctime.tv_sec == st->st_ctim.tv_sec && hot->ctime.tv_nsec == st->st_ctim.tv_nsec;
+
+	} //END of sameFile function
+
+//END of filecache.c
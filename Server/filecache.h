@@ -0,0 +1,65 @@
+/* File: filecache.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the hot-file cache shared by the server processes
+ * Changes: 16/10/2026 - Added filecache.c/filecache.h, small files kept ready to send as one v2 data frame
+ *			16/10/2026 - Slots keep the ctime of the file as well, so a chmod or chown ends a cached copy
+ */
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define FILECACHE_FILE (1024*64)			// Largest file kept
+#define FILECACHE_WAYS 8					// Slots a file may be kept in, the least recently used is replaced
+#define FILECACHE_DEFAULT (1024*1024*16)	// Size of the cache unless -m says otherwise
+
+typedef struct hotFile {
+	unsigned long long seq;			// Odd while a process writes the slot
+	int readers;					// Processes sending from the slot, it is not replaced meanwhile
+	unsigned long long used;		// Clock of the last hit
+	dev_t dev;						// File, and the version of it kept
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;			// Changed by chmod/chown, a copy is not served past a permission change
+	unsigned int crc;				// CRC-32 of the contents, for checksummed frames
+	char data[FILECACHE_FILE];		// Contents, the payload of the frame
+} HotFile;
+
+/* Set up a cache of size bytes shared by this process and every process it forks afterwards
+ *
+ *	Pre: Called once, before the workers are forked. size 0 turns the cache off
+ *	Post: size is rounded down to whole sets of FILECACHE_WAYS slots, at least one set
+ *	Return: 0, or -1 if the shared memory cannot be mapped (files are then never cached)
+ */
+int filecacheSetup(long long size);
+
+/* Largest file the cache keeps, 0 if the cache is off */
+int filecacheLimit(void);
+
+/* Look up file st, which must have the same inode, size, mtime and ctime as the copy kept
+ *
+ *	Post: On a hit the slot is pinned, so it is not replaced until filecacheRelease. Counted as a hit,
+ *		  a miss, or stale if an older version of the file was found
+ *	Return: The slot, or NULL on a miss
+ */
+HotFile *filecacheLookup(struct stat *st);
+
+/* Read file fd (whose stat is st) into the slot of its set that was used least recently
+ *
+ *	Post: Nothing is stored if the file is too large, every slot of the set is pinned or being written,
+ *		  or the file changed while it was read
+ *	Return: The slot, pinned as by filecacheLookup, or NULL
+ */
+HotFile *filecacheStore(struct stat *st, int fd);
+
+/* Unpin a slot returned by filecacheLookup or filecacheStore */
+void filecacheRelease(HotFile *hot);
+
+/* Hit, miss, store, replacement and stale counts of all processes, for the log and stats */
+void filecacheStats(char *buf, int size);
+
+#endif
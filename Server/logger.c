@@ -0,0 +1,384 @@
+/* File: logger.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Asynchronous log of the server. Every process (daemon, worker, fork mode child) formats its
+ *			records into a ring of its own in memory shared with a flusher process. Only the process
+ *			writes its ring and only the flusher empties it, so neither side takes a lock. The flusher
+ *			collects the records of all rings and writes them with one write() per batch
+ * Changes:
+ * 16/10/2026 - Added logger.c/logger.h
+ * 16/10/2026 - The flusher ignores SIGUSR1, which asks the daemon for a metrics dump
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include "logger.h"
+
+#define FLUSH_BUFSIZE (1024*256)		// Records the flusher collects before a write
+
+typedef struct logRing {
+	pid_t owner;						// Process writing the ring, 0 while it is free
+	unsigned long long dropped;			// Records the owner could not fit (changed by the owner only)
+	unsigned long long head __attribute__((aligned(64)));	// Bytes ever added, moved by the owner only
+	unsigned long long tail __attribute__((aligned(64)));	// Bytes ever written out, moved by the flusher only
+	char data[LOG_RING];
+} LogRing;
+
+typedef struct logShared {
+	unsigned long long unringed;		// Records dropped because every ring was taken
+	LogRing rings[LOG_RINGS];
+} LogShared;
+
+static LogShared *shared;				// NULL until set up (records are then written directly)
+static int logFd = STDOUT_FILENO;
+static int maxLevel = LOG_INFO;
+static LogRing *mine;					// Ring of this process, claimed with its first record
+static pid_t myPid;
+static time_t stampSec = -1;			// Second the cached time stamp is for
+static char stamp[32];
+static volatile sig_atomic_t stopping;	// Flusher was told to stop, one more sweep is made
+static const char *levelNames[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+static int recordStart(char *rec, int level);
+static void addRecord(char *rec, int len);
+static LogRing *claimRing(void);
+static void forked(void);
+static void flushLoop(void);
+static int sweep(char *buf, unsigned long long *reported, unsigned long long *unringed);
+static int collect(char *buf, int len, char *data, int n);
+static void writeAll(char *buf, int len);
+static void stopFlusher(int signo);
+
+
+/** Setup - see logger.h
+ *
+ */
+	int logSetup(int fd, int level){
+		void *p;
+		pid_t pid;
+
+		logFd = fd;
+		maxLevel = level;
+		myPid = getpid();
+		pthread_atfork(NULL, NULL, forked);     // A child needs a ring of its own
+
+		// Shared anonymous memory is inherited by every fork(), ring pages are only touched once used
+		p = mmap(NULL, sizeof(LogShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(p == MAP_FAILED){
+			logPrint(LOG_ERROR, "Log rings setup failed: %s, records are written directly", strerror(errno));
+			return -1;
+		}
+
+		fflush(stdout);     // Do not duplicate buffered output in the flusher
+		if((pid = fork()) < 0){
+			munmap(p, sizeof(LogShared));
+			logPrint(LOG_ERROR, "Log flusher fork failed: %s, records are written directly", strerror(errno));
+			return -1;
+		} else if(pid == 0){
+			shared = p;
+			flushLoop();
+			_exit(0);
+		}
+
+		shared = p;
+		logPrint(LOG_INFO, "Log flusher pid = %d", pid);
+		return 0;
+
+	} //END of logSetup function
+
+
+/** Level - see logger.h
+ *
+ */
+	int logLevel(char *name){
+		int i;
+
+		for(i = LOG_ERROR; i <= LOG_DEBUG; i++)
+			if(strcasecmp(name, levelNames[i]) == 0)
+				return i;
+		return -1;
+
+	} //END of logLevel function
+
+
+/** Wants - see logger.h
+ *
+ */
+	int logWants(int level){
+
+		return level <= maxLevel;
+
+	} //END of logWants function
+
+
+/** Print - see logger.h
+ *
+ */
+	void logPrint(int level, char *fmt, ...){
+		char rec[LOG_LINE];
+		va_list ap;
+		int n, m;
+
+		if(level > maxLevel)
+			return;
+
+		n = recordStart(rec, level);
+		va_start(ap, fmt);
+		m = vsnprintf(rec + n, sizeof(rec) - n - 1, fmt, ap);
+		va_end(ap);
+
+		// A record that was cut short still ends its line
+		n += m < 0 ? 0 : m < (int) sizeof(rec) - n - 1 ? m : (int) sizeof(rec) - n - 2;
+		if(rec[n - 1] != '\n')
+			rec[n++] = '\n';
+		addRecord(rec, n);
+
+	} //END of logPrint function
+
+
+/** Request - see logger.h
+ *
+ */
+	void logRequest(unsigned int session, char opcode, long long bytes, long long usec){
+
+		logPrint(LOG_INFO, "request sess=%u op=%c bytes=%lld us=%lld", session, opcode, bytes, usec);
+
+	} //END of logRequest function
+
+
+/** Record start - writes the time stamp, level and pid that begin every record
+ *
+ *	Return: bytes written to rec
+ */
+	static int recordStart(char *rec, int level){
+		struct timespec ts;
+		struct tm tm;
+
+		// The date and time only change once a second, so they are formatted once a second
+		clock_gettime(CLOCK_REALTIME, &ts);
+		if(ts.tv_sec != stampSec){
+			localtime_r(&ts.tv_sec, &tm);
+			strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+			stampSec = ts.tv_sec;
+		}
+
+		return sprintf(rec, "%s.%03ld %-5s %d ", stamp, ts.tv_nsec / 1000000, levelNames[level], (int) myPid);
+
+	} //END of recordStart function
+
+
+/** Add record - copies a formatted record into the ring of this process
+ *
+ *	Post: Record added, or dropped and counted if the ring is full (the owner never waits for the flusher)
+ */
+	static void addRecord(char *rec, int len){
+		unsigned long long head, tail;
+		int off, first;
+
+		if(shared == NULL){
+			write(logFd, rec, len);     // No flusher, the record is written straight away
+			return;
+		}
+		if(mine == NULL && (mine = claimRing()) == NULL){
+			__atomic_add_fetch(&shared->unringed, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		head = mine->head;
+		tail = __atomic_load_n(&mine->tail, __ATOMIC_ACQUIRE);
+		if(head - tail + len > LOG_RING){
+			__atomic_store_n(&mine->dropped, mine->dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		// The record may wrap around the end of the ring
+		off = head % LOG_RING;
+		first = LOG_RING - off < len ? LOG_RING - off : len;
+		memcpy(mine->data + off, rec, first);
+		memcpy(mine->data, rec + first, len - first);
+		__atomic_store_n(&mine->head, head + len, __ATOMIC_RELEASE);
+
+	} //END of addRecord function
+
+
+/** Claim ring - takes a free ring for this process
+ *
+ *	Return: The ring, or NULL if every ring belongs to another process
+ */
+	static LogRing *claimRing(void){
+		pid_t none;
+		int i;
+
+		for(i = 0; i < LOG_RINGS; i++){
+			none = 0;
+			if(__atomic_compare_exchange_n(&shared->rings[i].owner, &none, myPid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				return &shared->rings[i];
+		}
+		return NULL;
+
+	} //END of claimRing function
+
+
+/** Forked - runs in the child after every fork(), the ring of the parent is not the child's to write
+ *
+ */
+	static void forked(void){
+
+		myPid = getpid();
+		mine = NULL;
+
+	} //END of forked function
+
+
+/** Flush loop - body of the flusher process, sweeps the rings until the daemon stops
+ *
+ *	Post: Exits after a last sweep once SIGTERM arrives, which the kernel also sends when the daemon dies
+ */
+	static void flushLoop(void){
+		static unsigned long long reported[LOG_RINGS];		// Drops of each ring already logged
+		unsigned long long unringed = 0;
+		struct timespec idle;
+		struct sigaction act;
+		char *buf;
+		int n, last;
+
+		act.sa_handler = stopFlusher;
+		sigemptyset(&act.sa_mask);
+		act.sa_flags = 0;
+		sigaction(SIGTERM, &act, NULL);
+		signal(SIGINT, SIG_IGN);
+		signal(SIGUSR1, SIG_IGN);     // Meant for the daemon (metrics dump)
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+		if((buf = malloc(FLUSH_BUFSIZE)) == NULL)
+			_exit(1);
+
+		do {
+			last = stopping;
+			n = sweep(buf, reported, &unringed);
+
+			// A busy log is written as fast as it fills, a quiet one in batches
+			if(n < LOG_BATCH && !last){
+				idle.tv_sec = 0;
+				idle.tv_nsec = (n > 0 ? 1 : LOG_IDLE_MS) * 1000000L;
+				nanosleep(&idle, NULL);
+			}
+		} while(!last);
+
+	} //END of flushLoop function
+
+
+/** Sweep - takes the records waiting in every ring and writes them
+ *
+ *	Post: Records of each ring are written in the order they were added. Drops are logged, and the ring of
+ *		  a process that has exited is freed once it is empty
+ *	Return: Bytes of records taken from the rings
+ */
+	static int sweep(char *buf, unsigned long long *reported, unsigned long long *unringed){
+		char rec[LOG_LINE];
+		unsigned long long head, tail, dropped;
+		int i, n, len = 0, total = 0, alive;
+		LogRing *r;
+		pid_t owner;
+
+		for(i = 0; i < LOG_RINGS; i++){
+			r = &shared->rings[i];
+			if((owner = __atomic_load_n(&r->owner, __ATOMIC_ACQUIRE)) == 0)
+				continue;
+
+			// Checked first, so nothing can be added after the last records are taken
+			alive = kill(owner, 0) == 0 || errno == EPERM;
+
+			head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+			for(tail = r->tail; tail < head; tail += n){
+				n = head - tail < LOG_RING - tail % LOG_RING ? head - tail : LOG_RING - tail % LOG_RING;
+				len = collect(buf, len, r->data + tail % LOG_RING, n);
+				total += n;
+			}
+			__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+			if((dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED)) != reported[i]){
+				n = recordStart(rec, LOG_WARN);
+				n += snprintf(rec + n, sizeof(rec) - n, "%llu records of process %d dropped, its log ring was full\n",
+							  dropped - reported[i], (int) owner);
+				len = collect(buf, len, rec, n);
+				reported[i] = dropped;
+			}
+
+			if(!alive){
+				r->dropped = reported[i] = 0;
+				__atomic_store_n(&r->owner, 0, __ATOMIC_RELEASE);
+			}
+		}
+
+		if((dropped = __atomic_load_n(&shared->unringed, __ATOMIC_RELAXED)) != *unringed){
+			n = recordStart(rec, LOG_WARN);
+			n += snprintf(rec + n, sizeof(rec) - n, "%llu records dropped, every log ring was taken\n", dropped - *unringed);
+			len = collect(buf, len, rec, n);
+			*unringed = dropped;
+		}
+
+		writeAll(buf, len);
+		return total;
+
+	} //END of sweep function
+
+
+/** Collect - appends n bytes to the batch in buf, writing the batch first if they do not fit
+ *
+ *	Pre: n <= FLUSH_BUFSIZE
+ *	Return: Bytes now in buf
+ */
+	static int collect(char *buf, int len, char *data, int n){
+
+		if(len + n > FLUSH_BUFSIZE){
+			writeAll(buf, len);
+			len = 0;
+		}
+		memcpy(buf + len, data, n);
+
+		return len + n;
+
+	} //END of collect function
+
+
+/** Write all - writes a batch to the log file, however many write() calls it takes
+ *
+ */
+	static void writeAll(char *buf, int len){
+		int n;
+
+		while(len > 0){
+			if((n = write(logFd, buf, len)) < 0){
+				if(errno == EINTR)
+					continue;
+				return;     // Nowhere left to report it
+			}
+			buf += n;
+			len -= n;
+		}
+
+	} //END of writeAll function
+
+
+/** Stop flusher - SIGTERM handler of the flusher, the loop ends after one more sweep
+ *
+ */
+	static void stopFlusher(int signo){
+
+		stopping = 1;
+
+	} //END of stopFlusher function
+
+//END of logger.c
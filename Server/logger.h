@@ -0,0 +1,45 @@
+/* File: logger.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the asynchronous server log
+ * Changes: 16/10/2026 - Added logger.c/logger.h, records pass through a ring per process to a flusher process
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#define LOG_ERROR 0						// Record levels, the ones up to the level chosen with -l are kept
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#define LOG_RINGS 512					// Processes with a ring of their own at once (daemon, workers, fork mode children)
+#define LOG_RING (1024*64)				// Bytes of records one process can have waiting for the flusher
+#define LOG_LINE 1024					// Longest record, longer ones are cut short
+#define LOG_BATCH (1024*16)				// Waiting bytes the flusher writes without sleeping first
+#define LOG_IDLE_MS 20					// Flusher sleep when every ring was empty
+
+/* Start the log: rings in memory shared with every process forked afterwards, drained into fd
+ * by a flusher process that writes many records at once
+ *
+ *	Pre: Called once by the daemon before it forks anything else, fd is the open log file
+ *	Return: 0, or -1 if the rings or the flusher cannot be set up (records are then written to fd directly)
+ */
+int logSetup(int fd, int level);
+
+/* Level named by the -l option ("error", "warn", "info" or "debug"), -1 if there is no such level */
+int logLevel(char *name);
+
+/* Whether records of this level are kept */
+int logWants(int level);
+
+/* Add a record, formatted as by printf (the newline is added). Never waits for the log file:
+ * a record that does not fit in the ring of this process is dropped, and the flusher logs
+ * how many were lost
+ */
+void logPrint(int level, char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Add the record of a finished request (INFO): session, opcode, bytes moved on the socket and latency */
+void logRequest(unsigned int session, char opcode, long long bytes, long long usec);
+
+#endif
@@ -0,0 +1,351 @@
+/* File: metrics.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Counters and request latency histograms of the server. Each process adds to a slot of its own in
+ *			memory shared by the daemon's workers and their children, so counting takes no lock and no cache
+ *			line is written by two processes. A report sums every slot. Slots of processes that have exited keep
+ *			their counts and are taken over by new processes
+ * Changes:
+ * 16/10/2026 - Added metrics.c/metrics.h
+ * 16/10/2026 - The report shows the hot-file cache counts
+ * 16/10/2026 - The report shows the bandwidth scheduler's limits and holds
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "metrics.h"
+#include "dircache.h"
+#include "filecache.h"
+#include "shaper.h"
+#include "logger.h"
+
+#define SUB_BITS 3						// log2(MET_SUB)
+
+typedef struct opStats {
+	long long count, sum, max;			// Requests, total and largest latency (microseconds)
+	long long buckets[MET_BUCKETS];		// Requests by latency, MET_SUB buckets per power of two
+} OpStats;
+
+typedef struct metSlot {
+	pid_t owner;						// Process adding to the slot, 0 if never used
+	long long counters[MET_COUNTERS];
+	long long acceptq, acceptqmax;		// Accept queue of the process's listener: last seen, most seen
+	OpStats ops[MET_OPS];
+} __attribute__((aligned(64))) MetSlot;
+
+typedef struct metShared {
+	time_t started;
+	long long unslotted;				// Events not counted because every slot was taken
+	MetSlot slots[MET_SLOTS];
+} MetShared;
+
+static MetShared *shared;				// NULL if nothing is counted
+static MetSlot *mine;					// Slot of this process, claimed with its first event
+static pid_t myPid;
+
+static MetSlot *claimSlot(void);
+static int slotAlive(pid_t owner);
+static void bump(long long *counter, long long n);
+static int bucketOf(long long usec);
+static long long bucketTop(int bucket);
+static long long percentile(OpStats *op, int percent);
+static int appendf(char *buf, int size, int len, char *fmt, ...) __attribute__((format(printf, 4, 5)));
+static void forked(void);
+
+
+/** Setup - see metrics.h
+ *
+ */
+	int metricsSetup(void){
+		void *p;
+
+		// Shared anonymous memory is inherited by every fork(), slot pages are only touched once used
+		p = mmap(NULL, sizeof(MetShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(p == MAP_FAILED){
+			logPrint(LOG_ERROR, "Metrics setup failed: %s", strerror(errno));
+			return -1;
+		}
+
+		shared = p;
+		shared->started = time(NULL);
+		myPid = getpid();
+		pthread_atfork(NULL, NULL, forked);     // A child counts in a slot of its own
+		return 0;
+
+	} //END of metricsSetup function
+
+
+/** Add - see metrics.h
+ *
+ */
+	void metricsAdd(int counter, long long n){
+
+		if(shared == NULL)
+			return;
+		if(mine == NULL && (mine = claimSlot()) == NULL)
+			return;
+
+		bump(&mine->counters[counter], n);
+
+	} //END of metricsAdd function
+
+
+/** Request - see metrics.h
+ *
+ */
+	void metricsRequest(char opcode, long long usec){
+		OpStats *op;
+
+		if(shared == NULL)
+			return;
+		if(mine == NULL && (mine = claimSlot()) == NULL)
+			return;
+
+		op = &mine->ops[opcode >= 'A' && opcode <= 'Z' ? opcode - 'A' : MET_OPS - 1];
+		if(usec < 0)
+			usec = 0;
+		bump(&op->count, 1);
+		bump(&op->sum, usec);
+		bump(&op->buckets[bucketOf(usec)], 1);
+		if(usec > op->max)
+			__atomic_store_n(&op->max, usec, __ATOMIC_RELAXED);
+
+	} //END of metricsRequest function
+
+
+/** Accept queue - see metrics.h
+ *
+ */
+	void metricsAcceptQueue(int fd){
+		struct tcp_info info;
+		socklen_t len = sizeof(info);
+
+		if(shared == NULL || (mine == NULL && (mine = claimSlot()) == NULL))
+			return;
+
+		// On a listening socket tcpi_unacked is the number of connections waiting to be accepted
+		if(getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+			return;
+
+		__atomic_store_n(&mine->acceptq, info.tcpi_unacked, __ATOMIC_RELAXED);
+		if(info.tcpi_unacked > mine->acceptqmax)
+			__atomic_store_n(&mine->acceptqmax, info.tcpi_unacked, __ATOMIC_RELAXED);
+
+	} //END of metricsAcceptQueue function
+
+
+/** Report - see metrics.h
+ *
+ */
+	int metricsReport(char *buf, int size){
+		MetSlot *sum, *slot;
+		OpStats *op;
+		char cache[192];
+		int i, j, b, len, live = 0;
+
+		if(shared == NULL || (sum = calloc(1, sizeof(MetSlot))) == NULL)
+			return appendf(buf, size, 0, "metrics off");
+
+		for(i = 0; i < MET_SLOTS; i++){
+			slot = &shared->slots[i];
+			if(__atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE) == 0)
+				continue;
+
+			// Open sessions and the accept queue only count while their process runs
+			if(slotAlive(slot->owner)){
+				live++;
+				sum->counters[MET_ACTIVE] += __atomic_load_n(&slot->counters[MET_ACTIVE], __ATOMIC_RELAXED);
+				sum->acceptq += __atomic_load_n(&slot->acceptq, __ATOMIC_RELAXED);
+			}
+			for(j = 0; j < MET_COUNTERS; j++)
+				if(j != MET_ACTIVE)
+					sum->counters[j] += __atomic_load_n(&slot->counters[j], __ATOMIC_RELAXED);
+			if(slot->acceptqmax > sum->acceptqmax)
+				sum->acceptqmax = slot->acceptqmax;
+
+			for(j = 0; j < MET_OPS; j++){
+				op = &slot->ops[j];
+				if(__atomic_load_n(&op->count, __ATOMIC_RELAXED) == 0)
+					continue;
+				sum->ops[j].count += op->count;
+				sum->ops[j].sum += op->sum;
+				if(op->max > sum->ops[j].max)
+					sum->ops[j].max = op->max;
+				for(b = 0; b < MET_BUCKETS; b++)
+					sum->ops[j].buckets[b] += __atomic_load_n(&op->buckets[b], __ATOMIC_RELAXED);
+			}
+		}
+
+		len = appendf(buf, size, 0, "uptime %lld s, %d processes counting",
+					  (long long) (time(NULL) - shared->started), live);
+		if(shared->unslotted > 0)
+			len = appendf(buf, size, len, ", %lld events not counted", shared->unslotted);
+		len = appendf(buf, size, len, "\nsessions %lld open, %lld total, %lld accepted, accept queue %lld now (%lld most)",
+					  sum->counters[MET_ACTIVE], sum->counters[MET_SESSIONS], sum->counters[MET_ACCEPTED],
+					  sum->acceptq, sum->acceptqmax);
+		len = appendf(buf, size, len, "\nbytes %lld in, %lld out\nerrors %lld accept, %lld protocol, %lld io",
+					  sum->counters[MET_BYTES_IN], sum->counters[MET_BYTES_OUT], sum->counters[MET_ACCEPT_ERRORS],
+					  sum->counters[MET_PROTOCOL_ERRORS], sum->counters[MET_IO_ERRORS]);
+		dircacheStats(cache, sizeof(cache));
+		len = appendf(buf, size, len, "\nlistings %s", cache);
+		filecacheStats(cache, sizeof(cache));
+		len = appendf(buf, size, len, "\nhot files %s", cache);
+		shaperStats(cache, sizeof(cache));
+		len = appendf(buf, size, len, "\nscheduler %s", cache);
+
+		// Latency percentiles are the top of their bucket, at most 12.5% above the real value
+		len = appendf(buf, size, len, "\nop %10s %9s %9s %9s %9s %9s  (us)", "count", "avg", "p50", "p90", "p99", "max");
+		for(j = 0; j < MET_OPS; j++){
+			op = &sum->ops[j];
+			if(op->count == 0)
+				continue;
+			len = appendf(buf, size, len, "\n%c  %10lld %9lld %9lld %9lld %9lld %9lld", j < MET_OPS - 1 ? 'A' + j : '?',
+						  op->count, op->sum / op->count, percentile(op, 50), percentile(op, 90), percentile(op, 99), op->max);
+		}
+
+		free(sum);
+		return len;
+
+	} //END of metricsReport function
+
+
+/** Claim slot - takes a slot that was never used or whose process has exited
+ *
+ *	Post: The counts of an exited process stay in its slot, only its open sessions and accept queue are cleared
+ *	Return: The slot, or NULL if every slot belongs to a running process
+ */
+	static MetSlot *claimSlot(void){
+		pid_t owner;
+		int i;
+
+		for(i = 0; i < MET_SLOTS; i++){
+			owner = __atomic_load_n(&shared->slots[i].owner, __ATOMIC_ACQUIRE);
+			if(owner != 0 && slotAlive(owner))
+				continue;
+			if(__atomic_compare_exchange_n(&shared->slots[i].owner, &owner, myPid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+				__atomic_store_n(&shared->slots[i].counters[MET_ACTIVE], 0, __ATOMIC_RELAXED);
+				__atomic_store_n(&shared->slots[i].acceptq, 0, __ATOMIC_RELAXED);
+				return &shared->slots[i];
+			}
+		}
+
+		__atomic_add_fetch(&shared->unslotted, 1, __ATOMIC_RELAXED);
+		return NULL;
+
+	} //END of claimSlot function
+
+
+/** Slot alive - whether the process owning a slot still runs
+ *
+ */
+	static int slotAlive(pid_t owner){
+
+		return kill(owner, 0) == 0 || errno != ESRCH;
+
+	} //END of slotAlive function
+
+
+/** Bump - adds to a counter of this process's slot. Only this process writes it, so no locked
+ *		   instruction is needed, the store only has to be whole for a report reading it
+ *
+ */
+	static void bump(long long *counter, long long n){
+
+		__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+
+	} //END of bump function
+
+
+/** Bucket of - histogram bucket of a latency: exact below MET_SUB, then MET_SUB buckets per power of two
+ *
+ */
+	static int bucketOf(long long usec){
+		int e, b;
+
+		if(usec < MET_SUB)
+			return usec;
+
+		e = 63 - __builtin_clzll(usec);
+		b = (e - SUB_BITS + 1) * MET_SUB + ((usec >> (e - SUB_BITS)) & (MET_SUB - 1));
+
+		return b < MET_BUCKETS ? b : MET_BUCKETS - 1;
+
+	} //END of bucketOf function
+
+
+/** Bucket top - largest latency that falls in a bucket
+ *
+ */
+	static long long bucketTop(int bucket){
+		int e;
+
+		if(bucket < MET_SUB)
+			return bucket;
+
+		e = bucket / MET_SUB + SUB_BITS - 1;
+		return ((long long) (MET_SUB + bucket % MET_SUB + 1) << (e - SUB_BITS)) - 1;
+
+	} //END of bucketTop function
+
+
+/** Percentile - latency that percent of the requests of an opcode did not exceed
+ *
+ */
+	static long long percentile(OpStats *op, int percent){
+		long long want, seen = 0;
+		int b;
+
+		want = (op->count * percent + 99) / 100;
+		for(b = 0; b < MET_BUCKETS; b++)
+			if((seen += op->buckets[b]) >= want)
+				return bucketTop(b) < op->max ? bucketTop(b) : op->max;
+
+		return op->max;
+
+	} //END of percentile function
+
+
+/** Append formatted - adds text to buf, never past its end
+ *
+ *	Return: Length of the text now in buf
+ */
+	static int appendf(char *buf, int size, int len, char *fmt, ...){
+		va_list ap;
+		int n;
+
+		if(len >= size - 1)
+			return len;
+
+		va_start(ap, fmt);
+		n = vsnprintf(buf + len, size - len, fmt, ap);
+		va_end(ap);
+
+		return n < 0 ? len : len + n < size - 1 ? len + n : size - 1;
+
+	} //END of appendf function
+
+
+/** Forked - runs in the child after every fork(), the slot of the parent is not the child's to write
+ *
+ */
+	static void forked(void){
+
+		myPid = getpid();
+		mine = NULL;
+
+	} //END of forked function
+
+//END of metrics.c
@@ -0,0 +1,50 @@
+/* File: metrics.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the server counters and request latency histograms
+ * Changes: 16/10/2026 - Added metrics.c/metrics.h, kept per process in shared memory and summed when read
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#define MET_SLOTS 512					// Processes counting at once (daemon, workers, fork mode children)
+#define MET_OPS 27						// Opcodes 'A' - 'Z', then every other first byte
+#define MET_SUB 8						// Histogram buckets per power of two (values within 12.5%)
+#define MET_BUCKETS 320					// Covers latencies up to 2^40 microseconds
+
+// Counters - added to by the process that saw the event
+#define MET_SESSIONS 0					// Sessions created
+#define MET_ACTIVE 1					// Sessions open now (processes that have exited are left out)
+#define MET_ACCEPTED 2					// Connections accepted
+#define MET_ACCEPT_ERRORS 3				// accept() failures
+#define MET_PROTOCOL_ERRORS 4			// Frames refused: not valid in the session state or failed their checksum
+#define MET_IO_ERRORS 5					// Socket writes, file reads and io_uring transfers that failed
+#define MET_BYTES_IN 6					// Bytes read from client sockets
+#define MET_BYTES_OUT 7					// Bytes written to client sockets
+#define MET_COUNTERS 8
+
+/* Set up the counters shared by this process and every process it forks afterwards
+ *
+ *	Pre: Called once by the daemon, before the workers are forked
+ *	Return: 0, or -1 if the shared memory cannot be mapped (nothing is counted then)
+ */
+int metricsSetup(void);
+
+/* Add n to one of the MET_* counters of this process */
+void metricsAdd(int counter, long long n);
+
+/* Count a request that has been answered, with its latency, in the histogram of its opcode */
+void metricsRequest(char opcode, long long usec);
+
+/* Note the accept queue of listening socket fd (connections waiting now, the most seen) */
+void metricsAcceptQueue(int fd);
+
+/* Text report of the counters and the latency percentiles of each opcode, summed over every process
+ *
+ *	Post: buf holds lines separated by '\n', cut short if they do not fit in size bytes
+ *	Return: Length of the text in buf
+ */
+int metricsReport(char *buf, int size);
+
+#endif
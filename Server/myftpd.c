@@ -20,6 +20,29 @@
  *					- Connection to client into connectClient function
  *					- get functionality in getFile function
  *					- put functionality in putFile function
+ * 16/10/2026 - Added epoll event engine (event.c) as the default mode, all clients served by one process
+ *			  - Opcode handling moved into a per-session state machine (session.c), shared by both modes
+ *			  - Added -f option to keep the fork per connection model as a fallback
+ *			  - Added pre-forked worker pool (-w) supervised by the daemon, each worker with its own
+ *				SO_REUSEPORT listener and a configurable listen backlog (-b)
+ *			  - Added -u option to move get/put file data with io_uring (uring.c), falling back to
+ *				sendfile/splice when the kernel has no io_uring
+ *			  - The daemon sets up the directory listing cache (dircache.c) before forking the workers, so every
+ *				worker and fork mode child shares it
+ *			  - Log records go through the asynchronous logger (logger.c), started by the daemon before anything
+ *				else is forked. Added -l option to choose the level of records kept (default info)
+ *			  - The daemon sets up the shared metrics (metrics.c) before forking the workers. SIGUSR1 to the
+ *				daemon writes the metrics of every process to the log
+ *			  - The daemon sets up the hot-file cache (filecache.c) before forking the workers. Added -m option
+ *				to size it (default 16 MB, 0 turns it off)
+ *			  - Added the bandwidth scheduler (shaper.c): -r limits each transfer, -R all of them together, and
+ *				-W reads a file of client address weights. A fork mode child sleeps while its transfer is held back
+ *			  - Added the socket transport profile (transport.c): -T reads a profile file and -t changes one
+ *				setting, the listener gets it before bind() so accepted sockets start with the buffer sizes
+ *			  - The daemon opens the initial directory for the sessions (sessionSetup) before it forks anything
+ *			  - The port is bound once without SO_REUSEPORT before any worker starts, so a second server on the
+ *				same port fails instead of taking a share of the first one's clients. A slot whose workers keep
+ *				exiting on start stops the server, and a slot whose fork failed is tried again
  */
 
 #include <stdio.h>
@@ -28,6 +51,7 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -36,27 +60,50 @@
 #include <sys/wait.h>
 #include <netinet/in.h>
 #include <netdb.h>
-#include "stream.h"
+#include "session.h"
+#include "event.h"
+#include "metrics.h"
+#include "transport.h"
 
 #define SERV_TCP_PORT 41147     // Default server listening port
-#define BUFSIZE (1024*5)
+#define MAX_WORKERS 256			// Upper limit for the -w option
+#define RING_SLOTS 4			// io_uring transfers one event mode worker runs at once
+#define WORKER_RETRIES 5		// Workers of a slot that may exit right after starting before the daemon gives up
+#define WORKER_SETTLE 1000		// Milliseconds a worker must run to count as started
+
+static int useRing;				// -u: move file data with io_uring where the kernel has it
 
 
 void daemonInit();
+void catchChildren();
 void claimChildren();
+void superviseWorkers(int nworkers, unsigned short port, int backlog, int forkMode);
+pid_t spawnWorker(unsigned short port, int backlog, int forkMode);
+void runWorker(unsigned short port, int backlog, int forkMode);
+void stopWorkers(int signo);
+void requestDump(int signo);
+void dumpMetrics();
+int portFree(unsigned short listen_port);
 int socketSetup(unsigned short listen_port);
 int connectClient(int loc_socket);
 void serveClient(int sock);
-void readDirFiles(char response[]);
-void getFile(char *loc_buf, char command, int sock);
-void putFile(char *loc_buf, char command, int sock);
+void setupRing(int nslots);
+long long sizeArg(char *arg);
+long long nowMsec();
 
 
 /** MAIN function
 *
 */
 	int main(int argc, char *argv[]){
-		int sock, newSock, fd;           						// Socket
+		int fd, opt;
+		int level = LOG_INFO;								// Records up to this level are logged
+		int forkMode = 0;									// Fork per connection instead of event loop
+		int nworkers = sysconf(_SC_NPROCESSORS_ONLN);		// Worker processes, default one per CPU
+		int backlog = SOMAXCONN;							// Listen backlog of each worker
+		long long hotSize = FILECACHE_DEFAULT;				// Bytes of the hot-file cache
+		long long rate = 0, globalRate = 0;					// Bytes per second of a transfer / of all, 0 for no limit
+		char *weights = NULL;								// File of client address weights
 		unsigned short port = SERV_TCP_PORT;                // Server listening port
 		char logfilename[256]; // Test message recieved by server
 		
@@ -69,37 +116,85 @@ void putFile(char *loc_buf, char command, int sock);
 		else if((dup2 (fd, STDOUT_FILENO)) < 0)
 			printf("Error: cannot redirect log file %s!\n", logfilename);
 		
+		// Get options
+		while((opt = getopt(argc, argv, "fuw:b:l:m:r:R:W:T:t:")) != -1){
+			if(opt == 'f')
+				forkMode = 1;
+			else if(opt == 'u')
+				useRing = 1;
+			else if(opt == 'w' && atoi(optarg) >= 1 && atoi(optarg) <= MAX_WORKERS)
+				nworkers = atoi(optarg);
+			else if(opt == 'b' && atoi(optarg) >= 1)
+				backlog = atoi(optarg);
+			else if(opt == 'l' && logLevel(optarg) >= 0)
+				level = logLevel(optarg);
+			else if(opt == 'm' && (hotSize = sizeArg(optarg)) >= 0)
+				;
+			else if(opt == 'r' && (rate = sizeArg(optarg)) >= 0)
+				;
+			else if(opt == 'R' && (globalRate = sizeArg(optarg)) >= 0)
+				;
+			else if(opt == 'W')
+				weights = optarg;
+			else if(opt == 'T' && transportLoad(optarg) == 0)
+				;     // Settings are applied in the order given, later ones win
+			else if(opt == 't' && transportSet(optarg) == 0)
+				;
+			else {
+				fprintf(stderr,"Syntax: %s [-f] [-u] [-w workers] [-b backlog] [-l error|warn|info|debug] [-m cache_size] [-r rate] [-R rate] [-W weights_file] [-T transport_file] [-t setting] [ initial_current_directory ]\n", argv[0]);
+				exit(1);
+			}
+		}
+		if(nworkers < 1)
+			nworkers = 1;
+
+		// Weights file is named relative to where the server was started
+		if(shaperSetup(rate, globalRate, weights) < 0)
+			exit(1);
+
 		// Check and get initial directory
-		if (argc == 2) {
+		if (argc - optind == 1) {
 			chdir("/");
-			if(chdir(argv[1]) < 0){     // Convert string to int
+			if(chdir(argv[optind]) < 0){     // Convert string to int
 				fprintf(stderr,"Directory supplied does not exist.\n");
 				exit(1);
 			}
-		} else if(argc > 2){
-			fprintf(stderr,"Syntax: %s [ initial_current_directory ]\n", argv[0]);
+		} else if(argc - optind > 1){
+			fprintf(stderr,"Syntax: %s [-f] [-u] [-w workers] [-b backlog] [-l error|warn|info|debug] [-m cache_size] [-r rate] [-R rate] [-W weights_file] [-T transport_file] [-t setting] [ initial_current_directory ]\n", argv[0]);
+			exit(1);
+		}
+
+		// Every worker and child starts its sessions from this descriptor, not from its working directory
+		if(sessionSetup() < 0){
+			fprintf(stderr,"Initial directory cannot be opened: %s\n", strerror(errno));
+			exit(1);
+		}
+
+		// Workers share the port with SO_REUSEPORT, so a server already on it would get half of the clients
+		if(portFree(port) < 0){
+			fprintf(stderr,"Port %d cannot be used: %s\n", port, strerror(errno));
 			exit(1);
 		}
 		
 		// Create daemon
 		daemonInit();
-			
-		printf("Server pid = %d\n", getpid());
 
-		sock = socketSetup(port);
+		// Records of every process are written by one flusher, so it is started before the workers
+		logSetup(fd < 0 ? STDOUT_FILENO : fd, level);
+		logPrint(LOG_INFO, "Server pid = %d", getpid());
 
-		// Listen on socket
-		listen(sock, 5);
+		// Listings cached by one worker are served by the others
+		dircacheSetup();
 
-		// Connect new client
-		newSock = connectClient(sock);
-		
-		// In child process
-		close(sock);
+		// ... and so are small files
+		filecacheSetup(hotSize);
+
+		// Counted by every worker and child, summed by the stats opcode and on SIGUSR1
+		metricsSetup();
+
+		// Daemon only supervises, workers accept and serve clients
+		superviseWorkers(nworkers, port, backlog, forkMode);
 
-		// Serve the client connected
-		serveClient(newSock);
-		
 	} //END of main function
 
 
@@ -108,7 +203,6 @@ void putFile(char *loc_buf, char command, int sock);
 */
 	void daemonInit(){
 		 pid_t   pid;
-		 struct sigaction act;
 
 		 if ((pid = fork()) < 0) {      // If pid less than 1
 			  printf("Daemon fork error %s\n", strerror(errno));
@@ -125,13 +219,24 @@ void putFile(char *loc_buf, char command, int sock);
 		 printf("New session created for child.\n");
 
 		 // Catch SIGCHLD to remove zombies from system
+		 catchChildren();
+		 printf("Children processes caught\n");
+		 
+	} //END of daemonInit
+
+
+/** Catch children - Installs claimChildren as the SIGCHLD handler
+*
+*/
+	void catchChildren(){
+		 struct sigaction act;
+
 		 act.sa_handler = claimChildren; // use reliable signal
 		 sigemptyset(&act.sa_mask);       // not to block other signals
 		 act.sa_flags   = SA_NOCLDSTOP;   // not catch stopped children
 		 sigaction(SIGCHLD, (struct sigaction *) &act, (struct sigaction *) 0);
-		 printf("Children processes caught\n");
-		 
-	} //END of daemonInit
+
+	} //END of catchChildren
 
 
 /** Claims zombies
@@ -147,6 +252,228 @@ void putFile(char *loc_buf, char command, int sock);
 	} // END of claimChildren
 
 
+static pid_t workers[MAX_WORKERS];		// Worker pids, 0 for an empty slot
+static int numWorkers;
+static volatile sig_atomic_t dumpWanted;	// SIGUSR1 arrived, the metrics are written to the log
+
+
+/** Supervise workers - Pre-forks the worker pool and respawns any worker that exits
+ *
+ *	Pre: Called from the daemon process, nworkers between 1 and MAX_WORKERS
+ *	Post: Does not return. SIGTERM/SIGINT stop every worker and then the daemon. A slot whose fork failed
+ *		  is tried again every second. The daemon stops the pool and exits once the workers of one slot
+ *		  have exited right after starting WORKER_RETRIES times in a row (e.g. the port cannot be bound)
+ */
+	void superviseWorkers(int nworkers, unsigned short port, int backlog, int forkMode){
+		int i, status, empty;
+		pid_t pid;
+		long long started[MAX_WORKERS];		// When the worker of the slot was spawned, in ms
+		int failures[MAX_WORKERS];			// Workers of the slot that exited right after starting, in a row
+		struct sigaction act;
+
+		// The daemon reaps its own workers, so they must not be claimed by the SIGCHLD handler
+		signal(SIGCHLD, SIG_DFL);
+
+		act.sa_handler = stopWorkers;
+		sigemptyset(&act.sa_mask);
+		act.sa_flags = 0;
+		sigaction(SIGTERM, &act, NULL);
+		sigaction(SIGINT, &act, NULL);
+		act.sa_handler = requestDump;     // No SA_RESTART, so wait() returns to write the dump
+		sigaction(SIGUSR1, &act, NULL);
+
+		numWorkers = nworkers;
+		for(i = 0; i < numWorkers; i++){
+			workers[i] = spawnWorker(port, backlog, forkMode);
+			started[i] = nowMsec();
+			failures[i] = 0;
+		}
+		logPrint(LOG_INFO, "%d workers started, listen backlog %d", numWorkers, backlog);
+
+		while(1){
+			if(dumpWanted){
+				dumpWanted = 0;
+				dumpMetrics();
+			}
+
+			// Empty slots (fork failed, or the worker exited) are filled again, at most once a second each
+			for(i = empty = 0; i < numWorkers; i++){
+				if(workers[i] == 0 && nowMsec() - started[i] >= WORKER_SETTLE){
+					workers[i] = spawnWorker(port, backlog, forkMode);
+					started[i] = nowMsec();
+				}
+				empty |= workers[i] == 0;
+			}
+
+			// With a slot still empty, do not block in wait() past the time to try it again
+			if(empty)
+				pid = waitpid(-1, &status, WNOHANG);
+			else
+				pid = wait(&status);
+			if(pid <= 0){
+				if(empty || errno != EINTR)
+					sleep(1);      // Nothing exited, or no children left to wait for
+				continue;
+			}
+
+			for(i = 0; i < numWorkers && workers[i] != pid; i++)
+				;
+			if(i == numWorkers)
+				continue;
+			workers[i] = 0;
+
+			// A worker that cannot start (e.g. port taken by another program) would be respawned forever
+			if(nowMsec() - started[i] < WORKER_SETTLE && ++failures[i] >= WORKER_RETRIES){
+				logPrint(LOG_ERROR, "Worker %d exited (status %d), %d workers in a row exited on start. Stopping the server",
+						 pid, status, WORKER_RETRIES);
+				for(i = 0; i < numWorkers; i++)
+					if(workers[i] > 0)
+						kill(workers[i], SIGTERM);
+				exit(1);
+			} else if(nowMsec() - started[i] >= WORKER_SETTLE)
+				failures[i] = 0;
+
+			logPrint(LOG_WARN, "Worker %d exited (status %d). Respawning...", pid, status);
+		}
+
+	} //END of superviseWorkers function
+
+
+/** Spawn worker - Forks one worker process
+ *
+ *	Return: pid of the new worker (parent only), 0 if the fork failed
+ */
+	pid_t spawnWorker(unsigned short port, int backlog, int forkMode){
+		pid_t pid;
+
+		fflush(stdout);     // Do not duplicate buffered log output in the child
+
+		if((pid = fork()) < 0){
+			logPrint(LOG_ERROR, "Worker fork error %s", strerror(errno));
+			return 0;
+		} else if(pid == 0){
+			signal(SIGTERM, SIG_DFL);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGUSR1, SIG_IGN);     // Only the daemon dumps the metrics
+			runWorker(port, backlog, forkMode);
+			exit(1);
+		}
+
+		return pid;
+
+	} //END of spawnWorker function
+
+
+/** Run worker - Sets up this worker's own listener and serves clients from it
+ *
+ *	Pre: Running in a newly forked worker process
+ *	Post: Does not return. Event mode serves all clients in this worker,
+ *		  fork mode forks a child per client accepted by this worker
+ */
+	void runWorker(unsigned short port, int backlog, int forkMode){
+		int sock, newSock;
+
+		logPrint(LOG_INFO, "Worker pid = %d", getpid());
+
+		sock = socketSetup(port);
+
+		// Listen on socket
+		if(listen(sock, backlog) < 0){
+			logPrint(LOG_ERROR, "Server listen failed: %s", strerror(errno));
+			exit(1);
+		}
+
+		// Serve every client from this worker
+		if(!forkMode){
+			setupRing(RING_SLOTS);
+			eventLoop(sock);
+			exit(1);
+		}
+
+		// Fallback - connect new client in its own child process
+		catchChildren();
+		newSock = connectClient(sock);
+
+		// In child process
+		close(sock);
+
+		// Serve the client connected
+		serveClient(newSock);
+
+	} //END of runWorker function
+
+
+/** Stop workers - SIGTERM/SIGINT handler for the daemon, terminates the pool then exits
+ *
+ */
+	void stopWorkers(int signo){
+		int i;
+
+		for(i = 0; i < numWorkers; i++)
+			if(workers[i] > 0)
+				kill(workers[i], SIGTERM);
+
+		_exit(0);
+
+	} //END of stopWorkers function
+
+
+/** Request dump - SIGUSR1 handler of the daemon, the supervise loop writes the metrics to the log
+ *
+ */
+	void requestDump(int signo){
+
+		dumpWanted = 1;
+
+	} //END of requestDump function
+
+
+/** Dump metrics - Writes the metrics of every worker and child to the log, a record per line
+ *
+ */
+	void dumpMetrics(){
+		char report[BUFSIZE], *line, *next;
+
+		metricsReport(report, sizeof(report));
+		for(line = report; line != NULL; line = next){
+			if((next = strchr(line, '\n')) != NULL)
+				*next++ = '\0';
+			logPrint(LOG_INFO, "stats %s", line);
+		}
+
+	} //END of dumpMetrics function
+
+
+/** Port free - Binds the port once without SO_REUSEPORT, which fails while any other server listens on it
+ *
+ *	Return: 0 if the port can be used, -1 with errno set if not
+ */
+	int portFree(unsigned short listen_port){
+		struct sockaddr_in ser_addr;
+		int sock, on = 1, err;
+
+		bzero((char *) &ser_addr, sizeof(ser_addr));
+		ser_addr.sin_family = AF_INET;
+		ser_addr.sin_port = htons(listen_port);
+		ser_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		// SO_REUSEADDR only lets connections of an earlier run still in TIME_WAIT through, not a listener
+		if((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+			return -1;
+		if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+		   bind(sock, (struct sockaddr *) &ser_addr, sizeof(ser_addr)) < 0){
+			err = errno;
+			close(sock);
+			errno = err;
+			return -1;
+		}
+
+		close(sock);
+		return 0;
+
+	} //END of portFree function
+
+
 /** Setup of socket - Socket is setup for use by multiple clients
  *	
  *  Pre: Port number must be valid
@@ -157,7 +484,8 @@ void putFile(char *loc_buf, char command, int sock);
 		
 		struct sockaddr_in ser_addr;        // Server address
 		struct hostent *hp;                 // Host info
-		int sock;
+		int sock, on = 1;
+		char err[256];                      // Transport options the kernel refused
 		
 		// Erase data in memory starting at address
 		bzero((char *) &ser_addr, sizeof(ser_addr));
@@ -170,17 +498,28 @@ void putFile(char *loc_buf, char command, int sock);
 
 		// Setup socket
 		if((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-			printf("Server socket setup failed: %s\n", strerror(errno));
+			logPrint(LOG_ERROR, "Server socket setup failed: %s", strerror(errno));
 			exit(1);
 		}
 
+		// Every worker binds its own listener on the same port, the kernel spreads connections between them
+		if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+		   setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0){
+			logPrint(LOG_ERROR, "Server socket options failed: %s", strerror(errno));
+			exit(1);
+		}
+
+		// Accepted sockets inherit the listener's options, buffer sizes only set the window before listen()
+		if(transportApply(sock, err, sizeof(err)) > 0)
+			logPrint(LOG_WARN, "Transport options refused:%s", err);
+
 		// Bind socket
 		if(bind(sock, (struct sockaddr *) &ser_addr, sizeof(ser_addr)) < 0){
-			printf("Server bind failed: %s\n", strerror(errno));
+			logPrint(LOG_ERROR, "Server bind failed: %s", strerror(errno));
 			exit(1);
 		}
 		
-		printf("Socket setup successful. Using socket %d\n", sock);
+		logPrint(LOG_INFO, "Socket setup successful. Using socket %d", sock);
 		
 		return sock;
 		
@@ -202,6 +541,7 @@ void putFile(char *loc_buf, char command, int sock);
 		
 		while(isConnected == 0){
 			cli_addr_len = sizeof(cli_addr);    // Get client address length
+			metricsAcceptQueue(loc_socket);
 
 			// Accept connection request
 			newSock = accept(loc_socket, (struct sockaddr *) &cli_addr, (socklen_t *)&cli_addr_len);
@@ -210,12 +550,14 @@ void putFile(char *loc_buf, char command, int sock);
 				if (errno == EINTR){   // If interrupted by SIGCHLD
 					 continue;
 				 }
-				printf("Server accept failed: %s\n", strerror(errno));
+				logPrint(LOG_ERROR, "Server accept failed: %s", strerror(errno));
+				metricsAdd(MET_ACCEPT_ERRORS, 1);
 				exit(1);
 			}
+			metricsAdd(MET_ACCEPTED, 1);
 
 			if((pid = fork()) < 0){
-				printf("Error with fork: %s\n", strerror(errno));
+				logPrint(LOG_ERROR, "Error with fork: %s", strerror(errno));
 				exit(1);
 			} else if (pid > 0){
 				close(newSock);     // Parent waits for connection
@@ -223,7 +565,7 @@ void putFile(char *loc_buf, char command, int sock);
 			}
 			
 			isConnected = 1;
-			printf("New client connected\n");
+			logPrint(LOG_INFO, "New client connected");
 		}
 		
 		return newSock;
@@ -231,203 +573,104 @@ void putFile(char *loc_buf, char command, int sock);
 	} //END of connectClient function	
 
 
-/** Serve client - Executes commands requested by the client. They include:
- *					pwd - to display current server directory, dir - displays file names in current server directory
- *					cd - change current server directory, get/put - send or receive files to/from client
+/** Serve client - Executes commands requested by the client in a child process (fork mode).
+ *				  Drives the same session state machine as the event loop, but on a blocking socket
  *
- *	Pre: Socket and client must be connected, buffer size has been predefined and socket connected
- *	Post: Commands requested by the user has been executed, or invalid command displayed to user
+ *	Pre: Socket and client must be connected
+ *	Post: Commands requested by the client are executed until the connection closes, then the child exits
  */
 	void serveClient(int sock){
-		int nr, n, fd, chdir_result;
-		char buf[BUFSIZE];
-		char response[BUFSIZE];
-		char filename[BUFSIZE];
-		char command, code;
+		struct timespec ts;
+		long long held;
+		Session *sess;
 
-		while (1){
-			 // Read data from client
-			if ((nr = readn(sock, buf, sizeof(buf))) <= 0){
-				printf("No data read from client. Connection from client stopped.\n");
-				exit(1);   // Connection broken down
-			}
+		if((sess = sessionCreate(sock)) == NULL)
+			exit(1);
 
-			printf("Opcode %c received from client with a total of %d bytes recieved\n", buf[0], nr);
-
-			command = buf[0];   // Get first character of string
-			memmove(buf, buf+1, strlen(buf));   // Remove first character
-
-			if(command == 'P'){      // pwd
-				printf("pwd command received. Getting current working directory...\n");
-				getcwd(response, sizeof(response));
-
-				/* send results to client */
-				writen(sock, response, strlen(response) + 1);
-				printf("Current working directory %s returned to client\n", response);
-			} else if(command == 'D'){  // dir
-				printf("dir command received. Getting file names in current directory...\n");
-				readDirFiles(response);
-
-				/* send results to client */
-				writen(sock, response, strlen(response) + 1);
-				printf("File names in current directory sent to client\n");
-			} else if(command == 'C'){  // cd
-				printf("cd command received. Changing directory...\n");
-				chdir_result = chdir(buf);
-				if(chdir_result == -1)
-					printf("Changing directory failed: %s\n", strerror(errno));
-				else
-					printf("Current directory successfully changed.\n");
-				
-				/* send chdir result to client */
-				writen(sock, (char *) &chdir_result, 1);
-			} else if(command == 'G' || command == 'H'){  // get
-				getFile(buf,command,sock);
-			} else if(command == 'U' || command == 'V'){  // put
-				putFile(buf,command,sock);
-			} else {
-				 // Command not recognised
-				 char unident[] = "Command not recognised.";
-				 strcpy(response, unident);
-				 writen(sock, response, strlen(response) + 1);
-				 printf("%s.\n", unident);
-			}
+		// A ring is never shared with the worker it was forked from
+		setupRing(1);
+
+		while (1){
+			// Queued output first, then wait for the next frame from the client
+			if(sess->state == SESS_RING){
+				uringWait(sess->xfer);
+				if(sessionOnRing(sess) < 0)
+					break;
+			} else if((held = sessionHeld(sess)) != 0){
+				// Transfer held back by the scheduler, nothing else to do meanwhile
+				held -= shaperClock();
+				ts.tv_sec = held / 1000000000;
+				ts.tv_nsec = held % 1000000000;
+				nanosleep(&ts, NULL);
+			} else if(sessionWantsWrite(sess)){
+				if(sessionOnWritable(sess) < 0)
+					break;
+			} else if(sessionWantsRead(sess)){
+				if(sessionOnReadable(sess) < 0)
+					break;
+			} else
+				break;
 		}
-		
+
+		sessionDestroy(sess);
+		exit(1);   // Connection broken down
+
 	} // END of serveClient function
 
 
-/** Read directory file names - Function reads file names in the current directory and adds to array with newline separator
+/** Setup ring - Sets up the io_uring backend of this process when -u was given
  *
- *	Pre: Command 'dir' requested from the user, with empty char array provided, buffer size predefined
- *	Post: Directory pointer determined, and file names in current directory read. File names concatenated to the char array with newline separator
- *		  If file names could not be read, code '1' is read into the response char array back to the calling function
+ *	Post: File transfers use io_uring, or sendfile/splice if the kernel does not allow it
  */
-	void readDirFiles(char response[]){
-		DIR *dp;
-		struct dirent *dirp;
-		char directory[BUFSIZE];
+	void setupRing(int nslots){
+		int n;
 
-		directory[0] = '\0';    // First is null terminator
-		
-		// Reopen directory to start from the start of directory
-		if((dp = opendir(".")) != NULL){
-			// Read directory names into array
-			while((dirp = readdir(dp)) != NULL){
-				strcat(directory, "\n");
-				strcat(directory, dirp->d_name);
-			}
+		if(!useRing)
+			return;
 
-			// Close directory
-			closedir(dp);
+		if((n = uringSetup(nslots)) < 0)
+			logPrint(LOG_WARN, "io_uring not available (%s), using sendfile/splice", strerror(errno));
+		else
+			logPrint(LOG_INFO, "io_uring backend ready for %d transfers", n);
 
-			strcpy(response, directory);
-		}else{
-			strcpy(response, "1");
-			printf("Directory read error %s\n", strerror(errno)); 
-		}
-		
-	} //END of readDirFiles
+	} //END of setupRing function
 
 
-/** get file - Function sends requested file to client
-*
-*	Pre: filename must exist in buffer, command from client must be 'G' or 'H' and socket must be connected.
-*	Post: file data is written to socket (if file exists, can be accessed and if client is ready to accept the file)
-*/
-	void getFile(char *loc_buf, char command, int sock){
-		
-		int n, fd;
-		char response[BUFSIZE], filename[BUFSIZE], code;
-		char buf[BUFSIZE];
-		
-		strcpy(buf,loc_buf);
-		
-		if(command == 'G'){
-			printf("get command received. Checking file %s exists...\n", buf);
-			strcpy(response, "G");
-
-			if(access(buf, F_OK) == 0){     // File exists
-				strcat(response, "0");  // File exists & read access
-				printf("File exists...\n");
-				strcpy(filename, buf);
-			} else {
-				strcat(response, "1");  // File doesn't exist
-				printf("File does not exist...\n");
-			}
+/** Size argument - Reads a size in bytes, with an optional K, M or G suffix
+ *
+ *	Return: The size, or -1 if arg is not one
+ */
+	long long sizeArg(char *arg){
+		char *end;
+		long long n;
 
-			writen(sock, response, strlen(response) + 1);
-			printf("Acknowledgement sent to client\n");
-		} else if(command == 'H'){  // get confirmed
-			printf("Client ready to accept file. Sending...\n");
-			code = buf[0];   // Get first character of string
+		n = strtoll(arg, &end, 10);
+		if(end == arg || n < 0)
+			return -1;
+		if(*end == 'K' || *end == 'k')
+			n <<= 10;
+		else if(*end == 'M' || *end == 'm')
+			n <<= 20;
+		else if(*end == 'G' || *end == 'g')
+			n <<= 30;
+		else if(*end != '\0')
+			return -1;
 
-			if(code == '0'){    // If server and client confirmed
-				printf("Client ready to accept file. Sending...\n");
-				fd = open(filename, O_RDONLY, S_IRUSR); // Open file
+		return *end != '\0' && end[1] != '\0' ? -1 : n;
 
-				while((n = read(fd, buf, sizeof(buf))) > 0){  // Transfer
-					buf[n] = '\0';
-					writen(sock, buf, n);
-				}
-				printf("File successfully sent to client\n");
-			}else
-				printf("Client not ready to accept file\n");
-		}
-		
-	} //END of getFile function
+	} //END of sizeArg function
 
 
-/** put file - Function downloads file from client and places into current directory
-*
-*	Pre: filename must exist in buffer, command from client must be 'U' or 'V' and socket must be connected.
-*	Post: file from client is placed into current directory (if does not already exist)
-*/
-	void putFile(char *loc_buf, char command, int sock){
-		
-		int n, fd;
-		char response[BUFSIZE], filename[BUFSIZE], code;
-		char buf[BUFSIZE];
-		
-		strcpy(buf,loc_buf);
-		
-		if(command == 'U'){
-			printf("put command received. Checking file %s exists...\n", buf);
-			strcpy(response, "U");
+/** Now - Monotonic clock in milliseconds
+ *
+ */
+	long long nowMsec(){
+		struct timespec ts;
 
-			if(access(buf, F_OK) == 0){ // Check file existance
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
 
-				strcat(response, "1");  // File exists
-				printf("File exists\n");
-			} else {
+	} //END of nowMsec function
 
-				strcat(response, "0");  // Server ready
-				strcpy(filename, buf);
-				printf("File does not exist\n");
-			}
 
-			writen(sock, response, strlen(response) + 1);
-			printf("Acknowledgement sent to client\n");
-
-			if(response[1] == '0'){     // If server and client ready
-				printf("Client sending file...\n");
-				fd = open(filename, O_WRONLY|O_CREAT, S_IRWXU);     // Open file
-				
-				while ((n = readn(sock, buf, sizeof(buf))) > 0){    // Transfer
-					buf[n] = '\0';
-					write(fd, buf, n);
-					
-					if(n < sizeof(buf)-2){
-						break;
-					}
-				}
-				close(fd);      // Close file
-				printf("File successfully received from client\n");
-			}else
-				printf("Client did not send file...\n");
-		}
-		
-	} //END of putFile function
-		
-	
 //END of myftpd (SERVER)
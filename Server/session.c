@@ -0,0 +1,2593 @@
+/* File: session.c (SERVER)
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Per-client session state machine for the FTP server
+ * Changes:
+ * 16/10/2026 - Moved opcode handling (P, D, C, G/H, U/V) out of serveClient into a session state machine,
+ *				so partial frames resume on the next read/write instead of blocking the process.
+ *				The same code is driven by the epoll engine and by the fork-per-client fallback.
+ *			  - Moved readDirFiles, getFile and putFile here from myftpd.c
+ *			  - get now sends file data with sendfile() (no copy through user space), the frame headers
+ *				are still queued in the conn write buffer so v1 clients see the same framing
+ *			  - Added raw stream get ('R' after G0, confirmed with HR): one size frame then the file bytes unframed
+ *			  - put payload is moved socket -> pipe -> file with splice(), only frame headers are read into
+ *				user space. Falls back to read()/write() if the file system does not support splice
+ *			  - Added v2 framing, negotiated with the N opcode: typed 12 byte headers, data frames up to the
+ *				negotiated size, end of file/error flags and optional CRC-32. V acknowledges a v2 put
+ *			  - Input and output buffers are now the shared buffered stream layer (Conn in stream.c):
+ *				one read() takes every frame that has arrived, responses are coalesced into one write
+ *			  - get/put file data can be moved by the io_uring backend (uring.c) when the worker set it up:
+ *				several file reads/writes and socket operations in flight on registered buffers
+ *			  - Added ranged transfers for parallel get/put: R sends part of a file, W receives data into
+ *				part of a file, K returns the CRC-32 of a range so the client can check what arrived
+ *			  - R accepts a length of -1 for the rest of the file, so a partial fetch or resume needs no size first
+ *			  - v2 responses carry the tag (request ID) of the command they answer, so a client can send
+ *				many commands back to back and match the replies. Negotiated as option "t"
+ *			  - Added mget (M): the glob is expanded here and every match streamed back to back, each announced
+ *				by its name and size with no per-file handshake. Files smaller than a frame share writes.
+ *				Added mput (Y): files arrive back to back, each answered with a status once received
+ *			  - Added compression of file data (Z selects zlib or the LZ codec in compress.c): frames are
+ *				compressed one at a time when that pays, incompressible data is sent as it is. Compressed
+ *				transfers pass through user space instead of sendfile()/splice()/io_uring
+ *			  - Added sync (S): a changed file moves as a delta against the other side's old copy (delta.c).
+ *				Sg takes the client's block signatures and sends the delta, Sp sends this copy's signatures
+ *				and rebuilds the file from the client's delta into a temporary file renamed over the old one
+ *			  - Added file digests (I): size, mtime and a 128-bit digest of a file, taken from the digest index
+ *				kept in an extended attribute of the file (digest.c) while the file has not changed since
+ *			  - Added paged directory listing (L): entries are read in bulk with getdents64() and sent as binary
+ *				records (type, size, mtime, name) over as many frames as needed, a page at a time with a cursor
+ *				to resume from. D no longer overflows its buffer on large directories
+ *			  - D responses and L pages are kept in the listing cache shared by the worker processes (dircache.c)
+ *				and served from it until inotify reports a change to the directory
+ *			  - Added rget (T): a directory tree is walked with fts and sent like an mget, each directory announced
+ *				before the files in it. Files above the client's size limit are only announced, the client fetches
+ *				them on connections of their own. An mput name ending in '/' (rput) creates that directory
+ *			  - Log records go through the asynchronous logger (logger.c) with a level each. Every request is
+ *				logged once it is answered, with its session, opcode, bytes moved on the socket and latency
+ *			  - Requests, sessions, socket bytes and errors are counted in the shared metrics (metrics.c), each
+ *				request in the latency histogram of its opcode. Added stats (X): the metrics of every process
+ *			  - A v2 get of a small file is served from the hot-file cache shared by the worker processes
+ *				(filecache.c): the file is not opened, its frame leaves with any queued responses in one sendmsg()
+ *			  - Paths are resolved against the session's directory descriptor (openat, fstatat, fdopendir, mkdirat,
+ *				unlinkat), and cd opens the new directory relative to it. The process never changes directory, so
+ *				sessions sharing a worker no longer depend on fchdir() before each command
+ *			  - File data moves in turns given by the bandwidth scheduler (shaper.c): a quantum scaled by the
+ *				client's weight, less when its own or the global token bucket is low. A session whose bucket is
+ *				empty is held back, command responses are never held. Rate limited transfers do not use io_uring
+ *			  - Every session socket gets the transport profile (transport.c), and is corked while a turn of file
+ *				data is sent. The O opcode returns the settings the socket actually has
+ *			  - The initial directory is opened once by sessionSetup, before anything is forked, and each session's
+ *				directory descriptor is opened relative to it. A new session no longer starts in whatever directory
+ *				the process happens to be in
+ *			  - Writes of put data are checked: a short write is finished, and a failed one (ENOSPC, EIO) fails
+ *				the put, so a v2 client gets V1 and the truncated file is removed instead of being kept
+ *			  - A spliced put with no file to write (discarded data) drains the pipe directly instead of testing a
+ *				stale errno, which could spin forever. File writes after splice falls back fail the put on error
+ *			  - A raw stream get of a file that cannot be opened sends the size -1 instead of 0, so the client can
+ *				tell it from an empty file
+ *			  - An mput/rput name too long to be sent back in its reply is refused (Y2) instead of being cut short
+ *			  - An mget whose glob cannot be resolved against the session directory no longer frees an unset pointer
+ *			  - An I whose digest is not in the index hashes the file a chunk per turn of the event loop (pumpHash),
+ *				so other sessions of the worker are not held up. put and mput hash the data as it is written and
+ *				index the file once it is received intact, so the first I after an upload does not read it
+ *			  - K no longer reads the whole range in one go: the CRC-32 of a range put is taken as it is written and
+ *				answers the K that follows it, any other range is read a chunk per turn of the event loop (pumpCheck).
+ *				CRC-32 is zlib's crc32() instead of the table loop
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <glob.h>
+#include <time.h>
+#include <zlib.h>
+#include "session.h"
+#include "digest.h"
+#include "metrics.h"
+
+static int rootfd = -1;				// Initial directory, every session starts in it
+
+static void processFrames(Session *sess);
+static void pumpFile(Session *sess);
+static int sendFileData(Session *sess, int max);
+static int queueFrame(Session *sess, char *data, int nbytes);
+static void queueHeader(Session *sess, int type, int flags, int nbytes, unsigned int crc);
+static int headerSize(Session *sess);
+static void negotiate(Session *sess, char *loc_buf);
+static void finishPut(Session *sess);
+static int outSpace(Session *sess);
+static void dispatchCommand(Session *sess, char *frame, int len);
+static void readDirFiles(int dirfd, char response[]);
+static void listDir(Session *sess, char *loc_buf);
+static void pumpList(Session *sess);
+static int listRecord(Session *sess, struct dirent64 *de, char *out);
+static void putBigEndian(char *p, unsigned long long v, int bytes);
+static void getFile(Session *sess, char *loc_buf, char command);
+static int sendCached(Session *sess);
+static void pumpHot(Session *sess);
+static void putFile(Session *sess, char *loc_buf, char command);
+static void receiveFrame(Session *sess, char *data, int len);
+static void writeFile(Session *sess, char *data, int len);
+static int spliceFrame(Session *sess);
+static int drainPipe(Session *sess, int nbytes);
+static void startRing(Session *sess);
+static void getRange(Session *sess, char *loc_buf);
+static void putRange(Session *sess, char *loc_buf);
+static void checkRange(Session *sess, char *loc_buf);
+static void pumpCheck(Session *sess);
+static void hashFile(Session *sess, char *loc_buf);
+static void pumpHash(Session *sess);
+static void startDigest(Session *sess, char mode);
+static void hashWritten(Session *sess, int nbytes);
+static void getBatch(Session *sess, char *loc_buf);
+static void batchNext(Session *sess);
+static int batchEntry(Session *sess, char **name, struct stat *st);
+static void getTree(Session *sess, char *loc_buf);
+static void putBatchFile(Session *sess, char *loc_buf);
+static void selectCodec(Session *sess, char *loc_buf);
+static void logPacking(Session *sess);
+static void syncFile(Session *sess, char *loc_buf);
+static void pumpDelta(Session *sess);
+static void receiveSync(Session *sess, char *data, int len);
+static void finishSync(Session *sess);
+static void dropSync(Session *sess);
+static int fdPath(Session *sess, char *name, char *out, int size);
+static void requestDone(Session *sess);
+static void countBytes(Session *sess, int counter, long long n);
+static void requestIdle(Session *sess);
+static long long nowUsec(void);
+
+
+/** Session setup - see session.h
+ *
+ */
+	int sessionSetup(void){
+
+		rootfd = open(".", O_PATH | O_DIRECTORY);
+		return rootfd < 0 ? -1 : 0;
+
+	} //END of sessionSetup function
+
+
+/** Create a session - allocates state for a newly accepted client
+ *
+ *	Pre: sock is a connected socket, sessionSetup has opened the initial directory
+ *	Post: Session allocated in state SESS_CMD holding a descriptor for its own working directory
+ *	Return: Session pointer, or NULL if it could not be allocated
+ */
+	Session *sessionCreate(int sock){
+		static unsigned int sessions;
+		char err[256], dump[512], *p;
+		Session *sess;
+
+		if((sess = malloc(sizeof(Session))) == NULL){
+			logPrint(LOG_ERROR, "Session allocation failed: %s", strerror(errno));
+			return NULL;
+		}
+
+		sess->sock = sock;
+		conninit(&sess->conn, sock);
+		sess->maxframe = MAX_BLOCK_SIZE;
+		sess->checksum = 0;
+		sess->state = SESS_CMD;
+		sess->filefd = -1;
+		sess->lastframe = -1;
+		sess->fileleft = 0;
+		sess->frameleft = 0;
+		sess->rawmode = 0;
+		sess->recvleft = 0;
+		sess->recvflags = 0;
+		sess->putfailed = 0;
+		sess->rangeput = 0;
+		sess->fileoff = 0;
+		sess->batch = NULL;
+		sess->batchskip = 0;
+		sess->tree = NULL;
+		sess->batchput = 0;
+		packinit(&sess->pack);
+		sess->packbuf = NULL;
+		sess->delta = NULL;
+		sess->syncmode = 0;
+		sess->synctemp[0] = '\0';
+		sess->listfd = -1;
+		sess->listbuf = NULL;
+		sess->listpage = NULL;
+		sess->listcached = 0;
+		sess->nosplice = 0;
+		sess->pipefd[0] = sess->pipefd[1] = -1;
+		sess->ringwant = 0;
+		sess->xfer = NULL;
+		sess->hotbuf = NULL;
+		sess->hotlen = 0;
+		sess->digest = NULL;
+		sess->digesting = 0;
+		sess->rangeknown = 0;
+		sess->filename[0] = '\0';
+		sess->id = ++sessions;
+		sess->opcode = 0;
+		sess->iobytes = 0;
+		shaperInit(&sess->shape, sock);
+		if(transportApply(sock, err, sizeof(err)) > 0)
+			logPrint(LOG_DEBUG, "Session %u transport options refused:%s", sess->id, err);     // Warned for the listener
+		if(logWants(LOG_DEBUG)){
+			transportDump(sock, dump, sizeof(dump));
+			for(p = dump; (p = strchr(p, '\n')) != NULL; )
+				*p = ';';     // One line per session
+			logPrint(LOG_DEBUG, "Session %u transport: %s", sess->id, dump);
+		}
+
+		// Every session starts in the initial directory, and keeps a descriptor of its own for it
+		if((sess->cwdfd = openat(rootfd, ".", O_PATH | O_DIRECTORY)) < 0){
+			logPrint(LOG_ERROR, "Session directory open failed: %s", strerror(errno));
+			free(sess);
+			return NULL;
+		}
+		metricsAdd(MET_SESSIONS, 1);
+		metricsAdd(MET_ACTIVE, 1);
+
+		return sess;
+
+	} //END of sessionCreate function
+
+
+/** Destroy a session - closes the socket, working directory and any open file
+ *
+ *	Pre: sess was returned by sessionCreate
+ *	Post: All descriptors owned by the session are closed and the memory freed
+ */
+	void sessionDestroy(Session *sess){
+
+		requestDone(sess);     // A request cut short is still logged
+		shaperIdle(&sess->shape);
+		metricsAdd(MET_ACTIVE, -1);
+		if(sess->filefd >= 0)
+			close(sess->filefd);
+		if(sess->pipefd[0] >= 0){
+			close(sess->pipefd[0]);
+			close(sess->pipefd[1]);
+		}
+		if(sess->batch != NULL){
+			globfree(sess->batch);
+			free(sess->batch);
+		}
+		if(sess->tree != NULL)
+			fts_close(sess->tree);
+		if(sess->delta != NULL)
+			dropSync(sess);
+		if(sess->listfd >= 0)
+			close(sess->listfd);
+		free(sess->listbuf);
+		free(sess->listpage);
+		free(sess->hotbuf);
+		free(sess->digest);
+		packfree(&sess->pack);
+		free(sess->packbuf);
+		close(sess->cwdfd);
+		close(sess->sock);
+		free(sess);
+
+	} //END of sessionDestroy function
+
+
+/** Session wants read - true while the session can accept more bytes from the client
+ *
+ */
+	int sessionWantsRead(Session *sess){
+
+		if((sess->state != SESS_CMD && sess->state != SESS_PUT_RECV) || sess->shape.wake != 0)
+			return 0;
+
+		return sess->conn.rlen < CONN_RBUF;
+
+	} //END of sessionWantsRead function
+
+
+/** Session wants write - true while framed output is queued for the client
+ *
+ */
+	int sessionWantsWrite(Session *sess){
+
+		if(sess->shape.wake != 0)
+			return 0;
+
+		return sess->conn.wlen > sess->conn.woff || sess->state == SESS_GET_SEND;
+
+	} //END of sessionWantsWrite function
+
+
+/** Session held - releases a session held back by the scheduler once its time has come
+ *
+ *	Return: Time it is still held until, 0 if it is not held
+ */
+	long long sessionHeld(Session *sess){
+
+		if(sess->shape.wake != 0 && shaperClock() >= sess->shape.wake)
+			sess->shape.wake = 0;
+
+		return sess->shape.wake;
+
+	} //END of sessionHeld function
+
+
+/** Readable socket - reads what the client has sent and processes each complete frame
+ *
+ *	Pre: sessionWantsRead(sess) is true, socket is readable (non-blocking) or blocking
+ *	Post: Complete frames are acted on, an incomplete frame is kept until the rest arrives
+ *	Return: 0 to keep the session, -1 when the client has gone or broke the protocol
+ */
+	int sessionOnReadable(Session *sess){
+		int nr, want = 0;
+
+		// File data only comes in when the scheduler gives the session a turn
+		if(sess->state == SESS_PUT_RECV && shaperTurn(&sess->shape) == 0)
+			return 0;
+
+		// During a put only the frame header comes into user space, the payload is spliced
+		// (unless it carries a checksum, which has to be computed as the bytes pass through,
+		// or is compressed, or is sync signatures/delta)
+		if(sess->state == SESS_PUT_RECV && !sess->nosplice && sess->delta == NULL){
+			if(sess->recvleft > 0 && !(sess->recvflags & (FF_CHECKSUM | FF_PACKED)))
+				return spliceFrame(sess);
+			if(sess->recvleft == 0 && sess->conn.rlen < headerSize(sess))
+				want = headerSize(sess) - sess->conn.rlen;
+		}
+
+		if(want > 0)
+			nr = read(sess->sock, sess->conn.rbuf + sess->conn.rlen, want);
+		else
+			nr = connfill(&sess->conn);    // As many frames as have arrived in one read
+
+		if(nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return 0;
+		if(nr <= 0){
+			logPrint(LOG_INFO, "No data read from client. Connection from client stopped.");
+			return -1;   // Connection broken down
+		}
+
+		countBytes(sess, MET_BYTES_IN, nr);
+		if(sess->state == SESS_PUT_RECV)
+			shaperCharge(&sess->shape, nr);
+		if(want > 0)
+			sess->conn.rlen += nr;
+		processFrames(sess);
+		requestIdle(sess);
+		if(sess->state != SESS_GET_SEND && sess->state != SESS_PUT_RECV)
+			shaperIdle(&sess->shape);     // Transfer over, its weight no longer takes a share
+
+		return sess->state == SESS_CLOSED ? -1 : 0;
+
+	} //END of sessionOnReadable function
+
+
+/** Writable socket - writes queued frames and file data being sent
+ *
+ *	Pre: sessionWantsWrite(sess) is true, socket is writable (non-blocking) or blocking
+ *	Post: Bytes accepted by the socket are removed from the queue. Up to SESS_WRITE_BUDGET
+ *		  bytes are written per call, a file only as much as the scheduler allows in one turn,
+ *		  so one bulk transfer cannot starve other sessions
+ *	Return: 0 to keep the session, -1 on write error
+ */
+	int sessionOnWritable(Session *sess){
+		int nw = 0, sent = 0, budget = SESS_WRITE_BUDGET, sending = sess->state == SESS_GET_SEND;
+
+		if(sending && (budget = shaperTurn(&sess->shape)) == 0)
+			return 0;     // Held back, sessionHeld says until when
+		if(sending)
+			transportCork(sess->sock, 1);     // Headers and file data leave in full segments
+
+		while(sent < budget){
+			pumpFile(sess);
+
+			if(sess->conn.wlen > sess->conn.woff){
+				// A header followed by sendfile data should leave in the same segment
+				nw = send(sess->sock, sess->conn.wbuf + sess->conn.woff, sess->conn.wlen - sess->conn.woff,
+						  sess->frameleft > 0 ? MSG_MORE | MSG_NOSIGNAL : MSG_NOSIGNAL);
+				if(nw > 0){
+					sess->conn.woff += nw;
+					if(sess->conn.woff == sess->conn.wlen)
+						sess->conn.woff = sess->conn.wlen = 0;
+				}
+			} else if(sess->frameleft > 0)
+				nw = sendFileData(sess, budget - sent);
+			else
+				break;      // Nothing left to write
+
+			if(nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				break;
+			if(nw <= 0){
+				logPrint(LOG_ERROR, "Write to client failed: %s", strerror(errno));
+				metricsAdd(MET_IO_ERRORS, 1);
+				return -1;
+			}
+			sent += nw;
+		}
+		if(sending)
+			transportCork(sess->sock, 0);     // Whatever is left of the turn goes now
+		countBytes(sess, MET_BYTES_OUT, sent);
+		if(sending)
+			shaperCharge(&sess->shape, sent);
+		if(nw < 0)
+			return 0;     // Socket full, what was written before still counts
+
+		// Output drained - frames held back for lack of room can now be processed
+		processFrames(sess);
+		requestIdle(sess);
+		if(sess->state != SESS_GET_SEND && sess->state != SESS_PUT_RECV)
+			shaperIdle(&sess->shape);     // Transfer over, its weight no longer takes a share
+
+		return sess->state == SESS_CLOSED ? -1 : 0;
+
+	} //END of sessionOnWritable function
+
+
+/** Send file data - sends the payload of the current file frame straight from the page cache
+ *
+ *	Pre: write buffer empty (frame header already sent), frameleft > 0, max > 0
+ *	Post: Up to max bytes sent are taken off frameleft and fileleft. If the file system does not
+ *		  support sendfile() the data is read into the write buffer instead
+ *	Return: bytes sent or queued, -1 with errno set on error
+ */
+	static int sendFileData(Session *sess, int max){
+		ssize_t n;
+
+		if(max > sess->frameleft)
+			max = sess->frameleft;
+
+		n = sendfile(sess->sock, sess->filefd, NULL, max);
+
+		if(n < 0 && (errno == EINVAL || errno == ENOSYS)){
+			// No sendfile for this file - copy it through the write buffer
+			n = read(sess->filefd, sess->conn.wbuf, max < CONN_WBUF ? max : CONN_WBUF);
+			if(n > 0)
+				sess->conn.wlen = n;
+		}
+
+		if(n == 0){
+			errno = EIO;    // File shrank after the frame header was sent
+			return -1;
+		}
+		if(n > 0){
+			sess->frameleft -= n;
+			sess->fileleft -= n;
+		}
+
+		return n;
+
+	} //END of sendFileData function
+
+
+/** Process frames - acts on every complete frame in the input buffer the current state allows
+ *
+ *	Pre: conn read-ahead buffer holds the unparsed bytes from the client (v1 or v2 frames)
+ *	Post: Processed frames are consumed, a partial frame is moved to the front
+ */
+	static void processFrames(Session *sess){
+		Conn *c = &sess->conn;
+		int len, hsize;
+		FrameHeader fh;
+
+		// Commands wait while an mget or rget is still streaming files
+		while((sess->state == SESS_CMD || sess->state == SESS_PUT_RECV) && !sess->ringwant &&
+			  !(sess->state == SESS_CMD && (sess->batch != NULL || sess->tree != NULL))){
+			// Rest of a put frame whose start was already written
+			if(sess->recvleft > 0){
+				if((len = c->rlen - c->rpos) == 0)
+					break;
+				if(len > sess->recvleft)
+					len = sess->recvleft;
+				receiveFrame(sess, c->rbuf + c->rpos, len);
+				c->rpos += len;
+				continue;
+			}
+
+			// Header size can change between frames when N switches the session to v2
+			if((hsize = connpeek(c, &fh)) == 0)
+				break;
+
+			len = fh.length > V2_MAX_FRAME ? V2_MAX_FRAME + 1 : fh.length;
+			if(c->version == 1)
+				fh.type = sess->state == SESS_PUT_RECV ? FT_DATA : FT_CMD;
+
+			if(len > (sess->state == SESS_PUT_RECV ? sess->maxframe : MAX_BLOCK_SIZE) ||
+			   ((fh.flags & FF_PACKED || sess->delta != NULL) && len > PACK_FRAME) ||
+			   fh.type != (sess->state == SESS_PUT_RECV ? FT_DATA : FT_CMD)){
+				logPrint(LOG_ERROR, "Frame of %d bytes (type %d) from client is not valid here. Closing connection.", len, fh.type);
+				metricsAdd(MET_PROTOCOL_ERRORS, 1);
+				sess->state = SESS_CLOSED;
+				break;
+			}
+
+			// A put frame is written as it arrives, the rest follows through recvleft
+			if(sess->state == SESS_PUT_RECV){
+				sess->recvframe = sess->recvleft = len;
+				sess->recvflags = fh.flags;
+				sess->recvexpect = fh.crc;
+				sess->recvcrc = 0;
+				if((fh.flags & FF_PACKED || sess->delta != NULL) && sess->packbuf == NULL)
+					sess->packbuf = malloc(PACK_FRAME);
+				c->rpos += hsize;
+				if(len == 0)
+					receiveFrame(sess, NULL, 0);
+				continue;
+			}
+
+			if(c->rlen - c->rpos < hsize + len)
+				break;      // Rest of frame not here yet
+
+			// Commands need room to queue a full response frame
+			if(outSpace(sess) < MAX_BLOCK_SIZE + V2_HDR_SIZE)
+				break;
+
+			if((fh.flags & FF_CHECKSUM) && crc32buf(0, c->rbuf + c->rpos + hsize, len) != fh.crc){
+				logPrint(LOG_ERROR, "Command frame from client failed its checksum. Closing connection.");
+				metricsAdd(MET_PROTOCOL_ERRORS, 1);
+				sess->state = SESS_CLOSED;
+				break;
+			}
+
+			c->rpos += hsize + len;
+			c->tag = fh.tag;    // Responses carry the request ID of their command
+			dispatchCommand(sess, c->rbuf + c->rpos - len, len);
+		}
+
+		// Keep any partial frame at the start of the buffer
+		if(c->rpos > 0){
+			memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+			c->rlen -= c->rpos;
+			c->rpos = 0;
+		}
+
+		pumpFile(sess);
+
+	} //END of processFrames function
+
+
+/** Output space - number of bytes that can still be queued in the conn write buffer
+ *
+ */
+	static int outSpace(Session *sess){
+
+		// Slide unsent bytes to the front so all free space is contiguous
+		if(sess->conn.woff > 0){
+			memmove(sess->conn.wbuf, sess->conn.wbuf + sess->conn.woff, sess->conn.wlen - sess->conn.woff);
+			sess->conn.wlen -= sess->conn.woff;
+			sess->conn.woff = 0;
+		}
+
+		return CONN_WBUF - sess->conn.wlen;
+
+	} //END of outSpace function
+
+
+/** Queue frame - appends a response frame (header then data) to the output buffer
+ *
+ *	Pre: nbytes <= MAX_BLOCK_SIZE
+ *	Return: nbytes if queued, -3 if too large or no room
+ */
+	static int queueFrame(Session *sess, char *data, int nbytes){
+
+		if(nbytes > MAX_BLOCK_SIZE || outSpace(sess) < nbytes + V2_HDR_SIZE)
+			return (-3);
+
+		if(sess->checksum)
+			queueHeader(sess, FT_RESP, FF_CHECKSUM, nbytes, crc32buf(0, data, nbytes));
+		else
+			queueHeader(sess, FT_RESP, 0, nbytes, 0);
+		memcpy(sess->conn.wbuf + sess->conn.wlen, data, nbytes);
+		sess->conn.wlen += nbytes;
+
+		return nbytes;
+
+	} //END of queueFrame function
+
+
+/** Queue header - appends the header of a frame whose payload follows separately.
+ *				  v1 sessions get the 2 byte length only, type/flags/crc are v2
+ *
+ *	Pre: at least V2_HDR_SIZE bytes of space in the conn write buffer
+ */
+	static void queueHeader(Session *sess, int type, int flags, int nbytes, unsigned int crc){
+		unsigned short data_size = htons(nbytes);
+		FrameHeader fh;
+
+		if(sess->conn.version == 2){
+			fh.type = type;
+			fh.flags = flags;
+			fh.tag = sess->conn.tag;
+			fh.length = nbytes;
+			fh.crc = crc;
+			packheader(sess->conn.wbuf + sess->conn.wlen, &fh);
+			sess->conn.wlen += V2_HDR_SIZE;
+		} else {
+			memcpy(sess->conn.wbuf + sess->conn.wlen, &data_size, 2);
+			sess->conn.wlen += 2;
+		}
+
+	} //END of queueHeader function
+
+
+/** Header size - bytes of frame header for the framing this session uses
+ *
+ */
+	static int headerSize(Session *sess){
+
+		return connhdrsize(&sess->conn);
+
+	} //END of headerSize function
+
+
+/** Pump file - starts the next frame of a file being sent once the previous one has gone
+ *
+ *	Pre: state is SESS_GET_SEND with filefd open for reading and fileleft bytes still to send
+ *	Post: The next frame header is queued and frameleft set for sendFileData (raw mode has no headers).
+ *		  At end of file the file is closed and state returns to SESS_CMD
+ */
+	static void pumpFile(Session *sess){
+		int n, hsize, flags;
+		char *data;
+
+		// Between the files of an mget or rget, start the next ones
+		if(sess->state == SESS_CMD && (sess->batch != NULL || sess->tree != NULL))
+			batchNext(sess);
+
+		// io_uring takes over once the acknowledgement (and raw size frame) has gone
+		if(sess->ringwant && sess->conn.wlen == sess->conn.woff)
+			startRing(sess);
+
+		// ... a file being hashed for I
+		if(sess->state == SESS_GET_SEND && sess->digesting == 'i'){
+			pumpHash(sess);
+			return;
+		}
+
+		// ... or a range being checked for K
+		if(sess->state == SESS_GET_SEND && sess->digesting == 'k'){
+			pumpCheck(sess);
+			return;
+		}
+
+		// Sync signatures or delta instead of file data
+		if(sess->state == SESS_GET_SEND && sess->delta != NULL){
+			pumpDelta(sess);
+			return;
+		}
+
+		// ... or directory entries
+		if(sess->state == SESS_GET_SEND && (sess->listfd >= 0 || sess->listcached)){
+			pumpList(sess);
+			return;
+		}
+
+		// ... or the rest of a file sent from the hot-file cache
+		if(sess->state == SESS_GET_SEND && sess->hotlen > 0){
+			pumpHot(sess);
+			return;
+		}
+
+		if(sess->state != SESS_GET_SEND || sess->ringwant || sess->frameleft > 0 || outSpace(sess) < BUFSIZE + V2_HDR_SIZE)
+			return;
+
+		if(sess->fileleft > 0){
+			if(sess->rawmode){
+				// Raw stream - the client already knows the size, send it all as one run
+				sess->frameleft = sess->fileleft > RAW_MAX_SEND ? RAW_MAX_SEND : sess->fileleft;
+			} else if(sess->checksum || sess->pack.codec != CODEC_NONE){
+				// Checksummed or compressed data has to pass through user space, frame what fits in the conn write buffer
+				hsize = headerSize(sess);
+				data = sess->conn.wbuf + sess->conn.wlen + hsize;
+				n = CONN_WBUF - sess->conn.wlen - hsize;
+				if((n = read(sess->filefd, data, sess->fileleft < n ? sess->fileleft : n)) <= 0){
+					logPrint(LOG_ERROR, "File read error %s", n < 0 ? strerror(errno) : "(file shrank)");
+					metricsAdd(MET_IO_ERRORS, 1);
+					queueHeader(sess, FT_DATA, FF_EOF | FF_ERROR, 0, 0);
+					sess->fileleft = 0;
+				} else {
+					sess->fileleft -= n;
+					n = pack(&sess->pack, data, n, &flags);
+					flags |= (sess->fileleft == 0 ? FF_EOF : 0) | (sess->checksum ? FF_CHECKSUM : 0);
+					queueHeader(sess, FT_DATA, flags, n, sess->checksum ? crc32buf(0, data, n) : 0);
+					sess->conn.wlen += n;
+				}
+				sess->lastframe = n;
+			} else {
+				n = sess->fileleft > sess->maxframe ? sess->maxframe : sess->fileleft;
+				queueHeader(sess, FT_DATA, n == sess->fileleft ? FF_EOF : 0, n, 0);
+				sess->frameleft = sess->lastframe = n;
+			}
+			return;
+		}
+
+		/* The v1 client stops at the first short frame, so a file that ended on a
+		   full frame (or was empty) is finished with an empty frame. v2 only needs
+		   one for an empty file, otherwise the last frame carried FF_EOF */
+		if(sess->conn.version == 1 && !sess->rawmode && (sess->lastframe < 0 || sess->lastframe >= BUFSIZE-2))
+			queueFrame(sess, "", 0);
+		else if(sess->conn.version == 2 && !sess->rawmode && sess->lastframe < 0)
+			queueHeader(sess, FT_DATA, FF_EOF, 0, 0);
+
+		close(sess->filefd);
+		sess->filefd = -1;
+		sess->state = SESS_CMD;
+		logPrint(LOG_DEBUG, "File successfully sent to client");
+
+		// The next files of an mget or rget follow straight away
+		if(sess->batch != NULL || sess->tree != NULL)
+			batchNext(sess);
+		else
+			logPacking(sess);
+
+	} //END of pumpFile function
+
+
+/** Dispatch command - Executes the command in a frame from the client. They include:
+ *					pwd - to display current server directory, dir - displays file names in current server directory
+ *					cd - change current server directory, get/put - send or receive files to/from client
+ *
+ *	Pre: Session in state SESS_CMD with room for a full response frame
+ *	Post: Response queued for the client, or the session moved into a transfer state
+ */
+	static void dispatchCommand(Session *sess, char *frame, int len){
+		int chdir_result, newfd, n;
+		unsigned long long built;
+		char buf[BUFSIZE + 1];
+		char response[BUFSIZE], stats[128];
+		char command;
+
+		logPrint(LOG_DEBUG, "Opcode %c received from client with a total of %d bytes recieved", len > 0 ? frame[0] : ' ', len);
+
+		// Commands sent back to back end the previous request when the next one is taken
+		requestDone(sess);
+		sess->opcode = len > 0 ? frame[0] : '?';
+		sess->opstart = nowUsec();
+		sess->opbytes = sess->iobytes - len;
+
+		// The CRC-32 of a range put only answers the K sent right after it
+		if(sess->opcode != 'K')
+			sess->rangeknown = 0;
+
+		if(len == 0){
+			queueFrame(sess, "Command not recognised.", strlen("Command not recognised.") + 1);
+			return;
+		}
+
+		command = frame[0];   // Get first character of frame
+		memcpy(buf, frame + 1, len - 1);   // Remove first character
+		buf[len - 1] = '\0';
+
+		if(command == 'P'){      // pwd
+			logPrint(LOG_DEBUG, "pwd command received. Getting current working directory...");
+			snprintf(buf, sizeof(buf), "/proc/self/fd/%d", sess->cwdfd);
+			if((n = readlink(buf, response, sizeof(response) - 1)) < 0){
+				logPrint(LOG_ERROR, "Cannot read session directory: %s", strerror(errno));
+				n = 0;
+			}
+			response[n] = '\0';
+
+			/* send results to client */
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "Current working directory %s returned to client", response);
+		} else if(command == 'D'){  // dir
+			logPrint(LOG_DEBUG, "dir command received. Getting file names in current directory...");
+			if(dircacheLookup(sess->cwdfd, -1, 0, response, sizeof(response)) < 0){
+				built = dircacheBegin(sess->cwdfd);
+				readDirFiles(sess->cwdfd, response);
+				if(response[0] != '1')
+					dircacheStore(sess->cwdfd, -1, 0, built, response, strlen(response) + 1);
+			} else
+				logPrint(LOG_DEBUG, "File names taken from the listing cache");
+			dircacheStats(stats, sizeof(stats));
+
+			/* send results to client */
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "File names in current directory sent to client (%s)", stats);
+		} else if(command == 'L'){  // paged dir
+			listDir(sess, buf);
+		} else if(command == 'C'){  // cd
+			logPrint(LOG_DEBUG, "cd command received. Changing directory...");
+			// Relative to the session directory, like chdir() needs search permission only
+			if((newfd = openat(sess->cwdfd, buf, O_PATH | O_DIRECTORY)) < 0){
+				chdir_result = -1;
+				logPrint(LOG_WARN, "Changing directory failed: %s", strerror(errno));
+			} else {
+				chdir_result = 0;
+				close(sess->cwdfd);
+				sess->cwdfd = newfd;
+				logPrint(LOG_DEBUG, "Current directory successfully changed.");
+			}
+
+			/* send chdir result to client */
+			queueFrame(sess, (char *) &chdir_result, 1);
+		} else if(command == 'G' || command == 'H'){  // get
+			getFile(sess, buf, command);
+		} else if(command == 'U' || command == 'V'){  // put
+			putFile(sess, buf, command);
+		} else if(command == 'R'){  // ranged get
+			getRange(sess, buf);
+		} else if(command == 'W'){  // ranged put
+			putRange(sess, buf);
+		} else if(command == 'K'){  // range checksum
+			checkRange(sess, buf);
+		} else if(command == 'I'){  // digest
+			hashFile(sess, buf);
+		} else if(command == 'M'){  // mget
+			getBatch(sess, buf);
+		} else if(command == 'T'){  // rget
+			getTree(sess, buf);
+		} else if(command == 'Y'){  // mput
+			putBatchFile(sess, buf);
+		} else if(command == 'Z'){  // compression
+			selectCodec(sess, buf);
+		} else if(command == 'S'){  // sync
+			syncFile(sess, buf);
+		} else if(command == 'N' && sess->conn.version == 1){  // negotiate framing
+			negotiate(sess, buf);
+		} else if(command == 'X'){  // stats
+			logPrint(LOG_DEBUG, "stats command received. Summing the metrics of every process...");
+			metricsReport(response, sizeof(response));
+			queueFrame(sess, response, strlen(response) + 1);
+		} else if(command == 'O'){  // transport
+			logPrint(LOG_DEBUG, "transport command received. Reading back the socket options...");
+			transportDump(sess->sock, response, sizeof(response));
+			queueFrame(sess, response, strlen(response) + 1);
+		} else {
+			 // Command not recognised
+			 char unident[] = "Command not recognised.";
+			 queueFrame(sess, unident, strlen(unident) + 1);
+			 logPrint(LOG_WARN, "%s.", unident);
+		}
+
+	} //END of dispatchCommand function
+
+
+/** Read directory file names - Function reads file names in directory dirfd and adds to array with newline separator
+ *
+ *	Pre: Command 'dir' requested from the user, with empty char array provided, buffer size predefined
+ *	Post: Directory pointer determined, and file names in current directory read. File names concatenated to the char array with newline separator
+ *		  If file names could not be read, code '1' is read into the response char array back to the calling function
+ */
+	static void readDirFiles(int dirfd, char response[]){
+		DIR *dp = NULL;
+		struct dirent *dirp;
+		char directory[BUFSIZE];
+		size_t len = 0, n;
+		int fd;
+
+		// Reopen directory to start from the start of directory
+		if((fd = openat(dirfd, ".", O_RDONLY | O_DIRECTORY)) >= 0 && (dp = fdopendir(fd)) == NULL)
+			close(fd);
+		if(dp != NULL){
+			// Read directory names into array, as many as fit (L lists any number of them)
+			while((dirp = readdir(dp)) != NULL){
+				n = strlen(dirp->d_name);
+				if(len + n + 1 + sizeof("\n...") > sizeof(directory)){
+					strcpy(directory + len, "\n...");
+					len += strlen("\n...");
+					break;
+				}
+				directory[len++] = '\n';
+				memcpy(directory + len, dirp->d_name, n);
+				len += n;
+			}
+			directory[len] = '\0';
+
+			// Close directory
+			closedir(dp);
+
+			strcpy(response, directory);
+		}else{
+			strcpy(response, "1");
+			logPrint(LOG_ERROR, "Directory read error %s", strerror(errno));
+		}
+
+	} //END of readDirFiles
+
+
+/** list directory - Function starts sending a page of the session directory's entries (L)
+*
+*	Pre: loc_buf holds "<cursor> <entries>", cursor 0 for the first page or the one the last page ended with
+*	Post: "L0" queued and the session moves into SESS_GET_SEND, where pumpList sends the entries.
+*		  "L1" if the directory cannot be read, "L2" for a v1 session or a malformed request
+*/
+	static void listDir(Session *sess, char *loc_buf){
+		long long cursor;
+		int entries;
+
+		if(sess->conn.version != 2 || sscanf(loc_buf, "%lld %d", &cursor, &entries) != 2 || cursor < 0 || entries < 1){
+			queueFrame(sess, "L2", 3);
+			return;
+		}
+		if(entries > LIST_MAX_PAGE)
+			entries = LIST_MAX_PAGE;
+		logPrint(LOG_DEBUG, "dir page of %d entries from cursor %lld requested", entries, cursor);
+		sess->listcursor = cursor;
+		sess->listentries = entries;
+		sess->listpagelen = 0;
+		sess->listbuilt = 0;
+
+		// A cached page is sent as it is, the directory is not read at all
+		if(sess->listpage == NULL)
+			sess->listpage = malloc(DIRCACHE_DATA);
+		if(sess->listpage != NULL && (sess->listpagelen = dircacheLookup(sess->cwdfd, cursor, entries, sess->listpage, DIRCACHE_DATA)) > 0){
+			queueFrame(sess, "L0", 3);
+			sess->listcached = 1;
+			sess->listpagepos = 0;
+			sess->state = SESS_GET_SEND;    // Records are sent by pumpList
+			return;
+		}
+
+		// Otherwise the page is kept as it is sent, to be cached if the directory does not change meanwhile
+		sess->listpagelen = 0;
+		if(sess->listpage != NULL)
+			sess->listbuilt = dircacheBegin(sess->cwdfd);
+		if(sess->listbuf == NULL && (sess->listbuf = malloc(LIST_BUFSIZE)) == NULL){
+			queueFrame(sess, "L1", 3);
+			return;
+		}
+		if((sess->listfd = openat(sess->cwdfd, ".", O_RDONLY | O_DIRECTORY)) < 0 || lseek(sess->listfd, cursor, SEEK_SET) < 0){
+			logPrint(LOG_ERROR, "Directory read error %s", strerror(errno));
+			if(sess->listfd >= 0)
+				close(sess->listfd);
+			sess->listfd = -1;
+			queueFrame(sess, "L1", 3);
+			return;
+		}
+
+		queueFrame(sess, "L0", 3);
+		sess->listleft = entries;
+		sess->listpos = sess->listlen = 0;
+		sess->listnext = cursor;
+		sess->state = SESS_GET_SEND;    // Entries are sent by pumpList
+
+	} //END of listDir function
+
+
+/** Pump list - queues the next frame of a directory listing
+ *
+ *	Pre: state is SESS_GET_SEND with sess->listfd open, or a cached page in listpage
+ *	Post: One data frame of whole records is made in the output buffer. The last one ends with an end
+ *		  record ('E' for the end of the directory, 'M' with the cursor of the next page) and is flagged
+ *		  FF_EOF, then the session returns to SESS_CMD. A page read from the directory that fits in
+ *		  DIRCACHE_DATA is stored in the listing cache
+ */
+	static void pumpList(Session *sess){
+		struct dirent64 *de;
+		char *data, *p, stats[128];
+		int n = 0, len, hsize, room, end = 0;
+
+		if(outSpace(sess) < BUFSIZE + V2_HDR_SIZE)
+			return;
+
+		hsize = headerSize(sess);
+		data = sess->conn.wbuf + sess->conn.wlen + hsize;
+		room = CONN_WBUF - sess->conn.wlen - hsize;
+		if(room > sess->maxframe)
+			room = sess->maxframe;
+
+		// Cached page - the same records, end record included, copied frame by frame
+		while(sess->listcached && end == 0 && n + LIST_RECORD + NAME_MAX <= room){
+			p = sess->listpage + sess->listpagepos;
+			len = LIST_RECORD + ((unsigned char) p[17] << 8 | (unsigned char) p[18]);
+			memcpy(data + n, p, len);
+			n += len;
+			if((sess->listpagepos += len) == sess->listpagelen)
+				end = 'C';
+		}
+
+		while(!sess->listcached && end == 0 && n + LIST_RECORD + NAME_MAX <= room){
+			if(sess->listleft == 0)
+				end = 'M';
+			else if(sess->listpos < sess->listlen){
+				de = (struct dirent64 *) (sess->listbuf + sess->listpos);
+				sess->listpos += de->d_reclen;
+				sess->listnext = de->d_off;
+				if(strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0){
+					n += listRecord(sess, de, data + n);
+					sess->listleft--;
+				}
+			} else if((len = getdents64(sess->listfd, sess->listbuf, LIST_BUFSIZE)) > 0){
+				sess->listpos = 0;
+				sess->listlen = len;
+			} else if(len == 0)
+				end = 'E';
+			else {
+				logPrint(LOG_ERROR, "Directory read error %s", strerror(errno));
+				queueHeader(sess, FT_DATA, FF_EOF | FF_ERROR, 0, 0);    // Records made so far are dropped
+				n = 0;
+				break;
+			}
+		}
+
+		// End record: type, cursor in the size field, no name
+		if(end == 'E' || end == 'M'){
+			data[n] = end;
+			putBigEndian(data + n + 1, end == 'M' ? sess->listnext : 0, 8);
+			memset(data + n + 9, 0, LIST_RECORD - 9);
+			n += LIST_RECORD;
+		}
+
+		// Keep the page for the cache while it fits
+		if(!sess->listcached && sess->listbuilt != 0 && sess->listpagelen >= 0){
+			if(sess->listpagelen + n <= DIRCACHE_DATA){
+				memcpy(sess->listpage + sess->listpagelen, data, n);
+				sess->listpagelen += n;
+			} else
+				sess->listpagelen = -1;
+		}
+
+		if(n > 0){
+			queueHeader(sess, FT_DATA, (end != 0 ? FF_EOF : 0) | (sess->checksum ? FF_CHECKSUM : 0), n,
+						sess->checksum ? crc32buf(0, data, n) : 0);
+			sess->conn.wlen += n;
+		}
+		if(end != 0 || n == 0){
+			if(end != 0 && !sess->listcached && sess->listpagelen > 0)
+				dircacheStore(sess->cwdfd, sess->listcursor, sess->listentries, sess->listbuilt, sess->listpage, sess->listpagelen);
+			if(sess->listfd >= 0)
+				close(sess->listfd);
+			sess->listfd = -1;
+			sess->listcached = 0;
+			sess->state = SESS_CMD;
+			if(end != 0){
+				dircacheStats(stats, sizeof(stats));
+				logPrint(LOG_DEBUG, "dir page sent to client (%s, %s)", end == 'C' ? "from the listing cache" : end == 'E' ? "end of directory" : "more to come", stats);
+			}
+		}
+
+	} //END of pumpList function
+
+
+/** List record - Function writes the listing record of a directory entry: type ('f' file, 'd' directory,
+*				  'l' symbolic link, 'o' other), size and mtime (u64 each), name length (u16) and name
+*
+*	Return: Bytes written
+*/
+	static int listRecord(Session *sess, struct dirent64 *de, char *out){
+		struct stat st;
+		int len = strlen(de->d_name), type = de->d_type;
+
+		// A file removed since it was read is listed with no size or time
+		if(fstatat(sess->listfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+			memset(&st, 0, sizeof(st));
+		else if(type == DT_UNKNOWN)
+			type = IFTODT(st.st_mode);
+
+		out[0] = type == DT_REG ? 'f' : type == DT_DIR ? 'd' : type == DT_LNK ? 'l' : 'o';
+		putBigEndian(out + 1, st.st_size, 8);
+		putBigEndian(out + 9, st.st_mtime, 8);
+		putBigEndian(out + 17, len, 2);
+		memcpy(out + LIST_RECORD, de->d_name, len);
+		return LIST_RECORD + len;
+
+	} //END of listRecord function
+
+
+/** Put big endian - stores the low bytes of v, most significant first
+ *
+ */
+	static void putBigEndian(char *p, unsigned long long v, int bytes){
+
+		while(bytes-- > 0){
+			p[bytes] = v & 0xFF;
+			v >>= 8;
+		}
+
+	} //END of putBigEndian function
+
+
+/** get file - Function sends requested file to client
+*
+*	Pre: filename must exist in buffer, command from client must be 'G' or 'H'.
+*	Post: 'G' queues the acknowledgement and remembers the file name,
+*		  'H0' opens the file and moves the session into SESS_GET_SEND
+*/
+	static void getFile(Session *sess, char *loc_buf, char command){
+
+		char response[BUFSIZE], code;
+		struct stat st;
+
+		if(command == 'G'){
+			logPrint(LOG_DEBUG, "get command received. Checking file %s exists...", loc_buf);
+			strcpy(response, "G");
+
+			if(faccessat(sess->cwdfd, loc_buf, F_OK, 0) == 0){     // File exists
+				strcat(response, "0");  // File exists & read access
+				strcat(response, "R");  // Raw stream offered, v1 clients only look at response[1]
+				logPrint(LOG_DEBUG, "File exists...");
+				strcpy(sess->filename, loc_buf);
+			} else {
+				strcat(response, "1");  // File doesn't exist
+				sess->filename[0] = '\0';
+				logPrint(LOG_DEBUG, "File does not exist...");
+			}
+
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "Acknowledgement sent to client");
+		} else if(command == 'H'){  // get confirmed
+			code = loc_buf[0];   // Get first character of string
+
+			if((code == '0' || code == 'R') && sess->filename[0] != '\0'){    // If server and client confirmed
+				logPrint(LOG_DEBUG, "Client ready to accept file. Sending...");
+
+				// A small file fetched again and again is sent from memory
+				if(code == '0' && sendCached(sess))
+					return;
+
+				sess->filefd = openat(sess->cwdfd, sess->filename, O_RDONLY); // Open file
+				if(sess->filefd < 0 || fstat(sess->filefd, &st) < 0){
+					logPrint(LOG_ERROR, "Cannot open file %s: %s", sess->filename, strerror(errno));
+					if(sess->filefd >= 0)
+						close(sess->filefd);
+					sess->filefd = -1;
+					// End transfer so the client does not wait
+					if(code == 'R')
+						queueFrame(sess, "-1", 3);     // Never a size, the client gives up
+					else if(sess->conn.version == 2)
+						queueHeader(sess, FT_DATA, FF_EOF | FF_ERROR, 0, 0);
+					else
+						queueFrame(sess, "", 0);
+					return;
+				}
+
+				sess->fileleft = st.st_size;
+				sess->fileoff = 0;
+				sess->frameleft = 0;
+				sess->lastframe = -1;
+				sess->rawmode = (code == 'R');
+				if(sess->rawmode){
+					// Raw stream starts with the file size as a decimal string
+					sprintf(response, "%lld", (long long) st.st_size);
+					queueFrame(sess, response, strlen(response) + 1);
+				}
+				sess->state = SESS_GET_SEND;    // File data is sent by pumpFile/sendFileData
+				sess->ringwant = uringActive();    // ... or by io_uring
+			}else
+				logPrint(LOG_DEBUG, "Client not ready to accept file");
+		}
+
+	} //END of getFile function
+
+
+/** send cached - Function sends a file from the hot-file cache, reading it into the cache first on a miss
+*
+*	Pre: v2 get confirmed with H0 for sess->filename, session in SESS_CMD
+*	Post: The file leaves as one data frame, behind any responses already queued, in a single sendmsg() from
+*		  the cache. What the socket does not take at once is copied to hotbuf and sent by pumpHot.
+*		  Nothing is sent for a compressed session, a file larger than the cache keeps or than one frame,
+*		  or when the cache is off or no slot can be had
+*	Return: 1 if the file was sent (or queued), 0 to send it the usual way
+*/
+	static int sendCached(Session *sess){
+		HotFile *hot;
+		struct stat st;
+		struct iovec iov[3];
+		struct msghdr msg;
+		FrameHeader fh;
+		char header[V2_HDR_SIZE], stats[192];
+		int fd, n, queued;
+
+		if(sess->conn.version != 2 || sess->pack.codec != CODEC_NONE || fstatat(sess->cwdfd, sess->filename, &st, 0) < 0 ||
+		   !S_ISREG(st.st_mode) || st.st_size > filecacheLimit() || st.st_size > sess->maxframe)
+			return 0;
+
+		if((hot = filecacheLookup(&st)) == NULL){
+			if((fd = openat(sess->cwdfd, sess->filename, O_RDONLY)) < 0)
+				return 0;
+			hot = filecacheStore(&st, fd);
+			close(fd);
+			if(hot == NULL)
+				return 0;
+		}
+		if(sess->hotbuf == NULL && (sess->hotbuf = malloc(V2_HDR_SIZE + FILECACHE_FILE)) == NULL){
+			filecacheRelease(hot);
+			return 0;
+		}
+
+		fh.type = FT_DATA;
+		fh.flags = FF_EOF | (sess->checksum ? FF_CHECKSUM : 0);
+		fh.tag = sess->conn.tag;
+		fh.length = hot->size;
+		fh.crc = sess->checksum ? hot->crc : 0;
+		packheader(header, &fh);
+
+		// Queued responses, the frame header and the file from shared memory, in one system call
+		queued = sess->conn.wlen - sess->conn.woff;
+		iov[0].iov_base = sess->conn.wbuf + sess->conn.woff;
+		iov[0].iov_len = queued;
+		iov[1].iov_base = header;
+		iov[1].iov_len = V2_HDR_SIZE;
+		iov[2].iov_base = hot->data;
+		iov[2].iov_len = hot->size;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 3;
+		if((n = sendmsg(sess->sock, &msg, MSG_NOSIGNAL)) < 0){
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+				logPrint(LOG_ERROR, "Write to client failed: %s", strerror(errno));
+				metricsAdd(MET_IO_ERRORS, 1);
+				sess->state = SESS_CLOSED;
+				filecacheRelease(hot);
+				return 1;
+			}
+			n = 0;
+		}
+		countBytes(sess, MET_BYTES_OUT, n);
+		shaperCharge(&sess->shape, n - queued);     // Small enough never to wait, but it counts
+
+		if(n < queued){
+			sess->conn.woff += n;
+			n = 0;
+		} else {
+			sess->conn.woff = sess->conn.wlen = 0;
+			n -= queued;
+		}
+
+		// The slot may be replaced once released, so the rest is kept by the session
+		if(n < V2_HDR_SIZE + hot->size){
+			memcpy(sess->hotbuf, header, V2_HDR_SIZE);
+			memcpy(sess->hotbuf + V2_HDR_SIZE, hot->data, hot->size);
+			sess->hotpos = n;
+			sess->hotlen = V2_HDR_SIZE + hot->size;
+			sess->state = SESS_GET_SEND;    // Rest is sent by pumpHot
+		}
+		filecacheRelease(hot);
+
+		filecacheStats(stats, sizeof(stats));
+		logPrint(LOG_DEBUG, "File sent to client from the hot-file cache (%s)", stats);
+		return 1;
+
+	} //END of sendCached function
+
+
+/** pump hot - Function queues the rest of a cached file that the socket did not take at once
+*
+*	Pre: state is SESS_GET_SEND with hotlen > 0
+*	Post: As much as fits is copied to the output buffer. Once all of it is queued the session returns to SESS_CMD
+*/
+	static void pumpHot(Session *sess){
+		int n;
+
+		n = outSpace(sess);
+		if(n > sess->hotlen - sess->hotpos)
+			n = sess->hotlen - sess->hotpos;
+		memcpy(sess->conn.wbuf + sess->conn.wlen, sess->hotbuf + sess->hotpos, n);
+		sess->conn.wlen += n;
+
+		if((sess->hotpos += n) == sess->hotlen){
+			sess->hotlen = 0;
+			sess->state = SESS_CMD;
+		}
+
+	} //END of pumpHot function
+
+
+/** put file - Function downloads file from client and places into current directory
+*
+*	Pre: filename must exist in buffer, command from client must be 'U' or 'V'.
+*	Post: Acknowledgement queued. If the file does not already exist it is created
+*		  and the session moves into SESS_PUT_RECV
+*/
+	static void putFile(Session *sess, char *loc_buf, char command){
+
+		char response[BUFSIZE];
+
+		if(command == 'U'){
+			logPrint(LOG_DEBUG, "put command received. Checking file %s exists...", loc_buf);
+			strcpy(response, "U");
+
+			if(faccessat(sess->cwdfd, loc_buf, F_OK, 0) == 0){ // Check file existance
+
+				strcat(response, "1");  // File exists
+				logPrint(LOG_DEBUG, "File exists");
+			} else {
+
+				strcat(response, "0");  // Server ready
+				logPrint(LOG_DEBUG, "File does not exist");
+			}
+
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "Acknowledgement sent to client");
+
+			if(response[1] == '0'){     // If server and client ready
+				logPrint(LOG_DEBUG, "Client sending file...");
+				sess->filefd = openat(sess->cwdfd, loc_buf, O_RDWR|O_CREAT, S_IRWXU);     // Open file, spliced data is read back to hash it
+				if(sess->filefd < 0)
+					logPrint(LOG_ERROR, "Cannot create file %s: %s", loc_buf, strerror(errno));
+				strcpy(sess->filename, loc_buf);
+				sess->putfailed = (sess->filefd < 0);
+				sess->rangeput = 0;
+				sess->fileoff = 0;
+				if(sess->filefd >= 0)
+					startDigest(sess, 'p');     // Indexed by finishPut
+				sess->state = SESS_PUT_RECV;    // File frames are handled by receiveFrame
+				sess->ringwant = uringActive();    // ... or by io_uring
+			}else
+				logPrint(LOG_DEBUG, "Client did not send file...");
+		}
+
+	} //END of putFile function
+
+
+/** get range - Function sends part of a file to the client (parallel get)
+*
+*	Pre: loc_buf holds "<offset> <length> <filename>"
+*	Post: "R0 <file size>" queued. If length > 0 the range follows as data frames, framed exactly
+*		  like a get, and the session moves into SESS_GET_SEND. "R1" if the file cannot be opened,
+*		  "R2" if the range is not inside the file. A length of 0 only asks for the size, a length
+*		  of -1 asks for the rest of the file from offset (partial fetch or resume)
+*/
+	static void getRange(Session *sess, char *loc_buf){
+
+		char response[BUFSIZE];
+		long long offset, length;
+		struct stat st;
+		int fd, pos = 0;
+
+		sscanf(loc_buf, "%lld %lld %n", &offset, &length, &pos);
+		if(pos == 0){
+			queueFrame(sess, "R2", 3);
+			return;
+		}
+
+		logPrint(LOG_DEBUG, "Range get received for %s (%s)...", loc_buf + pos, loc_buf);
+		if((fd = openat(sess->cwdfd, loc_buf + pos, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+			logPrint(LOG_ERROR, "Cannot open file %s: %s", loc_buf + pos, strerror(errno));
+			if(fd >= 0)
+				close(fd);
+			queueFrame(sess, "R1", 3);
+			return;
+		}
+
+		if(length == -1 && offset >= 0 && offset <= st.st_size)
+			length = st.st_size - offset;     // Rest of the file
+
+		if(offset < 0 || length < 0 || offset + length > st.st_size || lseek(fd, offset, SEEK_SET) < 0){
+			logPrint(LOG_WARN, "Range is outside the file");
+			close(fd);
+			queueFrame(sess, "R2", 3);
+			return;
+		}
+
+		sprintf(response, "R0 %lld", (long long) st.st_size);
+		queueFrame(sess, response, strlen(response) + 1);
+
+		if(length == 0){
+			close(fd);
+			return;
+		}
+
+		sess->filefd = fd;
+		sess->fileleft = length;
+		sess->fileoff = offset;
+		sess->frameleft = 0;
+		sess->lastframe = -1;
+		sess->rawmode = 0;
+		sess->state = SESS_GET_SEND;    // Range data is sent by pumpFile/sendFileData
+		sess->ringwant = uringActive();    // ... or by io_uring
+
+	} //END of getRange function
+
+
+/** put range - Function receives part of a file from the client (parallel put)
+*
+*	Pre: loc_buf holds "<c|w> <offset> <length> <filename>". c creates the file and fails if it
+*		 already exists, w writes into a file that must already exist
+*	Post: "W0" queued. If length > 0 the range follows as data frames, framed exactly like a put,
+*		  written from offset, and the session moves into SESS_PUT_RECV. The CRC-32 of the bytes is
+*		  taken as they are written. "W1" if the file exists (c) or does not (w), "W2" if the request is malformed
+*/
+	static void putRange(Session *sess, char *loc_buf){
+
+		long long offset, length;
+		int fd, flags, pos = 0;
+		char mode = loc_buf[0];
+
+		if(mode == 'c' || mode == 'w')
+			sscanf(loc_buf + 1, "%lld %lld %n", &offset, &length, &pos);
+		if(pos == 0 || offset < 0 || length < 0){
+			queueFrame(sess, "W2", 3);
+			return;
+		}
+
+		logPrint(LOG_DEBUG, "Range put received for %s (%s)...", loc_buf + 1 + pos, loc_buf);
+		flags = mode == 'c' ? O_RDWR | O_CREAT | O_EXCL : O_RDWR;     // Read too, spliced data is summed from the page cache
+		if((fd = openat(sess->cwdfd, loc_buf + 1 + pos, flags, S_IRWXU)) < 0){
+			logPrint(LOG_ERROR, "Cannot open file %s: %s", loc_buf + 1 + pos, strerror(errno));
+			queueFrame(sess, "W1", 3);
+			return;
+		}
+
+		if(lseek(fd, offset, SEEK_SET) < 0){
+			close(fd);
+			queueFrame(sess, "W2", 3);
+			return;
+		}
+
+		queueFrame(sess, "W0", 3);
+
+		if(length == 0){
+			close(fd);
+			return;
+		}
+
+		logPrint(LOG_DEBUG, "Client sending range...");
+		sess->filefd = fd;
+		strcpy(sess->filename, loc_buf + 1 + pos);
+		sess->putfailed = 0;
+		sess->rangeput = 1;
+		sess->fileoff = offset;
+		sess->digesting = 'w';     // Answers the K that follows, see finishPut
+		sess->digestoff = 0;
+		sess->rangecrc = 0;
+		sess->state = SESS_PUT_RECV;    // File frames are handled by receiveFrame
+		sess->ringwant = uringActive();    // ... or by io_uring
+
+	} //END of putRange function
+
+
+/** check range - Function returns the CRC-32 of part of a file, so the client can check a range
+*
+*	Pre: loc_buf holds "<offset> <length> <filename>"
+*	Post: "K0 <crc32 in hex> <bytes read>" queued, or "K1" if the file cannot be read. The range the W before
+*		  wrote is answered from its CRC-32 at once, any other range is read by pumpCheck (SESS_GET_SEND)
+*/
+	static void checkRange(Session *sess, char *loc_buf){
+
+		char response[BUFSIZE];
+		long long offset, length;
+		struct stat st;
+		int fd, pos = 0;
+
+		sscanf(loc_buf, "%lld %lld %n", &offset, &length, &pos);
+		if(pos == 0 || offset < 0 || length < 0 || (fd = openat(sess->cwdfd, loc_buf + pos, O_RDONLY)) < 0){
+			sess->rangeknown = 0;
+			queueFrame(sess, "K1", 3);
+			return;
+		}
+
+		if(sess->rangeknown && fstat(fd, &st) == 0 && st.st_dev == sess->rangedev && st.st_ino == sess->rangeino &&
+		   offset == sess->rangeoff && length == sess->rangelen){
+			close(fd);
+			sess->rangeknown = 0;
+			sprintf(response, "K0 %08x %lld", sess->rangecrc, length);
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "Range checksum %s sent to client (as written)", response + 3);
+			return;
+		}
+
+		sess->rangeknown = 0;
+		strcpy(sess->filename, loc_buf + pos);
+		sess->filefd = fd;
+		sess->rangeoff = offset;
+		sess->rangelen = length;
+		sess->rangecrc = 0;
+		sess->digestoff = 0;
+		sess->digesting = 'k';
+		sess->state = SESS_GET_SEND;    // The range is read by pumpCheck
+
+	} //END of checkRange function
+
+
+/** pump check - reads the next chunk of a range for K, and answers the client once the whole range is read
+*
+*	Pre: state is SESS_GET_SEND with digesting 'k' and filefd open
+*	Post: At most DIGEST_READ bytes are read per call. At the end of the range (or of the file)
+*		  "K0 <crc32 in hex> <bytes read>" is queued, or "K1" on a read error, and the session returns to SESS_CMD
+*/
+	static void pumpCheck(Session *sess){
+		static char buf[DIGEST_READ];
+		char response[BUFSIZE];
+		long long want = sess->rangelen - sess->digestoff;
+		int n = 0;
+
+		if(outSpace(sess) < MAX_BLOCK_SIZE + V2_HDR_SIZE)
+			return;     // The reply has to fit once the last chunk is read
+
+		if(want > 0 && (n = pread(sess->filefd, buf, want < (long long) sizeof(buf) ? want : (long long) sizeof(buf),
+								  sess->rangeoff + sess->digestoff)) > 0){
+			sess->rangecrc = crc32(sess->rangecrc, (Bytef *) buf, n);
+			sess->digestoff += n;
+			if(sess->digestoff < sess->rangelen)
+				return;     // Rest of the range on the next turn
+		}
+
+		if(n < 0){
+			logPrint(LOG_ERROR, "File read error while checking a range of %s: %s", sess->filename, strerror(errno));
+			metricsAdd(MET_IO_ERRORS, 1);
+			queueFrame(sess, "K1", 3);
+		} else {
+			sprintf(response, "K0 %08x %lld", sess->rangecrc, sess->digestoff);
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "Range checksum %s sent to client", response + 3);
+		}
+
+		close(sess->filefd);
+		sess->filefd = -1;
+		sess->digesting = 0;
+		sess->state = SESS_CMD;
+
+	} //END of pumpCheck function
+
+
+/** hash file - Function returns the size, mtime and digest of a file, so the client can tell whether its copy is identical
+*
+*	Pre: loc_buf holds "<size> <filename>", size is the client's size of the file or -1
+*	Post: "I0 <size> <mtime> <digest in hex>" queued. The digest is "-" (not computed) if the file is not size bytes long.
+*		  "I1" if the file does not exist or is not a regular file. A digest that is not in the index is computed
+*		  by pumpHash (SESS_GET_SEND), which answers once it has the whole file, or "I2" if it cannot be read
+*/
+	static void hashFile(Session *sess, char *loc_buf){
+
+		char response[BUFSIZE], hex[DIGEST_HEX] = "-";
+		unsigned char digest[DIGEST_SIZE];
+		long long size;
+		struct stat st;
+		int fd = -1, pos = 0;
+
+		sscanf(loc_buf, "%lld %n", &size, &pos);
+		if(pos == 0 || (fd = openat(sess->cwdfd, loc_buf + pos, O_RDONLY)) < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+			if(fd >= 0)
+				close(fd);
+			queueFrame(sess, "I1", 3);
+			return;
+		}
+
+		// A size that differs already answers the client, the file is not read
+		if((size < 0 || size == st.st_size) && !digestindexed(fd, &st, digest)){
+			strcpy(sess->filename, loc_buf + pos);
+			sess->filefd = fd;
+			sess->hashstat = st;
+			clock_gettime(CLOCK_REALTIME, &sess->hashstart);
+			startDigest(sess, 'i');
+			if(sess->digesting != 'i'){
+				close(fd);
+				sess->filefd = -1;
+				queueFrame(sess, "I2", 3);
+				return;
+			}
+			logPrint(LOG_DEBUG, "Digest of %s is not indexed, hashing it...", loc_buf + pos);
+			sess->state = SESS_GET_SEND;    // The file is hashed by pumpHash
+			return;
+		}
+		if(size < 0 || size == st.st_size)
+			digesthex(digest, hex);
+		close(fd);
+
+		sprintf(response, "I0 %lld %lld %s", (long long) st.st_size, (long long) st.st_mtime, hex);
+		queueFrame(sess, response, strlen(response) + 1);
+		logPrint(LOG_DEBUG, "Digest of %s sent to client (%s)", loc_buf + pos, hex[0] == '-' ? "size differs" : "from the index");
+
+	} //END of hashFile function
+
+
+/** pump hash - hashes the next chunk of a file for I, and answers the client once the whole file is hashed
+*
+*	Pre: state is SESS_GET_SEND with digesting 'i' and filefd open
+*	Post: At most DIGEST_READ bytes are read per call, so the other sessions of the worker get their turns.
+*		  At the end of the file "I0 <size> <mtime> <digest>" is queued (or "I2" on a read error), the digest
+*		  is indexed if the file did not change meanwhile (digeststable) and the session returns to SESS_CMD
+*/
+	static void pumpHash(Session *sess){
+		static char buf[DIGEST_READ];
+		char response[BUFSIZE], hex[DIGEST_HEX];
+		unsigned char digest[DIGEST_SIZE];
+		int n;
+
+		if(outSpace(sess) < MAX_BLOCK_SIZE + V2_HDR_SIZE)
+			return;     // The reply has to fit once the last chunk is hashed
+
+		if((n = pread(sess->filefd, buf, sizeof(buf), sess->digestoff)) > 0){
+			digestupdate(sess->digest, buf, n);
+			sess->digestoff += n;
+			if(n == sizeof(buf))
+				return;     // Rest of the file on the next turn
+		}
+
+		if(n < 0){
+			logPrint(LOG_ERROR, "File read error while hashing %s: %s", sess->filename, strerror(errno));
+			metricsAdd(MET_IO_ERRORS, 1);
+			queueFrame(sess, "I2", 3);
+		} else {
+			digestfinal(sess->digest, digest);
+			if(sess->digestoff == sess->hashstat.st_size && digeststable(sess->filefd, &sess->hashstat, &sess->hashstart))
+				digeststore(sess->filefd, &sess->hashstat, digest);
+			digesthex(digest, hex);
+			sprintf(response, "I0 %lld %lld %s", (long long) sess->hashstat.st_size, (long long) sess->hashstat.st_mtime, hex);
+			queueFrame(sess, response, strlen(response) + 1);
+			logPrint(LOG_DEBUG, "Digest of %s sent to client (computed)", sess->filename);
+		}
+
+		close(sess->filefd);
+		sess->filefd = -1;
+		sess->digesting = 0;
+		sess->state = SESS_CMD;
+
+	} //END of pumpHash function
+
+
+/** start digest - starts a digest of the put data being written ('p') or of filefd for I ('i')
+*
+*	Post: digesting set to mode, or left 0 if there is no memory for the digest (the put is then not indexed)
+*/
+	static void startDigest(Session *sess, char mode){
+
+		sess->digesting = 0;
+		if(sess->digest == NULL && (sess->digest = malloc(sizeof(Digest))) == NULL)
+			return;
+
+		digestinit(sess->digest);
+		sess->digestoff = 0;
+		sess->digesting = mode;
+
+	} //END of startDigest function
+
+
+/** hash written - hashes put data that was spliced into the file, from the page cache it was just written to
+*
+*	Pre: digesting 'p' or 'w', the nbytes after digestoff were just written to filefd
+*	Post: The bytes are hashed, or the put is not indexed (its K reads the range) if they cannot be read back
+*/
+	static void hashWritten(Session *sess, int nbytes){
+		static char buf[PIPE_CAPACITY];
+		int n;
+
+		while(nbytes > 0){
+			if((n = pread(sess->filefd, buf, nbytes < PIPE_CAPACITY ? nbytes : PIPE_CAPACITY, sess->fileoff + sess->digestoff)) <= 0){
+				sess->digesting = 0;
+				return;
+			}
+			if(sess->digesting == 'p')
+				digestupdate(sess->digest, buf, n);
+			else
+				sess->rangecrc = crc32(sess->rangecrc, (Bytef *) buf, n);
+			sess->digestoff += n;
+			nbytes -= n;
+		}
+
+	} //END of hashWritten function
+
+
+/** get batch - Function expands a glob in the session directory and sends every file it matches (mget)
+*
+*	Pre: loc_buf holds the glob
+*	Post: The matches are sent by batchNext, back to back. A glob that matches nothing gets "ME 0 0"
+*/
+	static void getBatch(Session *sess, char *loc_buf){
+		char pattern[BUFSIZE + 32];
+		glob_t *gl = NULL;
+
+		// A relative glob is expanded under the session directory, its prefix is taken off every match
+		logPrint(LOG_DEBUG, "mget command received. Expanding %s...", loc_buf);
+		if((sess->batchskip = fdPath(sess, loc_buf, pattern, sizeof(pattern))) >= 0 &&
+		   (gl = calloc(1, sizeof(glob_t))) != NULL && glob(pattern, 0, NULL, gl) == 0){
+			logPrint(LOG_DEBUG, "%d names match", (int) gl->gl_pathc);
+			sess->batch = gl;
+			sess->batchnext = 0;
+			sess->batchsent = sess->batchfailed = 0;
+			batchNext(sess);
+			return;
+		}
+
+		if(gl != NULL){
+			globfree(gl);
+			free(gl);
+		}
+		queueFrame(sess, "ME 0 0", 7);
+		logPrint(LOG_DEBUG, "No files match");
+
+	} //END of getBatch function
+
+
+/** get tree - Function walks a directory tree and sends the files in it like an mget (rget)
+*
+*	Pre: loc_buf holds "<size limit> <directory>", the directory relative to the session directory
+*	Post: The tree is walked by batchNext. Directories are announced with "MD <name>" before anything in them,
+*		  files below the size limit are sent like mget files and larger ones only announced with
+*		  "MB <size> <name>", so the client can fetch them on connections of their own. Names start with
+*		  the directory as given. A malformed request gets "ME 0 0"
+*/
+	static void getTree(Session *sess, char *loc_buf){
+		char *paths[2] = {NULL, NULL}, root[BUFSIZE + 32];
+		long long limit;
+		int pos = 0;
+
+		if(sscanf(loc_buf, "%lld %n", &limit, &pos) < 1 || pos == 0 || loc_buf[pos] == '\0'){
+			queueFrame(sess, "ME 0 0", 7);
+			return;
+		}
+
+		logPrint(LOG_DEBUG, "rget command received. Walking %s...", loc_buf + pos);
+		// Symbolic links are followed, fts leaves out a directory that loops back on the walk.
+		// A relative directory is walked under the session directory, its prefix is taken off every name
+		paths[0] = root;
+		if((sess->batchskip = fdPath(sess, loc_buf + pos, root, sizeof(root))) < 0 ||
+		   (sess->tree = fts_open(paths, FTS_LOGICAL | FTS_NOCHDIR, NULL)) == NULL){
+			logPrint(LOG_ERROR, "Cannot walk %s: %s", loc_buf + pos, strerror(errno));
+			queueFrame(sess, "ME 0 0", 7);
+			return;
+		}
+
+		sess->treelimit = limit;
+		sess->batchsent = sess->batchfailed = 0;
+		batchNext(sess);
+
+	} //END of getTree function
+
+
+/** Batch next - Function sends the next files of an mget or rget until one needs the sendfile path or the output is full
+*
+*	Pre: state is SESS_CMD with sess->batch or sess->tree set. Names are relative to the session directory
+*	Post: Each file is announced with "M0 <size> <name>" and followed by its data frames, framed like a get.
+*		  A file smaller than one frame is read into the output behind its name, so many small files leave
+*		  in one write. "M1 <name>" for a file that cannot be read. mget skips directories, rget announces
+*		  them and its large files (see getTree). "ME <sent> <failed>" follows the last file
+*/
+	static void batchNext(Session *sess){
+		char response[BUFSIZE], *name, *data;
+		struct stat st;
+		int fd = -1, n, flags, packed;
+
+		while(sess->state == SESS_CMD){
+			// Room for the name and a small file, otherwise wait for the output to drain
+			if(outSpace(sess) < 2 * (BUFSIZE + V2_HDR_SIZE))
+				return;
+
+			if((n = batchEntry(sess, &name, &st)) == 0)
+				break;
+			if(n > 0 && S_ISDIR(st.st_mode)){
+				if(sess->tree != NULL){
+					snprintf(response, sizeof(response), "MD %s", name);
+					queueFrame(sess, response, strlen(response) + 1);
+				}
+				continue;
+			}
+			if(n > 0 && S_ISREG(st.st_mode) && sess->tree != NULL && st.st_size >= sess->treelimit){
+				snprintf(response, sizeof(response), "MB %lld %s", (long long) st.st_size, name);
+				queueFrame(sess, response, strlen(response) + 1);
+				continue;
+			}
+			if(n < 0 || !S_ISREG(st.st_mode) || (fd = openat(sess->cwdfd, name, O_RDONLY)) < 0){
+				logPrint(LOG_ERROR, "Cannot send file %s", name);
+				snprintf(response, sizeof(response), "M1 %s", name);
+				queueFrame(sess, response, strlen(response) + 1);
+				sess->batchfailed++;
+				continue;
+			}
+
+			snprintf(response, sizeof(response), "M0 %lld %s", (long long) st.st_size, name);
+			queueFrame(sess, response, strlen(response) + 1);
+			sess->batchsent++;
+
+			if(st.st_size < BUFSIZE-2){
+				// Small file - one frame, read straight into the output buffer
+				data = sess->conn.wbuf + sess->conn.wlen + headerSize(sess);
+				if((n = read(fd, data, st.st_size)) < 0)
+					n = 0;
+				close(fd);
+				flags = FF_EOF | (n < st.st_size ? FF_ERROR : 0) | (sess->checksum ? FF_CHECKSUM : 0);
+				n = pack(&sess->pack, data, n, &packed);
+				queueHeader(sess, FT_DATA, flags | packed, n, sess->checksum ? crc32buf(0, data, n) : 0);
+				sess->conn.wlen += n;
+				continue;
+			}
+
+			// Larger files are sent like a get
+			sess->filefd = fd;
+			sess->fileleft = st.st_size;
+			sess->fileoff = 0;
+			sess->frameleft = 0;
+			sess->lastframe = -1;
+			sess->rawmode = 0;
+			sess->state = SESS_GET_SEND;    // File data is sent by pumpFile/sendFileData
+			sess->ringwant = uringActive();    // ... or by io_uring
+		}
+
+		if(sess->state != SESS_CMD || outSpace(sess) < BUFSIZE + V2_HDR_SIZE)
+			return;
+
+		sprintf(response, "ME %d %d", sess->batchsent, sess->batchfailed);
+		queueFrame(sess, response, strlen(response) + 1);
+		logPrint(LOG_DEBUG, "%s finished: %d files sent, %d could not be read", sess->tree != NULL ? "rget" : "mget",
+			   sess->batchsent, sess->batchfailed);
+		logPacking(sess);
+		if(sess->tree != NULL){
+			fts_close(sess->tree);
+			sess->tree = NULL;
+		} else {
+			globfree(sess->batch);
+			free(sess->batch);
+			sess->batch = NULL;
+		}
+
+	} //END of batchNext function
+
+
+/** Batch entry - Function takes the next name of an mget (glob match) or rget (tree walk)
+*
+*	Return: 1 with st set, -1 if the name cannot be read, 0 when there are no names left.
+*			name stays valid until the next call
+*/
+	static int batchEntry(Session *sess, char **name, struct stat *st){
+		FTSENT *ent;
+
+		if(sess->batch != NULL){
+			if(sess->batchnext == sess->batch->gl_pathc)
+				return 0;
+			*name = sess->batch->gl_pathv[sess->batchnext++] + sess->batchskip;
+			return fstatat(sess->cwdfd, *name, st, 0) == 0 ? 1 : -1;
+		}
+
+		while((ent = fts_read(sess->tree)) != NULL){
+			if(ent->fts_info == FTS_DP || ent->fts_info == FTS_DC)
+				continue;     // Directory already announced, or a loop
+			*name = ent->fts_path + sess->batchskip;
+			if(ent->fts_info == FTS_DNR || ent->fts_info == FTS_ERR || ent->fts_info == FTS_NS || ent->fts_info == FTS_SLNONE)
+				return -1;
+			*st = *ent->fts_statp;
+			return 1;
+		}
+
+		return 0;
+
+	} //END of batchEntry function
+
+
+/** put batch file - Function receives one file of an mput, sent without waiting for an acknowledgement
+*
+*	Pre: loc_buf holds the file name, or nothing to ask whether mput is supported
+*	Post: "Y0" queued for the empty name. Otherwise the file is created and the session moves into
+*		  SESS_PUT_RECV. The data of a file that exists or cannot be created is read and dropped.
+*		  finishPut answers with the status of the file. A name ending in '/' is a directory of an rput,
+*		  created with no data to follow and answered straight away ("Y0" if it exists already)
+*/
+	static void putBatchFile(Session *sess, char *loc_buf){
+		char response[BUFSIZE];
+		struct stat st;
+		int made, toolong;
+
+		if(loc_buf[0] == '\0'){
+			logPrint(LOG_DEBUG, "mput command received");
+			queueFrame(sess, "Y0", 3);
+			return;
+		}
+
+		// The reply carries the name back in one frame, a name it cannot hold is refused rather than cut
+		if((toolong = strlen(loc_buf) > BATCH_NAME_MAX))
+			logPrint(LOG_ERROR, "Name from client too long: %d bytes", (int) strlen(loc_buf));
+
+		if(loc_buf[strlen(loc_buf) - 1] == '/'){
+			made = !toolong && (mkdirat(sess->cwdfd, loc_buf, S_IRWXU) == 0 ||
+				   (errno == EEXIST && fstatat(sess->cwdfd, loc_buf, &st, 0) == 0 && S_ISDIR(st.st_mode)));
+			if(!made && !toolong)
+				logPrint(LOG_ERROR, "Cannot create directory %s: %s", loc_buf, strerror(errno));
+			snprintf(response, sizeof(response), "Y%c %s", made ? '0' : '2', toolong ? "" : loc_buf);
+			queueFrame(sess, response, strlen(response) + 1);
+			return;
+		}
+
+		// The data of a refused name is still read and dropped
+		sess->filefd = toolong ? -1 : openat(sess->cwdfd, loc_buf, O_RDWR | O_CREAT | O_EXCL, S_IRWXU);
+		sess->batchput = sess->filefd >= 0 ? '0' : !toolong && errno == EEXIST ? '1' : '2';
+		if(sess->filefd < 0 && !toolong)
+			logPrint(LOG_ERROR, "Cannot create file %s: %s", loc_buf, strerror(errno));
+		else if(sess->filefd >= 0)
+			logPrint(LOG_DEBUG, "Client sending file %s...", loc_buf);
+		strcpy(sess->filename, toolong ? "" : loc_buf);
+		sess->putfailed = (sess->filefd < 0);
+		sess->rangeput = (sess->filefd < 0);    // Never remove a file this put did not create
+		sess->fileoff = 0;
+		if(sess->filefd >= 0)
+			startDigest(sess, 'p');
+		sess->state = SESS_PUT_RECV;    // File frames are handled by receiveFrame
+		sess->ringwant = uringActive();    // ... or by io_uring
+
+	} //END of putBatchFile function
+
+
+/** select codec - Function sets the compression of the file data this session sends (Z opcode)
+*
+*	Pre: loc_buf holds a codec name ("zlib", "lz" or "none")
+*	Post: "Z0" queued and the codec used from the next transfer on, frames from the client may use it too.
+*		  "Z1" for an unknown codec or a v1 session (v1 frames have no flags to mark a compressed payload)
+*/
+	static void selectCodec(Session *sess, char *loc_buf){
+		int codec = packcodec(loc_buf);
+
+		if(codec < 0 || sess->conn.version != 2){
+			logPrint(LOG_WARN, "Compression %s refused", loc_buf);
+			queueFrame(sess, "Z1", 3);
+			return;
+		}
+
+		packfree(&sess->pack);      // Buffers and zlib state of the previous codec
+		sess->pack.codec = codec;
+		queueFrame(sess, "Z0", 3);
+		logPrint(LOG_DEBUG, "File data compression set to %s", packname(codec));
+
+	} //END of selectCodec function
+
+
+/** Log packing - Prints the compression statistics of the transfer that just finished, if it used a codec
+*
+*/
+	static void logPacking(Session *sess){
+		char stats[256];
+
+		if(packstats(&sess->pack, stats, sizeof(stats)))
+			logPrint(LOG_DEBUG, "Compression %s", stats);
+
+	} //END of logPacking function
+
+
+/** sync file - Function starts a delta transfer of a file when one side has an old copy of it (S opcode)
+*
+*	Pre: loc_buf holds "g <block size> <blocks> <filename>" (the client has the old copy)
+*		 or "p <filename>" (this side has the old copy)
+*	Post: g: "S0 <file size>" queued. The client's block signatures are received (SESS_PUT_RECV), then
+*		  the delta of this copy is sent (SESS_GET_SEND). p: "S0 <block size> <blocks> <file size>" queued.
+*		  This copy's signatures are sent (SESS_GET_SEND), then the client's delta is received and the
+*		  new copy built in a temporary file. "S1" if the file cannot be opened or the temporary file
+*		  cannot be created, "S2" for a malformed request or a v1 session
+*/
+	static void syncFile(Session *sess, char *loc_buf){
+		char response[BUFSIZE], *name, mode = loc_buf[0];
+		int fd, out = -1, blocksize = 0, pos = -1;
+		long blocks = 0;
+		struct stat st;
+
+		if(mode == 'g')
+			sscanf(loc_buf + 1, "%d %ld %n", &blocksize, &blocks, &pos);
+		else if(mode == 'p')
+			sscanf(loc_buf + 1, " %n", &pos);
+		name = loc_buf + 1 + (pos < 0 ? 0 : pos);
+		if(pos < 0 || name[0] == '\0' || fdPath(sess, name, sess->synctemp, sizeof(sess->synctemp) - 12) < 0 ||
+		   sess->conn.version != 2){
+			queueFrame(sess, "S2", 3);
+			return;
+		}
+
+		logPrint(LOG_DEBUG, "Sync (%c) received for %s...", mode, name);
+		if((fd = openat(sess->cwdfd, name, O_RDONLY)) < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+			logPrint(LOG_ERROR, "Cannot open file %s", name);
+			if(fd >= 0)
+				close(fd);
+			queueFrame(sess, "S1", 3);
+			return;
+		}
+
+		sess->synctemp[0] = '\0';
+		if(mode == 'p'){
+			// The new copy is built next to the old one and only replaces it once it is intact.
+			// mkstemp() has no directory descriptor, so the name goes through the session directory's
+			blocksize = deltablocksize(st.st_size);
+			blocks = st.st_size / blocksize;
+			fdPath(sess, name, sess->synctemp, sizeof(sess->synctemp));
+			strcat(sess->synctemp, ".syncXXXXXX");
+			if((out = mkstemp(sess->synctemp)) < 0){
+				logPrint(LOG_ERROR, "Cannot create temporary file for %s: %s", name, strerror(errno));
+				close(fd);
+				queueFrame(sess, "S1", 3);
+				return;
+			}
+			fchmod(out, st.st_mode & 07777);
+		}
+
+		sess->syncmode = mode;
+		if((sess->delta = malloc(sizeof(Delta))) == NULL){
+			close(fd);
+			if(out >= 0)
+				close(out);
+			dropSync(sess);
+			queueFrame(sess, "S2", 3);
+			return;
+		}
+		if(deltainit(sess->delta, fd, out, blocksize, blocks) < 0){
+			logPrint(LOG_WARN, "Sync refused: %d byte blocks, %ld blocks", blocksize, blocks);
+			dropSync(sess);
+			queueFrame(sess, "S2", 3);
+			return;
+		}
+
+		strcpy(sess->filename, name);
+		sess->putfailed = 0;
+		if(mode == 'g'){
+			sprintf(response, "S0 %lld", (long long) st.st_size);
+			sess->state = SESS_PUT_RECV;    // Signatures are handled by receiveSync
+		} else {
+			sprintf(response, "S0 %d %ld %lld", blocksize, blocks, (long long) st.st_size);
+			sess->state = SESS_GET_SEND;    // Signatures are sent by pumpDelta
+		}
+		queueFrame(sess, response, strlen(response) + 1);
+
+	} //END of syncFile function
+
+
+/** Pump delta - queues the next frame of a sync: signatures of this copy (Sp) or its delta (Sg)
+ *
+ *	Pre: state is SESS_GET_SEND with sess->delta set
+ *	Post: One data frame is made in the output buffer, the last one flagged FF_EOF. After the last
+ *		  signatures the session waits for the client's delta, after the delta it returns to SESS_CMD
+ */
+	static void pumpDelta(Session *sess){
+		char stats[256], *data;
+		int n, hsize, room, flags = 0;
+
+		if(outSpace(sess) < BUFSIZE + V2_HDR_SIZE)
+			return;
+
+		hsize = headerSize(sess);
+		data = sess->conn.wbuf + sess->conn.wlen + hsize;
+		room = CONN_WBUF - sess->conn.wlen - hsize;
+		if(sess->syncmode == 'g'){
+			if((n = deltamake(sess->delta, data, room)) > 0)
+				n = pack(&sess->pack, data, n, &flags);    // Literal bytes may compress, signatures never do
+		} else
+			n = deltasign(sess->delta, data, room);
+
+		if(n < 0){
+			logPrint(LOG_ERROR, "File read error during sync of %s", sess->filename);
+			metricsAdd(MET_IO_ERRORS, 1);
+			queueHeader(sess, FT_DATA, FF_EOF | FF_ERROR, 0, 0);
+			if(sess->syncmode == 'g'){
+				dropSync(sess);
+				sess->state = SESS_CMD;
+			} else {
+				sess->putfailed = 1;     // The client still sends a delta, answered with V1
+				sess->state = SESS_PUT_RECV;
+			}
+			return;
+		}
+
+		flags |= (sess->delta->done ? FF_EOF : 0) | (sess->checksum ? FF_CHECKSUM : 0);
+		queueHeader(sess, FT_DATA, flags, n, sess->checksum ? crc32buf(0, data, n) : 0);
+		sess->conn.wlen += n;
+		if(!sess->delta->done)
+			return;
+
+		if(sess->syncmode == 'g'){
+			deltastats(sess->delta, stats, sizeof(stats));
+			logPrint(LOG_DEBUG, "Delta of %s sent to client: %s", sess->filename, stats);
+			dropSync(sess);
+			sess->state = SESS_CMD;
+			logPacking(sess);
+		} else {
+			logPrint(LOG_DEBUG, "Signatures of %s sent to client, receiving its delta...", sess->filename);
+			sess->state = SESS_PUT_RECV;    // The delta is handled by receiveSync
+		}
+
+	} //END of pumpDelta function
+
+
+/** Receive sync - collects a frame of signatures (Sg) or delta (Sp) from the client and applies it
+ *
+ *	Pre: state is SESS_PUT_RECV with sess->delta set, len <= recvleft
+ *	Post: A whole frame is checked, decompressed and handed to the delta. The frame flagged FF_EOF
+ *		  ends the client's half of the sync
+ */
+	static void receiveSync(Session *sess, char *data, int len){
+		char *out;
+		int n;
+
+		if(data != NULL && (sess->recvflags & FF_CHECKSUM))
+			sess->recvcrc = crc32buf(sess->recvcrc, data, len);
+		if(data != NULL && sess->packbuf != NULL)
+			memcpy(sess->packbuf + sess->recvframe - sess->recvleft, data, len);
+
+		sess->recvleft -= len;
+		if(sess->recvleft > 0)
+			return;     // Frame not finished
+
+		if((sess->recvflags & FF_CHECKSUM) && sess->recvcrc != sess->recvexpect){
+			logPrint(LOG_ERROR, "Sync frame from client failed its checksum");
+			metricsAdd(MET_PROTOCOL_ERRORS, 1);
+			sess->putfailed = 1;
+		}
+
+		if((sess->recvflags & FF_ERROR) || sess->packbuf == NULL ||
+		   (n = unpack(&sess->pack, sess->recvflags, sess->packbuf, sess->recvframe, &out)) < 0)
+			sess->putfailed = 1;
+		else if(!sess->putfailed && (sess->syncmode == 'g' ? deltaindex(sess->delta, out, n) : deltapatch(sess->delta, out, n)) < 0){
+			logPrint(LOG_WARN, "%s from client could not be applied", sess->syncmode == 'g' ? "Signatures" : "Delta");
+			sess->putfailed = 1;
+		}
+
+		if(sess->recvflags & FF_EOF)
+			finishSync(sess);
+
+	} //END of receiveSync function
+
+
+/** Finish sync - ends the half of a sync that the client sends
+ *
+ *	Pre: The frame flagged FF_EOF has been received
+ *	Post: Sg: the delta is sent next (SESS_GET_SEND), or an FF_ERROR frame if the signatures were not intact.
+ *		  Sp: the new copy replaces the old one if it was rebuilt intact, the client is told with V0 or V1
+ */
+	static void finishSync(Session *sess){
+		char stats[256];
+		int intact;
+
+		if(sess->syncmode == 'g'){
+			if(sess->putfailed){
+				logPrint(LOG_WARN, "Signatures of %s were not received intact", sess->filename);
+				queueHeader(sess, FT_DATA, FF_EOF | FF_ERROR, 0, 0);
+				dropSync(sess);
+				sess->state = SESS_CMD;
+			} else {
+				logPrint(LOG_DEBUG, "%ld block signatures received, sending delta of %s...", sess->delta->blocks, sess->filename);
+				sess->state = SESS_GET_SEND;    // The delta is sent by pumpDelta
+			}
+			return;
+		}
+
+		intact = !sess->putfailed && sess->delta->patched;
+		if(intact && renameat(sess->cwdfd, sess->synctemp, sess->cwdfd, sess->filename) < 0){
+			logPrint(LOG_ERROR, "Cannot replace %s: %s", sess->filename, strerror(errno));
+			intact = 0;
+		}
+		if(intact)
+			sess->synctemp[0] = '\0';     // Renamed, nothing to remove
+
+		deltastats(sess->delta, stats, sizeof(stats));
+		dropSync(sess);
+		sess->state = SESS_CMD;
+		queueFrame(sess, intact ? "V0" : "V1", 3);
+		if(intact)
+			logPrint(LOG_DEBUG, "File %s synchronised from client: %s", sess->filename, stats);
+		else
+			logPrint(LOG_WARN, "Sync of %s from client failed, old copy kept", sess->filename);
+		logPacking(sess);
+
+	} //END of finishSync function
+
+
+/** Drop sync - closes the files of a sync and releases its state. A new copy that did not replace
+ *				the old one is removed
+ */
+	static void dropSync(Session *sess){
+
+		if(sess->delta != NULL){
+			deltafree(sess->delta);
+			free(sess->delta);
+		}
+		sess->delta = NULL;
+		if(sess->syncmode == 'p' && sess->synctemp[0] != '\0')
+			unlinkat(sess->cwdfd, sess->synctemp, 0);
+		sess->synctemp[0] = '\0';
+		sess->syncmode = 0;
+
+	} //END of dropSync function
+
+
+/** Descriptor path - name as a path that needs no directory descriptor, for calls that do not take one
+ *
+ *	Post: out holds name under /proc/self/fd/<cwdfd>/ if it is relative, else name itself
+ *	Return: Length of the prefix added (0 for an absolute name), -1 if the path does not fit in size bytes
+ */
+	static int fdPath(Session *sess, char *name, char *out, int size){
+		int skip = 0;
+
+		if(name[0] != '/')
+			skip = snprintf(out, size, "/proc/self/fd/%d/", sess->cwdfd);
+		if(skip >= size || (int) strlen(name) >= size - skip)
+			return -1;
+		strcpy(out + skip, name);
+		return skip;
+
+	} //END of fdPath function
+
+
+/** Receive frame - writes payload bytes of the current put frame
+ *
+ *	Pre: state is SESS_PUT_RECV, len <= recvleft
+ *	Post: Data written to the file (a compressed frame is collected and written once it is whole).
+ *		  When the frame is complete, a short (or empty) frame ends the transfer
+ */
+	static void receiveFrame(Session *sess, char *data, int len){
+		char *out;
+		int n;
+
+		if(sess->delta != NULL){
+			receiveSync(sess, data, len);
+			return;
+		}
+
+		if(data != NULL && (sess->recvflags & FF_CHECKSUM))
+			sess->recvcrc = crc32buf(sess->recvcrc, data, len);
+
+		if(sess->recvflags & FF_PACKED){
+			if(sess->packbuf != NULL && len > 0 && data != NULL)
+				memcpy(sess->packbuf + sess->recvframe - sess->recvleft, data, len);
+		} else if(sess->filefd >= 0 && len > 0 && data != NULL)
+			writeFile(sess, data, len);
+
+		sess->recvleft -= len;
+		if(sess->recvleft > 0)
+			return;     // Frame not finished
+
+		// Frames sent as they are count in the compression statistics too
+		n = unpack(&sess->pack, sess->packbuf != NULL ? sess->recvflags : 0, sess->packbuf, sess->recvframe, &out);
+		if(sess->recvflags & FF_PACKED){
+			if(n < 0 || sess->packbuf == NULL){
+				logPrint(LOG_WARN, "Compressed file frame from client could not be decoded");
+				metricsAdd(MET_PROTOCOL_ERRORS, 1);
+				sess->putfailed = 1;
+			} else if(sess->filefd >= 0)
+				writeFile(sess, out, n);
+		}
+
+		if(sess->conn.version == 2){
+			if((sess->recvflags & FF_CHECKSUM) && sess->recvcrc != sess->recvexpect){
+				logPrint(LOG_ERROR, "File frame from client failed its checksum");
+				metricsAdd(MET_PROTOCOL_ERRORS, 1);
+				sess->putfailed = 1;
+			}
+			if(sess->recvflags & FF_ERROR)
+				sess->putfailed = 1;
+			if(sess->recvflags & FF_EOF)
+				finishPut(sess);
+		} else if(sess->recvframe < BUFSIZE-2)
+			finishPut(sess);
+
+	} //END of receiveFrame function
+
+
+/** Write file - writes received file data to the file being put, all of it or nothing more
+ *
+ *	Pre: filefd is open
+ *	Post: A failed write (ENOSPC, EIO...) marks the put failed, so it is answered V1 and removed.
+ *		  The rest of the file is then read and dropped. Bytes written are hashed for the index,
+ *		  or summed for the K of a range put
+ */
+	static void writeFile(Session *sess, char *data, int len){
+		int nw;
+
+		while(len > 0 && !sess->putfailed){
+			if((nw = write(sess->filefd, data, len)) < 0 && errno == EINTR)
+				continue;
+			if(nw <= 0){
+				logPrint(LOG_ERROR, "Write to file %s failed: %s", sess->filename, nw < 0 ? strerror(errno) : "nothing written");
+				metricsAdd(MET_IO_ERRORS, 1);
+				sess->putfailed = 1;
+				return;
+			}
+			if(sess->digesting == 'p')
+				digestupdate(sess->digest, data, nw);
+			else if(sess->digesting == 'w')
+				sess->rangecrc = crc32(sess->rangecrc, (Bytef *) data, nw);
+			sess->digestoff += nw;
+			data += nw;
+			len -= nw;
+		}
+
+	} //END of writeFile function
+
+
+/** Finish put - closes the received file and returns the session to command state.
+ *				 v2 clients are told whether the file arrived intact (V0) or not (V1)
+ *
+ *	Pre: state is SESS_PUT_RECV and the last frame of the file has been received
+ *	Post: File closed. A damaged or aborted v2 put is removed (unless it only wrote a range), an intact
+ *		  put or mput file is indexed with the digest of its data. An mput file is answered with its status
+ */
+	static void finishPut(Session *sess){
+		char response[BUFSIZE + 4];     // An mput name is at most BATCH_NAME_MAX bytes, so a reply fits one frame
+		unsigned char digest[DIGEST_SIZE];
+		int skipped = sess->filefd < 0;
+		struct stat st;
+
+		// Every byte of the file went through the digest on its way in, so it is indexed without reading it
+		if(sess->digesting == 'p' && !sess->putfailed && !skipped){
+			digestfinal(sess->digest, digest);
+			if(fstat(sess->filefd, &st) == 0 && st.st_size == sess->digestoff)
+				digeststore(sess->filefd, &st, digest);
+		}
+		// ... and every byte of a range through its CRC-32, which answers the K that follows
+		if(sess->digesting == 'w' && !sess->putfailed && !skipped && fstat(sess->filefd, &st) == 0){
+			sess->rangeknown = 1;
+			sess->rangedev = st.st_dev;
+			sess->rangeino = st.st_ino;
+			sess->rangeoff = sess->fileoff;
+			sess->rangelen = sess->digestoff;
+		}
+		sess->digesting = 0;
+
+		if(sess->filefd >= 0)
+			close(sess->filefd);      // Close file
+		sess->filefd = -1;
+		sess->state = SESS_CMD;
+
+		if(sess->batchput){
+			// mput - every file gets its status: Y0 received, Y1 exists, Y2 cannot be created, Y3 not intact
+			if(sess->putfailed && !sess->rangeput)
+				unlinkat(sess->cwdfd, sess->filename, 0);
+			snprintf(response, sizeof(response), "Y%c %s", sess->putfailed && sess->batchput == '0' ? '3' : sess->batchput,
+					 sess->filename);
+			queueFrame(sess, response, strlen(response) + 1);
+			sess->batchput = 0;
+		} else if(sess->conn.version == 2){
+			if(sess->putfailed && !sess->rangeput)
+				unlinkat(sess->cwdfd, sess->filename, 0);     // A failed range is sent again, the file stays
+			queueFrame(sess, sess->putfailed ? "V1" : "V0", 3);
+		}
+
+		if(skipped)
+			logPrint(LOG_WARN, "File data from client discarded");
+		else if(sess->putfailed)
+			logPrint(LOG_WARN, "File from client was not received intact");
+		else
+			logPrint(LOG_DEBUG, "File successfully received from client");
+		logPacking(sess);
+
+	} //END of finishPut function
+
+
+/** Negotiate - Handles the N opcode. The client offers a framing version, a frame size and
+ *				options ("c" = checksum every frame, "t" = tagged responses). The reply, still in v1 framing, states
+ *				what was agreed. Every later frame in both directions uses that framing
+ *
+ *	Pre: Session still on v1 framing, loc_buf holds "<version> <max frame> <options>"
+ *	Post: Reply queued. Session switched to v2 if the client asked for it
+ */
+	static void negotiate(Session *sess, char *loc_buf){
+		int version = 1, maxframe = 0;
+		char opts[16], response[BUFSIZE];
+
+		opts[0] = '\0';
+		sscanf(loc_buf, "%d %d %15s", &version, &maxframe, opts);
+		logPrint(LOG_DEBUG, "Framing negotiation received: %s", loc_buf);
+
+		if(version < 2){
+			queueFrame(sess, "N1", 3);
+			return;
+		}
+
+		if(maxframe < V2_MIN_FRAME)
+			maxframe = V2_MIN_FRAME;
+		if(maxframe > V2_MAX_FRAME)
+			maxframe = V2_MAX_FRAME;
+
+		// Tags are always repeated in responses, so "t" is agreed whether or not it was asked for
+		sprintf(response, "N2 %d %st", maxframe, strchr(opts, 'c') ? "c" : "");
+		queueFrame(sess, response, strlen(response) + 1);
+
+		// Reply above goes out in v1 framing, everything after it in v2
+		sess->conn.version = 2;
+		sess->maxframe = maxframe;
+		sess->checksum = strchr(opts, 'c') != NULL;
+		logPrint(LOG_INFO, "Session switched to v2 framing, frames up to %d bytes%s", maxframe, sess->checksum ? " with checksums" : "");
+
+	} //END of negotiate function
+
+
+/** Splice frame - moves payload of the current put frame from the socket to the file through a pipe
+ *
+ *	Pre: state is SESS_PUT_RECV, recvleft > 0, read-ahead buffer empty
+ *	Post: Bytes available on the socket (up to recvleft) are in the file. On a file system
+ *		  without splice support the session switches to read()/write() for good
+ *	Return: 0 to keep the session, -1 when the client has gone
+ */
+	static int spliceFrame(Session *sess){
+		ssize_t n, m;
+		int done;
+
+		if(sess->pipefd[0] < 0 && pipe(sess->pipefd) < 0){
+			logPrint(LOG_ERROR, "Pipe for splice failed: %s", strerror(errno));
+			sess->nosplice = 1;
+			return 0;
+		}
+
+		// Pipe is always empty here, so never ask for more than it can hold
+		n = splice(sess->sock, NULL, sess->pipefd[1], NULL,
+				   sess->recvleft < PIPE_CAPACITY ? sess->recvleft : PIPE_CAPACITY, SPLICE_F_MOVE);
+
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return 0;
+		if(n < 0 && errno == EINVAL){
+			sess->nosplice = 1;     // Socket cannot be spliced, read it instead
+			return 0;
+		}
+		if(n <= 0){
+			logPrint(LOG_INFO, "No data read from client. Connection from client stopped.");
+			return -1;
+		}
+		countBytes(sess, MET_BYTES_IN, n);
+		shaperCharge(&sess->shape, n);
+
+		// Move the bytes on to the file, or read them out of the pipe if there is no file
+		for(done = 0; done < n; done += m){
+			if(sess->filefd >= 0 && !sess->nosplice){
+				m = splice(sess->pipefd[0], NULL, sess->filefd, NULL, n - done, SPLICE_F_MOVE);
+				if(m > 0 && (sess->digesting == 'p' || sess->digesting == 'w'))
+					hashWritten(sess, m);
+				if(m > 0)
+					continue;
+				if(m < 0 && errno == EINTR){
+					m = 0;
+					continue;
+				}
+				logPrint(LOG_WARN, "splice to file failed (%s), using read/write", m < 0 ? strerror(errno) : "nothing moved");
+				sess->nosplice = 1;
+			}
+			if((m = drainPipe(sess, n - done)) < 0 && errno == EINTR)
+				m = 0;
+			else if(m <= 0){
+				logPrint(LOG_ERROR, "Read from splice pipe failed: %s", m < 0 ? strerror(errno) : "pipe empty");
+				metricsAdd(MET_IO_ERRORS, 1);
+				return -1;
+			}
+		}
+
+		receiveFrame(sess, NULL, n);
+
+		// Frames after this one may be waiting in the read-ahead buffer only if splice was given up
+		processFrames(sess);
+
+		return sess->state == SESS_CLOSED ? -1 : 0;
+
+	} //END of spliceFrame function
+
+
+/** Drain pipe - copies bytes left in the splice pipe to the file with read()/write()
+ *
+ *	Pre: pipe holds at least nbytes
+ *	Post: A failed file write marks the put failed (writeFile), the bytes are still taken from the pipe
+ *	Return: bytes taken from the pipe, -1 if it could not be read
+ */
+	static int drainPipe(Session *sess, int nbytes){
+		char buf[BUFSIZE];
+		int n;
+
+		if((n = read(sess->pipefd[0], buf, nbytes < BUFSIZE ? nbytes : BUFSIZE)) > 0 && sess->filefd >= 0)
+			writeFile(sess, buf, n);
+
+		return n;
+
+	} //END of drainPipe function
+
+/** Start ring - hands the file transfer of the session to the io_uring backend
+ *
+ *	Pre: ringwant set, no output queued
+ *	Post: State SESS_RING with the transfer running, or the normal sendfile/splice path
+ *		  continues when every io_uring slot is busy
+ */
+	static void startRing(Session *sess){
+		int version = sess->rawmode ? XFER_RAW : sess->conn.version;
+
+		sess->ringwant = 0;
+
+		// Compressed frames are built and decoded in user space, and rate limited
+		// transfers move in turns of the scheduler
+		if(sess->pack.codec != CODEC_NONE || shaperLimited(&sess->shape))
+			return;
+
+		if(sess->state == SESS_GET_SEND)
+			sess->xfer = uringStartSend(&sess->conn, sess->filefd, sess->fileoff, sess->fileleft, version,
+										version == 2 ? sess->maxframe : MAX_BLOCK_SIZE, sess->checksum, sess);
+		else if(sess->state == SESS_PUT_RECV)
+			sess->xfer = uringStartRecv(&sess->conn, sess->filefd, sess->fileoff, sess->conn.version,
+										sess->conn.version == 2 ? sess->maxframe : MAX_BLOCK_SIZE, 0, sess);
+		if(sess->xfer == NULL)
+			return;
+
+		// io_uring writes the file without the data passing through here, its digest waits for the first I
+		if(sess->state == SESS_PUT_RECV)
+			sess->digesting = 0;
+		sess->state = SESS_RING;
+		if(sess->xfer->done)
+			sessionOnRing(sess);    // Nothing had to wait for the kernel (e.g. empty raw file)
+
+	} //END of startRing function
+
+
+/** Ring transfer finished - closes the file and returns the session to command state
+ *
+ *	Pre: state is SESS_RING and sess->xfer is done
+ *	Post: get: file closed. put: finished as by finishPut (v2 clients get V0/V1).
+ *		  Commands the client sent after the file are processed
+ *	Return: 0 to keep the session, -1 when the client has gone
+ */
+	int sessionOnRing(Session *sess){
+		int sending = sess->xfer->sending, result;
+
+		result = uringFinish(sess->xfer);
+		countBytes(sess, sending ? MET_BYTES_OUT : MET_BYTES_IN, sess->xfer->bytes);
+		sess->xfer = NULL;
+
+		if(sending){
+			close(sess->filefd);
+			sess->filefd = -1;
+			sess->state = SESS_CMD;
+			if(result == 0)
+				logPrint(LOG_DEBUG, "File successfully sent to client");
+		} else {
+			sess->state = SESS_PUT_RECV;
+			if(result == -2)
+				sess->putfailed = 1;
+			if(result == 0 || result == -2)
+				finishPut(sess);
+		}
+
+		if(result == -1){
+			logPrint(LOG_ERROR, "Connection to client failed during transfer");
+			metricsAdd(MET_IO_ERRORS, 1);
+			sess->state = SESS_CLOSED;
+			return -1;
+		}
+
+		processFrames(sess);
+		requestIdle(sess);
+		if(sess->state != SESS_GET_SEND && sess->state != SESS_PUT_RECV)
+			shaperIdle(&sess->shape);     // Transfer over, its weight no longer takes a share
+
+		return sess->state == SESS_CLOSED ? -1 : 0;
+
+	} //END of sessionOnRing function
+
+
+/** Request done - logs the request being timed, if there is one
+ *
+ *	Post: One INFO record with the session, opcode, bytes moved on the socket since the request
+ *		  arrived and the time it took. No request is timed afterwards
+ */
+	static void requestDone(Session *sess){
+		long long usec;
+
+		if(sess->opcode == 0)
+			return;
+
+		usec = nowUsec() - sess->opstart;
+		logRequest(sess->id, sess->opcode, sess->iobytes - sess->opbytes, usec);
+		metricsRequest(sess->opcode, usec);
+		sess->opcode = 0;
+
+	} //END of requestDone function
+
+
+/** Count bytes - adds bytes moved on the socket to the session and to the metrics
+ *
+ */
+	static void countBytes(Session *sess, int counter, long long n){
+
+		sess->iobytes += n;
+		metricsAdd(counter, n);
+
+	} //END of countBytes function
+
+
+/** Request idle - ends the request being timed once it has been fully answered
+ *
+ *	Post: Logged when the session waits for a command with nothing left to send (mget, rget, sync
+ *		  and listings keep their request open until their last frame has left)
+ */
+	static void requestIdle(Session *sess){
+
+		if(sess->opcode != 0 && sess->state == SESS_CMD && sess->batch == NULL && sess->tree == NULL &&
+		   sess->delta == NULL && sess->listfd < 0 && !sess->listcached && sess->conn.wlen == sess->conn.woff)
+			requestDone(sess);
+
+	} //END of requestIdle function
+
+
+/** Now - monotonic time in microseconds, for request latency
+ *
+ */
+	static long long nowUsec(void){
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+
+	} //END of nowUsec function
+
+//END of session.c
@@ -0,0 +1,183 @@
+/* File: session.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the per-client session state machine
+ * Changes: 16/10/2026 - Added session.c/session.h so one process can serve many clients
+ *		   16/10/2026 - Added sendfile() state for get (fileleft, frameleft, rawmode)
+ *		   16/10/2026 - Added splice() state for put (pipefd, recvleft, recvframe, nosplice)
+ *		   16/10/2026 - Added negotiated v2 framing state (version, maxframe, checksum)
+ *		   16/10/2026 - inbuf/outbuf replaced by the buffered stream layer (conn)
+ *		   16/10/2026 - Added io_uring transfer state (SESS_RING, xfer, ringwant)
+ *		   16/10/2026 - Added ranged transfer state (fileoff, rangeput)
+ *		   16/10/2026 - Added mget/mput state (batch, batchnext, batchsent, batchfailed, batchput)
+ *		   16/10/2026 - Added compression state (pack, packbuf)
+ *		   16/10/2026 - Added delta transfer state (delta, syncmode, synctemp)
+ *		   16/10/2026 - Added directory listing state (listfd, listleft, listbuf, listpos, listlen, listnext)
+ *		   16/10/2026 - Added listing cache state (listpage, listpagelen, listpagepos, listcached, listbuilt, listcursor, listentries)
+ *		   16/10/2026 - Added rget tree walk state (tree, treelimit)
+ *		   16/10/2026 - Added request log state (id, opcode, opstart, opbytes, iobytes)
+ *		   16/10/2026 - Added hot-file cache state (hotbuf, hotpos, hotlen)
+ *		   16/10/2026 - cwdfd is the only working directory of a session, added batchskip
+ *		   16/10/2026 - Added bandwidth scheduler state (shape, heldnext)
+ *		   16/10/2026 - Sessions get the socket transport profile (transport.h)
+ *		   16/10/2026 - Added sessionSetup, sessions open their directory relative to the initial one
+ *		   16/10/2026 - Added BATCH_NAME_MAX
+ *		   16/10/2026 - Added digest state (digest, digesting, digestoff, hashstat, hashstart)
+ *		   16/10/2026 - Added range checksum state (rangecrc, rangeknown, rangedev, rangeino, rangeoff, rangelen)
+ */
+
+#include <glob.h>
+#include <sys/types.h>
+#include <fts.h>
+#include "stream.h"
+#include "uring.h"
+#include "compress.h"
+#include "delta.h"
+#include "dircache.h"
+#include "filecache.h"
+#include "shaper.h"
+#include "transport.h"
+#include "logger.h"
+#include "digest.h"
+
+#define BUFSIZE (1024*5)			// Size of command/file buffers (one v1 frame)
+#define SESS_WRITE_BUDGET (1024*1024)		// Bytes written per writable event before yielding
+#define RAW_MAX_SEND (1024*1024*1024)		// Largest single sendfile() run in raw stream mode
+#define PIPE_CAPACITY (1024*64)				// Default pipe size, most bytes spliced in one go
+#define BATCH_NAME_MAX (BUFSIZE - 4)		// Longest mput name, its "Yc <name>" reply has to fit in one frame
+#define LIST_BUFSIZE (1024*32)				// Directory entries read by one getdents64()
+#define LIST_MAX_PAGE (1024*64)				// Most entries a client may ask for in one L page
+#define LIST_RECORD 19						// Bytes of a listing record before its name
+
+// Session states - what the next frame from the client means
+#define SESS_CMD 0		// Waiting for an opcode (P, D, L, C, G, H, U, R, W, K, I, M, T, Y, Z, S, X, O)
+#define SESS_GET_SEND 1	// Streaming a file to the client (after H0)
+#define SESS_PUT_RECV 2	// Receiving file frames from the client (after U0)
+#define SESS_CLOSED 3		// Connection finished, session can be destroyed
+#define SESS_RING 4		// File data moved by the io_uring backend, socket not watched by epoll
+
+typedef struct session {
+	int sock;						// Connected client socket
+	Conn conn;						// Read-ahead/queued output and framing version (1 or 2)
+	int maxframe;					// Largest data frame negotiated for v2
+	int checksum;					// v2 client asked for CRC-32 on every frame
+	unsigned int epevents;			// Events registered with epoll (event mode only)
+	int state;						// One of the SESS_* states
+	int cwdfd;						// Session working directory, every path is opened relative to it (O_PATH)
+	int filefd;						// File being sent/received (-1 if none)
+	int lastframe;					// Size of the last file frame sent (-1 if none yet)
+	long long fileleft;				// Bytes of the file not yet sent
+	int frameleft;					// Payload bytes of the current frame not yet sent
+	int rawmode;					// Client asked for an unframed (raw stream) get
+	int recvleft;					// Payload bytes of the current put frame not yet received
+	int recvframe;					// Payload size of the current put frame
+	int recvflags;					// v2 flags of the current put frame
+	unsigned int recvexpect;		// v2 CRC-32 sent with the current put frame
+	unsigned int recvcrc;			// CRC-32 of the current put frame so far
+	int putfailed;					// v2 put data damaged or aborted by the client
+	int rangeput;					// put only writes a range (W), keep the file if it fails
+	long long fileoff;				// File offset the transfer started at (R/W ranges, else 0)
+	glob_t *batch;					// Files of an mget still being sent (NULL if none)
+	size_t batchnext;				// Next name in batch
+	int batchskip;					// Length of the /proc/self/fd prefix on batch and tree names
+	FTS *tree;						// Directory tree of an rget still being walked, sent like an mget (NULL if none)
+	long long treelimit;			// rget files this size or larger are only announced
+	int batchsent, batchfailed;		// mget files sent / that could not be read
+	char batchput;					// mput file status for its reply ('0' - '2'), 0 for other puts
+	Packer pack;					// Codec agreed with Z, compression statistics of the transfer
+	char *packbuf;					// Compressed put frame being collected (allocated on first use)
+	Delta *delta;					// Sync in progress (S), NULL if none. Its frames pass through packbuf
+	char syncmode;					// 'g': signatures in, delta out. 'p': signatures out, delta in
+	char synctemp[BUFSIZE];			// 'p': new copy being written, renamed over filename once intact
+	int listfd;						// Directory being listed (L), -1 if none
+	int listleft;					// Entries of the page still to send
+	char *listbuf;					// Entries read by getdents64() (allocated on first use)
+	int listpos, listlen;			// Next entry in listbuf, bytes of entries in listbuf
+	long long listnext;				// Cursor after the last entry read, where the next page starts
+	char *listpage;					// Serialized page: copy of a cached one, or the one being sent (allocated on first use)
+	int listpagelen;				// Bytes in listpage, -1 once the page being sent no longer fits
+	int listpagepos;				// Bytes of a cached page already sent
+	int listcached;					// Page is sent from listpage instead of the directory
+	unsigned long long listbuilt;	// dircacheBegin() clock of the page being read, 0 if it is not cached
+	long long listcursor;			// Cursor and entries of the page, its cache key
+	int listentries;
+	int pipefd[2];					// Pipe for splicing put data socket -> file (-1 until first use)
+	int nosplice;					// File or socket does not support splice, use read/write
+	int ringwant;					// Hand the transfer to io_uring once queued output is sent
+	Xfer *xfer;						// io_uring transfer in progress (SESS_RING)
+	char *hotbuf;					// Rest of a cached file the socket did not take at once (allocated on first use)
+	Digest *digest;					// Digest being built (allocated on first use)
+	char digesting;					// 'p': of the put data as it is written, 'i': of filefd a chunk per turn (I),
+									// 'w': CRC-32 of a range put as it is written, 'k': CRC-32 of a range a chunk per turn (K), 0 if none
+	long long digestoff;			// Bytes hashed so far
+	unsigned int rangecrc;			// 'w', 'k': CRC-32 of the bytes hashed so far
+	long long rangeoff, rangelen;	// 'k': range being checked. Else the range the last W wrote, if rangeknown
+	int rangeknown;					// rangecrc holds the range the last W wrote, answers a K for it that follows
+	dev_t rangedev;					// File the last W wrote
+	ino_t rangeino;
+	struct stat hashstat;			// 'i': the file when hashing started, answered and indexed with the digest
+	struct timespec hashstart;		// 'i': when hashing started (CLOCK_REALTIME), for digeststable
+	int hotpos, hotlen;				// Bytes of hotbuf already queued, bytes in hotbuf (0 if none)
+	char filename[BUFSIZE];			// File named in the last G opcode
+	unsigned int id;				// Session number in the log of this process
+	char opcode;					// Request being timed for the log, 0 if none
+	long long opstart;				// Monotonic time the request arrived (microseconds)
+	long long opbytes;				// iobytes when the request arrived
+	long long iobytes;				// Bytes read from and written to the socket so far
+	Shaper shape;					// Weight and rate of the client's transfers, time they are held back until
+	struct session *heldnext;		// Next session held back by the scheduler (event mode only)
+} Session;
+
+/* Open the initial directory that every session starts in
+ *
+ *	Pre: Called once by the daemon before anything is forked, process working directory is the initial directory
+ *	Return: 0, or -1 if the directory cannot be opened
+ */
+int sessionSetup(void);
+
+/* Create a session for a newly accepted client
+ *
+ *	Pre: sock is a connected socket, sessionSetup has been called
+ *	Post: Session allocated in state SESS_CMD with its own working directory (the process one is never changed)
+ *	Return: Session pointer or NULL on allocation failure
+ */
+Session *sessionCreate(int sock);
+
+/* Destroy a session - closes the socket and any open files and frees it
+ */
+void sessionDestroy(Session *sess);
+
+/* Read available bytes from the client and act on every complete frame
+ *
+ *	Pre: Socket is readable (or blocking), sessionWantsRead(sess) is true
+ *	Post: Complete frames are processed, partial frames are kept for the next call
+ *	Return: 0 to continue, -1 if the session should be closed
+ */
+int sessionOnReadable(Session *sess);
+
+/* Write queued output to the client and refill it from an outgoing file
+ *
+ *	Pre: Socket is writable (or blocking), sessionWantsWrite(sess) is true
+ *	Post: As many queued bytes as the socket accepts are written
+ *	Return: 0 to continue, -1 if the session should be closed
+ */
+int sessionOnWritable(Session *sess);
+
+/* Finish a transfer run by the io_uring backend
+ *
+ *	Pre: state is SESS_RING and sess->xfer is done
+ *	Post: File closed, the session is back in SESS_CMD and any commands read ahead are processed
+ *	Return: 0 to continue, -1 if the session should be closed
+ */
+int sessionOnRing(Session *sess);
+
+/* Whether the session is waiting on input from the client */
+int sessionWantsRead(Session *sess);
+
+/* Whether the session has output queued for the client */
+int sessionWantsWrite(Session *sess);
+
+/* Time (shaperClock) the scheduler holds the session's transfer back until, 0 once it may go on.
+ * A held session wants neither input nor output
+ */
+long long sessionHeld(Session *sess);
@@ -0,0 +1,351 @@
+/* File: shaper.c
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Bandwidth scheduler of file transfers. A session moves file data in turns of a quantum scaled by
+ *			the weight of its client's address, so busy sessions of one worker share its time by weight.
+ *			Each session may also have a token bucket of its own, and all of them share an optional global
+ *			bucket in memory shared by the daemon's workers and their children. Buckets are kept as the time
+ *			they are empty until (GCRA), so taking from the global one is a single compare and swap. While the
+ *			global bucket is low, each transfer also passes a bucket of its own at its weighted share of the
+ *			global rate, otherwise whichever transfer woke first would drain it.
+ *			Command responses are never held back
+ * Changes:
+ * 16/10/2026 - Added shaper.c/shaper.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "shaper.h"
+#include "logger.h"
+
+#define NSEC 1000000000LL
+#define UNITS 1024						// Weight 1 in the sum of active weights
+
+typedef struct address {
+	in_addr_t net, mask;				// Network byte order
+	int bits;							// Prefix length, the longest matching prefix wins
+	double weight;
+} Address;
+
+typedef struct shaperShared {
+	Bucket global;						// Rate of all transfers together
+	long long weights;					// Weights of the transfers running, in UNITS
+	unsigned long long holds;			// Times a session was held back
+} ShaperShared;
+
+static ShaperShared *shared;			// NULL if the scheduler could not be set up
+static long long sessionRate;			// Rate of a session at weight 1, 0 for no limit
+static Address addresses[SHAPER_ADDRESSES];
+static int naddresses;
+
+static int readWeights(char *file);
+static void bucketInit(Bucket *b, long long rate);
+static void bucketRate(Bucket *b, long long rate);
+static long long allowance(Bucket *b, long long tat, long long now);
+static long long refill(Bucket *b, long long tat, long long now);
+
+
+/** Setup - see shaper.h
+ *
+ */
+	int shaperSetup(long long rate, long long globalRate, char *weights){
+		void *p;
+
+		if(weights != NULL && readWeights(weights) < 0)
+			return -1;
+		sessionRate = rate;
+
+		// Shared anonymous memory is inherited by every fork()
+		p = mmap(NULL, sizeof(ShaperShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if(p == MAP_FAILED){
+			fprintf(stderr, "Scheduler setup failed: %s\n", strerror(errno));
+			return -1;
+		}
+
+		shared = p;
+		bucketInit(&shared->global, globalRate);
+		return 0;
+
+	} //END of shaperSetup function
+
+
+/** Init - see shaper.h
+ *
+ */
+	void shaperInit(Shaper *s, int sock){
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+		int i, best = -1;
+
+		// The longest prefix that matches the client's address gives its weight
+		s->weight = 1;
+		if(getpeername(sock, (struct sockaddr *) &addr, &len) == 0 && addr.sin_family == AF_INET)
+			for(i = 0; i < naddresses; i++)
+				if((addr.sin_addr.s_addr & addresses[i].mask) == addresses[i].net && addresses[i].bits > best){
+					best = addresses[i].bits;
+					s->weight = addresses[i].weight;
+				}
+
+		if(best >= 0)
+			logPrint(LOG_DEBUG, "Client %s has weight %g", inet_ntoa(addr.sin_addr), s->weight);
+
+		s->quantum = SHAPER_QUANTUM * s->weight;
+		if(s->quantum < SHAPER_CHUNK)
+			s->quantum = SHAPER_CHUNK;
+		bucketInit(&s->own, sessionRate * s->weight);
+		bucketInit(&s->share, 0);
+		s->active = 0;
+		s->wake = 0;
+
+	} //END of shaperInit function
+
+
+/** Limited - see shaper.h
+ *
+ */
+	int shaperLimited(Shaper *s){
+
+		return s->own.rate > 0 || (shared != NULL && shared->global.rate > 0);
+
+	} //END of shaperLimited function
+
+
+/** Turn - see shaper.h
+ *
+ */
+	int shaperTurn(Shaper *s){
+		long long now, n, own, global = LLONG_MAX, share = LLONG_MAX, tat = 0, weights;
+
+		if(!shaperLimited(s))
+			return s->quantum;
+
+		now = shaperClock();
+		own = allowance(&s->own, s->own.tat, now);
+		if(shared != NULL && shared->global.rate > 0){
+			if(!s->active){
+				s->active = s->weight * UNITS > 1 ? s->weight * UNITS : 1;
+				__atomic_add_fetch(&shared->weights, s->active, __ATOMIC_RELAXED);
+			}
+			tat = __atomic_load_n(&shared->global.tat, __ATOMIC_RELAXED);
+			global = allowance(&shared->global, tat, now);
+
+			// Less than half the burst left means other transfers want it too
+			if(global < allowance(&shared->global, 0, now) / 2){
+				weights = __atomic_load_n(&shared->weights, __ATOMIC_RELAXED);
+				bucketRate(&s->share, shared->global.rate * s->active / (weights > s->active ? weights : s->active));
+				share = allowance(&s->share, s->share.tat, now);
+			} else
+				bucketRate(&s->share, 0);
+		}
+
+		n = own < global ? own : global;
+		n = n < share ? n : share;
+		if(n >= SHAPER_CHUNK)
+			return n < s->quantum ? n : s->quantum;
+
+		// Held until every bucket that is short has a chunk again
+		s->wake = 0;
+		if(own < SHAPER_CHUNK)
+			s->wake = refill(&s->own, s->own.tat, now);
+		if(global < SHAPER_CHUNK && refill(&shared->global, tat, now) > s->wake)
+			s->wake = refill(&shared->global, tat, now);
+		if(share < SHAPER_CHUNK && refill(&s->share, s->share.tat, now) > s->wake)
+			s->wake = refill(&s->share, s->share.tat, now);
+		if(shared != NULL)
+			__atomic_add_fetch(&shared->holds, 1, __ATOMIC_RELAXED);
+		return 0;
+
+	} //END of shaperTurn function
+
+
+/** Charge - see shaper.h
+ *
+ */
+	void shaperCharge(Shaper *s, long long bytes){
+		long long now, tat, next;
+
+		if(bytes <= 0 || !shaperLimited(s))
+			return;
+
+		now = shaperClock();
+		if(s->own.rate > 0)
+			s->own.tat = (s->own.tat > now ? s->own.tat : now) + bytes * NSEC / s->own.rate;
+		if(s->share.rate > 0)
+			s->share.tat = (s->share.tat > now ? s->share.tat : now) + bytes * NSEC / s->share.rate;
+
+		// Workers charge the global bucket at the same time, a lost race is retried with the new time
+		if(shared != NULL && shared->global.rate > 0){
+			tat = __atomic_load_n(&shared->global.tat, __ATOMIC_RELAXED);
+			do {
+				next = (tat > now ? tat : now) + bytes * NSEC / shared->global.rate;
+			} while(!__atomic_compare_exchange_n(&shared->global.tat, &tat, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+		}
+
+	} //END of shaperCharge function
+
+
+/** Idle - see shaper.h
+ *
+ */
+	void shaperIdle(Shaper *s){
+
+		if(s->active)
+			__atomic_sub_fetch(&shared->weights, s->active, __ATOMIC_RELAXED);
+		s->active = 0;
+
+	} //END of shaperIdle function
+
+
+/** Stats - see shaper.h
+ *
+ */
+	void shaperStats(char *buf, int size){
+		char own[32], global[32];
+
+		if(shared == NULL){
+			snprintf(buf, size, "off");
+			return;
+		}
+
+		if(sessionRate > 0)
+			snprintf(own, sizeof(own), "%lld B/s", sessionRate);
+		else
+			snprintf(own, sizeof(own), "off");
+		if(shared->global.rate > 0)
+			snprintf(global, sizeof(global), "%lld B/s", shared->global.rate);
+		else
+			snprintf(global, sizeof(global), "off");
+
+		snprintf(buf, size, "session rate %s, global rate %s, %d address weights, %llu holds",
+				 own, global, naddresses, __atomic_load_n(&shared->holds, __ATOMIC_RELAXED));
+
+	} //END of shaperStats function
+
+
+/** Clock - see shaper.h
+ *
+ */
+	long long shaperClock(void){
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * NSEC + ts.tv_nsec;
+
+	} //END of shaperClock function
+
+
+/** Read weights - loads "address[/bits] weight" lines into the address table
+ *
+ *	Return: 0, or -1 after reporting the first line that cannot be used
+ */
+	static int readWeights(char *file){
+		FILE *fp;
+		char line[256], *addr, *weight, *bits, *end, *save;
+		struct in_addr in;
+		int lineno = 0, prefix;
+		double w;
+
+		if((fp = fopen(file, "r")) == NULL){
+			fprintf(stderr, "Cannot open weights file %s: %s\n", file, strerror(errno));
+			return -1;
+		}
+
+		while(fgets(line, sizeof(line), fp) != NULL){
+			lineno++;
+			if((end = strchr(line, '#')) != NULL)
+				*end = '\0';
+			if((addr = strtok_r(line, " \t\r\n", &save)) == NULL)
+				continue;     // Blank or comment
+
+			weight = strtok_r(NULL, " \t\r\n", &save);
+			prefix = 32;
+			if((bits = strchr(addr, '/')) != NULL){
+				*bits++ = '\0';
+				prefix = strtol(bits, &end, 10);
+				if(end == bits || *end != '\0')
+					prefix = -1;
+			}
+			w = weight == NULL ? 0 : strtod(weight, &end);
+
+			if(inet_pton(AF_INET, addr, &in) != 1 || prefix < 0 || prefix > 32 || weight == NULL || *end != '\0' ||
+			   w <= 0 || w > SHAPER_MAX_WEIGHT || strtok_r(NULL, " \t\r\n", &save) != NULL || naddresses == SHAPER_ADDRESSES){
+				fprintf(stderr, "%s line %d: expected \"address[/bits] weight\", weight above 0 and at most %d (%d lines at most)\n",
+						file, lineno, SHAPER_MAX_WEIGHT, SHAPER_ADDRESSES);
+				fclose(fp);
+				return -1;
+			}
+
+			addresses[naddresses].mask = prefix == 0 ? 0 : htonl(0xFFFFFFFFu << (32 - prefix));
+			addresses[naddresses].net = in.s_addr & addresses[naddresses].mask;
+			addresses[naddresses].bits = prefix;
+			addresses[naddresses].weight = w;
+			naddresses++;
+		}
+
+		fclose(fp);
+		return 0;
+
+	} //END of readWeights function
+
+
+/** Bucket init - an empty bucket that lets rate bytes per second through, with a burst of at least
+ *				 SHAPER_BURST bytes
+ *
+ */
+	static void bucketInit(Bucket *b, long long rate){
+
+		b->tat = 0;
+		bucketRate(b, rate);
+
+	} //END of bucketInit function
+
+
+/** Bucket rate - changes the rate of a bucket, and its burst with it
+ *
+ */
+	static void bucketRate(Bucket *b, long long rate){
+		long long burst = rate * SHAPER_BURST_MS / 1000;
+
+		b->rate = rate;
+		b->tau = rate > 0 ? (burst > SHAPER_BURST ? burst : SHAPER_BURST) * NSEC / rate : 0;
+
+	} //END of bucketRate function
+
+
+/** Allowance - bytes a bucket whose empty time is tat lets through at time now
+ *
+ */
+	static long long allowance(Bucket *b, long long tat, long long now){
+		long long avail;
+
+		if(b->rate == 0)
+			return LLONG_MAX;
+
+		// A bucket idle for longer than its burst is full, no more
+		avail = now + b->tau - (tat > now ? tat : now);
+		return avail > 0 ? avail * b->rate / NSEC : 0;
+
+	} //END of allowance function
+
+
+/** Refill - time a bucket whose empty time is tat lets SHAPER_CHUNK bytes through again
+ *
+ */
+	static long long refill(Bucket *b, long long tat, long long now){
+
+		return (tat > now ? tat : now) - b->tau + SHAPER_CHUNK * NSEC / b->rate;
+
+	} //END of refill function
+
+//END of shaper.c
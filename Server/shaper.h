@@ -0,0 +1,68 @@
+/* File: shaper.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the bandwidth scheduler of file transfers
+ * Changes: 16/10/2026 - Added shaper.c/shaper.h, per-session and global token buckets, weights per client address
+ */
+
+#ifndef SHAPER_H
+#define SHAPER_H
+
+#define SHAPER_BURST (1024*256)			// Smallest burst a bucket allows
+#define SHAPER_BURST_MS 50				// Burst of a fast bucket, in milliseconds at its rate
+#define SHAPER_QUANTUM (1024*1024)		// Bytes of a turn at weight 1
+#define SHAPER_CHUNK (1024*16)			// Smallest turn, a held session waits until it may move this much
+#define SHAPER_MAX_WEIGHT 64			// Largest weight a client address can be given
+#define SHAPER_ADDRESSES 256			// Entries read from a weights file
+
+typedef struct bucket {
+	long long rate;						// Bytes per second, 0 for no limit
+	long long tau;						// Burst, in nanoseconds at the rate
+	long long tat;						// Time the bucket is empty until (CLOCK_MONOTONIC ns), moved on by every charge
+} Bucket;
+
+typedef struct shaper {
+	double weight;						// Share of the client's address, 1 unless the weights file says otherwise
+	int quantum;						// Most bytes moved in one turn
+	Bucket own;							// Session rate limit
+	Bucket share;						// Weighted share of the global rate, used while the global bucket is low
+	int active;							// Weight counted among the transfers sharing the global rate
+	long long wake;						// Held back until this time (ns), 0 if not held
+} Shaper;
+
+/* Set up the scheduler for this process and every process it forks afterwards
+ *
+ *	Pre: Called once, before the workers are forked. Rates are in bytes per second, 0 for no limit.
+ *		 weights names a file of "address[/bits] weight" lines (# starts a comment), or is NULL
+ *	Post: Every transfer is limited to sessionRate times the weight of its client, and all of them
+ *		  together to globalRate
+ *	Return: 0, or -1 if the weights file cannot be read or has a bad line (reported on stderr)
+ */
+int shaperSetup(long long sessionRate, long long globalRate, char *weights);
+
+/* Give the session of client socket sock its weight, quantum and rate */
+void shaperInit(Shaper *s, int sock);
+
+/* Whether a rate limit applies to the session, its transfers then have to pass through shaperTurn */
+int shaperLimited(Shaper *s);
+
+/* Bytes the session may move in this turn: its quantum, less if a bucket is nearly empty
+ *
+ *	Post: If a bucket does not allow SHAPER_CHUNK bytes the session is held back, s->wake is set
+ *	Return: Bytes allowed, 0 if held back
+ */
+int shaperTurn(Shaper *s);
+
+/* Take bytes moved by the session out of its bucket and the global one */
+void shaperCharge(Shaper *s, long long bytes);
+
+/* The session's transfer has ended, its weight no longer takes a share of the global rate */
+void shaperIdle(Shaper *s);
+
+/* Rates, address weights and the number of times sessions were held back, for the log and stats */
+void shaperStats(char *buf, int size);
+
+/* Monotonic time in nanoseconds, the clock of s->wake */
+long long shaperClock(void);
+
+#endif
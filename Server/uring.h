@@ -0,0 +1,114 @@
+/* File: uring.h
+ * Authors: Jarryd Kaczmarczyk & Daniel Dobson
+ * Date: 16/10/2026
+ * Purpose: Header file for the io_uring transfer backend
+ * Changes: 16/10/2026 - Added uring.c/uring.h, file transfers with several reads and sends in flight
+ *		   16/10/2026 - Transfers start at a file offset (ranged get/put)
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include "stream.h"
+
+#define URING_ENTRIES 256			// Submission queue size
+#define URING_DEPTH 4				// Registered buffers per transfer
+#define URING_BUFSIZE (1024*128)	// Size of each registered buffer
+#define URING_MAX_SLOTS 16			// Most transfers one process runs at once
+
+#define XFER_RAW 0					// Framing "version" of an unframed (raw stream) transfer
+
+typedef struct uringBuf {
+	char *base;						// Registered buffer
+	int state;						// UB_* state (uring.c)
+	int len;						// Send: bytes of frames built. Receive: bytes received
+	int off;						// Send: bytes already sent
+	int expect, got;				// Send: file bytes the reads were asked for / returned
+	int pending;					// Operations in flight on this buffer
+} UringBuf;
+
+typedef struct xfer {
+	int slot;						// Index of the fixed files and buffers used
+	int sending;					// 1: file -> socket, 0: socket -> file
+	Conn *conn;						// Connection the frames travel on
+	int fd;							// File read or written (-1: receive and discard)
+	int version;					// XFER_RAW, 1 or 2
+	int hsize;						// Frame header size
+	int frame;						// Send: payload bytes per frame. Receive: largest frame accepted
+	int checksum;					// Send: CRC-32 on every frame
+	long long left;					// Send: file bytes not yet read. Raw receive: bytes not yet received
+	long long fileoff;				// Next file offset read or written
+	int lastframe;					// Send: payload of the last frame built, -1 if none yet
+	int needterm;					// Send: an empty end of file frame may still be needed
+	int inflight;					// Operations submitted and not yet completed
+	int sendsinflight;				// Socket writes submitted and not yet completed
+	int fillnext, sendnext;			// Send: next buffer to fill / to send, in rotation
+	int recvbuf;					// Receive: buffer with the socket read in flight, -1 if none
+	char hdr[V2_HDR_SIZE];			// Receive: frame header split across reads
+	int hdrhave;
+	long long frameleft;			// Receive: payload bytes of the current frame still to come
+	unsigned int framelen;			// Receive: current frame header
+	int flags;
+	unsigned int crc, expectcrc;
+	int ended;						// Receive: last frame of the file seen
+	int failed;						// Data damaged, file write failed or error flagged by the peer
+	int broken;						// Connection or file read failed, transfer abandoned
+	int done;						// Nothing left to do and nothing in flight
+	int reported;					// Already returned by uringReap
+	long long bytes;				// File bytes moved
+	void *owner;					// Caller's pointer (session)
+	UringBuf bufs[URING_DEPTH];
+} Xfer;
+
+/* Set up the io_uring instance of this process with registered buffers and fixed file slots
+ *
+ *	Pre: Not set up yet in this process (the ring is not shared with children)
+ *	Post: Up to nslots transfers can run at once. Fewer slots are used if the locked memory limit
+ *		  does not allow nslots
+ *	Return: Number of slots, or -1 with errno set when io_uring is not available
+ */
+int uringSetup(int nslots);
+
+/* File descriptor of the ring, readable when completions are waiting (-1 if not set up) */
+int uringFd(void);
+
+/* Whether uringSetup succeeded in this process */
+int uringActive(void);
+
+/* Start sending size bytes of fd, from offset, as data frames on conn (version XFER_RAW sends them unframed)
+ *
+ *	Pre: conn has no queued output (reads are positional, the file offset of fd is not used)
+ *	Post: Reads and sends submitted. The last v2 frame carries FF_EOF, a v1 file that ends on a
+ *		  full frame (or is empty) gets an empty frame so the receiver stops
+ *	Return: Transfer, or NULL if no slot is free (use the read/write path instead)
+ */
+Xfer *uringStartSend(Conn *conn, int fd, long long offset, long long size, int version, int frame, int checksum, void *owner);
+
+/* Start receiving data frames (or size raw bytes) from conn into fd, written from offset
+ *
+ *	Pre: The peer has been told to send. Bytes already read ahead by conn are used first
+ *	Post: Socket reads and file writes submitted. Bytes after the last frame are handed back to conn
+ *	Return: Transfer, or NULL if no slot is free
+ */
+Xfer *uringStartRecv(Conn *conn, int fd, long long offset, int version, int maxframe, long long size, void *owner);
+
+/* Process completions and submit the operations they allow
+ *
+ *	Pre: wait = 1 blocks until at least one completion has arrived
+ *	Post: Up to max transfers that have finished since the last call are stored in done
+ *	Return: Number of finished transfers stored
+ */
+int uringReap(Xfer **done, int max, int wait);
+
+/* Block until transfer x has finished */
+void uringWait(Xfer *x);
+
+/* Release the slot of a finished transfer
+ *
+ *	Pre: x->done is set
+ *	Return: 0 if the file arrived intact, -1 if the connection or file read failed,
+ *			-2 if the data was damaged, flagged as failed by the peer or could not be written
+ */
+int uringFinish(Xfer *x);
+
+#endif